@@ -25,6 +25,7 @@
 /* USER CODE BEGIN Includes */
 #include "common.h"
 #include "iap.h"
+#include "sched.h"
 /* USER CODE END Includes */
 
 /* Private typedef -----------------------------------------------------------*/
@@ -91,43 +92,17 @@ int main(void)
   MX_USART1_UART_Init();
   /* USER CODE BEGIN 2 */
   IAP_Init();
-  IAP_WriteFlag(INIT_FLAG_DATA);
   /* USER CODE END 2 */
 
   /* Infinite loop */
   /* USER CODE BEGIN WHILE */
+  /* The menu, YModem and flash tasks run from the scheduler; it sleeps in
+     WFI between events and never returns */
+  Sched_Run();
   while (1)
   {
     /* USER CODE END WHILE */
-	  switch(IAP_ReadFlag())
-	{
-		case APPRUN_FLAG_DATA://jump to app
-			if( IAP_RunApp())
-				IAP_WriteFlag(INIT_FLAG_DATA);
-			break;
-		case INIT_FLAG_DATA://initialze state (blank mcu)
-			IAP_Main_Menu();
-			break;
-		case UPDATE_FLAG_DATA:// download app state
-			if( !IAP_Update())
-				IAP_WriteFlag(APPRUN_FLAG_DATA);
-			else
-				IAP_WriteFlag(INIT_FLAG_DATA);
-			break;
-		case UPLOAD_FLAG_DATA:// upload app state
-//				if( !IAP_Upload())
-//					IAP_WriteFlag(APPRUN_FLAG_DATA);
-//				else
-//					IAP_WriteFlag(INIT_FLAG_DATA);
-			break;
-		case ERASE_FLAG_DATA:// erase app state
-			IAP_Erase();
-			IAP_WriteFlag(INIT_FLAG_DATA);
-			break;
-		default:
-			IAP_WriteFlag(INIT_FLAG_DATA);
-			break;
-	}
+
     /* USER CODE BEGIN 3 */
   }
   /* USER CODE END 3 */
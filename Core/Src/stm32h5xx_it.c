@@ -22,6 +22,8 @@
 #include "stm32h5xx_it.h"
 /* Private includes ----------------------------------------------------------*/
 /* USER CODE BEGIN Includes */
+#include "serial.h"
+#include "kvstore.h"
 /* USER CODE END Includes */
 
 /* Private typedef -----------------------------------------------------------*/
@@ -69,7 +71,11 @@ extern UART_HandleTypeDef huart1;
 void NMI_Handler(void)
 {
   /* USER CODE BEGIN NonMaskableInt_IRQn 0 */
-
+  /* A record of the state store torn by a reset fails ECC */
+  if (KvStore_EccIsr())
+  {
+    return;
+  }
   /* USER CODE END NonMaskableInt_IRQn 0 */
   /* USER CODE BEGIN NonMaskableInt_IRQn 1 */
    while (1)
@@ -213,5 +219,21 @@ void USART1_IRQHandler(void)
 }
 
 /* USER CODE BEGIN 1 */
+/**
+  * @brief This function handles FLASH non-secure global interrupt.
+  */
+void FLASH_IRQHandler(void)
+{
+  HAL_FLASH_IRQHandler();
+}
 
+#if (USE_SERIAL_TX_DMA == 1)
+/**
+  * @brief This function handles GPDMA1 Channel 0 global interrupt (USART1 TX).
+  */
+void GPDMA1_Channel0_IRQHandler(void)
+{
+  Serial_DmaIsr();
+}
+#endif
 /* USER CODE END 1 */
@@ -21,7 +21,7 @@
 #include "usart.h"
 
 /* USER CODE BEGIN 0 */
-
+#include "serial.h"
 /* USER CODE END 0 */
 
 UART_HandleTypeDef huart1;
@@ -151,20 +151,28 @@ void HAL_UART_MspDeInit(UART_HandleTypeDef* uartHandle)
 }
 
 /* USER CODE BEGIN 1 */
-uint8_t UART1_flag=0;
-extern uint8_t cmdStr[128];
 void HAL_UARTEx_RxEventCallback(UART_HandleTypeDef *huart, uint16_t Size)
 {
 	if (huart->Instance == USART1)
 	{
-		uint32_t event_type = HAL_UARTEx_GetRxEventType(huart);
-		// 如果是空闲事件，设置标志让主循环知道
-		if (event_type == HAL_UART_RXEVENT_IDLE)  // 或 HAL_UART_RXEVENT_TC
-		{
-			__HAL_UART_CLEAR_IDLEFLAG(huart);
-			UART1_flag=1;
-		}
-		HAL_UARTEx_ReceiveToIdle_IT(&huart1, cmdStr, 128);
+		// 接收块结束(空闲或缓冲满)，交给串口环形缓冲并重新启动接收
+		Serial_RxEventIsr(Size);
+	}
+}
+
+void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart)
+{
+	if (huart->Instance == USART1)
+	{
+		Serial_TxIsr();
+	}
+}
+
+void HAL_UART_ErrorCallback(UART_HandleTypeDef *huart)
+{
+	if (huart->Instance == USART1)
+	{
+		Serial_ErrorIsr();
 	}
 }
 /* USER CODE END 1 */
@@ -77,6 +77,23 @@ LoopCopyDataInit:
 	adds	r2, r0, r1
 	cmp	r2, r3
 	bcc	CopyDataInit
+
+/* Copy the code that runs from RAM (.ramfunc, see ramexec.h) */
+	movs	r1, #0
+	b	LoopCopyRamFunc
+
+CopyRamFunc:
+	ldr	r3, =_siramfunc
+	ldr	r3, [r3, r1]
+	str	r3, [r0, r1]
+	adds	r1, r1, #4
+
+LoopCopyRamFunc:
+	ldr	r0, =_sramfunc
+	ldr	r3, =_eramfunc
+	adds	r2, r0, r1
+	cmp	r2, r3
+	bcc	CopyRamFunc
 	ldr	r2, =_sbss
 	b	LoopFillZerobss
 /* Zero fill the bss segment. */
@@ -5,21 +5,84 @@
 
 # Add inputs and outputs from these tool invocations to the build variables 
 C_SRCS += \
+../IAP/src/bincmd.c \
+../IAP/src/bootinfo.c \
+../IAP/src/busupdate.c \
+../IAP/src/chacha20.c \
+../IAP/src/clock.c \
 ../IAP/src/common.c \
+../IAP/src/ed25519.c \
+../IAP/src/flashprog.c \
 ../IAP/src/iap.c \
+../IAP/src/icache.c \
+../IAP/src/imageenc.c \
+../IAP/src/imagesig.c \
+../IAP/src/kvstore.c \
+../IAP/src/partition.c \
+../IAP/src/ramexec.c \
+../IAP/src/sched.c \
+../IAP/src/selfupdate.c \
+../IAP/src/serial.c \
+../IAP/src/services.c \
+../IAP/src/sha256.c \
+../IAP/src/stats.c \
 ../IAP/src/stmflash.c \
+../IAP/src/trace.c \
+../IAP/src/trial.c \
 ../IAP/src/ymodem.c 
 
 OBJS += \
+./IAP/src/bincmd.o \
+./IAP/src/bootinfo.o \
+./IAP/src/busupdate.o \
+./IAP/src/chacha20.o \
+./IAP/src/clock.o \
 ./IAP/src/common.o \
+./IAP/src/ed25519.o \
+./IAP/src/flashprog.o \
 ./IAP/src/iap.o \
+./IAP/src/icache.o \
+./IAP/src/imageenc.o \
+./IAP/src/imagesig.o \
+./IAP/src/kvstore.o \
+./IAP/src/partition.o \
+./IAP/src/ramexec.o \
+./IAP/src/sched.o \
+./IAP/src/selfupdate.o \
+./IAP/src/serial.o \
+./IAP/src/services.o \
+./IAP/src/sha256.o \
+./IAP/src/stats.o \
 ./IAP/src/stmflash.o \
+./IAP/src/trace.o \
+./IAP/src/trial.o \
 ./IAP/src/ymodem.o 
 
 C_DEPS += \
+./IAP/src/bincmd.d \
+./IAP/src/bootinfo.d \
+./IAP/src/busupdate.d \
+./IAP/src/chacha20.d \
+./IAP/src/clock.d \
 ./IAP/src/common.d \
+./IAP/src/ed25519.d \
+./IAP/src/flashprog.d \
 ./IAP/src/iap.d \
+./IAP/src/icache.d \
+./IAP/src/imageenc.d \
+./IAP/src/imagesig.d \
+./IAP/src/kvstore.d \
+./IAP/src/partition.d \
+./IAP/src/ramexec.d \
+./IAP/src/sched.d \
+./IAP/src/selfupdate.d \
+./IAP/src/serial.d \
+./IAP/src/services.d \
+./IAP/src/sha256.d \
+./IAP/src/stats.d \
 ./IAP/src/stmflash.d \
+./IAP/src/trace.d \
+./IAP/src/trial.d \
 ./IAP/src/ymodem.d 
 
 
@@ -30,7 +93,7 @@ IAP/src/%.o IAP/src/%.su IAP/src/%.cyclo: ../IAP/src/%.c IAP/src/subdir.mk
 clean: clean-IAP-2f-src
 
 clean-IAP-2f-src:
-	-$(RM) ./IAP/src/common.cyclo ./IAP/src/common.d ./IAP/src/common.o ./IAP/src/common.su ./IAP/src/iap.cyclo ./IAP/src/iap.d ./IAP/src/iap.o ./IAP/src/iap.su ./IAP/src/stmflash.cyclo ./IAP/src/stmflash.d ./IAP/src/stmflash.o ./IAP/src/stmflash.su ./IAP/src/ymodem.cyclo ./IAP/src/ymodem.d ./IAP/src/ymodem.o ./IAP/src/ymodem.su
+	-$(RM) ./IAP/src/bincmd.cyclo ./IAP/src/bincmd.d ./IAP/src/bincmd.o ./IAP/src/bincmd.su ./IAP/src/bootinfo.cyclo ./IAP/src/bootinfo.d ./IAP/src/bootinfo.o ./IAP/src/bootinfo.su ./IAP/src/busupdate.cyclo ./IAP/src/busupdate.d ./IAP/src/busupdate.o ./IAP/src/busupdate.su ./IAP/src/chacha20.cyclo ./IAP/src/chacha20.d ./IAP/src/chacha20.o ./IAP/src/chacha20.su ./IAP/src/clock.cyclo ./IAP/src/clock.d ./IAP/src/clock.o ./IAP/src/clock.su ./IAP/src/common.cyclo ./IAP/src/common.d ./IAP/src/common.o ./IAP/src/common.su ./IAP/src/ed25519.cyclo ./IAP/src/ed25519.d ./IAP/src/ed25519.o ./IAP/src/ed25519.su ./IAP/src/flashprog.cyclo ./IAP/src/flashprog.d ./IAP/src/flashprog.o ./IAP/src/flashprog.su ./IAP/src/iap.cyclo ./IAP/src/iap.d ./IAP/src/iap.o ./IAP/src/iap.su ./IAP/src/icache.cyclo ./IAP/src/icache.d ./IAP/src/icache.o ./IAP/src/icache.su ./IAP/src/imageenc.cyclo ./IAP/src/imageenc.d ./IAP/src/imageenc.o ./IAP/src/imageenc.su ./IAP/src/imagesig.cyclo ./IAP/src/imagesig.d ./IAP/src/imagesig.o ./IAP/src/imagesig.su ./IAP/src/kvstore.cyclo ./IAP/src/kvstore.d ./IAP/src/kvstore.o ./IAP/src/kvstore.su ./IAP/src/partition.cyclo ./IAP/src/partition.d ./IAP/src/partition.o ./IAP/src/partition.su ./IAP/src/ramexec.cyclo ./IAP/src/ramexec.d ./IAP/src/ramexec.o ./IAP/src/ramexec.su ./IAP/src/sched.cyclo ./IAP/src/sched.d ./IAP/src/sched.o ./IAP/src/sched.su ./IAP/src/selfupdate.cyclo ./IAP/src/selfupdate.d ./IAP/src/selfupdate.o ./IAP/src/selfupdate.su ./IAP/src/serial.cyclo ./IAP/src/serial.d ./IAP/src/serial.o ./IAP/src/serial.su ./IAP/src/services.cyclo ./IAP/src/services.d ./IAP/src/services.o ./IAP/src/services.su ./IAP/src/sha256.cyclo ./IAP/src/sha256.d ./IAP/src/sha256.o ./IAP/src/sha256.su ./IAP/src/stats.cyclo ./IAP/src/stats.d ./IAP/src/stats.o ./IAP/src/stats.su ./IAP/src/stmflash.cyclo ./IAP/src/stmflash.d ./IAP/src/stmflash.o ./IAP/src/stmflash.su ./IAP/src/trace.cyclo ./IAP/src/trace.d ./IAP/src/trace.o ./IAP/src/trace.su ./IAP/src/trial.cyclo ./IAP/src/trial.d ./IAP/src/trial.o ./IAP/src/trial.su ./IAP/src/ymodem.cyclo ./IAP/src/ymodem.d ./IAP/src/ymodem.o ./IAP/src/ymodem.su
 
 .PHONY: clean-IAP-2f-src
 
@@ -0,0 +1,312 @@
+/*
+ * Reference production station. No request is repeated: on a clean line
+ * every answer must come, and be the one the protocol defines.
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "sim.h"
+#include "bincmd.h"
+#include "iap_config.h"
+#include "binhost.h"
+
+#define BINHOST_ANSWER_NS       1000000000ull   /* after the request is on the line */
+#define BINHOST_BAD_CMD         0x7F
+
+enum {
+	BS_INFO = 0,
+	BS_ERASE,
+	BS_WRITE,
+	BS_VERIFY,
+	BS_READ,
+	BS_BAD_CRC,
+	BS_BAD_CMD,
+	BS_BOOTLOADER,
+	BS_STATE,
+	BS_BOOT,
+	BS_IDLE
+};
+
+static const struct {
+	const char *name;
+	uint8_t status;         /* expected */
+} steps[BS_IDLE] = {
+	{ "GET_INFO", BINCMD_OK },
+	{ "ERASE_RANGE", BINCMD_OK },
+	{ "WRITE_BLOCK", BINCMD_OK },
+	{ "VERIFY", BINCMD_OK },
+	{ "READ_BLOCK", BINCMD_OK },
+	{ "frame with a bad CRC", BINCMD_ERR_CRC },
+	{ "unknown command", BINCMD_ERR_CMD },
+	{ "ERASE_RANGE of the bootloader", BINCMD_ERR_ARG },
+	{ "ERASE_RANGE of the state sector", BINCMD_ERR_ARG },
+	{ "BOOT", BINCMD_OK },
+};
+
+static struct binhost *cur;
+static int step = BS_IDLE;
+static uint32_t offset;         /* of the WRITE_BLOCK in flight */
+static uint8_t id;              /* of the last frame */
+static uint8_t cmd;
+static uint8_t frame[BINCMD_OVERHEAD + BINCMD_MAX_PAYLOAD];
+static uint8_t rx[BINCMD_HEADER_SIZE + BINCMD_MAX_PAYLOAD + 2];
+static uint32_t rx_count, rx_need;
+static int rx_sync;             /* SOF bytes seen */
+
+static void timeout(void *arg);
+
+/************************************************************************/
+static uint16_t crc16(const uint8_t *p, uint32_t n)
+{
+	uint16_t crc = 0;
+	int i;
+
+	while (n--) {
+		crc ^= (uint16_t)*p++ << 8;
+		for (i = 0; i < 8; i++)
+			crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+	}
+	return crc;
+}
+
+/************************************************************************/
+static void put16(uint8_t *p, uint32_t v)
+{
+	p[0] = (uint8_t)v;
+	p[1] = (uint8_t)(v >> 8);
+}
+
+/************************************************************************/
+static void put32(uint8_t *p, uint32_t v)
+{
+	put16(p, v);
+	put16(p + 2, v >> 16);
+}
+
+/************************************************************************/
+static uint32_t get16(const uint8_t *p)
+{
+	return p[0] | ((uint32_t)p[1] << 8);
+}
+
+/************************************************************************/
+static uint32_t get32(const uint8_t *p)
+{
+	return get16(p) | (get16(p + 2) << 16);
+}
+
+/**
+ * Put a frame on the line, with its CRC inverted if bad_crc.
+ */
+static void send_frame(uint8_t c, const uint8_t *payload, uint16_t len, int bad_crc)
+{
+	uint16_t crc;
+
+	cmd = c;
+	frame[0] = BINCMD_SOF0;
+	frame[1] = BINCMD_SOF1;
+	frame[2] = c;
+	frame[3] = ++id;
+	put16(frame + 4, len);
+	memcpy(frame + 6, payload, len);
+	crc = crc16(frame + 2, BINCMD_HEADER_SIZE + len);
+	if (bad_crc)
+		crc = (uint16_t)~crc;
+	frame[6 + len] = (uint8_t)(crc >> 8);
+	frame[7 + len] = (uint8_t)crc;
+	rx_sync = 0;
+	Sim_LinkSend(frame, BINCMD_OVERHEAD + len);
+	cur->requests++;
+	cur->bytes_sent += BINCMD_OVERHEAD + len;
+	Sim_Cancel(timeout, NULL);
+	Sim_At(Sim_Now + (uint64_t)(BINCMD_OVERHEAD + len) * Sim_CharTime() + BINHOST_ANSWER_NS,
+	       timeout, NULL);
+}
+
+/************************************************************************/
+static void send_range(uint8_t c, uint32_t addr, uint32_t size, int bad_crc)
+{
+	uint8_t p[8];
+
+	put32(p, addr);
+	put32(p + 4, size);
+	send_frame(c, p, sizeof(p), bad_crc);
+}
+
+/**
+ * The next block of the image; the last one padded to 16 bytes.
+ */
+static void send_write(void)
+{
+	uint8_t p[4 + BINCMD_MAX_DATA];
+	uint32_t len = cur->size - offset < BINCMD_MAX_DATA ? cur->size - offset : BINCMD_MAX_DATA;
+	uint32_t padded = (len + 15) & ~15u;
+
+	put32(p, cur->addr + offset);
+	memcpy(p + 4, cur->data + offset, len);
+	memset(p + 4 + len, 0xFF, padded - len);
+	send_frame(BINCMD_WRITE_BLOCK, p, (uint16_t)(4 + padded), 0);
+}
+
+/************************************************************************/
+static void request(void)
+{
+	uint8_t p[6];
+
+	switch (step) {
+	case BS_INFO:
+		send_frame(BINCMD_GET_INFO, NULL, 0, 0);
+		break;
+	case BS_ERASE:
+		send_range(BINCMD_ERASE_RANGE, cur->addr, cur->size, 0);
+		break;
+	case BS_WRITE:
+		offset = 0;
+		send_write();
+		break;
+	case BS_VERIFY:
+		send_range(BINCMD_VERIFY, cur->addr, cur->size, 0);
+		break;
+	case BS_READ:
+		put32(p, cur->addr);
+		put16(p + 4, BINCMD_MAX_DATA);
+		send_frame(BINCMD_READ_BLOCK, p, 6, 0);
+		break;
+	case BS_BAD_CRC:
+		send_range(BINCMD_VERIFY, cur->addr, cur->size, 1);
+		break;
+	case BS_BAD_CMD:
+		send_frame(BINHOST_BAD_CMD, NULL, 0, 0);
+		break;
+	case BS_BOOTLOADER:
+		send_range(BINCMD_ERASE_RANGE, STM32_FLASH_BASE, PAGE_SIZE, 0);
+		break;
+	case BS_STATE:
+		send_range(BINCMD_ERASE_RANGE, IAP_FLAG_ADDR, PAGE_SIZE, 0);
+		break;
+	case BS_BOOT:
+		put32(p, cur->size);
+		send_frame(BINCMD_BOOT, p, 4, 0);
+		break;
+	default:
+		break;
+	}
+}
+
+/************************************************************************/
+static void finish(int status, uint8_t answer)
+{
+	Sim_Cancel(timeout, NULL);
+	cur->status = status;
+	cur->answer = answer;
+	if (status < 0)
+		cur->failed = steps[step].name;
+	step = BS_IDLE;
+	cur->t_end = Sim_Now;
+	if (cur->done)
+		cur->done(cur);
+}
+
+/************************************************************************/
+static void timeout(void *arg)
+{
+	(void)arg;
+	if (step != BS_IDLE)
+		finish(-1, BINHOST_NO_ANSWER);
+}
+
+/**
+ * The answer to the request of this step: status, data...
+ * @return 1 as expected, 0 not
+ */
+static int answer(const uint8_t *p, uint32_t len)
+{
+	if (len < 1 || p[0] != steps[step].status)
+		return 0;
+	switch (step) {
+	case BS_INFO:
+		if (len < 20 || get32(p + 9) < cur->size)
+			return 0;
+		cur->addr = get32(p + 5);
+		return 1;
+	case BS_WRITE:
+		offset += BINCMD_MAX_DATA;
+		return 1;
+	case BS_VERIFY:
+		return len == 3 && get16(p + 1) == crc16(cur->data, cur->size);
+	case BS_READ:
+		return len == 1 + BINCMD_MAX_DATA &&
+		       memcmp(p + 1, cur->data, cur->size < BINCMD_MAX_DATA ? cur->size : BINCMD_MAX_DATA) == 0;
+	default:
+		return 1;
+	}
+}
+
+/**
+ * A byte from the device: the menu until the first frame, then answers.
+ */
+void Binhost_Rx(uint8_t c)
+{
+	uint32_t len;
+
+	if (step == BS_IDLE)
+		return;
+	if (rx_sync < 2) {
+		if (c == (rx_sync ? BINCMD_SOF1 : BINCMD_SOF0))
+			rx_sync++;
+		else
+			rx_sync = c == BINCMD_SOF0;
+		rx_count = 0;
+		rx_need = BINCMD_HEADER_SIZE;
+		return;
+	}
+	rx[rx_count++] = c;
+	if (rx_count < rx_need)
+		return;
+	if (rx_count == BINCMD_HEADER_SIZE) {
+		len = get16(rx + 2);
+		if (BINCMD_HEADER_SIZE + len + 2 > sizeof(rx)) {
+			finish(-1, BINHOST_NO_ANSWER);
+			return;
+		}
+		rx_need = BINCMD_HEADER_SIZE + len + 2;
+		return;
+	}
+	rx_sync = 0;
+	len = rx_count - BINCMD_HEADER_SIZE - 2;
+	if (crc16(rx, BINCMD_HEADER_SIZE + len) != ((uint32_t)rx[rx_count - 2] << 8 | rx[rx_count - 1]) ||
+	    rx[0] != (cmd | BINCMD_RESPONSE) || rx[1] != id || !answer(rx + BINCMD_HEADER_SIZE, len)) {
+		finish(-1, len >= 1 ? rx[BINCMD_HEADER_SIZE] : BINHOST_NO_ANSWER);
+		return;
+	}
+	if (step == BS_WRITE && offset < cur->size) {
+		send_write();
+		return;
+	}
+	if (step == BS_BOOT) {
+		finish(1, BINCMD_OK);
+		return;
+	}
+	step++;
+	request();
+}
+
+/**
+ * Start with GET_INFO; its first byte takes the menu to the binary protocol.
+ * @return 0, -1 no image
+ */
+int Binhost_Start(struct binhost *h)
+{
+	if (h->size == 0)
+		return -1;
+	cur = h;
+	h->status = 0;
+	h->failed = NULL;
+	h->answer = BINHOST_NO_ANSWER;
+	h->requests = 0;
+	h->bytes_sent = 0;
+	h->t_start = Sim_Now;
+	step = BS_INFO;
+	request();
+	return 0;
+}
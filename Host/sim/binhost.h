@@ -0,0 +1,36 @@
+/*
+ * Reference production station for the binary protocol (bincmd.h), driven
+ * by the bytes the device sends and simulation timers like the YModem peers
+ * (ympeer.h): one request at a time, each answer checked against what the
+ * protocol promises. GET_INFO, then ERASE_RANGE, WRITE_BLOCK, VERIFY and
+ * READ_BLOCK of the image at the application address, then the refusals:
+ * a frame with a bad CRC, an unknown command, erases of the bootloader and
+ * of the state sector; last BOOT with the file size.
+ */
+#ifndef BINHOST_H
+#define BINHOST_H
+
+#include <stdint.h>
+
+struct binhost {
+	/* set by the caller */
+	const uint8_t *data;    /* a signed application image */
+	uint32_t size;
+	void (*done)(struct binhost *h);
+	/* results, times in ns */
+	int status;             /* 0 running, 1 every answer as expected, -1 not */
+	const char *failed;     /* the request that went wrong */
+	uint8_t answer;         /* its status, BINHOST_NO_ANSWER */
+	uint32_t addr;          /* of the application, from GET_INFO */
+	uint64_t t_start;
+	uint64_t t_end;         /* BOOT answered */
+	uint32_t requests;
+	uint32_t bytes_sent;
+};
+
+#define BINHOST_NO_ANSWER       0xFF
+
+int Binhost_Start(struct binhost *h);
+void Binhost_Rx(uint8_t c);
+
+#endif
@@ -0,0 +1,90 @@
+/*
+ * What Core/ provides on the target: the USART1 handle and its HAL
+ * callbacks (usart.c), the interrupt handlers (stm32h5xx_it.c) and the
+ * start-up sequence of main().
+ */
+#include "sim.h"
+#include "stm32h5xx_hal.h"
+#include "iap_config.h"
+#include "iap.h"
+#include "sched.h"
+#include "serial.h"
+#include "ramexec.h"
+
+UART_HandleTypeDef huart1;
+
+/* startup_stm32h503cbtx.s, copied to RAM by RamExec_Init() */
+const uint32_t g_pfnVectors[RAMEXEC_VECTORS];
+
+/* stm32h5xx_it.c ------------------------------------------------------------*/
+static void USART1_IRQHandler(void)
+{
+	Sim_UartIrq();
+}
+
+/************************************************************************/
+static void FLASH_IRQHandler(void)
+{
+	HAL_FLASH_IRQHandler();
+}
+
+#if (USE_SERIAL_TX_DMA == 1)
+/************************************************************************/
+static void GPDMA1_Channel0_IRQHandler(void)
+{
+	Serial_DmaIsr();
+}
+#endif
+
+/**
+ * MX_USART1_UART_Init() and the vector table.
+ */
+void Sim_BoardInit(uint32_t baud)
+{
+	huart1.Instance = USART1;
+	huart1.Init.BaudRate = baud;
+	huart1.gState = HAL_UART_STATE_READY;
+	huart1.RxState = HAL_UART_STATE_READY;
+	Sim_IrqHandler(USART1_IRQn, USART1_IRQHandler);
+	Sim_IrqHandler(FLASH_IRQn, FLASH_IRQHandler);
+#if (USE_SERIAL_TX_DMA == 1)
+	Sim_IrqHandler(GPDMA1_Channel0_IRQn, GPDMA1_Channel0_IRQHandler);
+#endif
+	HAL_NVIC_EnableIRQ(USART1_IRQn);
+}
+
+/**
+ * main() after the clock and peripheral set-up; never returns.
+ */
+void Sim_Boot(void)
+{
+	IAP_Init();
+	Sched_Run();
+}
+
+/* usart.c -------------------------------------------------------------------*/
+void HAL_UARTEx_RxEventCallback(UART_HandleTypeDef *huart, uint16_t Size)
+{
+	if (huart->Instance == USART1)
+	{
+		Serial_RxEventIsr(Size);
+	}
+}
+
+/************************************************************************/
+void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart)
+{
+	if (huart->Instance == USART1)
+	{
+		Serial_TxIsr();
+	}
+}
+
+/************************************************************************/
+void HAL_UART_ErrorCallback(UART_HandleTypeDef *huart)
+{
+	if (huart->Instance == USART1)
+	{
+		Serial_ErrorIsr();
+	}
+}
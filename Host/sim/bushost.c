@@ -0,0 +1,416 @@
+/*
+ * Reference bus update host. Nothing is acknowledged during the stream;
+ * the host learns what got lost from the STATUS polls, one node at a
+ * time, and sends the union of what the nodes miss to all of them.
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "sim.h"
+#include "bincmd.h"
+#include "iap_config.h"
+#include "bushost.h"
+
+#define BUSHOST_SETTLE_NS       20000000ull     /* last packet programmed */
+#define BUSHOST_POLL_NS         20000000ull     /* a node's answer, after the line time */
+#define BUSHOST_POLL_CHARS      160             /* longest STATUS answer on the line */
+#define BUSHOST_RETRIES         3
+#define BUSHOST_ROUNDS          20
+#define BUSHOST_RX_MAX          512
+
+enum {
+	BH_IDLE = 0,
+	BH_ERASE,               /* BEGIN sent, nodes erasing */
+	BH_SETTLE,              /* packets sent, the last ones being programmed */
+	BH_POLL,                /* STATUS sent to node */
+	BH_BOOT,                /* BOOT sent to node */
+	BH_RETRY                /* line quiet before the request again */
+};
+
+static struct bushost *cur;
+static int state;
+static uint16_t packets;
+static uint8_t need[BINCMD_BUS_MAX_PACKETS];    /* to send in the next pass */
+static int rebegin;             /* a node lost its session */
+static int node;                /* polled */
+static uint16_t first;          /* of its missing list */
+static int tries;
+static void (*request)(void);   /* to node, repeated after BH_RETRY */
+static uint8_t id;              /* of the last frame */
+static uint8_t frame[BINCMD_OVERHEAD + BINCMD_MAX_PAYLOAD];
+static uint8_t rx[BUSHOST_RX_MAX];
+static uint32_t rx_count, rx_need;
+static int rx_sync;             /* SOF bytes seen */
+
+static void timeout(void *arg);
+
+/************************************************************************/
+static uint16_t crc16(const uint8_t *p, uint32_t n)
+{
+	uint16_t crc = 0;
+	int i;
+
+	while (n--) {
+		crc ^= (uint16_t)*p++ << 8;
+		for (i = 0; i < 8; i++)
+			crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+	}
+	return crc;
+}
+
+/************************************************************************/
+static void put16(uint8_t *p, uint32_t v)
+{
+	p[0] = (uint8_t)v;
+	p[1] = (uint8_t)(v >> 8);
+}
+
+/************************************************************************/
+static void put32(uint8_t *p, uint32_t v)
+{
+	put16(p, v);
+	put16(p + 2, v >> 16);
+}
+
+/************************************************************************/
+static uint32_t get16(const uint8_t *p)
+{
+	return p[0] | ((uint32_t)p[1] << 8);
+}
+
+/**
+ * Put a frame on the bus; payload[0] is the address.
+ */
+static void send_frame(uint8_t cmd, const uint8_t *payload, uint16_t len)
+{
+	uint16_t crc;
+
+	frame[0] = BINCMD_SOF0;
+	frame[1] = BINCMD_SOF1;
+	frame[2] = cmd;
+	frame[3] = ++id;
+	put16(frame + 4, len);
+	memcpy(frame + 6, payload, len);
+	crc = crc16(frame + 2, BINCMD_HEADER_SIZE + len);
+	frame[6 + len] = (uint8_t)(crc >> 8);
+	frame[7 + len] = (uint8_t)crc;
+	Sim_BusSend(frame, BINCMD_OVERHEAD + len);
+	cur->bytes_sent += BINCMD_OVERHEAD + len;
+}
+
+/************************************************************************/
+static void wait_until(uint64_t t, int next)
+{
+	state = next;
+	Sim_Cancel(timeout, NULL);
+	Sim_At(t, timeout, NULL);
+}
+
+/**
+ * BEGIN to all nodes; the ones in this session already ignore it.
+ */
+static void begin(void)
+{
+	uint8_t p[BINCMD_BUS_BEGIN_SIZE];
+	uint32_t sectors = (cur->size + PAGE_SIZE - 1) / PAGE_SIZE;
+
+	p[0] = BINCMD_ADDR_ALL;
+	put32(p + 1, cur->session);
+	put32(p + 5, cur->size);
+	put16(p + 9, cur->packet);
+	p[11] = cur->part;
+	p[12] = cur->flags;
+	memcpy(p + 13, cur->nonce, sizeof(cur->nonce));
+	send_frame(BINCMD_BUS_BEGIN, p, sizeof(p));
+	cur->begins++;
+	rebegin = 0;
+	wait_until(Sim_BusIdle() + (uint64_t)sectors * BINCMD_BUS_ERASE_MS * 1000000, BH_ERASE);
+}
+
+/**
+ * Every packet some node needs, once, to all nodes.
+ */
+static void send_packets(void)
+{
+	uint8_t p[3 + BINCMD_MAX_DATA];
+	uint32_t offset, len;
+	uint16_t seq;
+
+	for (seq = 0; seq < packets; seq++) {
+		if (!need[seq])
+			continue;
+		need[seq] = 0;
+		offset = (uint32_t)seq * cur->packet;
+		len = cur->size - offset < cur->packet ? cur->size - offset : cur->packet;
+		p[0] = BINCMD_ADDR_ALL;
+		put16(p + 1, seq);
+		memcpy(p + 3, cur->data + offset, len);
+		send_frame(BINCMD_BUS_DATA, p, (uint16_t)(3 + len));
+		cur->frames++;
+		if (cur->rounds != 0)
+			cur->repairs++;
+	}
+	if (cur->rounds == 0)
+		cur->t_stream = Sim_BusIdle();
+	wait_until(Sim_BusIdle() + BUSHOST_SETTLE_NS, BH_SETTLE);
+}
+
+/**
+ * @return when the answer of a node to the request on the line is late
+ */
+static uint64_t answer_due(void)
+{
+	uint64_t slot = 10ull * 1000000000ull / Sim_Bus.baud;
+
+	return Sim_BusIdle() + BUSHOST_POLL_CHARS * slot +
+	       2ull * (Sim_Link.latency_us + Sim_Link.jitter_us) * 1000 + BUSHOST_POLL_NS;
+}
+
+/************************************************************************/
+static void poll(void)
+{
+	uint8_t p[3];
+
+	p[0] = (uint8_t)(node + 1);
+	put16(p + 1, first);
+	send_frame(BINCMD_BUS_STATUS, p, sizeof(p));
+	cur->polls++;
+	request = poll;
+	rx_sync = 0;
+	wait_until(answer_due(), BH_POLL);
+}
+
+/************************************************************************/
+static void boot(void)
+{
+	send_frame(BINCMD_BUS_BOOT, (const uint8_t[]){ (uint8_t)(node + 1) }, 1);
+	request = boot;
+	rx_sync = 0;
+	wait_until(answer_due(), BH_BOOT);
+}
+
+/************************************************************************/
+static int node_done(int i)
+{
+	return cur->state[i] == BINCMD_BUS_VERIFIED || cur->state[i] == BINCMD_BUS_REJECTED;
+}
+
+/************************************************************************/
+static void finish(int status)
+{
+	Sim_Cancel(timeout, NULL);
+	state = BH_IDLE;
+	cur->status = status;
+	if (cur->done)
+		cur->done(cur);
+}
+
+/**
+ * Start the next node that has checked the image. One at a time, with an
+ * answer: a BOOT to all nodes that one of them misses would leave it in
+ * the bootloader unnoticed.
+ */
+static void boot_next(void)
+{
+	int i;
+
+	while (++node < cur->nodes && cur->state[node] != BINCMD_BUS_VERIFIED)
+		;
+	if (node < cur->nodes) {
+		tries = 0;
+		boot();
+		return;
+	}
+	cur->t_end = Sim_Now;
+	for (i = 0; i < cur->nodes && cur->state[i] == BINCMD_BUS_VERIFIED; i++)
+		;
+	finish(i == cur->nodes ? 1 : -1);
+}
+
+/**
+ * Every node polled: boot, or the next pass.
+ */
+static void round_end(void)
+{
+	int i;
+
+	for (i = 0; i < cur->nodes && node_done(i); i++)
+		;
+	if (i == cur->nodes) {
+		node = -1;
+		boot_next();
+		return;
+	}
+	if (cur->rounds >= BUSHOST_ROUNDS) {
+		finish(-1);
+		return;
+	}
+	if (rebegin)
+		begin();
+	else
+		send_packets();
+}
+
+/**
+ * Poll the next node that has not checked the image yet.
+ */
+static void next_node(void)
+{
+	while (++node < cur->nodes && node_done(node))
+		;
+	if (node == cur->nodes) {
+		round_end();
+		return;
+	}
+	first = 0;
+	tries = 0;
+	poll();
+}
+
+/**
+ * A STATUS answer of the polled node: status, session, state, packets,
+ * missing, seq...
+ */
+static void status_answer(const uint8_t *p, uint32_t len)
+{
+	uint32_t session, missing, n, i, seq = 0;
+	uint8_t st;
+
+	if (len < 10 || p[0] != BINCMD_OK || (len - 10) % 2 != 0)
+		return;
+	Sim_Cancel(timeout, NULL);
+	session = get16(p + 1) | (get16(p + 3) << 16);
+	st = p[5];
+	missing = get16(p + 8);
+	n = (len - 10) / 2;
+	if (session != cur->session || st == BINCMD_BUS_IDLE || st == BINCMD_BUS_FAILED) {
+		/* Missed BEGIN, or a flash error: start over with all packets */
+		cur->state[node] = session != cur->session ? BINCMD_BUS_IDLE : st;
+		rebegin = 1;
+		memset(need, 1, packets);
+		if (cur->rounds == 1)
+			cur->missed[node] = packets;
+		next_node();
+		return;
+	}
+	cur->state[node] = st;
+	if (cur->rounds == 1 && first == 0)
+		cur->missed[node] = (uint16_t)missing;
+	for (i = 0; i < n; i++) {
+		seq = get16(p + 10 + 2 * i);
+		if (seq < packets)
+			need[seq] = 1;
+	}
+	if (st == BINCMD_BUS_RECEIVING && n == BINCMD_BUS_MISSING_MAX && seq + 1 < packets) {
+		/* More than one answer holds */
+		first = (uint16_t)(seq + 1);
+		tries = 0;
+		poll();
+		return;
+	}
+	next_node();
+}
+
+/************************************************************************/
+static void timeout(void *arg)
+{
+	(void)arg;
+	switch (state) {
+	case BH_ERASE:
+		send_packets();
+		break;
+	case BH_SETTLE:
+		cur->rounds++;
+		node = -1;
+		next_node();
+		break;
+	case BH_POLL:
+	case BH_BOOT:
+		/* For BOOT the answer may be what got lost, with the application
+		   running already */
+		cur->timeouts++;
+		if (++tries < BUSHOST_RETRIES)
+			wait_until(Sim_Now + BINCMD_BUS_RETRY_MS * 1000000ull, BH_RETRY);
+		else if (state == BH_POLL)
+			next_node();
+		else
+			boot_next();
+		break;
+	case BH_RETRY:
+		request();
+		break;
+	default:
+		break;
+	}
+}
+
+/**
+ * A byte from the bus: answers of the polled node, and whatever else the
+ * nodes put there (their menu at boot, collisions).
+ */
+void Bushost_Rx(uint8_t c)
+{
+	uint32_t len;
+
+	if (state != BH_POLL && state != BH_BOOT)
+		return;
+	if (rx_sync < 2) {
+		if (c == (rx_sync ? BINCMD_SOF1 : BINCMD_SOF0))
+			rx_sync++;
+		else
+			rx_sync = c == BINCMD_SOF0;
+		rx_count = 0;
+		rx_need = BINCMD_HEADER_SIZE;
+		return;
+	}
+	rx[rx_count++] = c;
+	if (rx_count < rx_need)
+		return;
+	if (rx_count == BINCMD_HEADER_SIZE) {
+		len = get16(rx + 2);
+		if (BINCMD_HEADER_SIZE + len + 2 > sizeof(rx)) {
+			rx_sync = 0;
+			return;
+		}
+		rx_need = BINCMD_HEADER_SIZE + len + 2;
+		return;
+	}
+	rx_sync = 0;
+	len = rx_count - BINCMD_HEADER_SIZE - 2;
+	if (crc16(rx, BINCMD_HEADER_SIZE + len) != ((uint32_t)rx[rx_count - 2] << 8 | rx[rx_count - 1]))
+		return;
+	if (rx[1] != id)
+		return;
+	if (state == BH_POLL && rx[0] == (BINCMD_BUS_STATUS | BINCMD_RESPONSE)) {
+		status_answer(rx + BINCMD_HEADER_SIZE, len);
+	} else if (state == BH_BOOT && rx[0] == (BINCMD_BUS_BOOT | BINCMD_RESPONSE)) {
+		Sim_Cancel(timeout, NULL);
+		if (len >= 1 && rx[BINCMD_HEADER_SIZE] == BINCMD_OK)
+			cur->booted++;
+		boot_next();
+	}
+}
+
+/**
+ * Start the update: BEGIN, then the stream once the nodes have erased.
+ * @return 0, -1 bad parameters
+ */
+int Bushost_Start(struct bushost *h)
+{
+	uint32_t n;
+
+	if (h->packet == 0 || h->packet % BINCMD_BUS_BLOCK != 0 || h->packet > BINCMD_MAX_DATA ||
+	    h->size == 0 || h->nodes < 1 || h->nodes > BUSHOST_NODES_MAX)
+		return -1;
+	n = (h->size + h->packet - 1) / h->packet;
+	if (n > BINCMD_BUS_MAX_PACKETS)
+		return -1;
+	cur = h;
+	packets = (uint16_t)n;
+	memset(need, 1, packets);
+	memset(h->state, BINCMD_BUS_IDLE, sizeof(h->state));
+	h->status = 0;
+	h->t_start = Sim_Now;
+	begin();
+	return 0;
+}
@@ -0,0 +1,46 @@
+/*
+ * Reference host of a bus update (busupdate.h), driven by the bytes the
+ * nodes send and simulation timers like the YModem peers (ympeer.h): BEGIN
+ * to all nodes, every packet once, then rounds of STATUS polls and repairs
+ * of the packets any node misses, and BOOT to each node once all of them
+ * have checked the image.
+ */
+#ifndef BUSHOST_H
+#define BUSHOST_H
+
+#include <stdint.h>
+
+#define BUSHOST_NODES_MAX       64
+
+struct bushost {
+	/* set by the caller */
+	const uint8_t *data;    /* without an encryption header */
+	uint32_t size;
+	uint16_t packet;        /* multiple of BINCMD_BUS_BLOCK */
+	uint8_t part;           /* Partition_Type */
+	uint8_t flags;          /* BINCMD_BUS_ENCRYPTED */
+	uint8_t nonce[12];
+	uint32_t session;
+	int nodes;              /* addressed 1..nodes */
+	void (*done)(struct bushost *h);
+	/* results, times in ns */
+	int status;             /* 0 running, 1 all nodes checked the image, -1 gave up */
+	uint64_t t_start;       /* first BEGIN */
+	uint64_t t_stream;      /* every packet on the line once */
+	uint64_t t_end;         /* last node started */
+	uint32_t frames;        /* DATA frames sent */
+	uint32_t repairs;       /* of them, sent again */
+	uint32_t rounds;        /* poll rounds */
+	uint32_t polls;
+	uint32_t timeouts;
+	uint32_t begins;
+	uint32_t booted;        /* BOOT answered */
+	uint32_t bytes_sent;
+	uint8_t state[BUSHOST_NODES_MAX];       /* BINCMD_BUS_xxx as last polled */
+	uint16_t missed[BUSHOST_NODES_MAX];     /* packets missing after the first pass */
+};
+
+int Bushost_Start(struct bushost *h);
+void Bushost_Rx(uint8_t c);
+
+#endif
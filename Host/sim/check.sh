@@ -0,0 +1,74 @@
+#!/bin/sh
+# Scenarios of the simulated bootloader, run by "make -C Host check" after
+# the build. Each runs iapsim on its own; the first unexpected result
+# prints the run's output and fails the script.
+set -e
+cd "$(dirname "$0")/.."
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+
+# An application of SIZE bytes: a vector table for 0x0800A000, then filler
+app() {
+	printf '\300\177\000\040\001\241\000\010' > "$1"
+	head -c "$(($2 - 8))" sim/iapsim >> "$1"
+}
+
+# run NAME STATUS IAPSIM-ARGS...: iapsim must exit with STATUS
+run() {
+	name=$1
+	want=$2
+	shift 2
+	got=0
+	sim/iapsim "$@" > "$tmp/out" 2>&1 || got=$?
+	if [ "$got" != "$want" ]; then
+		echo "FAIL $name: exit $got, expected $want"
+		cat "$tmp/out"
+		exit 1
+	fi
+	echo "ok   $name"
+}
+
+# expect NAME TEXT: the output of the last run must contain TEXT
+expect() {
+	if ! grep -qF "$2" "$tmp/out"; then
+		echo "FAIL $1: no \"$2\""
+		cat "$tmp/out"
+		exit 1
+	fi
+	echo "ok   $1"
+}
+
+app "$tmp/app.bin" 40000
+tools/mksign tools/devkey.hex "$tmp/app.bin" "$tmp/app.signed" > /dev/null
+head -c 5000 sim/iapsim > "$tmp/config.bin"
+tail -c 3000 sim/iapsim > "$tmp/calib.bin"
+
+run "update" 0 -u "$tmp/app.signed"
+run "update, unsigned image refused" 1 -u "$tmp/app.bin"
+run "update, application confirms its trial" 0 -A ok -f "$tmp/flash.bin" -u "$tmp/app.signed"
+run "update, reboot" 0 -A ok -f "$tmp/flash.bin" -k
+expect "update, reboot, the app starts" "boot:    application started"
+run "confirmed trial, reboot" 0 -A ok -f "$tmp/flash.bin" -k
+expect "confirmed trial, reboot, the app starts again" "boot:    application started"
+run "update over the confirmed application, from the boot window" 0 -A ok -f "$tmp/flash.bin" \
+	-u "$tmp/app.signed"
+run "update, application hangs on trial" 0 -A hang -f "$tmp/hang.bin" -u "$tmp/app.signed"
+run "trial boot 2" 0 -A hang -f "$tmp/hang.bin" -k
+run "trial boot 3" 0 -A hang -f "$tmp/hang.bin" -k
+expect "trial boot 3, the app starts again" "boot:    application started, watchdog reset"
+run "trial given up" 0 -A hang -f "$tmp/hang.bin" -k
+expect "trial given up, the app is not started" "boot:    stayed in the bootloader"
+run "failed trial, reboot" 0 -A hang -f "$tmp/hang.bin" -k
+expect "failed trial, reboot, the app is not started" "boot:    stayed in the bootloader"
+run "update, line errors" 0 -e 1e-5 -u "$tmp/app.signed"
+run "update, sector that only reads blank" 0 -W 0x0800a400 -u "$tmp/app.signed"
+run "update, batch of three partitions" 0 -u "$tmp/app.signed" -u config:"$tmp/config.bin" \
+	-u calib:"$tmp/calib.bin"
+run "update, batch with a file for the state sector refused" 1 -u "$tmp/app.signed" \
+	-u edata:"$tmp/calib.bin"
+run "update, batch with the application and a bootloader refused" 1 -v -u "$tmp/app.signed" \
+	-u boot:"$tmp/calib.bin"
+expect "update, batch with the application and a bootloader refused" "one at a time"
+run "bus update, 3 nodes" 0 -N 3 -u "$tmp/app.signed"
+run "binary protocol: write, read, verify, refusals, boot" 0 -c "$tmp/app.signed"
+run "binary protocol, unsigned image not started" 1 -c "$tmp/app.bin"
@@ -0,0 +1,1063 @@
+/*
+ * iapsim - the bootloader built for the host, on simulated hardware.
+ *
+ *   iapsim [options] -u IMAGE.bin     send IMAGE through `update` over an
+ *                                     in-memory line, report the timing;
+ *                                     -u again for a batch, "-u part:FILE"
+ *                                     sends FILE to that partition
+ *   iapsim [options] -d IMAGE.bin     put IMAGE in the application area and
+ *                                     receive it back through `upload`
+ *   iapsim [options] -B (-u|-d) IMAGE.bin
+ *                                     benchmark: one session per
+ *                                     combination of the -b, -s and -e
+ *                                     lists and of -R seeds, a CSV row each
+ *   iapsim [options] -p               real time, console on a pseudo
+ *                                     terminal for a terminal or iapcmd
+ *   iapsim [options] -k               boot only: until the application
+ *                                     starts or the menu is up
+ *   iapsim [options] -N COUNT -u IMAGE.bin
+ *                                     update COUNT bootloaders on one
+ *                                     RS-485 bus at once (busupdate.h)
+ *   iapsim [options] -c IMAGE.bin     write IMAGE to the application area
+ *                                     with the binary protocol (bincmd.h),
+ *                                     check every answer and the refusals
+ *                                     (binhost.h), boot it
+ * Options:
+ *   -b BAUD        line rate (115200; -B: 115200,460800,921600)
+ *   -f FLASH.bin   flash contents, loaded at start, saved at exit (not -B;
+ *                  -N: the nodes start from it, it is not saved)
+ *   -n NAME        file name sent with a single -u, "part:name" picks the partition,
+ *                  "boot:name" installs a bootloader image (Host/tools/mkboot);
+ *                  application and bootloader images must be signed
+ *                  (Host/tools/mksign, the key of tools/devkey.hex), any
+ *                  file may be encrypted (Host/tools/mkenc, tools/devenc.hex)
+ *   -s SIZE        data packet size with -u, 8..2048 (1024; -B: all sizes);
+ *                  with -N a multiple of 64 up to 1024
+ *   -t SECONDS     virtual time limit (-u, -d: 120)
+ *   -v             echo the device console
+ *   -T DUMP.bin    -u, -d: save the protocol trace for Host/tools/iaptrace
+ *   -A hang|ok     the application once started: hangs until the watchdog
+ *                  resets it, or confirms its trial boot (trial.h); with -f
+ *                  and -k the next boots follow the trial
+ * Line faults, in both directions; with -N on the line of each node, with
+ * the seed plus its index:
+ *   -e BER         bit error rate (0; -B: 0,1e-5,1e-4)
+ *   -G RATE,LEN    error bursts: starts per byte, mean length in bytes (8)
+ *   -D RATE        byte loss rate
+ *   -U RATE        byte duplication rate
+ *   -L US          one way latency
+ *   -J US          latency jitter, uniform below US
+ *   -r SEED        seed of the faults (1)
+ *   -R COUNT       -B: run each case with COUNT seeds from SEED on (1)
+ * Flash:
+ *   -P US          quadword program time (50)
+ *   -E US          sector erase time (2000)
+ *   -S             no CPU stall while bank 1 is busy
+ *   -F             interrupt handlers run from flash, as without ramexec.h
+ *   -W ADDR        the quadword at ADDR reads blank but is programmed
+ *
+ * With -u, -d and -c the run is deterministic: time is virtual and only the
+ * simulated hardware consumes it. Each benchmark case runs in a child
+ * process, as the firmware state cannot be reset; the exit status is 1
+ * if any case failed. With -N each node runs in a child process too, in
+ * lockstep with the host (sim_bus.c); the nodes get the addresses 1..COUNT
+ * and the exit status is 1 unless every one of them has the image.
+ */
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "sim.h"
+#include "iap_config.h"
+#include "partition.h"
+#include "ymodem.h"
+#include "ympeer.h"
+#include "stats.h"
+#include "trace.h"
+#include "bootinfo.h"
+#include "kvstore.h"
+#include "services.h"
+#include "trial.h"
+#include "selfupdate.h"
+#include "imagesig.h"
+#include "imageenc.h"
+#include "chacha20.h"
+#include "bincmd.h"
+#include "busupdate.h"
+#include "bushost.h"
+#include "binhost.h"
+#include "iap.h"
+#include "sched.h"
+
+#define QUIET_NS        20000000ull     /* console silence that ends a step */
+#define LIST_MAX        16
+
+enum { PH_BOOT = 0, PH_COMMAND, PH_SESSION, PH_RESULT };
+
+struct list {
+	double v[LIST_MAX];
+	int n;
+};
+
+static int verbose;
+static uint32_t baud = 115200;
+static int upload;              /* -d: the device sends */
+static int station;             /* -c: binary protocol */
+static int boot_only;           /* -k */
+static int app_running;         /* -A: a silent console is no end then */
+static int phase;
+static int pty_fd = -1;
+static const uint8_t *image;
+static uint32_t image_size;
+static struct ymsend ys;
+static struct ymrecv yr;
+static struct ympeer_stats *st;
+static struct bushost bh;
+static struct binhost bc;
+static int bus_index;           /* -N: of the node in this process */
+
+static void quiet(void *arg);
+
+/************************************************************************/
+static void usage(void)
+{
+	fprintf(stderr,
+		"usage: iapsim [-b baud] [-f flash.bin] [-t s] [-v] [-T trace.bin] [-e ber] [-G rate,len] [-D rate]\n"
+		"              [-U rate] [-L us] [-J us] [-r seed] [-P us] [-E us] [-S] [-F] [-W addr]\n"
+		"              [-A hang|ok] ([-B] [-R count] (-u image.bin [-n name] [-s packet] | -d image.bin) |\n"
+		"               -u [part:]file -u [part:]file... [-s packet] |\n"
+		"               -p | -k | -N count -u image.bin [-n name] [-s packet] | -c image.bin)\n"
+		"       -B takes comma separated lists for -b, -s and -e\n");
+	exit(2);
+}
+
+/************************************************************************/
+static uint8_t *load(const char *path, uint32_t *size)
+{
+	FILE *fp = fopen(path, "rb");
+	uint8_t *buf;
+	long n;
+
+	if (fp == NULL || fseek(fp, 0, SEEK_END) != 0 || (n = ftell(fp)) <= 0) {
+		perror(path);
+		exit(1);
+	}
+	rewind(fp);
+	buf = malloc(n);
+	if (buf == NULL || fread(buf, 1, n, fp) != (size_t)n) {
+		perror(path);
+		exit(1);
+	}
+	fclose(fp);
+	*size = (uint32_t)n;
+	return buf;
+}
+
+/* Application ---------------------------------------------------------------*/
+static void app_hang(void)
+{
+	app_running = 1;
+	for (;;)
+		__NOP();
+}
+
+/**
+ * What a healthy application does: confirm, then keep the watchdog fed.
+ */
+static void app_ok(void)
+{
+	uint32_t err;
+
+	app_running = 1;
+	err = Services.trial_confirm();
+
+	fprintf(stderr, "app: trial_confirm %s\n", err == 0 ? "ok" : "FAILED");
+	IWDG->KR = 0xAAAA;
+}
+
+/**
+ * The trial state as the next boot finds it in flash.
+ */
+static void trial_report(void)
+{
+	static const char *const name[] = { "none", "pending", "failed" };
+	uint32_t boots;
+	uint8_t state;
+
+	KvStore_Init();
+	state = Trial_Get(&boots);
+	printf("trial:   %s, %u of %u boots\n", state <= TRIAL_FAILED ? name[state] : "?",
+	       boots, TRIAL_MAX_BOOTS);
+}
+
+/**
+ * What the application would find at BOOTINFO_ADDR.
+ */
+static void handoff_report(void)
+{
+	if (BootInfo_Valid(&BootInfo_Block))
+		printf("handoff: bootloader %u.%u.%u, %u MHz, update %d, reset cause 0x%08x\n",
+		       BootInfo_Block.bl_version >> 16, (BootInfo_Block.bl_version >> 8) & 0xFF,
+		       BootInfo_Block.bl_version & 0xFF, BootInfo_Block.sysclk / 1000000,
+		       BootInfo_Block.update, BootInfo_Block.reset_cause);
+	else
+		printf("handoff: no valid boot info\n");
+}
+
+/* Session -------------------------------------------------------------------*/
+static void session_end(void)
+{
+	phase = PH_RESULT;
+	Sim_Cancel(quiet, NULL);
+	Sim_At(Sim_Now + QUIET_NS, quiet, NULL);
+}
+
+/************************************************************************/
+static void sent(struct ymsend *s)
+{
+	(void)s;
+	session_end();
+}
+
+/************************************************************************/
+static void received(struct ymrecv *r)
+{
+	(void)r;
+	session_end();
+}
+
+/**
+ * The console has been silent for a while: the menu is up, the command
+ * has printed its prompt, or the result of the session is out.
+ */
+static void quiet(void *arg)
+{
+	static uint32_t flash_ops;
+	char cmd[48];
+
+	(void)arg;
+	if (app_running)
+		return;
+	/* Before the end, the flash must be quiet too: a bootloader copy
+	   prints nothing until it resets */
+	if ((boot_only || phase == PH_RESULT) && Sim_Flash.erases + Sim_Flash.programs != flash_ops) {
+		flash_ops = Sim_Flash.erases + Sim_Flash.programs;
+		Sim_At(Sim_Now + QUIET_NS, quiet, NULL);
+		return;
+	}
+	/* -k: the application starts once the boot window is over */
+	if (boot_only && Sim_Now < IAP_BOOT_WAIT_MS * 1000000ull + QUIET_NS) {
+		Sim_At(Sim_Now + QUIET_NS, quiet, NULL);
+		return;
+	}
+	if (boot_only) {
+		Sim_Stop(SIM_EXIT_STOP);
+	} else if (phase == PH_BOOT && station) {
+		phase = PH_SESSION;
+		Binhost_Start(&bc);
+	} else if (phase == PH_BOOT && !upload) {
+		phase = PH_SESSION;
+		snprintf(cmd, sizeof(cmd), "%s\r", CMD_UPDATE_STR);
+		Sim_LinkSend((const uint8_t *)cmd, (uint32_t)strlen(cmd));
+		if (Ymsend_Start(&ys) != 0) {
+			fprintf(stderr, "iapsim: bad packet size or name\n");
+			Sim_Stop(SIM_EXIT_ERROR);
+		}
+	} else if (phase == PH_BOOT) {
+		phase = PH_COMMAND;
+		snprintf(cmd, sizeof(cmd), "%s 0x%08X %u\r", CMD_UPLOAD_STR, ApplicationAddress, image_size);
+		Sim_LinkSend((const uint8_t *)cmd, (uint32_t)strlen(cmd));
+	} else if (phase == PH_COMMAND) {
+		phase = PH_SESSION;
+		Ymrecv_Start(&yr);
+	} else if (phase == PH_RESULT) {
+		Sim_Stop(SIM_EXIT_STOP);
+	}
+}
+
+/************************************************************************/
+static void session_rx(uint8_t c)
+{
+	if (phase == PH_SESSION) {
+		if (station)
+			Binhost_Rx(c);
+		else if (upload)
+			Ymrecv_Rx(c);
+		else
+			Ymsend_Rx(c);
+		return;
+	}
+	if (verbose)
+		putchar(c);
+	Sim_Cancel(quiet, NULL);
+	Sim_At(Sim_Now + QUIET_NS, quiet, NULL);
+}
+
+/**
+ * A request of the station got an unexpected answer, or none: the device
+ * stays in the binary protocol, nothing more to see.
+ */
+static void station_done(struct binhost *h)
+{
+	if (h->status < 0)
+		Sim_Stop(SIM_EXIT_STOP);
+}
+
+/**
+ * @return when the session ended, or now for one cut short
+ */
+static uint64_t session_end_time(void)
+{
+	return st->status != 0 ? st->t_end : Sim_Now;
+}
+
+/**
+ * @return a file sent with -u as the device writes it: decrypted with
+ *         IMAGEENC_KEY when it starts with an encryption header
+ *         (Host/tools/mkenc)
+ */
+static const uint8_t *image_plain(const struct ymsend_file *f, uint32_t *size)
+{
+	static const uint8_t key[CHACHA20_KEY_SIZE] = IMAGEENC_KEY;
+	static uint8_t *plain[YMSEND_FILES_MAX];
+	uint8_t **p = &plain[f - ys.file];
+	ImageEnc_Header h;
+	ChaCha20_Ctx ctx;
+
+	*size = f->size;
+	if (f->size <= sizeof(h))
+		return f->data;
+	memcpy(&h, f->data, sizeof(h));
+	if (h.magic != IMAGEENC_MAGIC)
+		return f->data;
+	*size = f->size - sizeof(h);
+	if (*p == NULL) {
+		*p = malloc(*size);
+		memcpy(*p, f->data + sizeof(h), *size);
+		ChaCha20_Init(&ctx, key, h.nonce, 0);
+		ChaCha20_Xor(&ctx, *p, *size);
+	}
+	return *p;
+}
+
+/**
+ * @return the bytes of the plain file before its signature trailer
+ *         (Host/tools/mksign), all of them for a file without one
+ */
+static uint32_t image_unsigned_size(const struct ymsend_file *f)
+{
+	ImageSig_Trailer t;
+	uint32_t size;
+	const uint8_t *plain = image_plain(f, &size);
+
+	if (size <= sizeof(t))
+		return size;
+	memcpy(&t, plain + size - sizeof(t), sizeof(t));
+	return t.magic == IMAGESIG_MAGIC && t.size == size - sizeof(t) ? t.size : size;
+}
+
+/**
+ * @return 1 the file is in its partition, or installed over the bootloader
+ *         for a "boot:" file, 0 not
+ */
+static int file_verified(const struct ymsend_file *f)
+{
+	uint32_t size;
+	const uint8_t *plain = image_plain(f, &size);
+	uint8_t type;
+
+	if (SelfUpdate_IsBootFile((const uint8_t *)f->name))
+		return image_unsigned_size(f) > sizeof(SelfUpdate_Trailer) &&
+		       memcmp((const void *)(uintptr_t)STM32_FLASH_BASE, plain,
+			      image_unsigned_size(f) - sizeof(SelfUpdate_Trailer)) == 0;
+	if (Partition_FromFileName((const uint8_t *)f->name, &type) != 0)
+		return 0;
+	return memcmp((const void *)(uintptr_t)Partition_Addr(type), plain, size) == 0;
+}
+
+/**
+ * @return 1 update: every file of the batch is where its name puts it;
+ *         upload: the image came back whole, 0 not
+ */
+static int session_verified(void)
+{
+	int i;
+
+	if (st->status != 1)
+		return 0;
+	if (upload)
+		return yr.size == image_size && yr.received == image_size &&
+		       memcmp(yr.buf, image, image_size) == 0;
+	for (i = 0; i < ys.files; i++) {
+		if (!file_verified(&ys.file[i]))
+			return 0;
+	}
+	return 1;
+}
+
+/************************************************************************/
+static int session_report(int exit_code)
+{
+	double total, data, sectors;
+	uint32_t line;
+	int ok = session_verified(), i;
+	Stats_Counters dev;
+
+	fflush(stdout);
+	total = (session_end_time() - st->t_start) / 1e9;
+	data = st->t_first_ack ? (session_end_time() - st->t_first_ack) / 1e9 : 0.0;
+	line = upload ? Sim_Uart.tx_bytes : st->bytes_sent;
+	printf("%s:  %u bytes, packet %u, %u baud: %s%s\n", upload ? "upload" : "update",
+	       image_size, upload ? yr.packet : ys.packet, baud, ok ? "verified" : "FAILED",
+	       exit_code == SIM_EXIT_APP ? ", application started" :
+	       exit_code == SIM_EXIT_RESET && app_running ? ", application started, watchdog reset" :
+	       exit_code == SIM_EXIT_RESET ? ", reset" : "");
+	for (i = 0; !upload && ys.files > 1 && i < ys.files; i++)
+		printf("file:    %s, %u bytes: %s\n", ys.file[i].name, ys.file[i].size,
+		       file_verified(&ys.file[i]) ? "verified" : "FAILED");
+	printf("time:    %.3f s total, %.3f s to first ACK, %.0f B/s\n", total,
+	       st->t_first_ack ? (st->t_first_ack - st->t_start) / 1e9 : 0.0, total > 0 ? image_size / total : 0.0);
+	printf("data:    %.3f s, %.0f B/s, line %.0f%% busy\n", data,
+	       data > 0 ? image_size / data : 0.0,
+	       total > 0 ? 100.0 * line * Sim_CharTime() / 1e9 / total : 0.0);
+	printf("packets: %u, %u resent, %u timeouts\n", st->packets, st->resends, st->timeouts);
+	printf("flash:   %u erases, %u programs, %u rejected, %u errors, busy %.3f s, stall %.3f s\n",
+	       Sim_Flash.erases, Sim_Flash.programs, Sim_Flash.rejected, Sim_Flash.errors,
+	       Sim_Flash.busy_ns / 1e9, Sim_Flash.stall_ns / 1e9);
+	/* Sectors worth of flash work: erases plus 512 quadwords per sector */
+	sectors = Sim_Flash.erases + Sim_Flash.programs / (double)(FLASH_SECTOR_SIZE / 16);
+	printf("         interrupts held %.3f ms, CPU stall %.1f us per sector\n",
+	       Sim_Flash.held_ns / 1e6, sectors > 0 ? (Sim_Flash.stall_ns + Sim_Flash.held_ns) / 1e3 / sectors : 0.0);
+	printf("uart:    %u received, %u sent, %u overruns\n",
+	       Sim_Uart.rx_bytes, Sim_Uart.tx_bytes, Sim_Uart.overruns);
+	printf("line:    %u bytes corrupted, %u lost, %u duplicated, %u bursts\n",
+	       Sim_Link.corrupted, Sim_Link.dropped, Sim_Link.duplicated, Sim_Link.bursts);
+	printf("faults:  %u recoveries, mean %.1f ms, max %.1f ms, %u bytes wasted\n",
+	       st->recoveries, st->recoveries ? st->recovery_ns / 1e6 / st->recoveries : 0.0,
+	       st->recovery_max_ns / 1e6, st->wasted);
+	/* The bootloader's own view (the "stats" command) */
+	Stats_Get(&dev);
+	printf("device:  %u crc, %u seq errors, %u naks, %u resent, %u overruns; "
+	       "compute %.3f s, uart wait %.3f s, flash busy %.3f s\n",
+	       dev.crc_errors, dev.seq_errors, dev.naks, dev.resends, dev.uart_overruns,
+	       (double)dev.compute_cycles / dev.core_clock, (double)dev.uart_wait_cycles / dev.core_clock,
+	       (double)dev.flash_busy_cycles / dev.core_clock);
+	printf("         %u sectors erased, %u already blank, blank check %.3f ms\n",
+	       dev.flash_erases, dev.erases_skipped, dev.blank_check_cycles * 1e3 / dev.core_clock);
+	if (exit_code == SIM_EXIT_APP || (exit_code == SIM_EXIT_RESET && app_running)) {
+		handoff_report();
+		trial_report();
+	}
+	return ok ? 0 : 1;
+}
+
+/**
+ * @return 0 every answer as expected, the image in place and started, 1 not
+ */
+static int station_report(int exit_code)
+{
+	double total = (bc.t_end - bc.t_start) / 1e9;
+	int ok = bc.status == 1 && exit_code == SIM_EXIT_APP &&
+		 memcmp((const void *)(uintptr_t)bc.addr, image, image_size) == 0;
+
+	fflush(stdout);
+	if (bc.status < 0)
+		printf("bincmd:  %s: %s, status 0x%02x\n", bc.failed,
+		       bc.answer == BINHOST_NO_ANSWER ? "no answer" : "unexpected answer", bc.answer);
+	printf("bincmd:  %u bytes at 0x%08X, %u requests, %u baud: %s%s\n", image_size, bc.addr,
+	       bc.requests, baud, ok ? "verified" : "FAILED",
+	       exit_code == SIM_EXIT_APP ? ", application started" : "");
+	printf("time:    %.3f s total, %.0f B/s\n", total, total > 0 ? image_size / total : 0.0);
+	printf("flash:   %u erases, %u programs, %u rejected, %u errors\n",
+	       Sim_Flash.erases, Sim_Flash.programs, Sim_Flash.rejected, Sim_Flash.errors);
+	printf("uart:    %u received, %u sent, %u overruns\n",
+	       Sim_Uart.rx_bytes, Sim_Uart.tx_bytes, Sim_Uart.overruns);
+	return ok ? 0 : 1;
+}
+
+/**
+ * Write the trace ring the way the "trace" command sends it.
+ */
+static int trace_save(const char *path)
+{
+	uint32_t head = Trace.head, first = head > TRACE_ENTRIES ? head - TRACE_ENTRIES : 0, i;
+	uint8_t buf[14 + TRACE_ENTRIES * sizeof(Trace_Entry) + 2];
+	uint32_t n = 14;
+	uint16_t crc;
+	FILE *f;
+
+	memcpy(buf, &(uint32_t){ TRACE_MAGIC }, 4);
+	memcpy(buf + 4, &SystemCoreClock, 4);
+	memcpy(buf + 8, &first, 4);
+	buf[12] = (uint8_t)(head - first);
+	buf[13] = (uint8_t)((head - first) >> 8);
+	for (i = first; i != head; i++, n += sizeof(Trace_Entry))
+		memcpy(buf + n, &Trace.ring[i % TRACE_ENTRIES], sizeof(Trace_Entry));
+	crc = Cal_CRC16(buf, n);
+	buf[n++] = (uint8_t)(crc >> 8);
+	buf[n++] = (uint8_t)crc;
+	f = fopen(path, "wb");
+	if (f == NULL || fwrite(buf, 1, n, f) != n) {
+		perror(path);
+		if (f)
+			fclose(f);
+		return -1;
+	}
+	fclose(f);
+	return 0;
+}
+
+/************************************************************************/
+static int session_run(const char *flash, double limit)
+{
+	int code;
+
+	if (Sim_FlashInit(flash) != 0)
+		return SIM_EXIT_ERROR;
+	if (upload && Sim_FlashPreload(ApplicationAddress, image, image_size) != 0) {
+		fprintf(stderr, "iapsim: image larger than the flash\n");
+		return SIM_EXIT_ERROR;
+	}
+	Sim_BoardInit(baud);
+	Sim_LinkSetPeer(session_rx);
+	Sim_At(QUIET_NS, quiet, NULL);
+	code = Sim_Run(Sim_Boot, (uint64_t)(limit * 1e9));
+	/* The last ACK may still be on the line when the application starts */
+	if (code == SIM_EXIT_APP || code == SIM_EXIT_RESET)
+		Sim_Drain(Sim_Now + (uint64_t)(Sim_Link.latency_us + Sim_Link.jitter_us) * 1000 + QUIET_NS);
+	return code;
+}
+
+/************************************************************************/
+static int boot_run(const char *flash, double limit)
+{
+	int code;
+
+	if (Sim_FlashInit(flash) != 0)
+		return SIM_EXIT_ERROR;
+	Sim_BoardInit(baud);
+	Sim_LinkSetPeer(session_rx);
+	Sim_At(QUIET_NS, quiet, NULL);
+	code = Sim_Run(Sim_Boot, (uint64_t)(limit * 1e9));
+	printf("boot:    %s, t=%.3f s\n",
+	       code == SIM_EXIT_APP ? "application started" :
+	       code == SIM_EXIT_RESET && app_running ? "application started, watchdog reset" :
+	       code == SIM_EXIT_RESET ? "reset" :
+	       code == SIM_EXIT_STOP ? "stayed in the bootloader" : "time limit reached",
+	       Sim_Now / 1e9);
+	if (code == SIM_EXIT_APP || (code == SIM_EXIT_RESET && app_running))
+		handoff_report();
+	trial_report();
+	return code;
+}
+
+/* Bus -----------------------------------------------------------------------*/
+struct bus_result {
+	int code;               /* SIM_EXIT_xxx, first for sim_bus.c */
+	int verified;
+	int app;                /* the application started */
+	uint32_t crc_errors;
+	uint32_t corrupted;
+	uint32_t dropped;
+	uint32_t erases;
+	uint32_t programs;
+	double end;             /* s */
+};
+
+/**
+ * main() of a node: the address is its index, then the bootloader starts
+ * as usual.
+ */
+static void bus_boot(void)
+{
+	IAP_Init();
+	if (BusUpdate_Address() != bus_index + 1)
+		BusUpdate_SetAddress((uint8_t)(bus_index + 1));
+	Sched_Run();
+}
+
+/************************************************************************/
+static int bus_node(int index, void *result)
+{
+	struct bus_result *r = result;
+	const uint8_t *plain;
+	Stats_Counters dev;
+	uint32_t size;
+
+	bus_index = index;
+	if (!verbose && freopen("/dev/null", "w", stderr) == NULL)
+		return SIM_EXIT_ERROR;
+	r->code = Sim_Run(bus_boot, 0);
+	r->end = Sim_Now / 1e9;
+	/* The answer to BOOT may still be on the line */
+	if (r->code == SIM_EXIT_APP || r->code == SIM_EXIT_RESET)
+		Sim_Drain(Sim_Now + (uint64_t)(Sim_Link.latency_us + Sim_Link.jitter_us) * 1000 + QUIET_NS);
+	plain = image_plain(ys.file, &size);
+	r->verified = memcmp((const void *)(uintptr_t)Partition_Addr(bh.part), plain, size) == 0;
+	r->app = r->code == SIM_EXIT_APP || (r->code == SIM_EXIT_RESET && app_running);
+	Stats_Get(&dev);
+	r->crc_errors = dev.crc_errors;
+	r->corrupted = Sim_Link.corrupted;
+	r->dropped = Sim_Link.dropped;
+	r->erases = Sim_Flash.erases;
+	r->programs = Sim_Flash.programs;
+	return r->code;
+}
+
+/************************************************************************/
+static void bus_done(struct bushost *h)
+{
+	(void)h;
+	Sim_BusStop();
+}
+
+/**
+ * The nodes have printed their menu: the update starts.
+ */
+static void bus_quiet(void *arg)
+{
+	(void)arg;
+	phase = PH_SESSION;
+	if (Bushost_Start(&bh) != 0) {
+		fprintf(stderr, "iapsim: bad packet size\n");
+		Sim_BusStop();
+	}
+}
+
+/************************************************************************/
+static void bus_rx(uint8_t c)
+{
+	if (phase == PH_SESSION) {
+		Bushost_Rx(c);
+		return;
+	}
+	Sim_Cancel(bus_quiet, NULL);
+	Sim_At(Sim_Now + QUIET_NS, bus_quiet, NULL);
+}
+
+/**
+ * The update of all nodes, and its report.
+ * @return 0 every node has the image, 1 not
+ */
+static int bus_run(const char *flash, int nodes, double limit)
+{
+	static const char *const state_name[] = { "idle", "receiving", "verified", "rejected", "failed" };
+	struct bus_result *res = calloc(nodes, sizeof(*res));
+	uint32_t verified = 0, apps = 0, i;
+	ImageEnc_Header h;
+	double total;
+
+	if (res == NULL || Sim_FlashInit(flash) != 0)
+		return 1;
+	Partition_Init();
+	if (SelfUpdate_IsBootFile((const uint8_t *)ys.file[0].name) ||
+	    Partition_FromFileName((const uint8_t *)ys.file[0].name, &bh.part) != 0) {
+		fprintf(stderr, "iapsim: %s: no partition for a bus update\n", ys.file[0].name);
+		return 1;
+	}
+	bh.data = image;
+	bh.size = image_size;
+	if (image_size > sizeof(h) && memcpy(&h, image, sizeof(h)) && h.magic == IMAGEENC_MAGIC) {
+		/* The nodes get the nonce with BEGIN */
+		bh.data = image + sizeof(h);
+		bh.size = image_size - sizeof(h);
+		bh.flags = BINCMD_BUS_ENCRYPTED;
+		memcpy(bh.nonce, h.nonce, sizeof(bh.nonce));
+	}
+	bh.packet = ys.packet;
+	bh.session = (uint32_t)(Sim_Link.seed * 2654435761u) | 1;
+	bh.nodes = nodes;
+	bh.done = bus_done;
+	Sim_BoardInit(baud);
+	Sim_Bus.nodes = nodes;
+	Sim_Bus.baud = baud;
+	Sim_Bus.host_rx = bus_rx;
+	Sim_Bus.node = bus_node;
+	Sim_Bus.result_size = sizeof(*res);
+	Sim_At(QUIET_NS, bus_quiet, NULL);
+	if (Sim_BusRun(res, (uint64_t)(limit * 1e9)) != 0) {
+		fprintf(stderr, "iapsim: cannot start the nodes\n");
+		return 1;
+	}
+	if (bh.status == 0)
+		fprintf(stderr, "iapsim: time limit reached\n");
+
+	for (i = 0; i < (uint32_t)nodes; i++) {
+		verified += res[i].verified;
+		apps += res[i].app;
+	}
+	total = bh.t_end > bh.t_start ? (bh.t_end - bh.t_start) / 1e9 : 0.0;
+	printf("bus:     %d nodes, %u bytes, packet %u, %u baud: %u verified, %u applications started, "
+	       "%u BOOT answered\n", nodes, bh.size, bh.packet, baud, verified, apps, bh.booted);
+	printf("time:    %.3f s total, stream %.3f s, %.0f B/s per node, %.0f B/s all nodes\n",
+	       total, bh.t_stream > bh.t_start ? (bh.t_stream - bh.t_start) / 1e9 : 0.0,
+	       total > 0 ? bh.size / total : 0.0, total > 0 ? (double)bh.size * nodes / total : 0.0);
+	printf("repair:  %u rounds, %u polls, %u timeouts, %u BEGIN, %u frames, %u of them repairs\n",
+	       bh.rounds, bh.polls, bh.timeouts, bh.begins, bh.frames, bh.repairs);
+	printf("line:    %u bytes from the host, %u from the nodes, %u collisions, %u steps\n",
+	       Sim_Bus.host_bytes, Sim_Bus.node_bytes, Sim_Bus.collisions, Sim_Bus.steps);
+	for (i = 0; i < (uint32_t)nodes; i++)
+		printf("node %-3u %-9s %s, missed %u, %u crc errors, line %u corrupted, %u lost, "
+		       "flash %u erases, %u programs, t=%.3f s\n",
+		       i + 1, bh.state[i] <= BINCMD_BUS_FAILED ? state_name[bh.state[i]] : "?",
+		       res[i].verified ? "image ok" : "image BAD",
+		       bh.missed[i], res[i].crc_errors, res[i].corrupted, res[i].dropped,
+		       res[i].erases, res[i].programs, res[i].end);
+	free(res);
+	return verified == (uint32_t)nodes ? 0 : 1;
+}
+
+/* Benchmark -----------------------------------------------------------------*/
+static const char bench_header[] =
+	"dir,baud,packet,ber,burst_rate,burst_len,drop,dup,latency_us,jitter_us,seed,bytes,"
+	"result,total_s,first_ack_s,bytes_per_s,data_bytes_per_s,packets,resends,timeouts,"
+	"overruns,corrupted,lost,duplicated,bursts,recoveries,recovery_mean_ms,"
+	"recovery_max_ms,wasted_bytes\n";
+
+enum { R_VERIFIED = 0, R_FAILED, R_ABORTED, R_TIMEOUT, R_CRASH, R_COUNT };
+static const char *const result_name[R_COUNT] = {
+	"verified", "failed", "aborted", "timeout", "crash"
+};
+
+/************************************************************************/
+static void bench_params(void)
+{
+	printf("%s,%u,%u,%g,%g,%g,%g,%g,%u,%u,%llu,%u,", upload ? "upload" : "update", baud,
+	       upload ? YMODEM_TX_PACKET_SIZE : ys.packet, Sim_Link.ber, Sim_Link.burst_rate,
+	       Sim_Link.burst_len, Sim_Link.drop, Sim_Link.dup, Sim_Link.latency_us,
+	       Sim_Link.jitter_us, (unsigned long long)Sim_Link.seed, image_size);
+}
+
+/**
+ * One CSV row.
+ * @return R_xxx: verified; failed (the data is wrong); aborted (one side
+ *         gave up or cancelled the session); timeout
+ */
+static int bench_row(int exit_code)
+{
+	double total = (session_end_time() - st->t_start) / 1e9;
+	double data = st->t_first_ack ? (session_end_time() - st->t_first_ack) / 1e9 : 0.0;
+	int result = R_VERIFIED;
+
+	if (!session_verified()) {
+		if (exit_code == SIM_EXIT_TIMEOUT && st->status == 0)
+			result = R_TIMEOUT;
+		else if (st->status == 1)
+			result = R_FAILED;
+		else
+			result = R_ABORTED;
+	}
+	bench_params();
+	printf("%s,%.6f,%.6f,%.0f,%.0f,%u,%u,%u,%u,%u,%u,%u,%u,%u,%.3f,%.3f,%u\n",
+	       result_name[result], total,
+	       st->t_first_ack ? (st->t_first_ack - st->t_start) / 1e9 : 0.0,
+	       result == R_VERIFIED && total > 0 ? image_size / total : 0.0,
+	       result == R_VERIFIED && data > 0 ? image_size / data : 0.0,
+	       st->packets, st->resends, st->timeouts, Sim_Uart.overruns,
+	       Sim_Link.corrupted, Sim_Link.dropped, Sim_Link.duplicated, Sim_Link.bursts,
+	       st->recoveries, st->recoveries ? st->recovery_ns / 1e6 / st->recoveries : 0.0,
+	       st->recovery_max_ns / 1e6, st->wasted);
+	return result;
+}
+
+/************************************************************************/
+static void parse_list(struct list *l, const char *arg)
+{
+	char *end;
+
+	l->n = 0;
+	do {
+		if (l->n == LIST_MAX)
+			usage();
+		l->v[l->n++] = strtod(arg, &end);
+		if (end == arg || (*end != ',' && *end != '\0'))
+			usage();
+		arg = end + 1;
+	} while (*end == ',');
+}
+
+/**
+ * Run one case in a fresh child.
+ * @return R_xxx
+ */
+static int bench_case(const char *flash, double limit)
+{
+	int status;
+	pid_t pid;
+
+	fflush(stdout);
+	pid = fork();
+	if (pid < 0) {
+		perror("iapsim: fork");
+		exit(1);
+	}
+	if (pid == 0) {
+		if (!verbose && freopen("/dev/null", "w", stderr) == NULL)
+			_exit(R_CRASH);
+		status = bench_row(session_run(flash, limit));
+		fflush(stdout);
+		_exit(status);
+	}
+	if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) >= R_CRASH) {
+		bench_params();
+		printf("crash,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0\n");
+		return R_CRASH;
+	}
+	return WEXITSTATUS(status);
+}
+
+/**
+ * Every combination of the lists and seeds.
+ * @return 0 all verified, 1 not
+ */
+static int bench(const char *flash, double limit, const struct list *bauds,
+		 const struct list *packets, const struct list *bers, uint32_t seeds)
+{
+	uint32_t count[R_COUNT] = { 0 }, cases = 0, i;
+	uint64_t seed = Sim_Link.seed;
+	int b, p, e;
+
+	printf("%s", bench_header);
+	for (b = 0; b < bauds->n; b++) {
+		for (p = 0; p < packets->n; p++) {
+			for (e = 0; e < bers->n; e++) {
+				for (i = 0; i < seeds; i++) {
+					baud = (uint32_t)bauds->v[b];
+					ys.packet = (uint16_t)packets->v[p];
+					Sim_Link.ber = bers->v[e];
+					Sim_Link.seed = seed + i;
+					count[bench_case(flash, limit)]++;
+					cases++;
+				}
+			}
+		}
+	}
+	fprintf(stderr, "iapsim: %u cases: %u verified, %u failed, %u aborted, %u timeout, %u crash\n",
+		cases, count[R_VERIFIED], count[R_FAILED], count[R_ABORTED], count[R_TIMEOUT],
+		count[R_CRASH]);
+	return count[R_VERIFIED] == cases ? 0 : 1;
+}
+
+/**
+ * Load a file given to -u as "[part:]path"; the name sent is the partition
+ * prefix and the file name without its directories, or name.
+ */
+static void batch_file(struct ymsend_file *f, const char *name)
+{
+	const char *arg = f->name, *colon = strchr(arg, ':'), *path = arg, *base;
+	char *prefixed;
+
+	if (colon != NULL && memchr(arg, '/', colon - arg) == NULL)
+		path = colon + 1;
+	f->data = load(path, &f->size);
+	image_size += f->size;
+	base = strrchr(path, '/') ? strrchr(path, '/') + 1 : path;
+	f->name = name != NULL ? name : base;
+	if (name == NULL && path != arg) {
+		if (asprintf(&prefixed, "%.*s:%s", (int)(colon - arg), arg, base) < 0)
+			exit(1);
+		f->name = prefixed;
+	}
+}
+
+/* Pseudo terminal -----------------------------------------------------------*/
+static void pty_rx(uint8_t c)
+{
+	if (write(pty_fd, &c, 1) != 1) {
+		/* Nobody on the other side yet: the byte is lost like on a wire */
+	}
+}
+
+/************************************************************************/
+static void pty_input(int fd)
+{
+	uint8_t buf[256];
+	ssize_t n = read(fd, buf, sizeof(buf));
+
+	if (n > 0)
+		Sim_LinkSend(buf, (uint32_t)n);
+}
+
+/************************************************************************/
+static int pty_open(void)
+{
+	struct termios tio;
+	int fd = posix_openpt(O_RDWR | O_NOCTTY);
+
+	if (fd < 0 || grantpt(fd) != 0 || unlockpt(fd) != 0) {
+		perror("iapsim: pty");
+		return -1;
+	}
+	if (tcgetattr(fd, &tio) == 0) {
+		cfmakeraw(&tio);
+		tcsetattr(fd, TCSANOW, &tio);
+	}
+	fprintf(stderr, "iapsim: console on %s\n", ptsname(fd));
+	return fd;
+}
+
+/************************************************************************/
+static void on_signal(int sig)
+{
+	(void)sig;
+	Sim_Stop(SIM_EXIT_STOP);
+}
+
+/************************************************************************/
+int main(int argc, char **argv)
+{
+	static const struct list all_packets = {
+		{ 8, 16, 32, 64, 128, 256, 512, 1024, 2048 }, 9
+	};
+	static const struct list bench_bauds = { { 115200, 460800, 921600 }, 3 };
+	static const struct list bench_bers = { { 0, 1e-5, 1e-4 }, 3 };
+	struct list bauds = { { 0 }, 0 }, packets = { { 0 }, 0 }, bers = { { 0 }, 0 };
+	const char *flash = NULL, *path = NULL, *trace = NULL, *name = NULL;
+	double limit = -1;
+	uint32_t seeds = 1;
+	int opt, pty = 0, benchmark = 0, nodes = 0, code, ret = 0;
+	char *end;
+
+	while ((opt = getopt(argc, argv, "b:f:n:s:t:vT:A:e:G:D:U:L:J:r:R:P:E:SFW:BN:u:d:c:pk")) != -1) {
+		switch (opt) {
+		case 'b': parse_list(&bauds, optarg); break;
+		case 'f': flash = optarg; break;
+		case 'n': name = optarg; break;
+		case 's': parse_list(&packets, optarg); break;
+		case 't': limit = strtod(optarg, NULL); break;
+		case 'v': verbose = 1; break;
+		case 'T': trace = optarg; break;
+		case 'A':
+			if (strcmp(optarg, "hang") == 0)
+				Sim_App = app_hang;
+			else if (strcmp(optarg, "ok") == 0)
+				Sim_App = app_ok;
+			else
+				usage();
+			break;
+		case 'e': parse_list(&bers, optarg); break;
+		case 'G':
+			Sim_Link.burst_rate = strtod(optarg, &end);
+			Sim_Link.burst_len = *end == ',' ? strtod(end + 1, NULL) : 8;
+			break;
+		case 'D': Sim_Link.drop = strtod(optarg, NULL); break;
+		case 'U': Sim_Link.dup = strtod(optarg, NULL); break;
+		case 'L': Sim_Link.latency_us = strtoul(optarg, NULL, 0); break;
+		case 'J': Sim_Link.jitter_us = strtoul(optarg, NULL, 0); break;
+		case 'r': Sim_Link.seed = strtoull(optarg, NULL, 0); break;
+		case 'R': seeds = strtoul(optarg, NULL, 0); break;
+		case 'P': Sim_Flash.program_us = strtoul(optarg, NULL, 0); break;
+		case 'E': Sim_Flash.erase_us = strtoul(optarg, NULL, 0); break;
+		case 'S': Sim_Flash.fetch_stall = 0; break;
+		case 'F': Sim_Flash.ram_exec = 0; break;
+		case 'W': Sim_Flash.stale = strtoul(optarg, NULL, 0); break;
+		case 'B': benchmark = 1; break;
+		case 'N': nodes = (int)strtol(optarg, NULL, 0); break;
+		case 'u':
+			if (ys.files == YMSEND_FILES_MAX)
+				usage();
+			ys.file[ys.files++].name = optarg;
+			path = optarg;
+			upload = 0;
+			break;
+		case 'd': path = optarg; upload = 1; break;
+		case 'c': path = optarg; upload = 0; station = 1; break;
+		case 'p': pty = 1; break;
+		case 'k': boot_only = 1; break;
+		default: usage();
+		}
+	}
+	if ((path != NULL) + pty + boot_only != 1 || optind != argc || (benchmark && path == NULL) ||
+	    seeds == 0 || (trace && path == NULL))
+		usage();
+	if (!benchmark && (bauds.n > 1 || packets.n > 1 || bers.n > 1 || seeds > 1))
+		usage();
+	if (station && (benchmark || nodes != 0 || trace))
+		usage();
+	if ((upload || station) && ys.files != 0)
+		usage();
+	if (ys.files > 1 && (benchmark || nodes != 0 || name != NULL))
+		usage();
+	if (nodes != 0 && (nodes < 1 || nodes > BUSHOST_NODES_MAX || path == NULL || upload ||
+			   benchmark || trace))
+		usage();
+	if (bauds.n == 0)
+		bauds = benchmark ? bench_bauds : (struct list){ { 115200 }, 1 };
+	if (packets.n == 0 || upload)
+		packets = benchmark && !upload ? all_packets : (struct list){ { PACKET_1KB_SIZE }, 1 };
+	if (bers.n == 0)
+		bers = benchmark ? bench_bers : (struct list){ { 0 }, 1 };
+	for (opt = 0; opt < bauds.n; opt++) {
+		if (bauds.v[opt] < 1)
+			usage();
+	}
+	baud = (uint32_t)bauds.v[0];
+	ys.packet = (uint16_t)packets.v[0];
+	Sim_Link.ber = bers.v[0];
+
+	if (path != NULL) {
+		if (upload || station)
+			image = load(path, &image_size);
+		if (station) {
+			bc.data = image;
+			bc.size = image_size;
+			bc.done = station_done;
+		} else if (upload) {
+			yr.buf = malloc(image_size);
+			yr.cap = image_size;
+			yr.done = received;
+			st = &yr.st;
+		} else {
+			for (opt = 0; opt < ys.files; opt++)
+				batch_file(&ys.file[opt], name);
+			image = ys.file[0].data;
+			ys.done = sent;
+			st = &ys.st;
+		}
+		if (limit < 0)
+			limit = 120;
+		if (benchmark)
+			return bench(flash, limit, &bauds, &packets, &bers, seeds);
+		if (nodes != 0)
+			return bus_run(flash, nodes, limit);
+		code = session_run(flash, limit);
+		if (code == SIM_EXIT_TIMEOUT)
+			fprintf(stderr, "iapsim: time limit reached\n");
+		if (station) {
+			ret = station_report(code);
+		} else {
+			ret = session_report(code);
+			if (trace != NULL && trace_save(trace) != 0)
+				ret = 1;
+		}
+	} else if (boot_only) {
+		code = boot_run(flash, limit < 0 ? 120 : limit);
+		if (code == SIM_EXIT_ERROR || code == SIM_EXIT_TIMEOUT)
+			ret = 1;
+	} else {
+		if (Sim_FlashInit(flash) != 0)
+			return 1;
+		Sim_BoardInit(baud);
+		pty_fd = pty_open();
+		if (pty_fd < 0)
+			return 1;
+		Sim_LinkSetPeer(pty_rx);
+		Sim_SetRealtime(pty_fd, pty_input);
+		signal(SIGINT, on_signal);
+		signal(SIGTERM, on_signal);
+		code = Sim_Run(Sim_Boot, limit > 0 ? (uint64_t)(limit * 1e9) : 0);
+		if (code == SIM_EXIT_ERROR || code == SIM_EXIT_TIMEOUT)
+			ret = 1;
+	}
+	if (flash != NULL && code != SIM_EXIT_ERROR && Sim_FlashSave(flash) != 0) {
+		perror(flash);
+		ret = 1;
+	}
+	return ret;
+}
@@ -0,0 +1,175 @@
+/*
+ * Host simulation stand-in for the CMSIS device header: the memory map, the
+ * IRQ numbers and the core intrinsics used by the IAP sources. The flash
+ * array is mapped at its real address by sim_flash.c; peripherals are host
+ * variables.
+ */
+#ifndef STM32H503xx_H
+#define STM32H503xx_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define __IO                    volatile
+#define __I                     volatile const
+#define __weak                  __attribute__((weak))
+#define __ALIGNED(x)            __attribute__((aligned(x)))
+
+typedef enum {
+	SysTick_IRQn            = -1,
+	FLASH_IRQn              = 6,
+	GPDMA1_Channel0_IRQn    = 27,
+	USART1_IRQn             = 58
+} IRQn_Type;
+
+#define SIM_IRQ_COUNT           64      /* IRQn + 1 */
+
+/* Memory map */
+#define FLASH_BASE              0x08000000UL
+#define FLASH_SIZE_DEFAULT      (0x20000U)
+#define FLASH_SECTOR_NB         (8U)
+#define FLASH_SECTOR_SIZE       0x2000U
+#define FLASH_BANK_SIZE         (FLASH_SECTOR_NB * FLASH_SECTOR_SIZE)
+#define SRAM1_BASE              0x20000000UL
+
+/* Peripheral instances are only compared, never dereferenced */
+typedef struct { uint32_t sim; } USART_TypeDef;
+typedef struct { uint32_t sim; } DMA_Channel_TypeDef;
+
+extern USART_TypeDef Sim_Usart1;
+extern DMA_Channel_TypeDef Sim_Gpdma1Ch0;
+
+#define USART1                  (&Sim_Usart1)
+#define GPDMA1_Channel0         (&Sim_Gpdma1Ch0)
+
+/* Cycle counter, counting virtual time at SystemCoreClock (sim_core.c) */
+typedef struct { volatile uint32_t CTRL; volatile uint32_t CYCCNT; } DWT_Type;
+typedef struct { volatile uint32_t DEMCR; } DCB_Type;
+
+extern DCB_Type Sim_Dcb;
+extern uint32_t SystemCoreClock;
+DWT_Type *Sim_Dwt(void);
+
+#define DWT                     (Sim_Dwt())
+#define DCB                     (&Sim_Dcb)
+#define DWT_CTRL_CYCCNTENA_Msk  (0x1UL)
+#define DCB_DEMCR_TRCENA_Msk    (0x1UL << 24)
+
+/* Vector table offset, the firmware moves the table to RAM (ramexec.h);
+ * the interrupt handlers then run while bank 1 is busy (sim_flash.c).
+ * A reset requested in AIRCR happens at the next __DSB() */
+typedef struct { volatile uint32_t ICSR; volatile uint32_t VTOR; volatile uint32_t AIRCR; } SCB_Type;
+
+extern SCB_Type Sim_Scb;
+
+#define SCB                     (&Sim_Scb)
+#define SCB_ICSR_PENDSTCLR_Msk  (0x1UL << 25)
+#define SCB_AIRCR_VECTKEY_Pos   16U
+#define SCB_AIRCR_PRIGROUP_Msk  (0x7UL << 8)
+#define SCB_AIRCR_SYSRESETREQ_Msk (0x1UL << 2)
+
+/* NVIC and SysTick as the handoff to the application leaves them
+ * (bootinfo.h), register file only */
+typedef struct { volatile uint32_t ICER[16]; volatile uint32_t ICPR[16]; } NVIC_Type;
+typedef struct { volatile uint32_t CTRL; } SysTick_Type;
+
+extern NVIC_Type Sim_Nvic;
+extern SysTick_Type Sim_SysTick;
+
+#define NVIC                    (&Sim_Nvic)
+#define SysTick                 (&Sim_SysTick)
+
+/* Reset and clock control, register file only: the clock tree
+ * SystemClock_Config() sets up */
+typedef struct { volatile uint32_t CR; volatile uint32_t RSR; } RCC_TypeDef;
+
+extern RCC_TypeDef Sim_Rcc;
+
+#define RCC                     (&Sim_Rcc)
+#define RCC_CR_CSION            (0x1UL << 8)
+#define RCC_CR_CSIRDY           (0x1UL << 9)
+#define RCC_CR_HSEON            (0x1UL << 16)
+#define RCC_CR_HSERDY           (0x1UL << 17)
+#define RCC_CR_PLL1ON           (0x1UL << 24)
+#define RCC_CR_PLL1RDY          (0x1UL << 25)
+#define RCC_CR_PLL2ON           (0x1UL << 26)
+#define RCC_CR_PLL2RDY          (0x1UL << 27)
+#define RCC_RSR_RMVF            (0x1UL << 23)
+#define RCC_RSR_PINRSTF         (0x1UL << 26)
+
+/* Independent watchdog, LSI 32 kHz (sim_core.c): a key written to KR
+ * takes effect at the next access, or when the watchdog would expire */
+typedef struct {
+	volatile uint32_t KR;
+	volatile uint32_t PR;
+	volatile uint32_t RLR;
+	volatile uint32_t SR;
+} IWDG_TypeDef;
+
+IWDG_TypeDef *Sim_Iwdg(void);
+
+#define IWDG                    (Sim_Iwdg())
+
+/* Instruction cache, register file only */
+typedef struct {
+	volatile uint32_t CR;
+	volatile uint32_t SR;
+	volatile uint32_t IER;
+	volatile uint32_t FCR;
+} ICACHE_TypeDef;
+
+extern ICACHE_TypeDef Sim_Icache;
+
+#define ICACHE                  (&Sim_Icache)
+#define ICACHE_CR_EN            (0x1UL << 0)
+#define ICACHE_CR_CACHEINV      (0x1UL << 1)
+#define ICACHE_SR_BUSYF         (0x1UL << 0)
+#define ICACHE_FCR_CBSYENDF     (0x1UL << 1)
+
+/* Flash interface, the registers the burst programmer and the services
+ * use (sim_flash.c). Stores to the array with PG set, and START, are
+ * picked up at the next register access, as the write buffer would hand
+ * them to the flash. */
+typedef struct {
+	volatile uint32_t NSKEYR;
+	volatile uint32_t NSCR;
+	volatile uint32_t NSSR;
+	volatile uint32_t NSCCR;
+	volatile uint32_t ECCDETR;      /* never set: the model has no ECC */
+} FLASH_TypeDef;
+
+FLASH_TypeDef *Sim_FlashRegs(void);
+
+#define FLASH                   (Sim_FlashRegs())
+#define FLASH_CR_LOCK           (0x1UL << 0)
+#define FLASH_CR_PG             (0x1UL << 1)
+#define FLASH_CR_SER            (0x1UL << 2)
+#define FLASH_CR_START          (0x1UL << 5)
+#define FLASH_CR_SNB_Pos        (6U)
+#define FLASH_CR_SNB            (0x7FUL << FLASH_CR_SNB_Pos)
+#define FLASH_CR_BKSEL          (0x1UL << 31)
+#define FLASH_SR_BSY            (0x1UL << 0)
+#define FLASH_SR_WBNE           (0x1UL << 1)
+#define FLASH_SR_DBNE           (0x1UL << 3)
+#define FLASH_ECCR_ECCD         (0x1UL << 31)
+
+/* Core intrinsics, sim_core.c */
+void __disable_irq(void);
+void __enable_irq(void);
+uint32_t __get_PRIMASK(void);
+void __set_PRIMASK(uint32_t primask);
+void __WFI(void);
+void __NOP(void);
+void __set_MSP(uint32_t msp);
+void __DSB(void);
+
+static inline void __ISB(void)
+{
+}
+
+static inline uint32_t __REV(uint32_t value)
+{
+	return __builtin_bswap32(value);
+}
+
+#endif
@@ -0,0 +1,123 @@
+/*
+ * Host simulation stand-in for the HAL: tick, NVIC, UART and DMA parts used
+ * by the IAP sources. sim_core.c and sim_uart.c implement them.
+ */
+#ifndef STM32H5xx_HAL_H
+#define STM32H5xx_HAL_H
+
+#include "stm32h5xx_hal_def.h"
+#include "stm32h5xx_hal_flash.h"
+
+/* Tick and NVIC */
+uint32_t HAL_GetTick(void);
+void HAL_Delay(uint32_t Delay);
+void HAL_NVIC_SetPriority(IRQn_Type IRQn, uint32_t PreemptPriority, uint32_t SubPriority);
+void HAL_NVIC_EnableIRQ(IRQn_Type IRQn);
+void HAL_NVIC_DisableIRQ(IRQn_Type IRQn);
+
+#define __HAL_RCC_GPDMA1_CLK_ENABLE()   ((void)0)
+#define __HAL_RCC_CRC_CLK_ENABLE()      ((void)0)
+#define __HAL_RCC_CLEAR_RESET_FLAGS()   (RCC->RSR |= RCC_RSR_RMVF, RCC->RSR = 0)
+
+/* Clock tree: one clock, SystemCoreClock, drives the buses and USART1 */
+#define RCC_PERIPHCLK_USART1            0x00000001U
+#define PWR_REGULATOR_VOLTAGE_SCALE3    0x00000000U
+
+uint32_t HAL_RCC_GetSysClockFreq(void);
+uint32_t HAL_RCC_GetHCLKFreq(void);
+uint32_t HAL_RCC_GetPCLK1Freq(void);
+uint32_t HAL_RCC_GetPCLK2Freq(void);
+uint32_t HAL_RCC_GetPCLK3Freq(void);
+uint32_t HAL_RCCEx_GetPeriphCLKFreq(uint64_t PeriphClk);
+uint32_t HAL_PWREx_GetVoltageRange(void);
+
+/* DMA */
+typedef struct {
+	uint32_t Request;
+	uint32_t BlkHWRequest;
+	uint32_t Direction;
+	uint32_t SrcInc;
+	uint32_t DestInc;
+	uint32_t SrcDataWidth;
+	uint32_t DestDataWidth;
+	uint32_t Priority;
+	uint32_t SrcBurstLength;
+	uint32_t DestBurstLength;
+	uint32_t TransferAllocatedPort;
+	uint32_t TransferEventMode;
+	uint32_t Mode;
+} DMA_InitTypeDef;
+
+typedef struct __DMA_HandleTypeDef {
+	DMA_Channel_TypeDef *Instance;
+	DMA_InitTypeDef Init;
+	void *Parent;
+} DMA_HandleTypeDef;
+
+#define GPDMA1_REQUEST_USART1_TX        22U
+#define DMA_BREQ_SINGLE_BURST           0U
+#define DMA_MEMORY_TO_PERIPH            1U
+#define DMA_SINC_INCREMENTED            1U
+#define DMA_DINC_FIXED                  0U
+#define DMA_SRC_DATAWIDTH_BYTE          0U
+#define DMA_DEST_DATAWIDTH_BYTE         0U
+#define DMA_LOW_PRIORITY_HIGH_WEIGHT    2U
+#define DMA_SRC_ALLOCATED_PORT0         0U
+#define DMA_DEST_ALLOCATED_PORT0        0U
+#define DMA_TCEM_BLOCK_TRANSFER         0U
+#define DMA_NORMAL                      0U
+
+HAL_StatusTypeDef HAL_DMA_Init(DMA_HandleTypeDef *hdma);
+void HAL_DMA_IRQHandler(DMA_HandleTypeDef *hdma);
+
+/* UART */
+typedef struct {
+	uint32_t BaudRate;
+	uint32_t WordLength;
+	uint32_t StopBits;
+	uint32_t Parity;
+	uint32_t Mode;
+	uint32_t HwFlowCtl;
+	uint32_t OverSampling;
+} UART_InitTypeDef;
+
+typedef struct __UART_HandleTypeDef {
+	USART_TypeDef *Instance;
+	UART_InitTypeDef Init;
+	volatile uint32_t gState;
+	volatile uint32_t RxState;
+	volatile uint32_t RxEventType;
+	volatile uint32_t ErrorCode;
+	DMA_HandleTypeDef *hdmatx;
+} UART_HandleTypeDef;
+
+#define HAL_UART_STATE_RESET            0x00000000U
+#define HAL_UART_STATE_READY            0x00000020U
+#define HAL_UART_STATE_BUSY_TX          0x00000021U
+#define HAL_UART_STATE_BUSY_RX          0x00000022U
+
+#define HAL_UART_RXEVENT_TC             (0x00000000U)
+#define HAL_UART_RXEVENT_HT             (0x00000001U)
+#define HAL_UART_RXEVENT_IDLE           (0x00000002U)
+
+#define HAL_UART_ERROR_NONE             (0x00000000U)
+#define HAL_UART_ERROR_FE               (0x00000004U)
+#define HAL_UART_ERROR_ORE              (0x00000008U)
+
+#define UART_FLAG_TC                    0x00000040U
+#define UART_FLAG_RXNE                  0x00000020U
+
+#define __HAL_UART_GET_FLAG(__HANDLE__, __FLAG__) Sim_UartFlag((__HANDLE__), (__FLAG__))
+
+FlagStatus Sim_UartFlag(UART_HandleTypeDef *huart, uint32_t flag);
+
+HAL_StatusTypeDef HAL_UARTEx_ReceiveToIdle_IT(UART_HandleTypeDef *huart, uint8_t *pData, uint16_t Size);
+uint32_t HAL_UARTEx_GetRxEventType(UART_HandleTypeDef *huart);
+HAL_StatusTypeDef HAL_UART_Transmit_IT(UART_HandleTypeDef *huart, const uint8_t *pData, uint16_t Size);
+HAL_StatusTypeDef HAL_UART_Transmit_DMA(UART_HandleTypeDef *huart, const uint8_t *pData, uint16_t Size);
+HAL_StatusTypeDef HAL_UART_Abort(UART_HandleTypeDef *huart);
+void HAL_UARTEx_RxEventCallback(UART_HandleTypeDef *huart, uint16_t Size);
+void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart);
+void HAL_UART_ErrorCallback(UART_HandleTypeDef *huart);
+
+#endif
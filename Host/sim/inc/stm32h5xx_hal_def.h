@@ -0,0 +1,27 @@
+/* Host simulation stand-in for the HAL common definitions */
+#ifndef STM32H5xx_HAL_DEF_H
+#define STM32H5xx_HAL_DEF_H
+
+#include "stm32h503xx.h"
+
+typedef enum {
+	HAL_OK       = 0x00U,
+	HAL_ERROR    = 0x01U,
+	HAL_BUSY     = 0x02U,
+	HAL_TIMEOUT  = 0x03U
+} HAL_StatusTypeDef;
+
+typedef enum {
+	RESET = 0,
+	SET = !RESET
+} FlagStatus, ITStatus;
+
+#define HAL_MAX_DELAY           0xFFFFFFFFU
+
+#define __HAL_LINKDMA(__HANDLE__, __PPP_DMA_FIELD__, __DMA_HANDLE__) \
+	do { \
+		(__HANDLE__)->__PPP_DMA_FIELD__ = &(__DMA_HANDLE__); \
+		(__DMA_HANDLE__).Parent = (__HANDLE__); \
+	} while (0)
+
+#endif
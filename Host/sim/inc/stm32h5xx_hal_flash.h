@@ -0,0 +1,57 @@
+/*
+ * Host simulation stand-in for the FLASH HAL (stm32h5xx_hal_flash.h and
+ * stm32h5xx_hal_flash_ex.h), implemented by sim_flash.c.
+ */
+#ifndef STM32H5xx_HAL_FLASH_H
+#define STM32H5xx_HAL_FLASH_H
+
+#include "stm32h5xx_hal_def.h"
+
+typedef struct {
+	uint32_t TypeErase;
+	uint32_t Banks;
+	uint32_t Sector;
+	uint32_t NbSectors;
+} FLASH_EraseInitTypeDef;
+
+#define FLASH_TYPEERASE_SECTORS         0x00000004U
+#define FLASH_TYPEERASE_MASSERASE       0x00008000U
+#define FLASH_TYPEPROGRAM_QUADWORD      0x00000002U
+
+#define FLASH_BANK_1                    0x00000001U
+#define FLASH_BANK_2                    0x00000002U
+
+#define FLASH_FLAG_BSY                  FLASH_SR_BSY
+#define FLASH_FLAG_WBNE                 FLASH_SR_WBNE
+#define FLASH_FLAG_DBNE                 FLASH_SR_DBNE
+#define FLASH_FLAG_EOP                  0x00010000U
+#define FLASH_FLAG_WRPERR               0x00020000U
+#define FLASH_FLAG_PGSERR               0x00040000U
+#define FLASH_FLAG_STRBERR              0x00080000U
+#define FLASH_FLAG_INCERR               0x00100000U
+#define FLASH_FLAG_ALL_ERRORS           (FLASH_FLAG_WRPERR | FLASH_FLAG_PGSERR | \
+                                         FLASH_FLAG_STRBERR | FLASH_FLAG_INCERR)
+#define FLASH_FLAG_SR_ERRORS            FLASH_FLAG_ALL_ERRORS
+
+#define FLASH_KEY1                      0x45670123U
+#define FLASH_KEY2                      0xCDEF89ABU
+
+#define FLASH_LATENCY_4                 0x00000004U
+
+#define __HAL_FLASH_CLEAR_FLAG(__FLAG__) Sim_FlashClearFlag(__FLAG__)
+#define __HAL_FLASH_GET_LATENCY()       FLASH_LATENCY_4
+
+void Sim_FlashClearFlag(uint32_t flag);
+
+HAL_StatusTypeDef HAL_FLASH_Unlock(void);
+HAL_StatusTypeDef HAL_FLASH_Lock(void);
+HAL_StatusTypeDef HAL_FLASH_Program(uint32_t TypeProgram, uint32_t FlashAddress, uintptr_t DataAddress);
+HAL_StatusTypeDef HAL_FLASH_Program_IT(uint32_t TypeProgram, uint32_t FlashAddress, uintptr_t DataAddress);
+HAL_StatusTypeDef HAL_FLASHEx_Erase(FLASH_EraseInitTypeDef *pEraseInit, uint32_t *SectorError);
+HAL_StatusTypeDef HAL_FLASHEx_Erase_IT(FLASH_EraseInitTypeDef *pEraseInit);
+uint32_t HAL_FLASH_GetError(void);
+void HAL_FLASH_IRQHandler(void);
+void HAL_FLASH_EndOfOperationCallback(uint32_t ReturnValue);
+void HAL_FLASH_OperationErrorCallback(uint32_t ReturnValue);
+
+#endif
@@ -0,0 +1,129 @@
+/*
+ * Host simulation of the bootloader hardware: virtual time, the NVIC, the
+ * flash array and USART1. The IAP sources are compiled unchanged against
+ * the headers in sim/inc, which route the HAL calls they make to here.
+ *
+ * Time is counted in nanoseconds. It only moves while the firmware waits
+ * (WFI, busy loops on a peripheral flag) or the CPU is stalled by a flash
+ * operation; the firmware code itself runs in zero time.
+ */
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdint.h>
+
+typedef void (*Sim_Fn)(void *arg);
+
+enum {
+	SIM_EXIT_STOP = 0,      /* Sim_Stop() from a peer */
+	SIM_EXIT_APP,           /* the bootloader jumped to the application */
+	SIM_EXIT_RESET,         /* the watchdog expired, or a reset request */
+	SIM_EXIT_TIMEOUT,       /* virtual time limit reached */
+	SIM_EXIT_ERROR
+};
+
+extern uint64_t Sim_Now;
+extern int Sim_CpuInRam;        /* the CPU waits in code that runs from RAM */
+extern void (*Sim_App)(void);   /* the application, run at the jump to it */
+
+/* sim_core.c */
+void Sim_At(uint64_t t, Sim_Fn fn, void *arg);
+void Sim_Cancel(Sim_Fn fn, void *arg);
+void Sim_IrqHandler(int irq, void (*handler)(void));
+void Sim_IrqSet(int irq);
+void Sim_Idle(void);
+void Sim_Stall(uint64_t until);
+void Sim_Poll(uint64_t until);
+void Sim_Stop(int code);
+int Sim_Run(void (*entry)(void), uint64_t limit);
+void Sim_Drain(uint64_t t);
+void Sim_SetRealtime(int fd, void (*input)(int fd));
+void Sim_SetLockstep(uint64_t (*sync)(void));
+void Sim_AppStart(uint32_t msp);
+
+/* sim_flash.c */
+struct sim_flash {
+	uint32_t program_us;    /* one quadword */
+	uint32_t erase_us;      /* one 8K sector */
+	int fetch_stall;        /* code runs from bank 1: busy bank 1 stalls the CPU */
+	int ram_exec;           /* handlers run from RAM once VTOR points there */
+	uint32_t stale;         /* quadword that reads blank but is programmed, 0: none */
+	/* statistics */
+	uint32_t erases;
+	uint32_t programs;
+	uint32_t rejected;      /* quadwords programmed twice without an erase */
+	uint32_t errors;
+	uint64_t busy_ns;
+	uint64_t stall_ns;
+	uint64_t held_ns;       /* interrupts pending while the CPU cannot fetch */
+};
+extern struct sim_flash Sim_Flash;
+
+int Sim_FlashInit(const char *image);
+int Sim_FlashSave(const char *image);
+int Sim_FlashPreload(uint32_t addr, const uint8_t *data, uint32_t len);
+uint64_t Sim_FlashFetchReady(void);
+uint64_t Sim_FlashIrqReady(void);
+void Sim_FlashIrq(void);
+
+/* sim_uart.c: USART1 */
+struct sim_uart {
+	uint32_t rx_bytes;      /* reached the receiver */
+	uint32_t tx_bytes;
+	uint32_t overruns;
+	uint32_t rx_idle;       /* idle line events */
+};
+extern struct sim_uart Sim_Uart;
+
+uint32_t Sim_CharTime(void);
+void Sim_UartRx(uint8_t c);
+void Sim_UartIrq(void);
+
+/* sim_link.c: the line to the peer */
+struct sim_link {
+	uint32_t latency_us;    /* one way */
+	uint32_t jitter_us;     /* added to the latency, uniform below this */
+	double ber;             /* bit error rate */
+	double burst_rate;      /* error burst starts, per byte */
+	double burst_len;       /* mean burst length in bytes */
+	double drop;            /* byte loss rate */
+	double dup;             /* byte duplication rate */
+	uint64_t seed;
+	/* statistics, both directions */
+	uint32_t corrupted;     /* bytes delivered with flipped bits */
+	uint32_t dropped;
+	uint32_t duplicated;
+	uint32_t bursts;
+};
+extern struct sim_link Sim_Link;
+
+void Sim_LinkSetPeer(void (*rx)(uint8_t c));
+void Sim_LinkSend(const uint8_t *data, uint32_t len);
+void Sim_LinkTx(uint8_t c);
+void Sim_LinkRxAt(uint64_t t, uint8_t c);
+
+/* sim_bus.c: an RS-485 bus, a node per process */
+struct sim_bus {
+	int nodes;
+	uint32_t baud;
+	void (*host_rx)(uint8_t c);             /* a byte from the bus */
+	int (*node)(int index, void *result);   /* runs a node, SIM_EXIT_xxx */
+	uint32_t result_size;                   /* starts with an int SIM_EXIT_xxx */
+	/* statistics */
+	uint32_t host_bytes;
+	uint32_t node_bytes;
+	uint32_t collisions;
+	uint32_t steps;
+};
+extern struct sim_bus Sim_Bus;
+
+int Sim_BusRun(void *results, uint64_t limit);
+void Sim_BusSend(const uint8_t *data, uint32_t len);
+uint64_t Sim_BusIdle(void);
+void Sim_BusStop(void);
+
+/* board.c: what Core/ does on the target */
+void Sim_Boot(void);
+void Sim_BoardInit(uint32_t baud);
+
+#endif
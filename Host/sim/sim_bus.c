@@ -0,0 +1,422 @@
+/*
+ * An RS-485 bus: the host in this process, every node a bootloader in a
+ * child process of its own, as the firmware state is global. The
+ * processes run in lockstep, one character time at a time: a byte the
+ * host sends at t ends its stop bit no earlier than t plus a character
+ * time, so what the nodes receive during a step is known when it starts,
+ * and what they send during it reaches the host by its end.
+ *
+ * Every node has its own line (sim_link.c, with its own seed) between
+ * the bus and its USART1, so faults and latency hit the nodes one by one;
+ * the host hears all of them. Two nodes sending at once, or a node
+ * sending while the host does, is a collision: counted, and the host
+ * gets a garbled byte.
+ */
+#define _GNU_SOURCE
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "sim.h"
+
+#define BUS_QUEUE       (1u << 18)      /* host bytes not delivered yet */
+#define BUS_NODES_MAX   64
+#define BUS_GRACE_NS    200000000ull    /* for the nodes after the host is done */
+
+struct bus_byte {
+	uint64_t t;             /* end of the stop bit */
+	uint8_t c;
+	uint8_t node;
+};
+
+/* Host to node, for the step ending at until; until 0: stop */
+struct bus_grant {
+	uint64_t until;
+	uint32_t n;
+};
+
+/* Node to host: the step is done, or the node has stopped (exit >= 0,
+   followed by its result) */
+struct bus_reply {
+	uint64_t now;
+	int32_t exit;
+	uint32_t n;
+};
+
+struct sim_bus Sim_Bus;
+
+static struct {
+	pid_t pid;
+	int to, from;           /* pipes */
+	int live;
+} node[BUS_NODES_MAX];
+
+static struct bus_byte *out;    /* host to nodes, in line order */
+static uint32_t out_head, out_tail;
+static uint64_t line_free;      /* end of the host's last byte */
+static uint64_t burst_start;    /* of the host's current transmission */
+
+static struct bus_byte in[BUS_NODES_MAX * 8];   /* nodes to host, by time */
+static uint32_t in_count;
+static uint64_t in_last;        /* line time of the last node byte */
+static int in_last_node;
+
+static uint64_t slot;
+static int stopping;
+
+/* In a node process */
+static int me = -1;
+static struct bus_byte tx[4096];
+static uint32_t tx_count;
+
+/************************************************************************/
+static int xwrite(int fd, const void *buf, size_t n)
+{
+	const uint8_t *p = buf;
+	ssize_t r;
+
+	while (n) {
+		r = write(fd, p, n);
+		if (r <= 0)
+			return -1;
+		p += r;
+		n -= (size_t)r;
+	}
+	return 0;
+}
+
+/************************************************************************/
+static int xread(int fd, void *buf, size_t n)
+{
+	uint8_t *p = buf;
+	ssize_t r;
+
+	while (n) {
+		r = read(fd, p, n);
+		if (r <= 0)
+			return -1;
+		p += r;
+		n -= (size_t)r;
+	}
+	return 0;
+}
+
+/* Node side -----------------------------------------------------------------*/
+
+/**
+ * A byte of this node reached the host end of its line.
+ */
+static void node_tx(uint8_t c)
+{
+	if (tx_count == sizeof(tx) / sizeof(tx[0])) {
+		fprintf(stderr, "sim: node %d: bus buffer full, byte dropped\n", me);
+		return;
+	}
+	tx[tx_count].t = Sim_Now;
+	tx[tx_count].c = c;
+	tx[tx_count].node = (uint8_t)me;
+	tx_count++;
+}
+
+/************************************************************************/
+static int node_reply(int32_t exit)
+{
+	struct bus_reply r = { Sim_Now, exit, tx_count };
+
+	if (xwrite(node[me].from, &r, sizeof(r)) != 0 ||
+	    xwrite(node[me].from, tx, tx_count * sizeof(tx[0])) != 0)
+		return -1;
+	tx_count = 0;
+	return 0;
+}
+
+/**
+ * Sim_SetLockstep(): report the step, take the bytes of the next one.
+ */
+static uint64_t node_sync(void)
+{
+	struct bus_grant g;
+	struct bus_byte b;
+	uint32_t i;
+
+	if (node_reply(-1) != 0 || xread(node[me].to, &g, sizeof(g)) != 0) {
+		Sim_Stop(SIM_EXIT_ERROR);
+		return UINT64_MAX;
+	}
+	for (i = 0; i < g.n; i++) {
+		if (xread(node[me].to, &b, sizeof(b)) != 0) {
+			Sim_Stop(SIM_EXIT_ERROR);
+			return UINT64_MAX;
+		}
+		Sim_LinkRxAt(b.t, b.c);
+	}
+	if (g.until == 0) {
+		Sim_Stop(SIM_EXIT_STOP);
+		return UINT64_MAX;
+	}
+	return g.until;
+}
+
+/**
+ * The child process of one node.
+ */
+static void node_main(int index, void *result)
+{
+	int code;
+
+	me = index;
+	Sim_Link.seed += (uint64_t)index;
+	Sim_LinkSetPeer(node_tx);
+	Sim_SetLockstep(node_sync);
+	code = Sim_Bus.node(index, result);
+	if (node_reply(code) == 0)
+		xwrite(node[me].from, result, Sim_Bus.result_size);
+	_exit(0);
+}
+
+/* Host side -----------------------------------------------------------------*/
+
+/**
+ * The host puts bytes on the bus, after what it sent before.
+ */
+void Sim_BusSend(const uint8_t *data, uint32_t len)
+{
+	uint64_t t = line_free > Sim_Now ? line_free : Sim_Now;
+
+	if (t == Sim_Now)
+		burst_start = t;
+	while (len--) {
+		if (out_head - out_tail == BUS_QUEUE) {
+			fprintf(stderr, "sim: bus queue full, byte dropped\n");
+			break;
+		}
+		t += slot;
+		out[out_head % BUS_QUEUE].t = t;
+		out[out_head % BUS_QUEUE].c = *data++;
+		out_head++;
+		Sim_Bus.host_bytes++;
+	}
+	line_free = t;
+}
+
+/**
+ * @return when the host's last byte has left the bus
+ */
+uint64_t Sim_BusIdle(void)
+{
+	return line_free > Sim_Now ? line_free : Sim_Now;
+}
+
+/**
+ * The host is done; the nodes still running are stopped once the bus has
+ * been quiet for a while.
+ */
+void Sim_BusStop(void)
+{
+	stopping = 1;
+}
+
+/************************************************************************/
+static void host_deliver(void *arg)
+{
+	uint8_t c = in[0].c;
+
+	(void)arg;
+	in_count--;
+	memmove(in, in + 1, in_count * sizeof(in[0]));
+	if (in_count)
+		Sim_At(in[0].t, host_deliver, NULL);
+	Sim_Bus.node_bytes++;
+	if (Sim_Bus.host_rx)
+		Sim_Bus.host_rx(c);
+}
+
+/**
+ * A byte from a node, in time order with the others.
+ */
+static void host_queue(struct bus_byte b)
+{
+	uint32_t i;
+
+	/* On the line a character time before it reaches the host */
+	if ((in_last_node != b.node && in_last + slot > b.t) ||
+	    (b.t > burst_start && b.t < line_free + slot)) {
+		Sim_Bus.collisions++;
+		b.c ^= 0xFF;
+	}
+	if (b.t >= in_last) {
+		in_last = b.t;
+		in_last_node = b.node;
+	}
+	if (in_count == sizeof(in) / sizeof(in[0])) {
+		fprintf(stderr, "sim: bus input full, byte dropped\n");
+		return;
+	}
+	for (i = in_count; i > 0 && in[i - 1].t > b.t; i--)
+		in[i] = in[i - 1];
+	in[i] = b;
+	if (in_count++ == 0 || i == 0) {
+		Sim_Cancel(host_deliver, NULL);
+		Sim_At(in[0].t, host_deliver, NULL);
+	}
+}
+
+/**
+ * Read the answer of a node to its last grant.
+ * @return 0 still running, 1 stopped, -1 lost
+ */
+static int host_collect(int i, uint8_t *result)
+{
+	struct bus_reply r;
+	struct bus_byte b;
+	uint32_t k;
+
+	if (xread(node[i].from, &r, sizeof(r)) != 0)
+		return -1;
+	for (k = 0; k < r.n; k++) {
+		if (xread(node[i].from, &b, sizeof(b)) != 0)
+			return -1;
+		host_queue(b);
+	}
+	if (r.exit < 0)
+		return 0;
+	if (xread(node[i].from, result, Sim_Bus.result_size) != 0)
+		return -1;
+	return 1;
+}
+
+/************************************************************************/
+static int host_grant(int i, uint64_t until, uint32_t first, uint32_t n)
+{
+	struct bus_grant g = { until, n };
+	uint32_t k;
+
+	if (xwrite(node[i].to, &g, sizeof(g)) != 0)
+		return -1;
+	for (k = 0; k < n; k++) {
+		if (xwrite(node[i].to, &out[(first + k) % BUS_QUEUE], sizeof(out[0])) != 0)
+			return -1;
+	}
+	return 0;
+}
+
+/************************************************************************/
+static void host_lost(int i, uint8_t *result)
+{
+	int status;
+
+	node[i].live = 0;
+	memset(result, 0, Sim_Bus.result_size);
+	*(int *)result = SIM_EXIT_ERROR;
+	close(node[i].to);
+	close(node[i].from);
+	waitpid(node[i].pid, &status, 0);
+}
+
+/**
+ * Start the nodes, then run the host and them in lockstep until the host
+ * has called Sim_BusStop() and the bus is quiet, every node has stopped,
+ * or the time limit (ns, 0: none).
+ * @param results Sim_Bus.result_size bytes per node, filled by
+ *        Sim_Bus.node in its process; a node that crashed gets
+ *        SIM_EXIT_ERROR in the first int
+ * @return 0, -1 the nodes could not be started
+ */
+int Sim_BusRun(void *results, uint64_t limit)
+{
+	uint8_t *res = results;
+	uint32_t n;
+	int i, live = 0, fd[4], code;
+	uint64_t t;
+
+	if (Sim_Bus.nodes < 1 || Sim_Bus.nodes > BUS_NODES_MAX || Sim_Bus.baud == 0)
+		return -1;
+	slot = 10ull * 1000000000ull / Sim_Bus.baud;
+	out = malloc(BUS_QUEUE * sizeof(out[0]));
+	if (out == NULL)
+		return -1;
+	signal(SIGPIPE, SIG_IGN);
+	fflush(NULL);
+	for (i = 0; i < Sim_Bus.nodes; i++) {
+		if (pipe(fd) != 0 || pipe(fd + 2) != 0) {
+			perror("sim: pipe");
+			return -1;
+		}
+		node[i].to = fd[1];
+		node[i].from = fd[2];
+		node[i].pid = fork();
+		if (node[i].pid < 0) {
+			perror("sim: fork");
+			return -1;
+		}
+		if (node[i].pid == 0) {
+			close(fd[1]);
+			close(fd[2]);
+			node[i].to = fd[0];
+			node[i].from = fd[3];
+			node_main(i, res + (size_t)i * Sim_Bus.result_size);
+		}
+		close(fd[0]);
+		close(fd[3]);
+		node[i].live = 1;
+		live++;
+	}
+	/* Each node reports at time 0 first */
+	for (i = 0; i < Sim_Bus.nodes; i++) {
+		code = host_collect(i, res + (size_t)i * Sim_Bus.result_size);
+		if (code != 0) {
+			if (code < 0)
+				host_lost(i, res + (size_t)i * Sim_Bus.result_size);
+			node[i].live = 0;
+			live--;
+		}
+	}
+	for (t = 0; live > 0; t += slot) {
+		Sim_Drain(t);
+		if ((stopping && t >= line_free + BUS_GRACE_NS) ||
+		    (limit != 0 && t >= limit))
+			break;
+		Sim_Bus.steps++;
+		for (n = 0; out_tail + n != out_head && out[(out_tail + n) % BUS_QUEUE].t < t + slot; n++)
+			;
+		for (i = 0; i < Sim_Bus.nodes; i++) {
+			if (node[i].live && host_grant(i, t + slot, out_tail, n) != 0)
+				host_lost(i, res + (size_t)i * Sim_Bus.result_size);
+		}
+		out_tail += n;
+		for (i = 0; i < Sim_Bus.nodes; i++) {
+			if (!node[i].live)
+				continue;
+			code = host_collect(i, res + (size_t)i * Sim_Bus.result_size);
+			if (code < 0)
+				host_lost(i, res + (size_t)i * Sim_Bus.result_size);
+			else if (code > 0)
+				node[i].live = 0;
+		}
+		for (live = 0, i = 0; i < Sim_Bus.nodes; i++)
+			live += node[i].live;
+	}
+	/* Every node has stopped: the host finds out by its own timeouts */
+	for (; live == 0 && !stopping && (limit == 0 || t < limit); t += slot)
+		Sim_Drain(t);
+	/* Stop the rest where they are */
+	for (i = 0; i < Sim_Bus.nodes; i++) {
+		if (!node[i].live)
+			continue;
+		if (host_grant(i, 0, out_tail, 0) != 0 ||
+		    host_collect(i, res + (size_t)i * Sim_Bus.result_size) != 1)
+			host_lost(i, res + (size_t)i * Sim_Bus.result_size);
+	}
+	for (i = 0; i < Sim_Bus.nodes; i++) {
+		if (node[i].pid > 0) {
+			close(node[i].to);
+			close(node[i].from);
+			waitpid(node[i].pid, &code, 0);
+		}
+	}
+	free(out);
+	return 0;
+}
@@ -0,0 +1,639 @@
+/*
+ * Virtual time, hardware events and the interrupt controller.
+ *
+ * Peripheral models schedule hardware events (a byte reaching the receiver,
+ * a flash operation completing) with Sim_At(). Events run at their time
+ * whatever the CPU does; they raise interrupts with Sim_IrqSet(). Interrupt
+ * handlers only run when the CPU can fetch code: not while a blocking flash
+ * call stalls it, not while bank 1 is busy unless they run from RAM
+ * (sim_flash.c), not with PRIMASK set.
+ */
+#define _GNU_SOURCE
+#include <poll.h>
+#include <setjmp.h>
+#include <signal.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "sim.h"
+#include "stm32h5xx_hal.h"
+
+#define SIM_EVENTS      64
+
+struct sim_event {
+	uint64_t t;
+	uint64_t seq;           /* keeps events of the same time in order */
+	Sim_Fn fn;
+	void *arg;
+};
+
+uint64_t Sim_Now;
+uint32_t SystemCoreClock = 100000000;   /* HSE 8 MHz, PLL1 x100 / 4 / 2 */
+DCB_Type Sim_Dcb;
+ICACHE_TypeDef Sim_Icache;
+SCB_Type Sim_Scb = { .VTOR = FLASH_BASE };
+NVIC_Type Sim_Nvic;
+SysTick_Type Sim_SysTick = { .CTRL = 0x7 };
+RCC_TypeDef Sim_Rcc = {
+	.CR = RCC_CR_CSION | RCC_CR_CSIRDY | RCC_CR_HSEON | RCC_CR_HSERDY |
+	      RCC_CR_PLL1ON | RCC_CR_PLL1RDY | RCC_CR_PLL2ON | RCC_CR_PLL2RDY,
+	.RSR = RCC_RSR_PINRSTF,
+};
+int Sim_CpuInRam;
+void (*Sim_App)(void);
+
+static struct sim_event events[SIM_EVENTS];
+static int nevents;
+static uint64_t event_seq;
+
+static void (*vector[SIM_IRQ_COUNT])(void);
+static uint8_t irq_enabled[SIM_IRQ_COUNT];
+static uint8_t irq_pending[SIM_IRQ_COUNT];
+static uint32_t primask;
+static int in_isr;
+
+static jmp_buf exit_jmp;
+static volatile sig_atomic_t stopping;
+static int exit_code;
+static uint64_t limit;
+
+static int rt_fd = -1;
+static void (*rt_input)(int fd);
+static uint64_t rt_base;
+
+static uint64_t (*lockstep)(void);
+static uint64_t lock_until;
+
+/************************************************************************/
+void Sim_At(uint64_t t, Sim_Fn fn, void *arg)
+{
+	if (nevents == SIM_EVENTS) {
+		fprintf(stderr, "sim: event queue full\n");
+		Sim_Stop(SIM_EXIT_ERROR);
+		return;
+	}
+	if (t < Sim_Now)
+		t = Sim_Now;
+	events[nevents].t = t;
+	events[nevents].seq = event_seq++;
+	events[nevents].fn = fn;
+	events[nevents].arg = arg;
+	nevents++;
+}
+
+/************************************************************************/
+void Sim_Cancel(Sim_Fn fn, void *arg)
+{
+	int i;
+
+	for (i = 0; i < nevents; i++) {
+		if (events[i].fn == fn && events[i].arg == arg) {
+			events[i] = events[--nevents];
+			i--;
+		}
+	}
+}
+
+/************************************************************************/
+static int next_event(void)
+{
+	int i, best = -1;
+
+	for (i = 0; i < nevents; i++) {
+		if (best < 0 || events[i].t < events[best].t ||
+		    (events[i].t == events[best].t && events[i].seq < events[best].seq))
+			best = i;
+	}
+	return best;
+}
+
+/**
+ * Run the hardware events up to t and move the clock there. SysTick
+ * becomes pending on every millisecond boundary crossed. In lockstep the
+ * clock stops at the time granted so far, where the other processes are
+ * met; the callers loop, since that may bring new events.
+ */
+static void advance_to(uint64_t t)
+{
+	struct sim_event ev;
+	uint64_t tick = Sim_Now / 1000000;
+	int i, sync = 0;
+
+	if (lockstep != NULL && t >= lock_until) {
+		t = lock_until;
+		sync = 1;
+	}
+	while ((i = next_event()) >= 0 && events[i].t <= t) {
+		ev = events[i];
+		events[i] = events[--nevents];
+		Sim_Now = ev.t;
+		ev.fn(ev.arg);
+	}
+	if (t > Sim_Now)
+		Sim_Now = t;
+	if (Sim_Now / 1000000 != tick)
+		Sim_IrqSet(SysTick_IRQn);
+	if (sync)
+		lock_until = lockstep();
+}
+
+/************************************************************************/
+static int irq_pending_any(void)
+{
+	int i;
+
+	for (i = 0; i < SIM_IRQ_COUNT; i++) {
+		if (irq_pending[i] && irq_enabled[i])
+			return 1;
+	}
+	return 0;
+}
+
+/************************************************************************/
+static int irq_ready(void)
+{
+	return Sim_FlashIrqReady() <= Sim_Now && irq_pending_any();
+}
+
+/**
+ * Move time on to t; the time an interrupt waits for bank 1 meanwhile
+ * counts as held.
+ */
+static void idle_to(uint64_t t)
+{
+	uint64_t from = Sim_Now;
+	int held = (!primask || Sim_CpuInRam) && !in_isr && irq_pending_any() && Sim_FlashIrqReady() > Sim_Now;
+
+	advance_to(t);
+	if (held)
+		Sim_Flash.held_ns += Sim_Now - from;
+}
+
+/**
+ * Take the pending interrupts; handlers do not nest, a handler that waits
+ * on another interrupt hangs like it would on the target.
+ * @return number of handlers run
+ */
+static int run_irqs(void)
+{
+	int i, n = 0, again = 1;
+
+	if (in_isr || primask)
+		return 0;
+	while (again && Sim_FlashIrqReady() <= Sim_Now) {
+		again = 0;
+		for (i = 0; i < SIM_IRQ_COUNT; i++) {
+			if (!irq_pending[i] || !irq_enabled[i])
+				continue;
+			irq_pending[i] = 0;
+			in_isr = 1;
+			if (vector[i])
+				vector[i]();
+			in_isr = 0;
+			n++;
+			again = 1;
+		}
+	}
+	return n;
+}
+
+/************************************************************************/
+static uint64_t wall_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * Realtime mode: wait until the wall clock reaches t or input arrives.
+ * @return the virtual time reached
+ */
+static uint64_t rt_wait(uint64_t t, int *input)
+{
+	struct pollfd pfd = { .fd = rt_fd, .events = POLLIN };
+	uint64_t wall, ns;
+	struct timespec ts;
+
+	*input = 0;
+	for (;;) {
+		wall = wall_ns() - rt_base;
+		if (wall >= t)
+			return t;
+		/* Nanosecond timeout: flash operations are much shorter than 1 ms */
+		ns = t - wall;
+		if (ns > 100000000)
+			ns = 100000000;
+		ts.tv_sec = 0;
+		ts.tv_nsec = (long)ns;
+		if (ppoll(&pfd, 1, &ts, NULL) > 0) {
+			*input = 1;
+			wall = wall_ns() - rt_base;
+			return wall < Sim_Now ? Sim_Now : (wall < t ? wall : t);
+		}
+		if (stopping)
+			return Sim_Now;
+	}
+}
+
+/************************************************************************/
+static void check_stop(void)
+{
+	if (stopping)
+		longjmp(exit_jmp, 1);
+}
+
+/**
+ * Wait for an interrupt. ram: the CPU sleeps in the scheduler loop, which
+ * runs from RAM with ramexec.h and unmasks the interrupts after WFI; the
+ * handlers are taken while bank 1 is busy if they run from RAM too, and
+ * the tasks only get the CPU back once bank 1 can be read again.
+ */
+static void idle(int ram)
+{
+	uint64_t next, ready;
+	uint32_t mask;
+	int i, input;
+
+	for (;;) {
+		check_stop();
+		Sim_CpuInRam = ram;
+		if (irq_ready() || (primask && irq_pending_any())) {
+			mask = primask;
+			if (ram && Sim_FlashFetchReady() > Sim_Now)
+				primask = 0;
+			run_irqs();
+			primask = mask;
+			if (!ram || Sim_FlashFetchReady() <= Sim_Now) {
+				Sim_CpuInRam = 0;
+				return;
+			}
+		}
+		next = (Sim_Now / 1000000 + 1) * 1000000;
+		i = next_event();
+		if (i >= 0 && events[i].t < next)
+			next = events[i].t;
+		ready = Sim_FlashFetchReady();
+		if (ready > Sim_Now && ready < next)
+			next = ready;
+		if (limit != 0 && next > limit) {
+			Sim_Stop(SIM_EXIT_TIMEOUT);
+			check_stop();
+		}
+		if (rt_fd >= 0) {
+			next = rt_wait(next, &input);
+			idle_to(next);
+			if (input)
+				rt_input(rt_fd);
+			continue;
+		}
+		idle_to(next);
+	}
+}
+
+/**
+ * The CPU waits for an interrupt: a busy loop on something an interrupt
+ * changes. Returns once an interrupt has been taken, or with PRIMASK set
+ * once one is pending (the caller takes it when it unmasks).
+ */
+void Sim_Idle(void)
+{
+	idle(0);
+}
+
+/**
+ * The CPU polls a status flag that the hardware clears at the given time
+ * (flash busy on the bank it does not run from): interrupts are taken as
+ * they come, and it goes on right at that time rather than at the next
+ * interrupt as Sim_Idle() would.
+ */
+void Sim_Poll(uint64_t until)
+{
+	uint64_t next;
+	int i, input;
+
+	while (Sim_Now < until) {
+		check_stop();
+		/* With PRIMASK set a pending interrupt waits for the unmask */
+		if (!primask && irq_ready()) {
+			run_irqs();
+			continue;
+		}
+		next = until;
+		i = next_event();
+		if (i >= 0 && events[i].t < next)
+			next = events[i].t;
+		if (limit != 0 && next > limit) {
+			Sim_Stop(SIM_EXIT_TIMEOUT);
+			check_stop();
+		}
+		if (rt_fd >= 0) {
+			next = rt_wait(next, &input);
+			idle_to(next);
+			if (input)
+				rt_input(rt_fd);
+			continue;
+		}
+		idle_to(next);
+	}
+	check_stop();
+}
+
+/**
+ * The CPU is held until the given time (blocking flash operation on the
+ * bank it runs from); hardware events still happen meanwhile.
+ */
+void Sim_Stall(uint64_t until)
+{
+	if (until > Sim_Now)
+		Sim_Flash.stall_ns += until - Sim_Now;
+	while (Sim_Now < until && !stopping)
+		advance_to(until);
+	check_stop();
+	run_irqs();
+}
+
+/************************************************************************/
+void Sim_Stop(int code)
+{
+	if (!stopping) {
+		exit_code = code;
+		stopping = 1;
+	}
+}
+
+/**
+ * Run the firmware from entry until a peer stops the simulation, the
+ * bootloader starts the application or the virtual time reaches limit (ns,
+ * 0: none).
+ * @return SIM_EXIT_xxx
+ */
+int Sim_Run(void (*entry)(void), uint64_t limit_ns)
+{
+	limit = limit_ns;
+	irq_enabled[SysTick_IRQn + 1] = 1;
+	if (rt_fd >= 0)
+		rt_base = wall_ns() - Sim_Now;
+	if (setjmp(exit_jmp) == 0) {
+		entry();
+		fprintf(stderr, "sim: firmware returned\n");
+		return SIM_EXIT_ERROR;
+	}
+	return exit_code;
+}
+
+/**
+ * After Sim_Run() has returned: let the hardware events run until t, for
+ * the bytes still on their way to the peer; in lockstep, still meeting
+ * the other processes.
+ */
+void Sim_Drain(uint64_t t)
+{
+	do
+		advance_to(t);
+	while (Sim_Now < t);
+}
+
+/**
+ * Let virtual time follow the wall clock; input(fd) is called whenever fd
+ * becomes readable (a pty the user or a host tool talks to).
+ */
+void Sim_SetRealtime(int fd, void (*input)(int fd))
+{
+	rt_fd = fd;
+	rt_input = input;
+}
+
+/**
+ * Lockstep with other processes (sim_bus.c): time only passes up to what
+ * sync() returned last. sync() is called once the clock has reached that
+ * time, to exchange what happened meanwhile and get the next one; it is
+ * called first at time 0.
+ */
+void Sim_SetLockstep(uint64_t (*sync)(void))
+{
+	lockstep = sync;
+	lock_until = 0;
+}
+
+/**
+ * The jump to the application: Sim_App, if set, stands in for it. It runs
+ * until it returns or the watchdog resets the device.
+ */
+void Sim_AppStart(uint32_t msp)
+{
+	extern uint32_t JumpAddress;
+
+	fprintf(stderr, "sim: application started at 0x%08x, MSP 0x%08x, t=%.3f s\n",
+		JumpAddress, msp, Sim_Now / 1e9);
+	(void)Sim_Iwdg();
+	if (Sim_App != NULL)
+		Sim_App();
+	Sim_Stop(SIM_EXIT_APP);
+	check_stop();
+}
+
+/* NVIC --------------------------------------------------------------------*/
+void Sim_IrqHandler(int irq, void (*handler)(void))
+{
+	vector[irq + 1] = handler;
+}
+
+/************************************************************************/
+void Sim_IrqSet(int irq)
+{
+	irq_pending[irq + 1] = 1;
+}
+
+/************************************************************************/
+void HAL_NVIC_SetPriority(IRQn_Type IRQn, uint32_t PreemptPriority, uint32_t SubPriority)
+{
+	(void)IRQn;
+	(void)PreemptPriority;
+	(void)SubPriority;
+}
+
+/************************************************************************/
+void HAL_NVIC_EnableIRQ(IRQn_Type IRQn)
+{
+	irq_enabled[IRQn + 1] = 1;
+}
+
+/************************************************************************/
+void HAL_NVIC_DisableIRQ(IRQn_Type IRQn)
+{
+	irq_enabled[IRQn + 1] = 0;
+}
+
+/* Clock tree --------------------------------------------------------------*/
+uint32_t HAL_RCC_GetSysClockFreq(void)
+{
+	return SystemCoreClock;
+}
+
+/************************************************************************/
+uint32_t HAL_RCC_GetHCLKFreq(void)
+{
+	return SystemCoreClock;
+}
+
+/************************************************************************/
+uint32_t HAL_RCC_GetPCLK1Freq(void)
+{
+	return SystemCoreClock;
+}
+
+/************************************************************************/
+uint32_t HAL_RCC_GetPCLK2Freq(void)
+{
+	return SystemCoreClock;
+}
+
+/************************************************************************/
+uint32_t HAL_RCC_GetPCLK3Freq(void)
+{
+	return SystemCoreClock;
+}
+
+/************************************************************************/
+uint32_t HAL_RCCEx_GetPeriphCLKFreq(uint64_t PeriphClk)
+{
+	(void)PeriphClk;
+	return SystemCoreClock;
+}
+
+/************************************************************************/
+uint32_t HAL_PWREx_GetVoltageRange(void)
+{
+	return PWR_REGULATOR_VOLTAGE_SCALE3;
+}
+
+/* Tick --------------------------------------------------------------------*/
+uint32_t HAL_GetTick(void)
+{
+	return (uint32_t)(Sim_Now / 1000000);
+}
+
+/************************************************************************/
+void HAL_Delay(uint32_t Delay)
+{
+	uint64_t end = Sim_Now + (uint64_t)Delay * 1000000;
+
+	while (Sim_Now < end)
+		Sim_Idle();
+}
+
+/* Core intrinsics -----------------------------------------------------------*/
+void __disable_irq(void)
+{
+	primask = 1;
+}
+
+/************************************************************************/
+void __enable_irq(void)
+{
+	primask = 0;
+	run_irqs();
+}
+
+/************************************************************************/
+uint32_t __get_PRIMASK(void)
+{
+	return primask;
+}
+
+/************************************************************************/
+void __set_PRIMASK(uint32_t value)
+{
+	primask = value;
+	run_irqs();
+}
+
+/************************************************************************/
+void __WFI(void)
+{
+	idle(1);
+}
+
+/* Only used as the body of busy-wait loops */
+void __NOP(void)
+{
+	Sim_Idle();
+}
+
+/************************************************************************/
+void __DSB(void)
+{
+	if (Sim_Scb.AIRCR & SCB_AIRCR_SYSRESETREQ_Msk) {
+		fprintf(stderr, "sim: system reset, t=%.3f s\n", Sim_Now / 1e9);
+		Sim_Stop(SIM_EXIT_RESET);
+		check_stop();
+	}
+}
+
+/************************************************************************/
+void __set_MSP(uint32_t msp)
+{
+	Sim_AppStart(msp);
+}
+
+/* IWDG --------------------------------------------------------------------*/
+static IWDG_TypeDef iwdg = { .RLR = 0xFFF };
+static int iwdg_on;
+
+static void iwdg_expire(void *arg);
+
+/**
+ * The key last written to KR: start or reload. The counter runs at LSI
+ * 32 kHz / (4 << PR) from RLR down.
+ */
+static void iwdg_key(void)
+{
+	uint32_t key = iwdg.KR;
+
+	iwdg.KR = 0;
+	if (key == 0xCCCC)
+		iwdg_on = 1;
+	else if (key != 0xAAAA || !iwdg_on)
+		return;
+	Sim_Cancel(iwdg_expire, NULL);
+	Sim_At(Sim_Now + (uint64_t)((iwdg.RLR & 0xFFF) + 1) * (4u << (iwdg.PR & 7)) * 31250,
+	       iwdg_expire, NULL);
+}
+
+/**
+ * A reload not seen yet counts as done now rather than when it was
+ * written: the model gives the firmware the benefit of the doubt.
+ */
+static void iwdg_expire(void *arg)
+{
+	(void)arg;
+	if (iwdg.KR != 0) {
+		iwdg_key();
+		return;
+	}
+	fprintf(stderr, "sim: watchdog reset, t=%.3f s\n", Sim_Now / 1e9);
+	Sim_Stop(SIM_EXIT_RESET);
+}
+
+/************************************************************************/
+IWDG_TypeDef *Sim_Iwdg(void)
+{
+	iwdg_key();
+	return &iwdg;
+}
+
+/**
+ * DWT: CYCCNT follows virtual time once enabled, so cycles only pass where
+ * time does (waits, flash stalls).
+ */
+DWT_Type *Sim_Dwt(void)
+{
+	static DWT_Type dwt;
+
+	if ((Sim_Dcb.DEMCR & DCB_DEMCR_TRCENA_Msk) && (dwt.CTRL & DWT_CTRL_CYCCNTENA_Msk))
+		dwt.CYCCNT = (uint32_t)(Sim_Now * (SystemCoreClock / 1000000) / 1000);
+	return &dwt;
+}
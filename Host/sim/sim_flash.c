@@ -0,0 +1,484 @@
+/*
+ * Flash model: 2 banks of 8 x 8K sectors mapped at FLASH_BASE so the
+ * firmware reads it in place, programmed by 16-byte quadwords.
+ *
+ * - Erase and program take Sim_Flash.erase_us / program_us; the data
+ *   changes when the operation completes.
+ * - One operation at a time: the HAL waits for the previous one first.
+ * - A quadword can be programmed once after an erase; the real part accepts
+ *   a second write and fails the ECC check on the next read, the model
+ *   rejects it so the offending write shows up where it happens.
+ *   Sim_Flash.stale marks one quadword programmed that still reads blank,
+ *   as after a write of 0xFF or an erase cut short.
+ * - The bootloader runs from bank 1: while bank 1 is busy the CPU cannot
+ *   fetch, so no interrupt handler runs (fetch_stall). Once the firmware
+ *   has moved the vector table to RAM, the handlers and the flash waits
+ *   of the engine run from RAM (ramexec.h, ram_exec); task code still
+ *   waits for bank 1.
+ * - Besides the HAL calls, the registers of the burst programmer: a
+ *   quadword stored straight to the array is found by comparing the array
+ *   with the model's copy at the next FLASH register access, and programmed
+ *   from there if PG is set. A sector erase (SER, START) set up by the
+ *   services starts at that access too. So does the lock of the services:
+ *   KEY1 then KEY2 written to NSKEYR unlocks, LOCK set in NSCR locks;
+ *   the HAL calls and the LOCK bit read back agree.
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "sim.h"
+#include "stm32h5xx_hal.h"
+
+#define QUADWORD        16u
+
+struct sim_flash Sim_Flash = {
+	.program_us = 50,
+	.erase_us = 2000,
+	.fetch_stall = 1,
+	.ram_exec = 1,
+};
+
+enum { OP_NONE = 0, OP_ERASE, OP_PROGRAM };
+
+static uint8_t *mem;
+static uint8_t written[FLASH_SIZE_DEFAULT / QUADWORD];
+static uint8_t copy[FLASH_SIZE_DEFAULT];        /* mem as the model left it */
+static uint32_t last_store;                     /* quadword index + 1 */
+static FLASH_TypeDef regs;
+static uint32_t key1_seen;                      /* NSKEYR got KEY1 last */
+static uint32_t lock_shown;                     /* LOCK as NSCR last read */
+
+static struct {
+	int locked;
+	int op;
+	int it;                 /* completion raises FLASH_IRQn */
+	uint32_t bank;
+	uint32_t sector;        /* next sector of an erase */
+	uint32_t nb;            /* sectors left */
+	uint32_t addr;
+	uint8_t data[QUADWORD];
+	uint64_t start;
+	uint64_t end;
+	uint32_t sr;            /* EOP and error flags */
+	uint32_t param;         /* for the callbacks */
+} f = { .locked = 1 };
+
+/**
+ * Map the array at its target address, blank or loaded from image.
+ * @return 0 ok, -1 error
+ */
+static int flash_load(const char *image)
+{
+	FILE *fp;
+	size_t n;
+
+	fp = fopen(image, "rb");
+	if (fp == NULL)
+		return errno == ENOENT ? 0 : -1;
+	n = fread(mem, 1, FLASH_SIZE_DEFAULT, fp);
+	fclose(fp);
+	memcpy(copy, mem, FLASH_SIZE_DEFAULT);
+	/* Whatever is not blank counts as programmed */
+	for (n = 0; n < sizeof(written); n++) {
+		const uint8_t *q = mem + n * QUADWORD;
+		uint32_t i;
+
+		for (i = 0; i < QUADWORD && q[i] == 0xFF; i++)
+			;
+		written[n] = i < QUADWORD;
+	}
+	return 0;
+}
+
+/************************************************************************/
+int Sim_FlashInit(const char *image)
+{
+	mem = mmap((void *)FLASH_BASE, FLASH_SIZE_DEFAULT, PROT_READ | PROT_WRITE,
+		   MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+	if (mem == MAP_FAILED || mem != (uint8_t *)FLASH_BASE) {
+		fprintf(stderr, "sim: cannot map flash at 0x%08lx: %s\n", FLASH_BASE, strerror(errno));
+		return -1;
+	}
+	memset(mem, 0xFF, FLASH_SIZE_DEFAULT);
+	memset(copy, 0xFF, FLASH_SIZE_DEFAULT);
+	if (image != NULL && flash_load(image) != 0)
+		return -1;
+	if (Sim_Flash.stale - FLASH_BASE < FLASH_SIZE_DEFAULT)
+		written[(Sim_Flash.stale - FLASH_BASE) / QUADWORD] = 1;
+	return 0;
+}
+
+/************************************************************************/
+int Sim_FlashSave(const char *image)
+{
+	FILE *fp = fopen(image, "wb");
+	int ok;
+
+	if (fp == NULL)
+		return -1;
+	ok = fwrite(mem, 1, FLASH_SIZE_DEFAULT, fp) == FLASH_SIZE_DEFAULT;
+	return (fclose(fp) == 0 && ok) ? 0 : -1;
+}
+
+/**
+ * Put data in flash as if it had been programmed earlier.
+ * @return 0 ok, -1 outside the array
+ */
+int Sim_FlashPreload(uint32_t addr, const uint8_t *data, uint32_t len)
+{
+	uint32_t off = addr - FLASH_BASE, q;
+
+	if (addr < FLASH_BASE || len > FLASH_SIZE_DEFAULT || off > FLASH_SIZE_DEFAULT - len)
+		return -1;
+	memcpy(mem + off, data, len);
+	memcpy(copy + off, data, len);
+	for (q = off / QUADWORD; q * QUADWORD < off + len; q++)
+		written[q] = 1;
+	return 0;
+}
+
+/************************************************************************/
+uint64_t Sim_FlashFetchReady(void)
+{
+	if (Sim_Flash.fetch_stall && f.op != OP_NONE && f.bank == FLASH_BANK_1)
+		return f.end;
+	return Sim_Now;
+}
+
+/**
+ * 1 when the interrupt handlers run from RAM, with the vector table
+ */
+static int handlers_in_ram(void)
+{
+	return Sim_Flash.ram_exec && SCB->VTOR != FLASH_BASE;
+}
+
+/**
+ * When the interrupt handlers can run: right away if they and the code the
+ * CPU waits in are in RAM, else once bank 1 can be read.
+ */
+uint64_t Sim_FlashIrqReady(void)
+{
+	return (handlers_in_ram() && Sim_CpuInRam) ? Sim_Now : Sim_FlashFetchReady();
+}
+
+/**
+ * Poll the busy flag until the operation ends, from RAM
+ */
+static void poll_ram(void)
+{
+	Sim_CpuInRam = 1;
+	Sim_Poll(f.end);
+	Sim_CpuInRam = 0;
+}
+
+/************************************************************************/
+static void sector_erase(uint32_t bank, uint32_t sector)
+{
+	uint32_t offset = (bank - 1) * FLASH_BANK_SIZE + sector * FLASH_SECTOR_SIZE;
+
+	memset(mem + offset, 0xFF, FLASH_SECTOR_SIZE);
+	memset(copy + offset, 0xFF, FLASH_SECTOR_SIZE);
+	memset(written + offset / QUADWORD, 0, FLASH_SECTOR_SIZE / QUADWORD);
+}
+
+/**
+ * Hardware: the operation in progress completes.
+ */
+static void op_done(void *arg)
+{
+	(void)arg;
+	Sim_Flash.busy_ns += Sim_Now - f.start;
+	if (f.op == OP_PROGRAM) {
+		memcpy(mem + (f.addr - FLASH_BASE), f.data, QUADWORD);
+		memcpy(copy + (f.addr - FLASH_BASE), f.data, QUADWORD);
+		written[(f.addr - FLASH_BASE) / QUADWORD] = 1;
+		f.param = f.addr;
+	} else {
+		sector_erase(f.bank, f.sector);
+		f.param = f.sector;
+		if (--f.nb != 0) {
+			/* The HAL starts the next sector from the interrupt */
+			f.sector++;
+			f.start = Sim_Now;
+			f.end = Sim_Now + Sim_Flash.erase_us * 1000ull;
+			Sim_Flash.erases++;
+			Sim_At(f.end, op_done, NULL);
+			if (f.it)
+				Sim_IrqSet(FLASH_IRQn);
+			f.sr |= FLASH_FLAG_EOP;
+			return;
+		}
+		f.param = 0xFFFFFFFFu;
+	}
+	f.op = OP_NONE;
+	f.sr |= FLASH_FLAG_EOP;
+	if (f.it)
+		Sim_IrqSet(FLASH_IRQn);
+}
+
+/**
+ * FLASH_WaitForLastOperation(): polls from flash, so the CPU is held when
+ * the busy bank is the one it runs from, unless the caller is one of the
+ * HAL functions the linker script puts in RAM.
+ */
+static void wait_last(int ram)
+{
+	while (f.op != OP_NONE) {
+		if (ram && handlers_in_ram())
+			poll_ram();
+		else if (Sim_FlashFetchReady() > Sim_Now)
+			Sim_Stall(f.end);
+		else
+			Sim_Poll(f.end);
+	}
+}
+
+/************************************************************************/
+static HAL_StatusTypeDef start_program(uint32_t addr, uintptr_t data, int it)
+{
+	uint32_t offset = addr - FLASH_BASE;
+
+	wait_last(it);
+	if (f.locked) {
+		f.sr |= FLASH_FLAG_WRPERR;
+		Sim_Flash.errors++;
+		return HAL_ERROR;
+	}
+	if (addr < FLASH_BASE || offset >= FLASH_SIZE_DEFAULT || (addr & (QUADWORD - 1)) != 0) {
+		f.sr |= FLASH_FLAG_PGSERR;
+		Sim_Flash.errors++;
+		return HAL_ERROR;
+	}
+	if (written[offset / QUADWORD]) {
+		f.sr |= FLASH_FLAG_PGSERR;
+		Sim_Flash.rejected++;
+		fprintf(stderr, "sim: quadword 0x%08x programmed twice without an erase\n", addr);
+		return HAL_ERROR;
+	}
+	memcpy(f.data, (const void *)data, QUADWORD);
+	f.op = OP_PROGRAM;
+	f.it = it;
+	f.addr = addr;
+	f.bank = offset < FLASH_BANK_SIZE ? FLASH_BANK_1 : FLASH_BANK_2;
+	f.start = Sim_Now;
+	f.end = Sim_Now + Sim_Flash.program_us * 1000ull;
+	Sim_Flash.programs++;
+	Sim_At(f.end, op_done, NULL);
+	return HAL_OK;
+}
+
+/************************************************************************/
+static HAL_StatusTypeDef start_erase(const FLASH_EraseInitTypeDef *init, int it)
+{
+	wait_last(1);
+	if (f.locked) {
+		f.sr |= FLASH_FLAG_WRPERR;
+		Sim_Flash.errors++;
+		return HAL_ERROR;
+	}
+	if (init->TypeErase != FLASH_TYPEERASE_SECTORS ||
+	    (init->Banks != FLASH_BANK_1 && init->Banks != FLASH_BANK_2) ||
+	    init->NbSectors == 0 || init->Sector + init->NbSectors > FLASH_SECTOR_NB) {
+		fprintf(stderr, "sim: bad erase bank %u sector %u count %u\n",
+			init->Banks, init->Sector, init->NbSectors);
+		f.sr |= FLASH_FLAG_INCERR;
+		Sim_Flash.errors++;
+		return HAL_ERROR;
+	}
+	f.op = OP_ERASE;
+	f.it = it;
+	f.bank = init->Banks;
+	f.sector = init->Sector;
+	f.nb = init->NbSectors;
+	f.start = Sim_Now;
+	f.end = Sim_Now + Sim_Flash.erase_us * 1000ull;
+	Sim_Flash.erases++;
+	Sim_At(f.end, op_done, NULL);
+	return HAL_OK;
+}
+
+/**
+ * Index of a quadword the CPU stored to since the model last touched it,
+ * -1 if none. Bursts go up the array, so try the one after the last first.
+ */
+static int32_t find_store(void)
+{
+	uint32_t q;
+
+	if (last_store < sizeof(written) &&
+	    memcmp(mem + last_store * QUADWORD, copy + last_store * QUADWORD, QUADWORD) != 0)
+		return (int32_t)last_store;
+	if (memcmp(mem, copy, FLASH_SIZE_DEFAULT) == 0)
+		return -1;
+	for (q = 0; memcmp(mem + q * QUADWORD, copy + q * QUADWORD, QUADWORD) == 0; q++)
+		;
+	return (int32_t)q;
+}
+
+/**
+ * The LOCK bit of NSCR as the model has it.
+ */
+static void show_lock(void)
+{
+	lock_shown = f.locked ? FLASH_CR_LOCK : 0;
+	regs.NSCR = (regs.NSCR & ~FLASH_CR_LOCK) | lock_shown;
+}
+
+/**
+ * FLASH register access: take the stores and flag clears made since the
+ * last one, then let a poll of a busy flash take time.
+ */
+FLASH_TypeDef *Sim_FlashRegs(void)
+{
+	uint8_t data[QUADWORD];
+	int32_t q;
+
+	f.sr &= ~regs.NSCCR;
+	regs.NSCCR = 0;
+	if (regs.NSKEYR != 0) {
+		if (key1_seen && regs.NSKEYR == FLASH_KEY2)
+			f.locked = 0;
+		key1_seen = regs.NSKEYR == FLASH_KEY1;
+		regs.NSKEYR = 0;
+	}
+	if ((regs.NSCR & FLASH_CR_LOCK) && !lock_shown)
+		f.locked = 1;
+	if (regs.NSCR & FLASH_CR_START) {
+		FLASH_EraseInitTypeDef init = {
+			.TypeErase = FLASH_TYPEERASE_SECTORS,
+			.Banks = (regs.NSCR & FLASH_CR_BKSEL) ? FLASH_BANK_2 : FLASH_BANK_1,
+			.Sector = (regs.NSCR & FLASH_CR_SNB) >> FLASH_CR_SNB_Pos,
+			.NbSectors = 1,
+		};
+
+		regs.NSCR &= ~FLASH_CR_START;
+		if (regs.NSCR & FLASH_CR_SER)
+			start_erase(&init, 0);
+	}
+	while ((q = find_store()) >= 0) {
+		uint32_t addr = FLASH_BASE + (uint32_t)q * QUADWORD;
+
+		memcpy(data, mem + q * QUADWORD, QUADWORD);
+		memcpy(mem + q * QUADWORD, copy + q * QUADWORD, QUADWORD);
+		last_store = (uint32_t)q + 1;
+		if (!(regs.NSCR & FLASH_CR_PG)) {
+			fprintf(stderr, "sim: store to flash at 0x%08x without PG\n", addr);
+			f.sr |= FLASH_FLAG_PGSERR;
+			Sim_Flash.errors++;
+			continue;
+		}
+		start_program(addr, (uintptr_t)data, 0);
+	}
+	if (f.op != OP_NONE) {
+		/* The burst programmer polls from RAM */
+		if (handlers_in_ram())
+			poll_ram();
+		else if (Sim_FlashFetchReady() > Sim_Now)
+			Sim_Stall(f.end);
+		else
+			Sim_Poll(f.end);
+	}
+	regs.NSSR = f.sr | (f.op != OP_NONE ? FLASH_SR_BSY : 0);
+	show_lock();
+	return &regs;
+}
+
+/* HAL -----------------------------------------------------------------------*/
+HAL_StatusTypeDef HAL_FLASH_Unlock(void)
+{
+	Sim_FlashRegs();
+	f.locked = 0;
+	show_lock();
+	return HAL_OK;
+}
+
+/************************************************************************/
+HAL_StatusTypeDef HAL_FLASH_Lock(void)
+{
+	Sim_FlashRegs();
+	f.locked = 1;
+	show_lock();
+	return HAL_OK;
+}
+
+/************************************************************************/
+void Sim_FlashClearFlag(uint32_t flag)
+{
+	f.sr &= ~flag;
+}
+
+/************************************************************************/
+uint32_t HAL_FLASH_GetError(void)
+{
+	return f.sr & FLASH_FLAG_ALL_ERRORS;
+}
+
+/************************************************************************/
+HAL_StatusTypeDef HAL_FLASH_Program(uint32_t TypeProgram, uint32_t FlashAddress, uintptr_t DataAddress)
+{
+	if (TypeProgram != FLASH_TYPEPROGRAM_QUADWORD ||
+	    start_program(FlashAddress, DataAddress, 0) != HAL_OK)
+		return HAL_ERROR;
+	wait_last(0);
+	f.sr &= ~FLASH_FLAG_EOP;
+	return HAL_OK;
+}
+
+/************************************************************************/
+HAL_StatusTypeDef HAL_FLASH_Program_IT(uint32_t TypeProgram, uint32_t FlashAddress, uintptr_t DataAddress)
+{
+	if (TypeProgram != FLASH_TYPEPROGRAM_QUADWORD)
+		return HAL_ERROR;
+	return start_program(FlashAddress, DataAddress, 1);
+}
+
+/************************************************************************/
+HAL_StatusTypeDef HAL_FLASHEx_Erase(FLASH_EraseInitTypeDef *pEraseInit, uint32_t *SectorError)
+{
+	*SectorError = 0xFFFFFFFFu;
+	if (start_erase(pEraseInit, 0) != HAL_OK) {
+		*SectorError = pEraseInit->Sector;
+		return HAL_ERROR;
+	}
+	wait_last(1);
+	f.sr &= ~FLASH_FLAG_EOP;
+	return HAL_OK;
+}
+
+/************************************************************************/
+HAL_StatusTypeDef HAL_FLASHEx_Erase_IT(FLASH_EraseInitTypeDef *pEraseInit)
+{
+	return start_erase(pEraseInit, 1);
+}
+
+/**
+ * FLASH_IRQn handler, the HAL_FLASH_IRQHandler() part the model needs.
+ */
+void Sim_FlashIrq(void)
+{
+	if (f.sr & FLASH_FLAG_EOP) {
+		f.sr &= ~FLASH_FLAG_EOP;
+		HAL_FLASH_EndOfOperationCallback(f.param);
+	}
+}
+
+/************************************************************************/
+void HAL_FLASH_IRQHandler(void)
+{
+	Sim_FlashIrq();
+}
+
+/************************************************************************/
+__weak void HAL_FLASH_EndOfOperationCallback(uint32_t ReturnValue)
+{
+	(void)ReturnValue;
+}
+
+/************************************************************************/
+__weak void HAL_FLASH_OperationErrorCallback(uint32_t ReturnValue)
+{
+	(void)ReturnValue;
+}
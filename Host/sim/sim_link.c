@@ -0,0 +1,194 @@
+/*
+ * The serial line between the peer and USART1, one pipe per direction.
+ *
+ * Peer to device, the bytes queued by Sim_LinkSend() go out back to back at
+ * the line rate. Device to peer, the UART has already spent the character
+ * time. Either way a byte reaches the other end `latency_us` later plus a
+ * random jitter below `jitter_us`, never overtaking the one before. The
+ * jitter is drawn once per Sim_LinkSend() (a USB serial adapter delays a
+ * whole write) and per byte from the device (it bunches them up).
+ *
+ * Faults, each direction on its own:
+ * - bit errors at `ber` over the ten bits of the frame; an error in the
+ *   start or stop bit loses the byte (a framing error the receivers here
+ *   do not report)
+ * - error bursts, starting before a byte with probability `burst_rate`
+ *   and lasting `burst_len` bytes on average, during which every bit is
+ *   noise (a motor starting next to the cable)
+ * - byte loss at `drop` and duplication at `dup`
+ * A lost byte still occupies its slot on the line, a duplicate takes one.
+ */
+#include <stdio.h>
+
+#include "sim.h"
+
+#define PIPE_SIZE       65536u
+
+struct pipe {
+	struct {
+		uint64_t t;     /* delivery */
+		uint8_t c;
+	} q[PIPE_SIZE];
+	uint32_t head, tail;
+	uint64_t last;          /* delivery of the previous byte */
+	uint32_t slot;          /* ns a byte occupies the line, 0: already spent */
+	uint32_t burst;         /* bytes left in the current error burst */
+	void (*deliver)(uint8_t c);
+};
+
+struct sim_link Sim_Link = { .seed = 1 };
+
+static struct pipe to_device = { .deliver = Sim_UartRx };
+static struct pipe to_peer;
+static uint64_t rng;
+
+/**
+ * xorshift64*: deterministic for a given seed, so a run can be repeated.
+ * @return uniform in [0, 1)
+ */
+static double rnd(void)
+{
+	if (rng == 0)
+		rng = Sim_Link.seed ? Sim_Link.seed : 1;
+	rng ^= rng >> 12;
+	rng ^= rng << 25;
+	rng ^= rng >> 27;
+	return (double)((rng * 0x2545F4914F6CDD1Dull) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/**
+ * @return 0 deliver *c (possibly corrupted), -1 lost
+ */
+static int impair(struct pipe *p, uint8_t *c)
+{
+	double ber = Sim_Link.ber;
+	uint8_t flip = 0;
+	int bit;
+
+	if (p->burst == 0 && Sim_Link.burst_rate > 0 && rnd() < Sim_Link.burst_rate) {
+		/* Geometric length with the configured mean */
+		p->burst = 1;
+		while (Sim_Link.burst_len > 1 && rnd() >= 1.0 / Sim_Link.burst_len)
+			p->burst++;
+		Sim_Link.bursts++;
+	}
+	if (p->burst) {
+		p->burst--;
+		ber = 0.5;
+	}
+	if (Sim_Link.drop > 0 && rnd() < Sim_Link.drop) {
+		Sim_Link.dropped++;
+		return -1;
+	}
+	if (ber > 0) {
+		for (bit = 0; bit < 10; bit++) {
+			if (rnd() >= ber)
+				continue;
+			if (bit == 0 || bit == 9) {
+				Sim_Link.dropped++;
+				return -1;
+			}
+			flip ^= (uint8_t)(1u << (bit - 1));
+		}
+	}
+	if (flip) {
+		*c ^= flip;
+		Sim_Link.corrupted++;
+	}
+	return 0;
+}
+
+/************************************************************************/
+static void pipe_deliver(void *arg)
+{
+	struct pipe *p = arg;
+	uint8_t c = p->q[p->tail % PIPE_SIZE].c;
+
+	p->tail++;
+	if (p->head != p->tail)
+		Sim_At(p->q[p->tail % PIPE_SIZE].t, pipe_deliver, p);
+	if (impair(p, &c) == 0 && p->deliver)
+		p->deliver(c);
+}
+
+/************************************************************************/
+static void pipe_push(struct pipe *p, uint8_t c, uint64_t delay)
+{
+	uint64_t t = Sim_Now + delay;
+
+	if (p->head - p->tail == PIPE_SIZE) {
+		fprintf(stderr, "sim: line buffer full, byte dropped\n");
+		return;
+	}
+	/* In order, and no closer than a character time when serialising */
+	if (p->slot) {
+		t += p->slot;
+		if (t < p->last + p->slot)
+			t = p->last + p->slot;
+	} else if (t < p->last) {
+		t = p->last;
+	}
+	p->last = t;
+	p->q[p->head % PIPE_SIZE].t = t;
+	p->q[p->head % PIPE_SIZE].c = c;
+	if (p->head++ == p->tail)
+		Sim_At(t, pipe_deliver, p);
+}
+
+/************************************************************************/
+static void pipe_send(struct pipe *p, uint8_t c, uint64_t delay)
+{
+	pipe_push(p, c, delay);
+	if (Sim_Link.dup > 0 && rnd() < Sim_Link.dup) {
+		Sim_Link.duplicated++;
+		pipe_push(p, c, delay);
+	}
+}
+
+/**
+ * @return latency plus a new jitter draw, ns
+ */
+static uint64_t delay(void)
+{
+	uint64_t ns = (uint64_t)Sim_Link.latency_us * 1000;
+
+	if (Sim_Link.jitter_us)
+		ns += (uint64_t)(rnd() * Sim_Link.jitter_us * 1000);
+	return ns;
+}
+
+/************************************************************************/
+void Sim_LinkSetPeer(void (*rx)(uint8_t c))
+{
+	to_peer.deliver = rx;
+}
+
+/**
+ * Queue bytes from the peer.
+ */
+void Sim_LinkSend(const uint8_t *data, uint32_t len)
+{
+	uint64_t ns = delay();
+
+	to_device.slot = Sim_CharTime();
+	while (len--)
+		pipe_send(&to_device, *data++, ns);
+}
+
+/**
+ * A byte has left the USART1 shift register.
+ */
+void Sim_LinkTx(uint8_t c)
+{
+	pipe_send(&to_peer, c, delay());
+}
+
+/**
+ * A byte the bus (sim_bus.c) has already put on the line, its stop bit
+ * at time t: it reaches USART1 after the latency.
+ */
+void Sim_LinkRxAt(uint64_t t, uint8_t c)
+{
+	to_device.slot = 0;
+	pipe_send(&to_device, c, (t > Sim_Now ? t - Sim_Now : 0) + (uint64_t)Sim_Link.latency_us * 1000);
+}
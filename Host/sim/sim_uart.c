@@ -0,0 +1,300 @@
+/*
+ * USART1 model, 8N1 with the FIFO disabled as MX_USART1_UART_Init() sets it
+ * up: a single receive data register (a second byte arriving before the
+ * handler has read the first is an overrun), a transmit data register in
+ * front of the shift register, idle line detection one frame after the last
+ * stop bit. The line to the peer is sim_link.c.
+ */
+#include <stdio.h>
+
+#include "sim.h"
+#include "stm32h5xx_hal.h"
+
+struct sim_uart Sim_Uart;
+USART_TypeDef Sim_Usart1;
+DMA_Channel_TypeDef Sim_Gpdma1Ch0;
+
+extern UART_HandleTypeDef huart1;
+
+static struct {
+	uint8_t rdr;
+	int rxne;
+	int ore;
+	int idle;
+	int on;                 /* ReceiveToIdle_IT armed */
+	uint8_t *buf;
+	uint16_t size;
+	uint16_t count;
+} rx;
+
+static struct {
+	const uint8_t *buf;
+	uint16_t len;
+	uint16_t pos;
+	int active;
+	int dma;
+	int dma_done;           /* GPDMA transfer complete flag */
+	int tc_ie;              /* HAL waits for TC to call TxCplt */
+	uint8_t tdr;
+	int tdr_full;
+	uint8_t shift;
+	int shifting;
+	int tc;
+} tx = { .tc = 1 };
+
+static void rx_idle(void *arg);
+static void tx_shifted(void *arg);
+
+/************************************************************************/
+uint32_t Sim_CharTime(void)
+{
+	return (uint32_t)(10ull * 1000000000ull / huart1.Init.BaudRate);
+}
+
+/**
+ * Hardware: the stop bit of a byte from the line has been sampled.
+ */
+void Sim_UartRx(uint8_t c)
+{
+	Sim_Uart.rx_bytes++;
+	if (rx.rxne) {
+		rx.ore = 1;
+		Sim_Uart.overruns++;
+	} else {
+		rx.rdr = c;
+		rx.rxne = 1;
+	}
+	if (rx.on)
+		Sim_IrqSet(USART1_IRQn);
+	/* Idle once a frame time passes without a start bit */
+	Sim_Cancel(rx_idle, NULL);
+	Sim_At(Sim_Now + Sim_CharTime(), rx_idle, NULL);
+}
+
+/************************************************************************/
+static void rx_idle(void *arg)
+{
+	(void)arg;
+	Sim_Uart.rx_idle++;
+	rx.idle = 1;
+	if (rx.on)
+		Sim_IrqSet(USART1_IRQn);
+}
+
+/**
+ * Move TDR into the idle shift register; the DMA refills TDR by itself.
+ */
+static void tx_kick(void)
+{
+	if (!tx.shifting && tx.tdr_full) {
+		tx.shift = tx.tdr;
+		tx.tdr_full = 0;
+		tx.shifting = 1;
+		tx.tc = 0;
+		Sim_At(Sim_Now + Sim_CharTime(), tx_shifted, NULL);
+	}
+	if (!tx.active || tx.tdr_full || tx.pos == tx.len)
+		return;
+	if (tx.dma) {
+		tx.tdr = tx.buf[tx.pos++];
+		tx.tdr_full = 1;
+		tx.tc = 0;
+		if (tx.pos == tx.len) {
+			tx.dma_done = 1;
+			Sim_IrqSet(GPDMA1_Channel0_IRQn);
+		}
+		tx_kick();
+	} else {
+		Sim_IrqSet(USART1_IRQn);        /* TXE */
+	}
+}
+
+/**
+ * Hardware: a byte has left the shift register.
+ */
+static void tx_shifted(void *arg)
+{
+	uint8_t c = tx.shift;
+
+	(void)arg;
+	Sim_Uart.tx_bytes++;
+	tx.shifting = 0;
+	tx_kick();
+	if (!tx.shifting && !tx.tdr_full) {
+		tx.tc = 1;
+		if (tx.active && tx.tc_ie)
+			Sim_IrqSet(USART1_IRQn);
+	}
+	Sim_LinkTx(c);
+}
+
+/**
+ * USART1_IRQn handler, HAL_UART_IRQHandler() for the modes serial.c uses.
+ */
+void Sim_UartIrq(void)
+{
+	if (rx.on && rx.rxne) {
+		rx.buf[rx.count++] = rx.rdr;
+		rx.rxne = 0;
+	}
+	if (rx.on && rx.ore) {
+		/* Blocking error: the reception is aborted, its data lost */
+		rx.ore = 0;
+		rx.on = 0;
+		huart1.RxState = HAL_UART_STATE_READY;
+		huart1.ErrorCode |= HAL_UART_ERROR_ORE;
+		HAL_UART_ErrorCallback(&huart1);
+	} else if (rx.on && rx.count == rx.size) {
+		rx.on = 0;
+		huart1.RxState = HAL_UART_STATE_READY;
+		huart1.RxEventType = HAL_UART_RXEVENT_TC;
+		HAL_UARTEx_RxEventCallback(&huart1, rx.count);
+	} else if (rx.on && rx.idle) {
+		rx.idle = 0;
+		if (rx.count != 0) {
+			rx.on = 0;
+			huart1.RxState = HAL_UART_STATE_READY;
+			huart1.RxEventType = HAL_UART_RXEVENT_IDLE;
+			HAL_UARTEx_RxEventCallback(&huart1, rx.count);
+		}
+	}
+
+	if (tx.active && !tx.dma && !tx.tdr_full && tx.pos < tx.len) {
+		tx.tdr = tx.buf[tx.pos++];
+		tx.tdr_full = 1;
+		tx.tc = 0;
+		if (tx.pos == tx.len)
+			tx.tc_ie = 1;
+		tx_kick();
+	}
+	if (tx.active && tx.tc_ie && tx.tc) {
+		tx.active = 0;
+		tx.tc_ie = 0;
+		huart1.gState = HAL_UART_STATE_READY;
+		HAL_UART_TxCpltCallback(&huart1);
+	}
+}
+
+/* HAL -----------------------------------------------------------------------*/
+HAL_StatusTypeDef HAL_UARTEx_ReceiveToIdle_IT(UART_HandleTypeDef *huart, uint8_t *pData, uint16_t Size)
+{
+	if (rx.on)
+		return HAL_BUSY;
+	if (pData == NULL || Size == 0)
+		return HAL_ERROR;
+	rx.buf = pData;
+	rx.size = Size;
+	rx.count = 0;
+	rx.idle = 0;
+	rx.on = 1;
+	huart->RxState = HAL_UART_STATE_BUSY_RX;
+	huart->ErrorCode = HAL_UART_ERROR_NONE;
+	if (rx.rxne || rx.ore)
+		Sim_IrqSet(USART1_IRQn);
+	return HAL_OK;
+}
+
+/************************************************************************/
+uint32_t HAL_UARTEx_GetRxEventType(UART_HandleTypeDef *huart)
+{
+	return huart->RxEventType;
+}
+
+/************************************************************************/
+static HAL_StatusTypeDef tx_start(UART_HandleTypeDef *huart, const uint8_t *pData, uint16_t Size, int dma)
+{
+	if (tx.active)
+		return HAL_BUSY;
+	if (pData == NULL || Size == 0)
+		return HAL_ERROR;
+	tx.buf = pData;
+	tx.len = Size;
+	tx.pos = 0;
+	tx.dma = dma;
+	tx.dma_done = 0;
+	tx.tc_ie = 0;
+	tx.active = 1;
+	huart->gState = HAL_UART_STATE_BUSY_TX;
+	tx_kick();
+	return HAL_OK;
+}
+
+/************************************************************************/
+HAL_StatusTypeDef HAL_UART_Transmit_IT(UART_HandleTypeDef *huart, const uint8_t *pData, uint16_t Size)
+{
+	return tx_start(huart, pData, Size, 0);
+}
+
+/************************************************************************/
+HAL_StatusTypeDef HAL_UART_Transmit_DMA(UART_HandleTypeDef *huart, const uint8_t *pData, uint16_t Size)
+{
+	return tx_start(huart, pData, Size, 1);
+}
+
+/************************************************************************/
+HAL_StatusTypeDef HAL_UART_Abort(UART_HandleTypeDef *huart)
+{
+	rx.on = 0;
+	tx.active = 0;
+	tx.tc_ie = 0;
+	huart->gState = HAL_UART_STATE_READY;
+	huart->RxState = HAL_UART_STATE_READY;
+	return HAL_OK;
+}
+
+/**
+ * Busy loops on a flag give the interrupts a chance to change it.
+ */
+FlagStatus Sim_UartFlag(UART_HandleTypeDef *huart, uint32_t flag)
+{
+	int set = 0;
+
+	(void)huart;
+	if (flag == UART_FLAG_TC)
+		set = tx.tc;
+	else if (flag == UART_FLAG_RXNE)
+		set = rx.rxne;
+	if (!set)
+		Sim_Idle();
+	return set ? SET : RESET;
+}
+
+/************************************************************************/
+HAL_StatusTypeDef HAL_DMA_Init(DMA_HandleTypeDef *hdma)
+{
+	(void)hdma;
+	return HAL_OK;
+}
+
+/**
+ * GPDMA1 channel 0 transfer complete: the UART HAL then waits for TC.
+ */
+void HAL_DMA_IRQHandler(DMA_HandleTypeDef *hdma)
+{
+	(void)hdma;
+	if (tx.dma_done) {
+		tx.dma_done = 0;
+		tx.tc_ie = 1;
+		if (tx.tc)
+			Sim_IrqSet(USART1_IRQn);
+	}
+}
+
+/************************************************************************/
+__weak void HAL_UARTEx_RxEventCallback(UART_HandleTypeDef *huart, uint16_t Size)
+{
+	(void)huart;
+	(void)Size;
+}
+
+/************************************************************************/
+__weak void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart)
+{
+	(void)huart;
+}
+
+/************************************************************************/
+__weak void HAL_UART_ErrorCallback(UART_HandleTypeDef *huart)
+{
+	(void)huart;
+}
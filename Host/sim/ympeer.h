@@ -0,0 +1,82 @@
+/*
+ * Reference YModem peers, the PC side of a session, driven by the bytes
+ * the device sends and simulation timers: a sender for `update`, of one
+ * file or a batch, and a receiver for `upload`. Written from the protocol, not from ymodem.c, so
+ * the simulation checks the engines against an independent implementation.
+ */
+#ifndef YMPEER_H
+#define YMPEER_H
+
+#include <stdint.h>
+
+/* Results, times in ns */
+struct ympeer_stats {
+	int status;             /* 0 running, 1 done, -1 gave up, -2 cancelled */
+	uint64_t t_start;       /* first 'C' */
+	uint64_t t_first_ack;   /* file name packet acknowledged */
+	uint64_t t_end;         /* end of batch acknowledged */
+	uint32_t packets;       /* data packets accepted */
+	uint32_t resends;       /* packets sent (sender) or asked for (receiver) again */
+	uint32_t timeouts;
+	uint32_t bytes_sent;    /* everything the peer put on the line */
+	uint32_t wasted;        /* line bytes that carried no accepted packet */
+	/* Recovery: from the last progress before a fault to the next one */
+	uint32_t recoveries;
+	uint64_t recovery_ns;
+	uint64_t recovery_max_ns;
+};
+
+#define YMSEND_FILES_MAX        8
+
+struct ymsend_file {
+	const uint8_t *data;
+	uint32_t size;
+	const char *name;       /* "part:name" selects the partition */
+};
+
+struct ymsend {
+	/* set by the caller */
+	struct ymsend_file file[YMSEND_FILES_MAX];      /* sent in one batch */
+	int files;
+	uint16_t packet;        /* payload bytes per data packet, 8..2048 */
+	void (*done)(struct ymsend *s);
+	struct ympeer_stats st;
+};
+
+struct ymrecv {
+	/* set by the caller */
+	uint8_t *buf;
+	uint32_t cap;
+	void (*done)(struct ymrecv *r);
+	/* the file */
+	char name[64];
+	uint32_t size;          /* from the file name packet */
+	uint32_t received;
+	uint16_t packet;        /* largest data packet seen */
+	struct ympeer_stats st;
+};
+
+int Ymsend_Start(struct ymsend *s);
+void Ymsend_Rx(uint8_t c);
+
+void Ymrecv_Start(struct ymrecv *r);
+void Ymrecv_Rx(uint8_t c);
+
+/**
+ * The session moved on at time now; *last is the previous progress, *fault
+ * set when something went wrong in between.
+ */
+static inline void Ympeer_Progress(struct ympeer_stats *st, uint64_t now,
+				   uint64_t *last, int *fault)
+{
+	if (*fault) {
+		*fault = 0;
+		st->recoveries++;
+		st->recovery_ns += now - *last;
+		if (now - *last > st->recovery_max_ns)
+			st->recovery_max_ns = now - *last;
+	}
+	*last = now;
+}
+
+#endif
@@ -0,0 +1,320 @@
+/*
+ * Reference YModem receiver. Accepts SOH/STX and every STX_xxx packet
+ * size, NAKs a damaged packet once the line has gone quiet (the rest of
+ * it may still be coming), ACKs a repeated one and asks again with 'C' or
+ * NAK after a second of silence. Like lrzsz it NAKs the first EOT and
+ * takes the repeated one, so a stray 0x04 in the stream (a start byte
+ * lost, the payload read as start bytes) does not end the file.
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "sim.h"
+#include "ymodem.h"
+#include "ympeer.h"
+
+#define YMRECV_TIMEOUT_NS       1000000000ull
+#define YMRECV_PURGE_NS         20000000ull     /* silence before a NAK */
+#define YMRECV_RETRIES          10
+
+enum {
+	YR_IDLE = 0,
+	YR_HEADER,              /* 'C' sent, waiting for the file name packet */
+	YR_DATA,
+	YR_END                  /* EOT acknowledged, waiting for the empty name */
+};
+
+static struct ymrecv *cur;
+static int state;
+static uint8_t expect;          /* sequence number of the next data packet */
+static int tries;
+static int ca;
+static int eot;                 /* first EOT NAKed */
+static int purge;               /* dropping bytes until the line is quiet */
+static uint64_t progress;
+static int fault;
+static uint8_t pkt[PACKET_8KB_SIZE + PACKET_OVERHEAD];
+static uint32_t need, count, size;
+
+static void timeout(void *arg);
+static void purged(void *arg);
+
+/************************************************************************/
+static uint16_t crc16(const uint8_t *p, uint32_t n)
+{
+	uint16_t crc = 0;
+	int i;
+
+	while (n--) {
+		crc ^= (uint16_t)*p++ << 8;
+		for (i = 0; i < 8; i++)
+			crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+	}
+	return crc;
+}
+
+/************************************************************************/
+static uint32_t packet_size(uint8_t c)
+{
+	switch (c) {
+	case SOH: return PACKET_128B_SIZE;
+	case STX: return PACKET_1KB_SIZE;
+	case STX_8B: return PACKET_8B_SIZE;
+	case STX_16B: return PACKET_16B_SIZE;
+	case STX_32B: return PACKET_32B_SIZE;
+	case STX_64B: return PACKET_64B_SIZE;
+	case STX_128B: return PACKET_128B_SIZE;
+	case STX_256B: return PACKET_256B_SIZE;
+	case STX_512B: return PACKET_512B_SIZE;
+	case STX_1KB: return PACKET_1KB_SIZE;
+	case STX_2KB: return PACKET_2KB_SIZE;
+	case STX_4KB: return PACKET_4KB_SIZE;
+	case STX_8KB: return PACKET_8KB_SIZE;
+	default: return 0;
+	}
+}
+
+/************************************************************************/
+static void send(uint8_t c)
+{
+	cur->st.bytes_sent++;
+	Sim_LinkSend(&c, 1);
+}
+
+/************************************************************************/
+static void arm(void)
+{
+	Sim_Cancel(timeout, NULL);
+	Sim_At(Sim_Now + YMRECV_TIMEOUT_NS, timeout, NULL);
+}
+
+/************************************************************************/
+static void finish(int status)
+{
+	Sim_Cancel(timeout, NULL);
+	Sim_Cancel(purged, NULL);
+	state = YR_IDLE;
+	cur->st.status = status;
+	cur->st.t_end = Sim_Now;
+	if (cur->done)
+		cur->done(cur);
+}
+
+/************************************************************************/
+static void moved_on(void)
+{
+	tries = 0;
+	Ympeer_Progress(&cur->st, Sim_Now, &progress, &fault);
+}
+
+/**
+ * Ask for the packet again: 'C' while waiting for a file name packet
+ * (the sender only starts on it), NAK otherwise.
+ */
+static void again(void)
+{
+	if (++tries > YMRECV_RETRIES) {
+		send(CA);
+		send(CA);
+		finish(-1);
+		return;
+	}
+	cur->st.resends++;
+	fault = 1;
+	send(state == YR_DATA ? NAK : CRC16);
+}
+
+/**
+ * Something arrived damaged: ask again once the line is quiet.
+ */
+static void reject(void)
+{
+	purge = 1;
+	need = count = 0;
+	Sim_Cancel(purged, NULL);
+	Sim_At(Sim_Now + YMRECV_PURGE_NS, purged, NULL);
+}
+
+/************************************************************************/
+static void purged(void *arg)
+{
+	(void)arg;
+	purge = 0;
+	if (state != YR_IDLE)
+		again();
+}
+
+/************************************************************************/
+static void timeout(void *arg)
+{
+	(void)arg;
+	cur->st.timeouts++;
+	need = count = 0;
+	again();
+	if (state != YR_IDLE)
+		arm();
+}
+
+/************************************************************************/
+static void header(void)
+{
+	const char *name = (const char *)pkt + PACKET_HEADER;
+
+	if (state == YR_END || name[0] == '\0') {
+		/* End of the batch: one file is all the device sends */
+		send(ACK);
+		moved_on();
+		finish(state == YR_END ? 1 : -1);
+		return;
+	}
+	if (state == YR_DATA) {
+		/* Our ACK was lost */
+		cur->st.wasted += size + PACKET_OVERHEAD;
+		send(ACK);
+		send(CRC16);
+		return;
+	}
+	snprintf(cur->name, sizeof(cur->name), "%.*s", (int)sizeof(cur->name) - 1, name);
+	sscanf(name + strlen(name) + 1, "%u", &cur->size);
+	cur->st.t_first_ack = Sim_Now;
+	send(ACK);
+	send(CRC16);
+	state = YR_DATA;
+	expect = 1;
+	moved_on();
+}
+
+/************************************************************************/
+static void data(void)
+{
+	uint32_t n;
+
+	if (pkt[1] != expect) {
+		cur->st.wasted += size + PACKET_OVERHEAD;
+		if (pkt[1] == (uint8_t)(expect - 1)) {
+			send(ACK);
+		} else {
+			fault = 1;
+			send(NAK);
+		}
+		return;
+	}
+	n = cur->size - cur->received;
+	if (n > size)
+		n = size;
+	if (cur->received + n > cur->cap)
+		n = cur->cap - cur->received;
+	memcpy(cur->buf + cur->received, pkt + PACKET_HEADER, n);
+	cur->received += n;
+	if (size > cur->packet)
+		cur->packet = (uint16_t)size;
+	cur->st.packets++;
+	expect++;
+	send(ACK);
+	moved_on();
+}
+
+/************************************************************************/
+static void packet(void)
+{
+	uint16_t crc = (uint16_t)(pkt[PACKET_HEADER + size] << 8 | pkt[PACKET_HEADER + size + 1]);
+
+	need = count = 0;
+	if ((uint8_t)(pkt[1] ^ pkt[2]) != 0xFF || crc16(pkt + PACKET_HEADER, size) != crc) {
+		cur->st.wasted += size + PACKET_OVERHEAD;
+		reject();
+		return;
+	}
+	if (pkt[1] == 0 && (state != YR_DATA || expect == 1))
+		header();
+	else if (state == YR_DATA)
+		data();
+	else
+		again();
+}
+
+/************************************************************************/
+static void start_byte(uint8_t c)
+{
+	if (c == EOT && state == YR_DATA && !eot) {
+		eot = 1;
+		send(NAK);
+		return;
+	}
+	if (c == EOT && state == YR_DATA) {
+		eot = 0;
+		send(ACK);
+		send(CRC16);
+		state = YR_END;
+		moved_on();
+		return;
+	}
+	if (c == EOT && state == YR_END) {
+		/* Our ACK was lost */
+		cur->st.wasted++;
+		send(ACK);
+		send(CRC16);
+		return;
+	}
+	size = packet_size(c);
+	if (size == 0) {
+		cur->st.wasted++;
+		reject();
+		return;
+	}
+	eot = 0;
+	pkt[0] = c;
+	count = 1;
+	need = size + PACKET_OVERHEAD - 1;
+}
+
+/**
+ * A byte from the device.
+ */
+void Ymrecv_Rx(uint8_t c)
+{
+	if (cur == NULL || state == YR_IDLE)
+		return;
+	arm();
+	if (purge) {
+		cur->st.wasted++;
+		reject();
+		return;
+	}
+	if (need == 0 && c == CA) {
+		if (ca++)
+			finish(-2);
+		return;
+	}
+	if (need == 0)
+		ca = 0;
+	if (need == 0) {
+		start_byte(c);
+		return;
+	}
+	pkt[count++] = c;
+	if (--need == 0)
+		packet();
+}
+
+/**
+ * Start a session: ask for the file name packet.
+ */
+void Ymrecv_Start(struct ymrecv *r)
+{
+	cur = r;
+	memset(&r->st, 0, sizeof(r->st));
+	r->name[0] = '\0';
+	r->size = r->received = 0;
+	r->packet = 0;
+	state = YR_HEADER;
+	tries = 0;
+	ca = 0;
+	eot = 0;
+	purge = 0;
+	fault = 0;
+	need = count = 0;
+	r->st.t_start = progress = Sim_Now;
+	send(CRC16);
+	arm();
+}
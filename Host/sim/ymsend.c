@@ -0,0 +1,293 @@
+/*
+ * Reference YModem sender. Data packets use the STX_xxx start byte of the
+ * configured size; the file name packets are plain 128-byte SOH packets.
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "sim.h"
+#include "ymodem.h"
+#include "ympeer.h"
+
+#define YMSEND_TIMEOUT_NS       3000000000ull
+#define YMSEND_RETRIES          10
+
+enum {
+	YS_IDLE = 0,
+	YS_WAIT_C,              /* waiting for the receiver's first 'C' */
+	YS_HEADER,              /* file name packet sent */
+	YS_DATA_C,              /* header acknowledged, waiting for 'C' */
+	YS_DATA,                /* data packet sent */
+	YS_EOT,
+	YS_END_C,               /* EOT acknowledged, waiting for 'C' */
+	YS_END                  /* empty file name packet sent */
+};
+
+static struct ymsend *cur;
+static const struct ymsend_file *file;  /* being sent */
+static int state;
+static uint32_t offset;         /* of the packet in flight */
+static uint8_t seq;
+static int tries;
+static int ca;
+static uint64_t progress;       /* last packet acknowledged */
+static int fault;
+static uint8_t pkt[PACKET_2KB_SIZE + PACKET_OVERHEAD];
+static uint32_t pkt_len;
+
+static void timeout(void *arg);
+
+/************************************************************************/
+static uint16_t crc16(const uint8_t *p, uint32_t n)
+{
+	uint16_t crc = 0;
+	int i;
+
+	while (n--) {
+		crc ^= (uint16_t)*p++ << 8;
+		for (i = 0; i < 8; i++)
+			crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+	}
+	return crc;
+}
+
+/************************************************************************/
+static uint8_t start_byte(uint16_t size)
+{
+	switch (size) {
+	case PACKET_8B_SIZE: return STX_8B;
+	case PACKET_16B_SIZE: return STX_16B;
+	case PACKET_32B_SIZE: return STX_32B;
+	case PACKET_64B_SIZE: return STX_64B;
+	case PACKET_128B_SIZE: return STX_128B;
+	case PACKET_256B_SIZE: return STX_256B;
+	case PACKET_512B_SIZE: return STX_512B;
+	case PACKET_1KB_SIZE: return STX_1KB;
+	case PACKET_2KB_SIZE: return STX_2KB;
+	default: return 0;
+	}
+}
+
+/************************************************************************/
+static void build(uint8_t start, uint8_t n, const uint8_t *data, uint32_t len, uint32_t size)
+{
+	uint16_t crc;
+
+	pkt[0] = start;
+	pkt[1] = n;
+	pkt[2] = (uint8_t)~n;
+	memcpy(pkt + PACKET_HEADER, data, len);
+	memset(pkt + PACKET_HEADER + len, start == SOH ? 0 : 0x1A, size - len);
+	crc = crc16(pkt + PACKET_HEADER, size);
+	pkt[PACKET_HEADER + size] = (uint8_t)(crc >> 8);
+	pkt[PACKET_HEADER + size + 1] = (uint8_t)crc;
+	pkt_len = size + PACKET_OVERHEAD;
+}
+
+/************************************************************************/
+static void send(const uint8_t *p, uint32_t n)
+{
+	cur->st.bytes_sent += n;
+	Sim_LinkSend(p, n);
+	Sim_Cancel(timeout, NULL);
+	Sim_At(Sim_Now + (uint64_t)n * Sim_CharTime() + YMSEND_TIMEOUT_NS, timeout, NULL);
+}
+
+/************************************************************************/
+static void send_header(int last)
+{
+	uint8_t block[PACKET_128B_SIZE];
+	int n = 0;
+
+	memset(block, 0, sizeof(block));
+	if (!last) {
+		n = snprintf((char *)block, sizeof(block), "%s", file->name) + 1;
+		snprintf((char *)block + n, sizeof(block) - n, "%u", file->size);
+	}
+	build(SOH, 0, block, sizeof(block), PACKET_128B_SIZE);
+	send(pkt, pkt_len);
+}
+
+/************************************************************************/
+static void send_data(void)
+{
+	uint32_t len = file->size - offset;
+
+	if (len > cur->packet)
+		len = cur->packet;
+	build(start_byte(cur->packet), seq, file->data + offset, len, cur->packet);
+	send(pkt, pkt_len);
+}
+
+/************************************************************************/
+static void finish(int status)
+{
+	Sim_Cancel(timeout, NULL);
+	state = YS_IDLE;
+	cur->st.status = status;
+	cur->st.t_end = Sim_Now;
+	if (cur->done)
+		cur->done(cur);
+}
+
+/************************************************************************/
+static void resend(void)
+{
+	static const uint8_t eot = EOT;
+
+	if (++tries > YMSEND_RETRIES) {
+		finish(-1);
+		return;
+	}
+	cur->st.resends++;
+	fault = 1;
+	if (state == YS_EOT) {
+		cur->st.wasted++;
+		send(&eot, 1);
+	} else {
+		cur->st.wasted += pkt_len;
+		send(pkt, pkt_len);
+	}
+}
+
+/************************************************************************/
+static void timeout(void *arg)
+{
+	(void)arg;
+	cur->st.timeouts++;
+	fault = 1;
+	if (state == YS_WAIT_C || state == YS_DATA_C || state == YS_END_C) {
+		if (++tries > YMSEND_RETRIES)
+			finish(-1);
+		else
+			Sim_At(Sim_Now + YMSEND_TIMEOUT_NS, timeout, NULL);
+		return;
+	}
+	resend();
+}
+
+/************************************************************************/
+static void next_packet(void)
+{
+	static const uint8_t eot = EOT;
+
+	tries = 0;
+	if (offset >= file->size) {
+		state = YS_EOT;
+		send(&eot, 1);
+		return;
+	}
+	state = YS_DATA;
+	send_data();
+}
+
+/**
+ * A byte from the device.
+ */
+void Ymsend_Rx(uint8_t c)
+{
+	if (cur == NULL || state == YS_IDLE)
+		return;
+	if (c == CA) {
+		if (ca++)
+			finish(-2);
+		return;
+	}
+	ca = 0;
+	switch (state) {
+	case YS_WAIT_C:
+		if (c != CRC16)
+			break;
+		cur->st.t_start = Sim_Now;
+		progress = Sim_Now;
+		state = YS_HEADER;
+		tries = 0;
+		send_header(0);
+		break;
+	case YS_HEADER:
+		if (c == ACK) {
+			if (cur->st.t_first_ack == 0)
+				cur->st.t_first_ack = Sim_Now;
+			Ympeer_Progress(&cur->st, Sim_Now, &progress, &fault);
+			state = YS_DATA_C;
+			tries = 0;
+		} else if (c == NAK || c == CRC16) {
+			resend();
+		}
+		break;
+	case YS_DATA_C:
+		if (c == CRC16) {
+			seq = 1;
+			offset = 0;
+			next_packet();
+		}
+		break;
+	case YS_DATA:
+		if (c == ACK) {
+			cur->st.packets++;
+			Ympeer_Progress(&cur->st, Sim_Now, &progress, &fault);
+			offset += cur->packet;
+			seq++;
+			next_packet();
+		} else if (c == NAK || c == CRC16) {
+			resend();
+		}
+		break;
+	case YS_EOT:
+		if (c == ACK) {
+			Ympeer_Progress(&cur->st, Sim_Now, &progress, &fault);
+			state = YS_END_C;
+			tries = 0;
+		} else if (c == NAK) {
+			resend();
+		}
+		break;
+	case YS_END_C:
+		if (c != CRC16)
+			break;
+		tries = 0;
+		if (++file < cur->file + cur->files) {
+			/* The next file of the batch */
+			state = YS_HEADER;
+			send_header(0);
+		} else {
+			state = YS_END;
+			send_header(1);
+		}
+		break;
+	case YS_END:
+		if (c == ACK) {
+			Ympeer_Progress(&cur->st, Sim_Now, &progress, &fault);
+			finish(1);
+		}
+		else if (c == NAK || c == CRC16)
+			resend();
+		break;
+	}
+}
+
+/**
+ * Start a session; the receiver's 'C' begins the transfer of the first file.
+ * @return 0 started, -1 bad packet size, name or file count
+ */
+int Ymsend_Start(struct ymsend *s)
+{
+	int i;
+
+	if (start_byte(s->packet) == 0 || s->files < 1 || s->files > YMSEND_FILES_MAX)
+		return -1;
+	for (i = 0; i < s->files; i++) {
+		if (strlen(s->file[i].name) > PACKET_128B_SIZE - FILE_SIZE_LENGTH - 2)
+			return -1;
+	}
+	cur = s;
+	file = s->file;
+	memset(&s->st, 0, sizeof(s->st));
+	state = YS_WAIT_C;
+	tries = 0;
+	ca = 0;
+	fault = 0;
+	Sim_Cancel(timeout, NULL);
+	Sim_At(Sim_Now + YMSEND_TIMEOUT_NS, timeout, NULL);
+	return 0;
+}
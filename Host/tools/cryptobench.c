@@ -0,0 +1,262 @@
+/*
+ * cryptobench - known answer checks and host timings of the bootloader's
+ * crypto code (IAP/src/sha256.c, ed25519.c, chacha20.c), built from the
+ * same sources as the firmware.
+ *
+ *   cryptobench [MBYTES]       hash MBYTES (16) for the timing
+ *
+ * The known answers are FIPS 180-2 for SHA-256, fed whole and in odd
+ * pieces at odd alignments, the first RFC 8032 tests for Ed25519 and the
+ * RFC 8439 encryption test for ChaCha20, also in pieces.
+ * Timings are in host nanoseconds and, on x86, TSC cycles. The exit
+ * status is 1 if a check failed.
+ */
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "sha256.h"
+#include "ed25519.h"
+#include "chacha20.h"
+
+static int failures;
+
+static void hex(const char *s, uint8_t *out)
+{
+	unsigned byte;
+
+	while (*s && sscanf(s, "%2x", &byte) == 1) {
+		*out++ = (uint8_t)byte;
+		s += 2;
+	}
+}
+
+static void check(const char *name, const uint8_t *got, const char *want_hex, size_t len)
+{
+	uint8_t want[64];
+
+	hex(want_hex, want);
+	if (memcmp(got, want, len) != 0) {
+		printf("FAIL %s\n", name);
+		failures++;
+	} else {
+		printf("ok   %s\n", name);
+	}
+}
+
+static double now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static uint64_t cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+static void sha256_kat(void)
+{
+	static const char abc448[] = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+	static const char *million = "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0";
+	uint8_t digest[SHA256_DIGEST_SIZE], *buf;
+	uint32_t off, piece;
+	Sha256_Ctx ctx;
+
+	Sha256((const uint8_t *)"", 0, digest);
+	check("sha256 empty", digest, "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855", 32);
+	Sha256((const uint8_t *)"abc", 3, digest);
+	check("sha256 abc", digest, "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad", 32);
+	Sha256((const uint8_t *)abc448, sizeof(abc448) - 1, digest);
+	check("sha256 448 bits", digest, "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1", 32);
+
+	buf = malloc(1000000 + 3);
+	memset(buf, 'a', 1000000 + 3);
+	Sha256(buf, 1000000, digest);
+	check("sha256 million a", digest, million, 32);
+	/* Pieces of 1 to 200 bytes, from every alignment */
+	Sha256_Init(&ctx);
+	for (off = 0, piece = 1; off < 1000000; off += piece, piece = piece % 200 + 1) {
+		if (piece > 1000000 - off)
+			piece = 1000000 - off;
+		Sha256_Update(&ctx, buf + 3 - off % 4 + off, piece);
+	}
+	Sha256_Final(&ctx, digest);
+	check("sha256 million a, pieces", digest, million, 32);
+	free(buf);
+}
+
+static void ed25519_kat(void)
+{
+	static const struct {
+		const char *seed, *pub, *msg, *sig;
+	} tests[] = {
+		{ "9d61b19deffd5a60ba844af492ec2cc44449c5697b326919703bac031cae7f60",
+		  "d75a980182b10ab7d54bfed3c964073a0ee172f3daa62325af021a68f707511a", "",
+		  "e5564300c360ac729086e2cc806e828a84877f1eb8e5d974d873e06522490155"
+		  "5fb8821590a33bacc61e39701cf9b46bd25bf5f0595bbe24655141438e7a100b" },
+		{ "4ccd089b28ff96da9db6c346ec114e0f5b8a319f35aba624da8cf6ed4fb8a6fb",
+		  "3d4017c3e843895a92b70aa74d1b7ebc9c982ccf2ec4968cc0cd55f12af4660c", "72",
+		  "92a009a9f0d4cab8720e820b5f642540a2b27b5416503f8fb3762223ebdb69da"
+		  "085ac1e43e15996e458f3613d0f11d8c387b2eaeb4302aeeb00d291612bb0c00" },
+		{ "c5aa8df43f9f837bedb7442f31dcb7b166d38535076f094b85ce3a2e0b4458f7",
+		  "fc51cd8e6218a1a38da47ed00230f0580816ed13ba3303ac5deb911548908025", "af82",
+		  "6291d657deec24024827e69c3abe01a30ce548a284743a445e3680d7db5ac3ac"
+		  "18ff9b538d16f290ae67f760984dc6594a7c15e9716ed28dc027beceea1ec40a" },
+	};
+	uint8_t seed[32], pub[32], msg[8] = { 0 }, sig[64];
+	uint32_t i, len;
+	char name[40];
+
+	for (i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+		hex(tests[i].seed, seed);
+		hex(tests[i].msg, msg);
+		len = strlen(tests[i].msg) / 2;
+		Ed25519_PublicKey(pub, seed);
+		snprintf(name, sizeof(name), "ed25519 test %u public key", i + 1);
+		check(name, pub, tests[i].pub, 32);
+		Ed25519_Sign(sig, msg, len, seed);
+		snprintf(name, sizeof(name), "ed25519 test %u signature", i + 1);
+		check(name, sig, tests[i].sig, 64);
+		snprintf(name, sizeof(name), "ed25519 test %u verify", i + 1);
+		if (Ed25519_Verify(sig, msg, len, pub) != 0) {
+			printf("FAIL %s\n", name);
+			failures++;
+		} else {
+			printf("ok   %s\n", name);
+		}
+		/* A flipped bit in R, in S, or in the message */
+		sig[3] ^= 0x10;
+		snprintf(name, sizeof(name), "ed25519 test %u forgeries", i + 1);
+		if (Ed25519_Verify(sig, msg, len, pub) == 0 ||
+		    (sig[3] ^= 0x10, sig[40] ^= 1, Ed25519_Verify(sig, msg, len, pub) == 0) ||
+		    (sig[40] ^= 1, msg[0] ^= 1, Ed25519_Verify(sig, msg, len + (len == 0), pub) == 0)) {
+			printf("FAIL %s\n", name);
+			failures++;
+		} else {
+			printf("ok   %s\n", name);
+		}
+	}
+}
+
+static void chacha20_kat(void)
+{
+	static const char text[] = "Ladies and Gentlemen of the class of '99: If I could offer you only one "
+				    "tip for the future, sunscreen would be it.";
+	static const char *want =
+		"6e2e359a2568f98041ba0728dd0d6981e97e7aec1d4360c20a27afccfd9fae0b"
+		"f91b65c5524733ab8f593dabcd62b3571639d624e65152ab8f530c359f0861d8"
+		"07ca0dbf500d6a6156a38e088a22b65e52bc514d16ccf806818ce91ab7793736"
+		"5af90bbf74a35be6b40b8eedf2785e42874d";
+	uint8_t key[32], nonce[12] = { 0, 0, 0, 0, 0, 0, 0, 0x4a }, buf[sizeof(text) + 3], expect[sizeof(text)];
+	uint32_t i, off, piece;
+	ChaCha20_Ctx ctx;
+
+	for (i = 0; i < sizeof(key); i++)
+		key[i] = (uint8_t)i;
+	hex(want, expect);
+	memcpy(buf, text, sizeof(text) - 1);
+	ChaCha20_Init(&ctx, key, nonce, 1);
+	ChaCha20_Xor(&ctx, buf, sizeof(text) - 1);
+	if (memcmp(buf, expect, sizeof(text) - 1) != 0) {
+		printf("FAIL chacha20 rfc8439 2.4.2\n");
+		failures++;
+	} else {
+		printf("ok   chacha20 rfc8439 2.4.2\n");
+	}
+	/* Pieces of 1 to 13 bytes, unaligned */
+	memcpy(buf + 3, text, sizeof(text) - 1);
+	ChaCha20_Init(&ctx, key, nonce, 1);
+	for (off = 0, piece = 1; off < sizeof(text) - 1; off += piece, piece = piece % 13 + 1) {
+		if (piece > sizeof(text) - 1 - off)
+			piece = sizeof(text) - 1 - off;
+		ChaCha20_Xor(&ctx, buf + 3 + off, piece);
+	}
+	if (memcmp(buf + 3, expect, sizeof(text) - 1) != 0) {
+		printf("FAIL chacha20 rfc8439 2.4.2, pieces\n");
+		failures++;
+	} else {
+		printf("ok   chacha20 rfc8439 2.4.2, pieces\n");
+	}
+}
+
+static void bench(uint32_t mbytes)
+{
+	uint8_t digest[SHA256_DIGEST_SIZE], seed[32] = { 1 }, pub[32], sig[64];
+	uint32_t size = 1 << 20, i, runs = 20;
+	uint8_t *buf = malloc(size);
+	uint64_t c0, c1;
+	double t0, t1;
+	Sha256_Ctx ctx;
+	ChaCha20_Ctx cc;
+
+	for (i = 0; i < size; i++)
+		buf[i] = (uint8_t)(i * 2654435761u >> 24);
+	/* 1 KB pieces, as the YModem packets come */
+	Sha256_Init(&ctx);
+	t0 = now_ns();
+	c0 = cycles();
+	for (i = 0; i < mbytes * 1024; i++)
+		Sha256_Update(&ctx, buf + (i % 1024) * 1024, 1024);
+	Sha256_Final(&ctx, digest);
+	c1 = cycles();
+	t1 = now_ns();
+	printf("sha256:  %u MB, %.2f ns/byte", mbytes, (t1 - t0) / ((double)mbytes * size));
+	if (c1 != c0)
+		printf(", %.2f cycles/byte", (double)(c1 - c0) / ((double)mbytes * size));
+	printf("\n");
+
+	ChaCha20_Init(&cc, seed, seed, 0);
+	t0 = now_ns();
+	c0 = cycles();
+	for (i = 0; i < mbytes * 1024; i++)
+		ChaCha20_Xor(&cc, buf + (i % 1024) * 1024, 1024);
+	c1 = cycles();
+	t1 = now_ns();
+	printf("chacha20: %u MB, %.2f ns/byte", mbytes, (t1 - t0) / ((double)mbytes * size));
+	if (c1 != c0)
+		printf(", %.2f cycles/byte", (double)(c1 - c0) / ((double)mbytes * size));
+	printf("\n");
+
+	Ed25519_PublicKey(pub, seed);
+	Ed25519_Sign(sig, digest, sizeof(digest), seed);
+	t0 = now_ns();
+	c0 = cycles();
+	for (i = 0; i < runs; i++)
+		failures += Ed25519_Verify(sig, digest, sizeof(digest), pub) != 0;
+	c1 = cycles();
+	t1 = now_ns();
+	printf("ed25519: verify %.3f ms", (t1 - t0) / 1e6 / runs);
+	if (c1 != c0)
+		printf(", %.2f Mcycles", (double)(c1 - c0) / 1e6 / runs);
+	printf("\n");
+	free(buf);
+}
+
+int main(int argc, char **argv)
+{
+	uint32_t mbytes = argc > 1 ? (uint32_t)atoi(argv[1]) : 16;
+
+	if (argc > 2 || mbytes == 0) {
+		fprintf(stderr, "usage: cryptobench [MBYTES]\n");
+		return 2;
+	}
+	sha256_kat();
+	ed25519_kat();
+	chacha20_kat();
+	bench(mbytes);
+	printf("%s\n", failures ? "FAILED" : "all checks passed");
+	return failures ? 1 : 0;
+}
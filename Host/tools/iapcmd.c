@@ -0,0 +1,685 @@
+/*
+ * iapcmd - reference host client for the bootloader binary command protocol
+ * (IAP/inc/bincmd.h).
+ *
+ *   iapcmd [-p /dev/ttyUSB0] [-b 115200] info
+ *   iapcmd ... erase ADDR SIZE
+ *   iapcmd ... read ADDR SIZE OUT.bin
+ *   iapcmd ... verify ADDR SIZE
+ *   iapcmd ... boot
+ *   iapcmd ... stats                         counters of the session
+ *   iapcmd ... provision IMAGE.bin [ADDR]    erase, write, verify, boot; an
+ *                                            application must be signed (mksign)
+ *   iapcmd ... addr N                        bus address, 0 to leave the bus
+ *   iapcmd ... busupdate IMAGE.bin N[,N...]  application to the nodes of an
+ *                                            RS-485 bus at once
+ *
+ * The bootloader must be sitting at its menu prompt. Writes are pipelined:
+ * up to BINCMD_WINDOW requests are in flight before the first answer is read.
+ * A bus update (IAP/inc/busupdate.h) sends the image once to all nodes,
+ * then asks each for the packets it missed and sends those again to all,
+ * until every node has checked the image; an encrypted file (mkenc) goes
+ * without its header, the nonce with BEGIN.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/select.h>
+#include <termios.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "bincmd.h"
+#include "stats.h"
+#include "imageenc.h"
+
+#define RESPONSE_TIMEOUT_MS     5000
+#define BUS_TIMEOUT_MS          100     /* a node's answer on the bus */
+#define BUS_RETRIES             3
+#define BUS_ROUNDS              20
+#define BUS_SETTLE_MS           20      /* last packet programmed */
+#define BUS_NODES_MAX           64
+#define BUS_SECTOR_SIZE         8192    /* erased per BINCMD_BUS_ERASE_MS */
+
+static int fd = -1;
+static uint8_t next_id;
+static int timeout_ms = RESPONSE_TIMEOUT_MS;
+static long line_baud;
+static double line_due;         /* when the bytes written so far are out */
+
+static uint16_t crc16(uint16_t crc, const uint8_t *p, size_t n)
+{
+	int i;
+
+	while (n--) {
+		crc ^= (uint16_t)*p++ << 8;
+		for (i = 0; i < 8; i++)
+			crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+	}
+	return crc;
+}
+
+static void put32(uint8_t *p, uint32_t v)
+{
+	p[0] = (uint8_t)v;
+	p[1] = (uint8_t)(v >> 8);
+	p[2] = (uint8_t)(v >> 16);
+	p[3] = (uint8_t)(v >> 24);
+}
+
+static void put16(uint8_t *p, uint32_t v)
+{
+	p[0] = (uint8_t)v;
+	p[1] = (uint8_t)(v >> 8);
+}
+
+static uint32_t get16(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+static uint32_t get32(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static speed_t baud_const(long baud)
+{
+	switch (baud) {
+	case 9600: return B9600;
+	case 19200: return B19200;
+	case 38400: return B38400;
+	case 57600: return B57600;
+	case 115200: return B115200;
+	case 230400: return B230400;
+	case 460800: return B460800;
+	case 921600: return B921600;
+	default: return 0;
+	}
+}
+
+static int open_port(const char *dev, long baud)
+{
+	struct termios tio;
+	speed_t speed = baud_const(baud);
+
+	if (speed == 0) {
+		fprintf(stderr, "unsupported baud rate %ld\n", baud);
+		return -1;
+	}
+	fd = open(dev, O_RDWR | O_NOCTTY);
+	if (fd < 0) {
+		perror(dev);
+		return -1;
+	}
+	if (tcgetattr(fd, &tio) == 0) {
+		cfmakeraw(&tio);
+		cfsetispeed(&tio, speed);
+		cfsetospeed(&tio, speed);
+		tio.c_cflag |= CLOCAL | CREAD;
+		tio.c_cc[VMIN] = 0;
+		tio.c_cc[VTIME] = 0;
+		tcsetattr(fd, TCSANOW, &tio);
+	}
+	tcflush(fd, TCIOFLUSH);
+	return 0;
+}
+
+static int read_exact(uint8_t *buf, size_t n)
+{
+	size_t got = 0;
+
+	while (got < n) {
+		fd_set set;
+		struct timeval tv = { timeout_ms / 1000, (timeout_ms % 1000) * 1000 };
+		ssize_t r;
+
+		FD_ZERO(&set);
+		FD_SET(fd, &set);
+		if (select(fd + 1, &set, NULL, NULL, &tv) <= 0)
+			return -1;
+		r = read(fd, buf + got, n - got);
+		if (r < 0 && errno != EINTR)
+			return -1;
+		if (r > 0)
+			got += (size_t)r;
+	}
+	return 0;
+}
+
+static double now_s(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static int write_all(const uint8_t *buf, size_t n)
+{
+	double now = now_s();
+
+	line_due = (line_due > now ? line_due : now) + n * 10.0 / line_baud;
+	while (n) {
+		ssize_t w = write(fd, buf, n);
+
+		if (w < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		buf += w;
+		n -= (size_t)w;
+	}
+	return 0;
+}
+
+/* Send one request, returns the id used */
+static int send_request(uint8_t cmd, const uint8_t *payload, uint16_t len)
+{
+	uint8_t frame[BINCMD_MAX_PAYLOAD + BINCMD_OVERHEAD];
+	uint16_t crc;
+	uint8_t id = next_id++;
+
+	frame[0] = BINCMD_SOF0;
+	frame[1] = BINCMD_SOF1;
+	frame[2] = cmd;
+	frame[3] = id;
+	frame[4] = (uint8_t)len;
+	frame[5] = (uint8_t)(len >> 8);
+	memcpy(frame + 6, payload, len);
+	crc = crc16(0, frame + 2, BINCMD_HEADER_SIZE + len);
+	frame[6 + len] = (uint8_t)(crc >> 8);
+	frame[7 + len] = (uint8_t)crc;
+	if (write_all(frame, len + BINCMD_OVERHEAD) != 0)
+		return -1;
+	return id;
+}
+
+/* Read one response; data (without the status byte) goes to out */
+static int read_response(uint8_t cmd, int id, uint8_t *out, uint16_t *out_len)
+{
+	uint8_t head[BINCMD_HEADER_SIZE], body[BINCMD_MAX_PAYLOAD + 2], c = 0;
+	uint16_t len, crc;
+
+	/* Hunt for the sync pattern, skipping any menu text */
+	for (;;) {
+		if (read_exact(&c, 1) != 0)
+			goto timeout;
+		while (c == BINCMD_SOF0) {
+			if (read_exact(&c, 1) != 0)
+				goto timeout;
+			if (c == BINCMD_SOF1)
+				goto synced;
+		}
+	}
+synced:
+	if (read_exact(head, sizeof(head)) != 0)
+		goto timeout;
+	len = head[2] | (head[3] << 8);
+	if (len == 0 || len > BINCMD_MAX_PAYLOAD || read_exact(body, len + 2u) != 0)
+		goto timeout;
+	crc = crc16(crc16(0, head, sizeof(head)), body, len);
+	if (crc != ((body[len] << 8) | body[len + 1])) {
+		fprintf(stderr, "response CRC error\n");
+		return -1;
+	}
+	if (head[0] != (cmd | BINCMD_RESPONSE) || head[1] != (uint8_t)id) {
+		fprintf(stderr, "unexpected response %02x id %u (wanted %02x id %d)\n",
+			head[0], head[1], cmd | BINCMD_RESPONSE, id);
+		return -1;
+	}
+	if (out && out_len) {
+		*out_len = len - 1;
+		memcpy(out, body + 1, len - 1u);
+	}
+	return body[0];
+timeout:
+	fprintf(stderr, "timeout waiting for response to command %02x\n", cmd);
+	return -1;
+}
+
+static int transact(uint8_t cmd, const uint8_t *payload, uint16_t len, uint8_t *out, uint16_t *out_len)
+{
+	int id = send_request(cmd, payload, len);
+
+	if (id < 0)
+		return -1;
+	return read_response(cmd, id, out, out_len);
+}
+
+static int check(int status, const char *what)
+{
+	if (status != BINCMD_OK) {
+		fprintf(stderr, "%s failed (status %d)\n", what, status);
+		return -1;
+	}
+	return 0;
+}
+
+static int cmd_info(uint32_t *app_addr, uint32_t *app_size)
+{
+	uint8_t out[BINCMD_MAX_PAYLOAD];
+	uint16_t n = 0;
+
+	if (check(transact(BINCMD_GET_INFO, NULL, 0, out, &n), "GET_INFO") || n < 18)
+		return -1;
+	printf("protocol %u, bootloader %u.%u.%u\n", out[0], out[1], out[2], out[3]);
+	printf("application 0x%08x, %u bytes, sector %u, max block %u\n",
+	       get32(out + 4), get32(out + 8), get32(out + 12), out[16] | (out[17] << 8));
+	if (n > 18)
+		printf("bus address %u\n", out[18]);
+	if (app_addr)
+		*app_addr = get32(out + 4);
+	if (app_size)
+		*app_size = get32(out + 8);
+	return 0;
+}
+
+static int cmd_range(uint8_t cmd, uint32_t addr, uint32_t size, uint8_t *out, uint16_t *n)
+{
+	uint8_t p[8];
+
+	put32(p, addr);
+	put32(p + 4, size);
+	return transact(cmd, p, 8, out, n);
+}
+
+static int cmd_verify(uint32_t addr, uint32_t size, uint16_t *crc)
+{
+	uint8_t out[4];
+	uint16_t n = 0;
+
+	if (check(cmd_range(BINCMD_VERIFY, addr, size, out, &n), "VERIFY") || n != 2)
+		return -1;
+	*crc = out[0] | (out[1] << 8);
+	return 0;
+}
+
+static int cmd_read(uint32_t addr, uint32_t size, const char *path)
+{
+	FILE *f = fopen(path, "wb");
+	uint8_t p[6], out[BINCMD_MAX_PAYLOAD];
+	uint16_t n;
+
+	if (!f) {
+		perror(path);
+		return -1;
+	}
+	while (size) {
+		uint32_t chunk = size > BINCMD_MAX_DATA ? BINCMD_MAX_DATA : size;
+
+		put32(p, addr);
+		p[4] = (uint8_t)chunk;
+		p[5] = (uint8_t)(chunk >> 8);
+		if (check(transact(BINCMD_READ_BLOCK, p, 6, out, &n), "READ_BLOCK") || n != chunk) {
+			fclose(f);
+			return -1;
+		}
+		fwrite(out, 1, n, f);
+		addr += chunk;
+		size -= chunk;
+	}
+	fclose(f);
+	return 0;
+}
+
+static int cmd_stats(void)
+{
+	uint8_t out[BINCMD_MAX_PAYLOAD];
+	uint16_t n = 0;
+	Stats_Counters st;
+	double hz;
+	uint32_t packets = 0;
+	int i;
+
+	if (check(transact(BINCMD_GET_STATS, NULL, 0, out, &n), "GET_STATS") || n != sizeof(st))
+		return -1;
+	memcpy(&st, out, sizeof(st));
+	hz = st.core_clock ? st.core_clock : 1;
+	printf("elapsed %u ms, %u bytes received\n", st.elapsed_ms, st.rx_bytes);
+	for (i = 0; i < STATS_SIZE_CLASSES; i++) {
+		packets += st.packets[i];
+		if (st.packets[i])
+			printf("packets of %u bytes: %u\n", 8u << i, st.packets[i]);
+	}
+	printf("errors: %u crc, %u sequence, %u naks sent, %u resent, %u overruns, %u framing\n",
+	       st.crc_errors, st.seq_errors, st.naks, st.resends, st.uart_overruns, st.uart_framing);
+	printf("flash: %u sectors erased, %u already blank, %u quadwords programmed\n",
+	       st.flash_erases, st.erases_skipped, st.flash_programs);
+	printf("blank check: %.3f ms\n", st.blank_check_cycles * 1e3 / hz);
+	printf("cycles: flash busy %.3f ms, uart wait %.3f ms, compute %.3f ms\n",
+	       st.flash_busy_cycles * 1e3 / hz, st.uart_wait_cycles * 1e3 / hz, st.compute_cycles * 1e3 / hz);
+	if (packets)
+		printf("compute per packet: %.1f us at %u MHz\n",
+		       st.compute_cycles * 1e6 / hz / packets, st.core_clock / 1000000);
+	if (st.hashed_bytes)
+		printf("sha-256: %u bytes, %.1f cycles/byte; signature check %.3f ms\n", st.hashed_bytes,
+		       (double)st.hash_cycles / st.hashed_bytes, st.verify_cycles * 1e3 / hz);
+	if (st.decrypted_bytes)
+		printf("chacha20: %u bytes, %.1f cycles/byte\n", st.decrypted_bytes,
+		       (double)st.decrypt_cycles / st.decrypted_bytes);
+	return 0;
+}
+
+static int cmd_provision(const char *path, uint32_t addr, int have_addr)
+{
+	uint8_t *image, payload[BINCMD_MAX_PAYLOAD];
+	uint32_t app_addr, app_size, size, padded, off = 0;
+	int ids[BINCMD_WINDOW], head = 0, tail = 0, status = -1;
+	uint16_t crc;
+	FILE *f = fopen(path, "rb");
+	long flen;
+
+	if (!f) {
+		perror(path);
+		return -1;
+	}
+	fseek(f, 0, SEEK_END);
+	flen = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	if (cmd_info(&app_addr, &app_size) != 0) {
+		fclose(f);
+		return -1;
+	}
+	if (!have_addr)
+		addr = app_addr;
+	size = (uint32_t)flen;
+	padded = (size + 15u) & ~15u;
+	image = malloc(padded);
+	if (!image || fread(image, 1, size, f) != size) {
+		fclose(f);
+		free(image);
+		return -1;
+	}
+	fclose(f);
+	memset(image + size, 0xFF, padded - size);
+
+	printf("erasing %u bytes at 0x%08x\n", padded, addr);
+	if (check(cmd_range(BINCMD_ERASE_RANGE, addr, padded, NULL, NULL), "ERASE_RANGE"))
+		goto out;
+
+	/* Keep BINCMD_WINDOW writes in flight */
+	while (off < padded || tail != head) {
+		if (off < padded && head - tail < BINCMD_WINDOW) {
+			uint32_t chunk = padded - off > BINCMD_MAX_DATA ? BINCMD_MAX_DATA : padded - off;
+
+			put32(payload, addr + off);
+			memcpy(payload + 4, image + off, chunk);
+			ids[head++ % BINCMD_WINDOW] = send_request(BINCMD_WRITE_BLOCK, payload, (uint16_t)(chunk + 4));
+			off += chunk;
+			continue;
+		}
+		if (check(read_response(BINCMD_WRITE_BLOCK, ids[tail++ % BINCMD_WINDOW], NULL, NULL), "WRITE_BLOCK"))
+			goto out;
+		printf("\rwritten %u / %u", off, padded);
+		fflush(stdout);
+	}
+	printf("\n");
+
+	if (cmd_verify(addr, padded, &crc) != 0)
+		goto out;
+	if (crc != crc16(0, image, padded)) {
+		fprintf(stderr, "verify mismatch: device crc %04x\n", crc);
+		goto out;
+	}
+	printf("verified, booting\n");
+	/* The bootloader checks the signature of an application first */
+	put32(payload, size);
+	status = check(transact(BINCMD_BOOT, payload, addr == app_addr ? 4 : 0, NULL, NULL), "BOOT");
+out:
+	free(image);
+	return status;
+}
+
+static int cmd_addr(uint8_t addr)
+{
+	return check(transact(BINCMD_SET_ADDR, &addr, 1, NULL, NULL), "SET_ADDR");
+}
+
+/* Wait until the bytes written so far are on the line, then ms more. Not
+   just tcdrain(): USB adapters and ptys take the bytes long before that */
+static void bus_wait(unsigned ms)
+{
+	double wait;
+
+	tcdrain(fd);
+	wait = line_due - now_s();
+	usleep((wait > 0 ? (useconds_t)(wait * 1e6) : 0) + ms * 1000u);
+}
+
+/* A request to one node, repeated after a quiet line if the answer is lost */
+static int bus_transact(uint8_t cmd, const uint8_t *p, uint16_t len, uint8_t *out, uint16_t *n)
+{
+	int i, status = -1;
+
+	timeout_ms = BUS_TIMEOUT_MS;
+	for (i = 0; i < BUS_RETRIES && status < 0; i++) {
+		if (i != 0) {
+			bus_wait(BINCMD_BUS_RETRY_MS);
+			tcflush(fd, TCIFLUSH);
+		}
+		status = transact(cmd, p, len, out, n);
+	}
+	timeout_ms = RESPONSE_TIMEOUT_MS;
+	return status;
+}
+
+static void bus_begin(uint32_t session, uint32_t size, uint8_t flags, const uint8_t *nonce)
+{
+	uint8_t p[BINCMD_BUS_BEGIN_SIZE];
+
+	p[0] = BINCMD_ADDR_ALL;
+	put32(p + 1, session);
+	put32(p + 5, size);
+	put16(p + 9, BINCMD_MAX_DATA);
+	p[11] = 0;      /* PART_APP */
+	p[12] = flags;
+	memcpy(p + 13, nonce, 12);
+	send_request(BINCMD_BUS_BEGIN, p, sizeof(p));
+	bus_wait((size + BUS_SECTOR_SIZE - 1) / BUS_SECTOR_SIZE * BINCMD_BUS_ERASE_MS);
+}
+
+/* Poll one node; adds what it misses to need[].
+ * Returns its state, or -1 if it does not answer */
+static int bus_poll(uint8_t addr, uint32_t session, uint32_t packets, uint8_t *need, int *rebegin)
+{
+	uint8_t p[3], out[BINCMD_MAX_PAYLOAD];
+	uint16_t n = 0;
+	uint32_t first = 0, seq = 0, i, count;
+	int state;
+
+	do {
+		p[0] = addr;
+		put16(p + 1, first);
+		if (check(bus_transact(BINCMD_BUS_STATUS, p, sizeof(p), out, &n), "BUS_STATUS") || n < 9)
+			return -1;
+		state = out[4];
+		if (get32(out) != session || state == BINCMD_BUS_IDLE || state == BINCMD_BUS_FAILED) {
+			memset(need, 1, packets);
+			*rebegin = 1;
+			return BINCMD_BUS_IDLE;
+		}
+		count = (n - 9u) / 2;
+		for (i = 0; i < count; i++) {
+			seq = get16(out + 9 + 2 * i);
+			if (seq < packets)
+				need[seq] = 1;
+		}
+		if (first == 0 && state == BINCMD_BUS_RECEIVING)
+			printf("node %u: %u packets missing\n", addr, get16(out + 7));
+		first = seq + 1;
+	} while (state == BINCMD_BUS_RECEIVING && count == BINCMD_BUS_MISSING_MAX && first < packets);
+	return state;
+}
+
+static int cmd_busupdate(const char *path, const char *list)
+{
+	static const char *const state_name[] = { "idle", "receiving", "verified", "rejected", "failed" };
+	uint8_t addr[BUS_NODES_MAX], state[BUS_NODES_MAX], nonce[12] = { 0 };
+	uint8_t *file, *image, *need, payload[BINCMD_MAX_PAYLOAD], flags = 0;
+	uint32_t size, packets, seq, off, chunk, session, round;
+	int nodes = 0, i, rebegin = 0, pending, status = -1;
+	char *end;
+	FILE *f = fopen(path, "rb");
+	long flen;
+
+	do {
+		if (nodes == BUS_NODES_MAX)
+			return -1;
+		addr[nodes] = (uint8_t)strtoul(list, &end, 0);
+		if (end == list || addr[nodes] == BINCMD_ADDR_NONE || addr[nodes] == BINCMD_ADDR_ALL) {
+			fprintf(stderr, "bad node address list\n");
+			return -1;
+		}
+		state[nodes++] = BINCMD_BUS_IDLE;
+		list = end + 1;
+	} while (*end == ',');
+	if (!f) {
+		perror(path);
+		return -1;
+	}
+	fseek(f, 0, SEEK_END);
+	flen = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	file = malloc(flen > 0 ? (size_t)flen : 1);
+	if (!file || flen <= 0 || fread(file, 1, (size_t)flen, f) != (size_t)flen) {
+		fclose(f);
+		free(file);
+		return -1;
+	}
+	fclose(f);
+	image = file;
+	size = (uint32_t)flen;
+	if (size > sizeof(ImageEnc_Header) && get32(file) == IMAGEENC_MAGIC) {
+		memcpy(nonce, file + 4, sizeof(nonce));
+		image += sizeof(ImageEnc_Header);
+		size -= sizeof(ImageEnc_Header);
+		flags = BINCMD_BUS_ENCRYPTED;
+	}
+	packets = (size + BINCMD_MAX_DATA - 1) / BINCMD_MAX_DATA;
+	if (packets > BINCMD_BUS_MAX_PACKETS) {
+		free(file);
+		return -1;
+	}
+	need = malloc(packets);
+	memset(need, 1, packets);
+	session = (uint32_t)time(NULL) ^ ((uint32_t)getpid() << 16);
+
+	printf("session %08x: %u bytes in %u packets to %d nodes%s\n", session, size, packets,
+	       nodes, flags ? ", encrypted" : "");
+	bus_begin(session, size, flags, nonce);
+	for (round = 0; round < BUS_ROUNDS; round++) {
+		if (rebegin) {
+			printf("BEGIN again\n");
+			rebegin = 0;
+			bus_begin(session, size, flags, nonce);
+		}
+		for (seq = 0; seq < packets; seq++) {
+			if (!need[seq])
+				continue;
+			need[seq] = 0;
+			off = seq * BINCMD_MAX_DATA;
+			chunk = size - off > BINCMD_MAX_DATA ? BINCMD_MAX_DATA : size - off;
+			payload[0] = BINCMD_ADDR_ALL;
+			put16(payload + 1, seq);
+			memcpy(payload + 3, image + off, chunk);
+			send_request(BINCMD_BUS_DATA, payload, (uint16_t)(chunk + 3));
+		}
+		bus_wait(BUS_SETTLE_MS);
+		tcflush(fd, TCIFLUSH);
+		pending = 0;
+		for (i = 0; i < nodes; i++) {
+			if (state[i] == BINCMD_BUS_VERIFIED || state[i] == BINCMD_BUS_REJECTED)
+				continue;
+			state[i] = (uint8_t)bus_poll(addr[i], session, packets, need, &rebegin);
+			if (state[i] != BINCMD_BUS_VERIFIED && state[i] != BINCMD_BUS_REJECTED)
+				pending++;
+		}
+		if (pending == 0)
+			break;
+	}
+	for (i = 0, status = 0; i < nodes; i++) {
+		if (state[i] == BINCMD_BUS_VERIFIED &&
+		    check(bus_transact(BINCMD_BUS_BOOT, &addr[i], 1, NULL, NULL), "BUS_BOOT") == 0) {
+			printf("node %u: verified, started\n", addr[i]);
+			continue;
+		}
+		printf("node %u: %s\n", addr[i], state[i] <= BINCMD_BUS_FAILED ? state_name[state[i]] : "no answer");
+		status = -1;
+	}
+	free(need);
+	free(file);
+	return status;
+}
+
+static void usage(void)
+{
+	fprintf(stderr,
+		"usage: iapcmd [-p PORT] [-b BAUD] COMMAND\n"
+		"  info\n"
+		"  erase ADDR SIZE\n"
+		"  read ADDR SIZE OUT\n"
+		"  verify ADDR SIZE\n"
+		"  boot\n"
+		"  stats\n"
+		"  provision IMAGE [ADDR]\n"
+		"  addr N\n"
+		"  busupdate IMAGE N[,N...]\n");
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	const char *port = "/dev/ttyUSB0";
+	long baud = 115200;
+	int opt, rc = 1;
+	uint16_t crc;
+
+	while ((opt = getopt(argc, argv, "p:b:")) != -1) {
+		if (opt == 'p')
+			port = optarg;
+		else if (opt == 'b')
+			baud = strtol(optarg, NULL, 0);
+		else
+			usage();
+	}
+	argc -= optind;
+	argv += optind;
+	if (argc < 1)
+		usage();
+	if (open_port(port, baud) != 0)
+		return 1;
+	line_baud = baud;
+
+	if (!strcmp(argv[0], "info"))
+		rc = cmd_info(NULL, NULL) != 0;
+	else if (!strcmp(argv[0], "erase") && argc == 3)
+		rc = check(cmd_range(BINCMD_ERASE_RANGE, strtoul(argv[1], NULL, 0),
+				     strtoul(argv[2], NULL, 0), NULL, NULL), "ERASE_RANGE") != 0;
+	else if (!strcmp(argv[0], "read") && argc == 4)
+		rc = cmd_read(strtoul(argv[1], NULL, 0), strtoul(argv[2], NULL, 0), argv[3]) != 0;
+	else if (!strcmp(argv[0], "verify") && argc == 3) {
+		rc = cmd_verify(strtoul(argv[1], NULL, 0), strtoul(argv[2], NULL, 0), &crc) != 0;
+		if (!rc)
+			printf("crc 0x%04x\n", crc);
+	} else if (!strcmp(argv[0], "boot"))
+		rc = check(transact(BINCMD_BOOT, NULL, 0, NULL, NULL), "BOOT") != 0;
+	else if (!strcmp(argv[0], "stats"))
+		rc = cmd_stats() != 0;
+	else if (!strcmp(argv[0], "provision") && (argc == 2 || argc == 3))
+		rc = cmd_provision(argv[1], argc == 3 ? strtoul(argv[2], NULL, 0) : 0, argc == 3) != 0;
+	else if (!strcmp(argv[0], "addr") && argc == 2)
+		rc = cmd_addr((uint8_t)strtoul(argv[1], NULL, 0)) != 0;
+	else if (!strcmp(argv[0], "busupdate") && argc == 3)
+		rc = cmd_busupdate(argv[1], argv[2]) != 0;
+	else
+		usage();
+
+	close(fd);
+	return rc;
+}
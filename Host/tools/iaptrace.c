@@ -0,0 +1,372 @@
+/*
+ * iaptrace - decoder for the bootloader protocol trace (IAP/inc/trace.h).
+ *
+ *   iaptrace [-v] DUMP.bin                 decode a saved dump
+ *   iaptrace [-v] [-b BAUD] -p PORT [-o DUMP.bin]
+ *                                          fetch it with the "trace" command
+ *
+ * Prints one line per received packet: when its start byte was seen, how
+ * long the payload took to arrive, the CRC check, the time to the ACK and
+ * the flash job the packet started, then where the time of the session
+ * went, with the processing time per packet at each core clock. -v also
+ * lists every event. The bootloader must be sitting at its menu prompt for
+ * -p.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/select.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "trace.h"
+
+#define HEADER_SIZE             14
+#define DUMP_MAX                (HEADER_SIZE + TRACE_ENTRIES * 8 + 2)
+#define RESPONSE_TIMEOUT_MS     3000
+
+static const char *const event_names[] = {
+	"?", "boot", "session-start", "session-end", "pkt-start", "pkt-data", "pkt-crc",
+	"ack", "nak", "poll", "eot", "erase-start", "erase-end", "prog-start", "prog-end",
+	"tx-pkt", "tx-ack", "tx-nak", "clock"
+};
+
+struct event {
+	double us;              /* since the first event after the last boot */
+	double mhz;             /* core clock the event was counted at */
+	uint8_t event;
+	uint8_t seq;
+	uint16_t arg;
+};
+
+static struct event ev[TRACE_ENTRIES];
+static int nev;
+
+static uint16_t crc16(uint16_t crc, const uint8_t *p, size_t n)
+{
+	int i;
+
+	while (n--) {
+		crc ^= (uint16_t)*p++ << 8;
+		for (i = 0; i < 8; i++)
+			crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+	}
+	return crc;
+}
+
+static uint32_t get32(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static speed_t baud_const(long baud)
+{
+	switch (baud) {
+	case 9600: return B9600;
+	case 19200: return B19200;
+	case 38400: return B38400;
+	case 57600: return B57600;
+	case 115200: return B115200;
+	case 230400: return B230400;
+	case 460800: return B460800;
+	case 921600: return B921600;
+	default: return 0;
+	}
+}
+
+static int open_port(const char *dev, long baud)
+{
+	struct termios tio;
+	speed_t speed = baud_const(baud);
+	int fd;
+
+	if (speed == 0) {
+		fprintf(stderr, "unsupported baud rate %ld\n", baud);
+		return -1;
+	}
+	fd = open(dev, O_RDWR | O_NOCTTY);
+	if (fd < 0) {
+		perror(dev);
+		return -1;
+	}
+	if (tcgetattr(fd, &tio) == 0) {
+		cfmakeraw(&tio);
+		cfsetispeed(&tio, speed);
+		cfsetospeed(&tio, speed);
+		tio.c_cflag |= CLOCAL | CREAD;
+		tio.c_cc[VMIN] = 0;
+		tio.c_cc[VTIME] = 0;
+		tcsetattr(fd, TCSANOW, &tio);
+	}
+	tcflush(fd, TCIOFLUSH);
+	return fd;
+}
+
+static int read_exact(int fd, uint8_t *buf, size_t n)
+{
+	size_t got = 0;
+
+	while (got < n) {
+		fd_set set;
+		struct timeval tv = { RESPONSE_TIMEOUT_MS / 1000, (RESPONSE_TIMEOUT_MS % 1000) * 1000 };
+		ssize_t r;
+
+		FD_ZERO(&set);
+		FD_SET(fd, &set);
+		if (select(fd + 1, &set, NULL, NULL, &tv) <= 0)
+			return -1;
+		r = read(fd, buf + got, n - got);
+		if (r < 0 && errno != EINTR)
+			return -1;
+		if (r > 0)
+			got += (size_t)r;
+	}
+	return 0;
+}
+
+/* Send "trace" and read the dump behind the echo of the menu */
+static long fetch(const char *port, long baud, uint8_t *buf)
+{
+	static const uint8_t magic[4] = { 'T', 'R', 'C', '1' };
+	int fd = open_port(port, baud);
+	size_t i = 0, n;
+
+	if (fd < 0)
+		return -1;
+	if (write(fd, "trace\r", 6) != 6)
+		goto fail;
+	while (i < 4) {
+		if (read_exact(fd, buf + i, 1) != 0)
+			goto fail;
+		if (buf[i] == magic[i])
+			i++;
+		else
+			i = (buf[i] == magic[0]);
+	}
+	memcpy(buf, magic, 4);
+	if (read_exact(fd, buf + 4, HEADER_SIZE - 4) != 0)
+		goto fail;
+	n = (size_t)(buf[12] | (buf[13] << 8));
+	if (n > TRACE_ENTRIES || read_exact(fd, buf + HEADER_SIZE, n * 8 + 2) != 0)
+		goto fail;
+	close(fd);
+	return (long)(HEADER_SIZE + n * 8 + 2);
+fail:
+	fprintf(stderr, "no trace dump from %s\n", port);
+	close(fd);
+	return -1;
+}
+
+static int parse(const uint8_t *buf, long len, uint32_t *clock, uint32_t *lost)
+{
+	uint32_t prev = 0, n, i;
+	double mhz, t = 0;
+	const uint8_t *p;
+
+	if (len < HEADER_SIZE + 2 || get32(buf) != TRACE_MAGIC) {
+		fprintf(stderr, "not a trace dump\n");
+		return -1;
+	}
+	*clock = get32(buf + 4);
+	*lost = get32(buf + 8);
+	n = buf[12] | (buf[13] << 8);
+	if (n > TRACE_ENTRIES || len != (long)(HEADER_SIZE + n * 8 + 2)) {
+		fprintf(stderr, "truncated trace dump\n");
+		return -1;
+	}
+	if (crc16(0, buf, len - 2) != ((buf[len - 2] << 8) | buf[len - 1])) {
+		fprintf(stderr, "trace dump CRC error\n");
+		return -1;
+	}
+	for (i = 0, p = buf + HEADER_SIZE; i < n; i++, p += 8) {
+		uint32_t c = get32(p);
+
+		/* The counter restarts at every boot, at the startup clock */
+		if (i == 0 || p[4] == TRACE_BOOT) {
+			t = 0;
+			mhz = *clock ? *clock / 1e6 : 1.0;
+		} else {
+			t += (uint32_t)(c - prev) / mhz;
+		}
+		prev = c;
+		ev[nev].us = t;
+		ev[nev].event = p[4];
+		ev[nev].seq = p[5];
+		ev[nev].arg = (uint16_t)(p[6] | (p[7] << 8));
+		/* The cycles after a clock switch count at the new rate */
+		if (p[4] == TRACE_CLOCK && ev[nev].arg)
+			mhz = ev[nev].arg;
+		ev[nev].mhz = mhz;
+		nev++;
+	}
+	return 0;
+}
+
+static void list_events(void)
+{
+	int i;
+
+	for (i = 0; i < nev; i++) {
+		const char *name = ev[i].event < sizeof(event_names) / sizeof(event_names[0]) ?
+				   event_names[ev[i].event] : "?";
+
+		printf("%12.3f ms %+10.3f  %-13s seq %3u arg %u\n", ev[i].us / 1e3,
+		       i ? (ev[i].us - ev[i - 1].us) / 1e3 : 0.0, name, ev[i].seq, ev[i].arg);
+	}
+}
+
+/* Index of the first event of the given type in [from, to), -1 if none */
+static int find(int from, int to, uint8_t type)
+{
+	for (; from < to; from++)
+		if (ev[from].event == type)
+			return from;
+	return -1;
+}
+
+static void timeline(void)
+{
+	double wire = 0, crc = 0, ack = 0, flash = 0, turn = 0, last_reply = -1;
+	/* CRC check to reply per clock profile */
+	double prof_mhz[4] = { 0 }, prof_us[4] = { 0 };
+	int prof_n[4] = { 0 };
+	int i, j, next, d, c, a, ps, pe, packets = 0, bad = 0;
+
+	printf("%12s %5s %4s %9s %8s %8s %9s %9s\n", "start ms", "size", "seq", "payload", "crc us",
+	       "ack us", "flash ms", "host ms");
+	for (i = 0; i < nev; i++) {
+		if (ev[i].event == TRACE_ACK || ev[i].event == TRACE_NAK || ev[i].event == TRACE_POLL)
+			last_reply = ev[i].us;
+		if (ev[i].event == TRACE_BOOT)
+			last_reply = -1;
+		if (ev[i].event != TRACE_PKT_START)
+			continue;
+		next = find(i + 1, nev, TRACE_PKT_START);
+		if (next < 0)
+			next = nev;
+		d = find(i + 1, next, TRACE_PKT_DATA);
+		c = find(i + 1, next, TRACE_PKT_CRC);
+		if (d < 0 || c < 0) {
+			printf("%12.3f %5u  (incomplete)\n", ev[i].us / 1e3, ev[i].arg);
+			continue;
+		}
+		/* The reply and the flash job may come after the next start byte
+		 * when the answer waits for the programmer */
+		a = c + 1;
+		while (a < nev && ev[a].event != TRACE_ACK && ev[a].event != TRACE_NAK &&
+		       ev[a].event != TRACE_POLL && ev[a].event != TRACE_PKT_CRC)
+			a++;
+		ps = find(c + 1, nev, TRACE_PROG_START);
+		if (ps >= 0 && find(c + 1, ps, TRACE_PKT_CRC) >= 0)
+			ps = -1;
+		pe = ps >= 0 ? find(ps + 1, nev, TRACE_PROG_END) : -1;
+
+		printf("%12.3f %5u %4u %7.3f ms %8.1f", ev[i].us / 1e3, ev[i].arg, ev[d].seq,
+		       (ev[d].us - ev[i].us) / 1e3, ev[c].us - ev[d].us);
+		if (a < nev && ev[a].event != TRACE_PKT_CRC)
+			printf(" %8.1f %-3s", ev[a].us - ev[c].us, event_names[ev[a].event]);
+		else
+			printf(" %12s", "-");
+		if (pe >= 0)
+			printf(" %6.3f", (ev[pe].us - ev[ps].us) / 1e3);
+		else
+			printf(" %6s", "-");
+		if (last_reply >= 0)
+			printf(" %9.3f", (ev[i].us - last_reply) / 1e3);
+		printf("%s\n", ev[c].arg ? "" : "  CRC error");
+
+		packets++;
+		bad += !ev[c].arg;
+		wire += ev[d].us - ev[i].us;
+		crc += ev[c].us - ev[d].us;
+		if (a < nev && ev[a].event != TRACE_PKT_CRC) {
+			ack += ev[a].us - ev[c].us;
+			for (j = 0; j < 3 && prof_n[j] && prof_mhz[j] != ev[c].mhz; j++)
+				;
+			prof_mhz[j] = ev[c].mhz;
+			prof_us[j] += ev[a].us - ev[d].us;
+			prof_n[j]++;
+		}
+		if (pe >= 0)
+			flash += ev[pe].us - ev[ps].us;
+		if (last_reply >= 0)
+			turn += ev[i].us - last_reply;
+	}
+	if (packets == 0)
+		return;
+	printf("\n%d packets, %d CRC errors\n", packets, bad);
+	printf("payload on the wire %10.3f ms\n", wire / 1e3);
+	printf("CRC check           %10.3f ms\n", crc / 1e3);
+	printf("CRC to reply        %10.3f ms\n", ack / 1e3);
+	printf("flash programming   %10.3f ms (overlaps the next packet)\n", flash / 1e3);
+	printf("host turnaround     %10.3f ms\n", turn / 1e3);
+	for (j = 0; j < 4 && prof_n[j]; j++)
+		printf("per packet at %3.0f MHz %8.1f us CRC check and reply (%d packets)\n",
+		       prof_mhz[j], prof_us[j] / prof_n[j], prof_n[j]);
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: iaptrace [-v] DUMP.bin\n"
+			"       iaptrace [-v] [-b BAUD] -p PORT [-o DUMP.bin]\n");
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	static uint8_t buf[DUMP_MAX + 1];
+	const char *port = NULL, *out = NULL;
+	long baud = 115200, len;
+	uint32_t clock, lost;
+	int opt, verbose = 0;
+	FILE *f;
+
+	while ((opt = getopt(argc, argv, "p:b:o:v")) != -1) {
+		if (opt == 'p')
+			port = optarg;
+		else if (opt == 'b')
+			baud = strtol(optarg, NULL, 0);
+		else if (opt == 'o')
+			out = optarg;
+		else if (opt == 'v')
+			verbose = 1;
+		else
+			usage();
+	}
+	if ((port == NULL) == (optind >= argc))
+		usage();
+
+	if (port) {
+		len = fetch(port, baud, buf);
+		if (len < 0)
+			return 1;
+		if (out) {
+			f = fopen(out, "wb");
+			if (!f || fwrite(buf, 1, (size_t)len, f) != (size_t)len) {
+				perror(out);
+				return 1;
+			}
+			fclose(f);
+		}
+	} else {
+		f = fopen(argv[optind], "rb");
+		if (!f) {
+			perror(argv[optind]);
+			return 1;
+		}
+		len = (long)fread(buf, 1, sizeof(buf), f);
+		fclose(f);
+	}
+	if (parse(buf, len, &clock, &lost) != 0)
+		return 1;
+	printf("%d events, %u overwritten, core clock %u Hz\n\n", nev, lost, clock);
+	if (verbose) {
+		list_events();
+		printf("\n");
+	}
+	timeline();
+	return 0;
+}
@@ -0,0 +1,87 @@
+/*
+ * mkboot - turn a bootloader binary into a self-update image
+ * (IAP/inc/selfupdate.h): the binary padded to 16 bytes with 0xFF, then
+ * the trailer. Send the output as "boot:NAME" in an update batch.
+ *
+ *   mkboot IN.bin OUT.bin
+ *
+ * The binary is the bootloader area from its start, as objcopy -O binary
+ * writes it; it must end below the partition table.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "iap_config.h"
+#include "selfupdate.h"
+
+static void put32(uint8_t *p, uint32_t v)
+{
+	p[0] = (uint8_t)v;
+	p[1] = (uint8_t)(v >> 8);
+	p[2] = (uint8_t)(v >> 16);
+	p[3] = (uint8_t)(v >> 24);
+}
+
+/* Bit at a time, the reference for the firmware's table version */
+static uint32_t crc32(const uint8_t *data, uint32_t size)
+{
+	uint32_t crc = 0xFFFFFFFF;
+	int i;
+
+	while (size--) {
+		crc ^= *data++;
+		for (i = 0; i < 8; i++)
+			crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+	}
+	return ~crc;
+}
+
+int main(int argc, char **argv)
+{
+	uint8_t *buf;
+	uint32_t size, padded, crc;
+	FILE *f;
+	long n;
+
+	if (argc != 3) {
+		fprintf(stderr, "usage: mkboot IN.bin OUT.bin\n");
+		return 2;
+	}
+	f = fopen(argv[1], "rb");
+	if (!f || fseek(f, 0, SEEK_END) != 0 || (n = ftell(f)) <= 0) {
+		perror(argv[1]);
+		return 1;
+	}
+	if (n > SELFUPDATE_IMAGE_MAX) {
+		fprintf(stderr, "%s: %ld bytes, the bootloader area holds %u\n", argv[1], n,
+			(unsigned)SELFUPDATE_IMAGE_MAX);
+		return 1;
+	}
+	size = (uint32_t)n;
+	padded = (size + 15) & ~15u;
+	buf = malloc(padded + sizeof(SelfUpdate_Trailer));
+	rewind(f);
+	if (!buf || fread(buf, 1, size, f) != size) {
+		perror(argv[1]);
+		return 1;
+	}
+	fclose(f);
+	memset(buf + size, 0xFF, padded - size);
+
+	crc = crc32(buf, padded);
+	put32(buf + padded, SELFUPDATE_MAGIC);
+	put32(buf + padded + 4, padded);
+	put32(buf + padded + 8, crc);
+	put32(buf + padded + 12, ~crc);
+
+	f = fopen(argv[2], "wb");
+	if (!f || fwrite(buf, 1, padded + sizeof(SelfUpdate_Trailer), f) != padded + sizeof(SelfUpdate_Trailer)) {
+		perror(argv[2]);
+		return 1;
+	}
+	fclose(f);
+	printf("%s: %u bytes, CRC-32 0x%08X\n", argv[2], padded, crc);
+	return 0;
+}
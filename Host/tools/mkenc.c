@@ -0,0 +1,91 @@
+/*
+ * mkenc - encrypt a firmware image for USE_ENCRYPTED_IMAGES
+ * (IAP/inc/imageenc.h): the header with a random nonce, then the image
+ * under ChaCha20. Sign first (mksign), then encrypt the signed file.
+ *
+ *   mkenc KEY IN.bin OUT.bin
+ *
+ * KEY holds the 32 byte key as 64 hex digits, as for mksign;
+ * tools/devenc.hex is the key of the sample configuration, for
+ * development only.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "imageenc.h"
+#include "chacha20.h"
+
+static int read_key(const char *path, uint8_t key[CHACHA20_KEY_SIZE])
+{
+	FILE *f = fopen(path, "r");
+	unsigned byte;
+	int i;
+
+	if (!f) {
+		perror(path);
+		return -1;
+	}
+	for (i = 0; i < CHACHA20_KEY_SIZE; i++) {
+		if (fscanf(f, "%2x", &byte) != 1) {
+			fprintf(stderr, "%s: expected %d hex digits\n", path, 2 * CHACHA20_KEY_SIZE);
+			fclose(f);
+			return -1;
+		}
+		key[i] = (uint8_t)byte;
+	}
+	fclose(f);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	uint8_t key[CHACHA20_KEY_SIZE], *buf;
+	ImageEnc_Header header;
+	ChaCha20_Ctx ctx;
+	uint32_t size;
+	FILE *f;
+	long n;
+
+	if (argc != 4) {
+		fprintf(stderr, "usage: mkenc KEY IN.bin OUT.bin\n");
+		return 2;
+	}
+	if (read_key(argv[1], key) != 0)
+		return 1;
+	f = fopen("/dev/urandom", "rb");
+	if (!f || fread(header.nonce, 1, sizeof(header.nonce), f) != sizeof(header.nonce)) {
+		perror("/dev/urandom");
+		return 1;
+	}
+	fclose(f);
+	header.magic = IMAGEENC_MAGIC;
+
+	f = fopen(argv[2], "rb");
+	if (!f || fseek(f, 0, SEEK_END) != 0 || (n = ftell(f)) <= 0) {
+		perror(argv[2]);
+		return 1;
+	}
+	size = (uint32_t)n;
+	buf = malloc(sizeof(header) + size);
+	rewind(f);
+	if (!buf || fread(buf + sizeof(header), 1, size, f) != size) {
+		perror(argv[2]);
+		return 1;
+	}
+	fclose(f);
+
+	memcpy(buf, &header, sizeof(header));
+	ChaCha20_Init(&ctx, key, header.nonce, 0);
+	ChaCha20_Xor(&ctx, buf + sizeof(header), size);
+
+	f = fopen(argv[3], "wb");
+	if (!f || fwrite(buf, 1, sizeof(header) + size, f) != sizeof(header) + size) {
+		perror(argv[3]);
+		return 1;
+	}
+	fclose(f);
+	printf("%s: %u bytes encrypted\n", argv[3], size);
+	return 0;
+}
@@ -0,0 +1,89 @@
+/*
+ * mkptable - build the partition table blob the bootloader reads from
+ * PTABLE_ADDR (IAP/inc/partition.h). Program the output there with the
+ * bootloader image to give a product its own flash layout.
+ *
+ *   mkptable OUT.bin TYPE:NAME:ADDR:SIZE ...
+ *
+ * TYPE is one of app, config, calib, edata, flag, scratch, app_b (reserved,
+ * the bootloader treats it as a data partition).
+ * Example, the default layout:
+ *   mkptable layout.bin app:app:0x0800A000:0x12000 config:config:0x0801C000:0x2000 \
+ *            calib:calib:0x0801E000:0x2000 edata:edata:0x08008010:0x1FF0 \
+ *            flag:flag:0x08008000:16
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "partition.h"
+
+#define PTABLE_AREA_SIZE        256
+
+static const char *const type_names[PART_COUNT] = {
+	"app", "config", "calib", "edata", "flag", "scratch", "app_b"
+};
+
+static void put16(uint8_t *p, uint32_t v)
+{
+	p[0] = (uint8_t)v;
+	p[1] = (uint8_t)(v >> 8);
+}
+
+static void put32(uint8_t *p, uint32_t v)
+{
+	put16(p, v);
+	put16(p + 2, v >> 16);
+}
+
+int main(int argc, char **argv)
+{
+	uint8_t blob[PTABLE_AREA_SIZE];
+	uint8_t *e;
+	FILE *f;
+	int i, t;
+
+	if (argc < 3 || argc - 2 > PTABLE_MAX_ENTRIES) {
+		fprintf(stderr, "usage: mkptable OUT.bin TYPE:NAME:ADDR:SIZE ... (at most %d)\n",
+			PTABLE_MAX_ENTRIES);
+		return 2;
+	}
+	/* Unused bytes stay erased */
+	memset(blob, 0xFF, sizeof(blob));
+	put32(blob, PTABLE_MAGIC);
+	put16(blob + 4, PTABLE_VERSION);
+	put16(blob + 6, (uint32_t)(argc - 2));
+
+	for (i = 2; i < argc; i++) {
+		char *type = strtok(argv[i], ":");
+		char *name = strtok(NULL, ":");
+		char *addr = strtok(NULL, ":");
+		char *size = strtok(NULL, ":");
+
+		if (!size || strlen(name) >= PARTITION_NAME_SIZE) {
+			fprintf(stderr, "bad entry '%s'\n", argv[i]);
+			return 2;
+		}
+		for (t = 0; t < PART_COUNT && strcmp(type, type_names[t]); t++)
+			;
+		if (t == PART_COUNT) {
+			fprintf(stderr, "unknown type '%s'\n", type);
+			return 2;
+		}
+		e = blob + 8 + (size_t)(i - 2) * sizeof(Partition);
+		put32(e, (uint32_t)t);
+		put32(e + 4, (uint32_t)strtoul(addr, NULL, 0));
+		put32(e + 8, (uint32_t)strtoul(size, NULL, 0));
+		memset(e + 12, 0, PARTITION_NAME_SIZE);
+		memcpy(e + 12, name, strlen(name));
+	}
+
+	f = fopen(argv[1], "wb");
+	if (!f || fwrite(blob, 1, sizeof(blob), f) != sizeof(blob)) {
+		perror(argv[1]);
+		return 1;
+	}
+	fclose(f);
+	return 0;
+}
@@ -0,0 +1,105 @@
+/*
+ * mksign - sign a firmware image for USE_SIGNED_IMAGES (IAP/inc/imagesig.h):
+ * the image followed by the signature trailer, Ed25519 over its SHA-256
+ * digest.
+ *
+ *   mksign KEY IN.bin OUT.bin
+ *   mksign -p KEY              print the public key, for IMAGESIG_PUBLIC_KEY
+ *
+ * KEY holds the 32 byte private seed as 64 hex digits, made with e.g.
+ *   head -c 32 /dev/urandom | xxd -p -c 32 > KEY
+ * tools/devkey.hex is the key of the sample configuration, for
+ * development only. Sign a bootloader image after mkboot.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "imagesig.h"
+#include "sha256.h"
+#include "ed25519.h"
+
+static int read_key(const char *path, uint8_t seed[ED25519_KEY_SIZE])
+{
+	FILE *f = fopen(path, "r");
+	unsigned byte;
+	int i;
+
+	if (!f) {
+		perror(path);
+		return -1;
+	}
+	for (i = 0; i < ED25519_KEY_SIZE; i++) {
+		if (fscanf(f, "%2x", &byte) != 1) {
+			fprintf(stderr, "%s: expected %d hex digits\n", path, 2 * ED25519_KEY_SIZE);
+			fclose(f);
+			return -1;
+		}
+		seed[i] = (uint8_t)byte;
+	}
+	fclose(f);
+	return 0;
+}
+
+static void put32(uint8_t *p, uint32_t v)
+{
+	p[0] = (uint8_t)v;
+	p[1] = (uint8_t)(v >> 8);
+	p[2] = (uint8_t)(v >> 16);
+	p[3] = (uint8_t)(v >> 24);
+}
+
+int main(int argc, char **argv)
+{
+	uint8_t seed[ED25519_KEY_SIZE], pub[ED25519_KEY_SIZE], digest[SHA256_DIGEST_SIZE], *buf;
+	uint32_t size;
+	FILE *f;
+	long n;
+	int i;
+
+	if (argc == 3 && strcmp(argv[1], "-p") == 0) {
+		if (read_key(argv[2], seed) != 0)
+			return 1;
+		Ed25519_PublicKey(pub, seed);
+		for (i = 0; i < ED25519_KEY_SIZE; i++)
+			printf("0x%02x,%s", pub[i], (i % 16 == 15) ? "\n" : " ");
+		return 0;
+	}
+	if (argc != 4) {
+		fprintf(stderr, "usage: mksign KEY IN.bin OUT.bin\n       mksign -p KEY\n");
+		return 2;
+	}
+	if (read_key(argv[1], seed) != 0)
+		return 1;
+	f = fopen(argv[2], "rb");
+	if (!f || fseek(f, 0, SEEK_END) != 0 || (n = ftell(f)) <= 0) {
+		perror(argv[2]);
+		return 1;
+	}
+	size = (uint32_t)n;
+	buf = malloc(size + sizeof(ImageSig_Trailer));
+	rewind(f);
+	if (!buf || fread(buf, 1, size, f) != size) {
+		perror(argv[2]);
+		return 1;
+	}
+	fclose(f);
+
+	Sha256(buf, size, digest);
+	put32(buf + size, IMAGESIG_MAGIC);
+	put32(buf + size + 4, size);
+	Ed25519_Sign(buf + size + 8, digest, sizeof(digest), seed);
+
+	f = fopen(argv[3], "wb");
+	if (!f || fwrite(buf, 1, size + sizeof(ImageSig_Trailer), f) != size + sizeof(ImageSig_Trailer)) {
+		perror(argv[3]);
+		return 1;
+	}
+	fclose(f);
+	printf("%s: %u bytes signed, SHA-256 ", argv[3], size);
+	for (i = 0; i < SHA256_DIGEST_SIZE; i++)
+		printf("%02x", digest[i]);
+	printf("\n");
+	return 0;
+}
@@ -0,0 +1,92 @@
+#ifndef __BINCMD_H__
+#define __BINCMD_H__
+#include <stdint.h>
+
+/* Binary command protocol for production stations. Shared with the host
+ * client, so keep this header free of HAL includes.
+ *
+ * Frame:    SOF0 SOF1 | cmd | id | len (LE16) | payload[len] | crc (BE16)
+ * Response: SOF0 SOF1 | cmd|0x80 | id | len (LE16) | status, data | crc (BE16)
+ *
+ * The CRC is CRC-16/XMODEM over cmd..payload, the same as the YModem
+ * packets. Requests are executed in order and every request gets exactly
+ * one response carrying its id, so a host may send several requests
+ * before reading the answers (BINCMD_WINDOW). Multi-byte fields are
+ * little endian.
+ *
+ * On an RS-485 bus (busupdate.h) only the node a request is for may
+ * answer: bus requests for all nodes get no response, and a node with a
+ * bus address does not answer a frame that fails its CRC, which may have
+ * been for another node. The commands without an address are for a node
+ * alone on the line.
+ *
+ * ERASE_RANGE and WRITE_BLOCK in the application partition clear the
+ * record of its checked image (imagesig.h). BOOT then carries the size of
+ * the signed file written there and the bootloader checks it from flash
+ * before it answers; BOOT without a size only starts an image that is
+ * still checked. */
+
+#define BINCMD_SOF0             0xA5
+#define BINCMD_SOF1             0x5A
+#define BINCMD_HEADER_SIZE      4       /* cmd, id, len */
+#define BINCMD_OVERHEAD         (2 + BINCMD_HEADER_SIZE + 2)
+#define BINCMD_RESPONSE         0x80
+#define BINCMD_VERSION          1
+
+#define BINCMD_MAX_DATA         1024    /* Largest WRITE_BLOCK / READ_BLOCK data */
+#define BINCMD_MAX_PAYLOAD      (BINCMD_MAX_DATA + 8)
+#define BINCMD_WINDOW           2       /* Requests a host may have outstanding */
+#define BINCMD_BYTE_TIMEOUT_MS  200     /* A frame that stops mid-way is dropped */
+
+/* Commands */
+#define BINCMD_GET_INFO         0x01    /* -> ver, major, minor, patch, app addr, app size, sector size, max data(16), addr(8) */
+#define BINCMD_ERASE_RANGE      0x02    /* addr, size */
+#define BINCMD_WRITE_BLOCK      0x03    /* addr, data (addr and length multiple of 16) */
+#define BINCMD_READ_BLOCK       0x04    /* addr, len(16) -> data */
+#define BINCMD_VERIFY           0x05    /* addr, size -> crc16 */
+#define BINCMD_BOOT             0x06    /* [file size]: jump to the checked application after answering */
+#define BINCMD_GET_STATS        0x07    /* -> Stats_Counters of this session (stats.h) */
+#define BINCMD_SET_ADDR         0x08    /* addr(8): bus address, BINCMD_ADDR_NONE to leave the bus */
+
+/* Bus update (busupdate.h). The payload starts with the address of the
+ * node, or BINCMD_ADDR_ALL: a request for all nodes is never answered,
+ * one for a single node is answered like the commands above. */
+#define BINCMD_BUS_BEGIN        0x10    /* addr, session, size, packet(16), part(8), flags(8), nonce[12] */
+#define BINCMD_BUS_DATA         0x11    /* addr, seq(16), data (packet bytes, the last one less) */
+#define BINCMD_BUS_STATUS       0x12    /* addr, first(16) -> session, state(8), packets(16), missing(16), seq(16)... */
+#define BINCMD_BUS_BOOT         0x13    /* addr: start the checked image */
+#define BINCMD_IS_BUS(cmd)      (((cmd) & 0xF0) == 0x10)
+
+#define BINCMD_ADDR_NONE        0x00    /* Not on a bus: bus requests are ignored */
+#define BINCMD_ADDR_ALL         0xFF
+
+#define BINCMD_BUS_BEGIN_SIZE   25
+#define BINCMD_BUS_ENCRYPTED    0x01    /* flags: packets are ChaCha20 under the nonce (imageenc.h) */
+#define BINCMD_BUS_BLOCK        64      /* packet is a multiple of this, the ChaCha20 block */
+#define BINCMD_BUS_MAX_PACKETS  2048
+#define BINCMD_BUS_MISSING_MAX  64      /* Sequence numbers in one STATUS answer */
+#define BINCMD_BUS_ERASE_MS     10      /* Host wait after BEGIN, per sector erased */
+#define BINCMD_BUS_RETRY_MS     (BINCMD_BYTE_TIMEOUT_MS + 50)   /* Quiet line before a request is
+                                                                   repeated: noise taken for a
+                                                                   frame header swallows it */
+
+/* Node state in a STATUS answer */
+#define BINCMD_BUS_IDLE         0       /* No session, or not this one */
+#define BINCMD_BUS_RECEIVING    1
+#define BINCMD_BUS_VERIFIED     2       /* Every packet in, image checked */
+#define BINCMD_BUS_REJECTED     3       /* Signature check failed (imagesig.h) */
+#define BINCMD_BUS_FAILED       4       /* Flash error: BEGIN again */
+
+/* Response status */
+#define BINCMD_OK               0x00
+#define BINCMD_ERR_CRC          0x01
+#define BINCMD_ERR_CMD          0x02
+#define BINCMD_ERR_ARG          0x03
+#define BINCMD_ERR_FLASH        0x04
+#define BINCMD_ERR_BOOT         0x05
+
+/* Bootloader side */
+extern void BinCmd_Init(void);
+extern void BinCmd_Start(uint8_t notify);
+
+#endif
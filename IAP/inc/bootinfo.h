@@ -0,0 +1,62 @@
+#ifndef __BOOTINFO_H__
+#define __BOOTINFO_H__
+#include <stdint.h>
+
+/* Handoff from the bootloader to the application. IAP_RunApp() fills the
+ * block in the last 64 bytes of the RAM (BOOTINFO region of the linker
+ * script, not cleared by either startup code) right before the jump. The
+ * application includes this header and ends its own RAM region, stack
+ * included, at BOOTINFO_ADDR.
+ *
+ * State at the jump, when the block is valid:
+ * - clocks as SystemClock_Config() leaves them: HSE and CSI on, PLL1
+ *   100 MHz at VOS3 with 4 wait states, PLL2 on as the USART1 kernel
+ *   clock; the block has the frequencies, an application that wants this
+ *   tree sets SystemCoreClock = sysclk and skips its clock set-up
+ * - USART1 enabled at the bootloader baud rate, its interrupts off
+ * - all NVIC interrupts disabled and not pending, SysTick stopped, PRIMASK
+ *   clear, flash locked, instruction cache enabled and clean
+ * - VTOR at the application's vector table
+ * The block is valid when magic and size match and check is the XOR of
+ * the words before it, inverted. */
+
+#define BOOTINFO_ADDR           0x20007FC0
+#define BOOTINFO_SIZE           64
+#define BOOTINFO_MAGIC          0x4F464E49      /* "INFO" */
+#define BOOTINFO_VERSION        1
+#define BOOTINFO_NO_UPDATE      (-128)
+
+typedef struct
+{
+	uint32_t magic;
+	uint16_t version;
+	uint16_t size;          /* sizeof(BootInfo) */
+	uint32_t bl_version;    /* IAP_VERSION_MAJOR << 16 | MINOR << 8 | PATCH */
+	uint32_t reset_cause;   /* RCC->RSR at bootloader start, then cleared */
+	int32_t update;         /* Last update this boot, the Ymodem_Start()
+	                           result: > 0 bytes written, <= 0 failed;
+	                           BOOTINFO_NO_UPDATE: none */
+	uint32_t sysclk;        /* Hz */
+	uint32_t hclk;
+	uint32_t pclk1;
+	uint32_t pclk2;
+	uint32_t pclk3;
+	uint32_t usart1_clk;    /* USART1 kernel clock */
+	uint32_t rcc_cr;        /* RCC->CR: oscillators and PLLs on and ready */
+	uint32_t vos;           /* HAL_PWREx_GetVoltageRange() */
+	uint32_t latency;       /* Flash wait states */
+	uint32_t check;
+} BootInfo;
+
+/* The application's view of the block */
+#define BOOTINFO                ((const BootInfo *)BOOTINFO_ADDR)
+
+/* The bootloader's, placed at BOOTINFO_ADDR by the linker script */
+extern BootInfo BootInfo_Block;
+
+extern void BootInfo_Init(void);
+extern void BootInfo_SetUpdate(int32_t result);
+extern void BootInfo_Publish(void);
+extern uint8_t BootInfo_Valid(const BootInfo *info);
+
+#endif
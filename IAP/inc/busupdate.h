@@ -0,0 +1,51 @@
+#ifndef __BUSUPDATE_H__
+#define __BUSUPDATE_H__
+#include <stdint.h>
+
+/* Update of many boards on one RS-485 bus at once, over the binary
+ * command protocol (bincmd.h, BINCMD_BUS_xxx). Every bootloader on the
+ * bus has an address, KV_BUSADDR of the state store (BINCMD_SET_ADDR).
+ *
+ * The host starts a session on all nodes with BINCMD_BUS_BEGIN, which
+ * erases the target range, then sends every packet of the image once to
+ * all of them. There is no acknowledge: each node programs the packets
+ * that pass their CRC and keeps a bitmap of them. Afterwards the host
+ * polls the nodes one at a time with BINCMD_BUS_STATUS for the sequence
+ * numbers they miss, sends those packets again to all nodes (the ones
+ * that have them drop them) and polls again, until every node is
+ * complete. A node that missed BEGIN is brought in with a BEGIN of its
+ * own. Updating N boards costs one image on the line plus the repairs,
+ * not N sessions.
+ *
+ * A node checks the image once it has every packet: the signature of an
+ * application (imagesig.h), hashed from flash as the packets come in any
+ * order; a failed image is erased like after a YModem update. Encrypted
+ * files (imageenc.h) travel without their header: BEGIN carries the
+ * nonce and each packet is decrypted at its offset, which is why packets
+ * are multiples of the ChaCha20 block. BINCMD_BUS_BOOT starts the checked
+ * application on trial (trial.h). Bootloader images ("boot:") are not
+ * taken over the bus.
+ *
+ * The transceiver's driver enable is the board's business (the DE output
+ * of USART1 in RS-485 mode); the protocol only makes sure a node drives
+ * the bus when it was asked. */
+
+typedef struct
+{
+	uint32_t session;       /* Chosen by the host; BEGIN again is a no-op */
+	uint32_t size;          /* Image bytes, without an encryption header */
+	uint16_t packet;        /* Data bytes per BINCMD_BUS_DATA */
+	uint8_t part;           /* Partition_Type */
+	uint8_t flags;          /* BINCMD_BUS_ENCRYPTED */
+	uint8_t nonce[12];
+} BusUpdate_Params;
+
+extern uint8_t BusUpdate_Address(void);
+extern int8_t BusUpdate_SetAddress(uint8_t addr);
+extern int8_t BusUpdate_Begin(const BusUpdate_Params *params);
+extern int8_t BusUpdate_Data(uint16_t seq, uint8_t *data, uint32_t size);
+extern uint8_t BusUpdate_FlashDone(uint32_t status);
+extern uint16_t BusUpdate_Status(uint16_t first, uint8_t *out);
+extern int8_t BusUpdate_Boot(void);
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef __CHACHA20_H__
+#define __CHACHA20_H__
+#include <stdint.h>
+
+/* ChaCha20 stream cipher (RFC 8439): 256-bit key, 96-bit nonce, 32-bit
+ * block counter. Encryption and decryption are the same XOR with the key
+ * stream, which can be applied a piece at a time. Whole blocks of word
+ * aligned data are XORed a word at a time: the key stream is little
+ * endian, like the M33 and the hosts. Free of HAL includes, the host
+ * tools build it too. */
+
+#define CHACHA20_KEY_SIZE       32
+#define CHACHA20_NONCE_SIZE     12
+#define CHACHA20_BLOCK_SIZE     64
+
+typedef struct
+{
+	uint32_t state[16];                             /* Key, counter and nonce */
+	uint32_t stream[CHACHA20_BLOCK_SIZE / 4];       /* Key stream of the current block */
+	uint32_t used;                                  /* Bytes of it used */
+} ChaCha20_Ctx;
+
+extern void ChaCha20_Init(ChaCha20_Ctx *ctx, const uint8_t key[CHACHA20_KEY_SIZE],
+                          const uint8_t nonce[CHACHA20_NONCE_SIZE], uint32_t counter);
+extern void ChaCha20_Xor(ChaCha20_Ctx *ctx, uint8_t *data, uint32_t size);
+
+#endif
@@ -0,0 +1,22 @@
+#ifndef __CLOCK_H__
+#define __CLOCK_H__
+#include <stdint.h>
+
+/* System clock profiles. The bootloader idles at the profile the startup
+ * code sets up (VOS3, 100 MHz) and switches to the fastest one for the
+ * length of an update, upload or binary command session, so the CPU work
+ * per packet (CRC, copies, flash job set up) takes 2.5 times less. USART1
+ * runs from PLL2Q, so the line speed does not depend on the profile; the
+ * baud divisor is checked against the kernel clock after every switch
+ * anyway. */
+
+typedef enum
+{
+	CLOCK_NORMAL = 0,       /* VOS3, PLL1 100 MHz, 4 wait states */
+	CLOCK_PERF              /* VOS0, PLL1 250 MHz, 5 wait states */
+} Clock_Profile;
+
+extern int8_t Clock_SetProfile(uint8_t profile);
+extern uint8_t Clock_GetProfile(void);
+
+#endif
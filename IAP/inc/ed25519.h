@@ -0,0 +1,20 @@
+#ifndef __ED25519_H__
+#define __ED25519_H__
+#include <stdint.h>
+
+/* Ed25519 signatures (RFC 8032), after TweetNaCl: field elements of 16
+ * limbs of 16 bits, products as 32 x 32 -> 64 bit multiplies. The
+ * bootloader only verifies; the key derivation and signing are for the
+ * host tools and the linker drops them from the firmware (--gc-sections).
+ * Free of HAL includes. */
+
+#define ED25519_KEY_SIZE        32      /* Public key, and the private seed */
+#define ED25519_SIG_SIZE        64
+
+extern int8_t Ed25519_Verify(const uint8_t sig[ED25519_SIG_SIZE], const uint8_t *msg, uint32_t size,
+                             const uint8_t pub[ED25519_KEY_SIZE]);
+extern void Ed25519_PublicKey(uint8_t pub[ED25519_KEY_SIZE], const uint8_t seed[ED25519_KEY_SIZE]);
+extern void Ed25519_Sign(uint8_t sig[ED25519_SIG_SIZE], const uint8_t *msg, uint32_t size,
+                         const uint8_t seed[ED25519_KEY_SIZE]);
+
+#endif
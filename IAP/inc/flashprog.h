@@ -0,0 +1,17 @@
+#ifndef __FLASHPROG_H__
+#define __FLASHPROG_H__
+#include <stdint.h>
+
+/* Interrupt driven flash programmer task. One job at a time; the task that
+ * submitted it gets EVT_FLASH_DONE (param 0 = ok) when the job has finished. */
+
+#define FLASH_QUADWORD_SIZE     16
+
+extern void FlashProg_Init(void);
+extern int8_t FlashProg_Erase(uint32_t addr, uint32_t size, uint8_t notify);
+extern int8_t FlashProg_Program(uint32_t addr, const uint8_t *data, uint32_t len, uint8_t notify);
+extern uint8_t FlashProg_Busy(void);
+extern uint32_t FlashProg_SectorCount(uint32_t addr, uint32_t size);
+extern uint8_t FlashProg_Blank(uint32_t addr, uint32_t size);
+
+#endif
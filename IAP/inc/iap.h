@@ -15,8 +15,16 @@ extern void IAP_WriteFlag(uint16_t flag);
 extern int8_t IAP_RunApp(void);
 extern void IAP_Main_Menu(void);
 extern int8_t IAP_Update(void);
-extern int8_t IAP_Upload(void);
+extern int8_t IAP_UpdateResult(int32_t Size);
+extern void IAP_Reject(uint8_t part);
+extern int8_t IAP_Upload(uint32_t addr, uint32_t size);
+extern int8_t IAP_UploadResult(int32_t status);
 extern int8_t IAP_Erase(void);
+extern int8_t IAP_EraseResult(uint32_t status);
+extern void IAP_Stats(void);
+#if (USE_FLASH_BENCH == 1)
+extern void IAP_FlashBench(void);
+#endif
 
 
 
@@ -1,9 +1,21 @@
 #ifndef __IAP_CONFIG_H__
 #define __IAP_CONFIG_H__
+/* Bootloader version -----------------------------------------*/
+#define IAP_VERSION_MAJOR     0
+#define IAP_VERSION_MINOR     2
+#define IAP_VERSION_PATCH     0
+
+/* "MAJOR.MINOR.PATCH", for the console */
+#define IAP_STR_(x)           #x
+#define IAP_STR(x)            IAP_STR_(x)
+#define IAP_VERSION_STRING    IAP_STR(IAP_VERSION_MAJOR) "." IAP_STR(IAP_VERSION_MINOR) "." IAP_STR(IAP_VERSION_PATCH)
+
 /* Define if use bkp save flag  -------------------------------*/
 #define USE_BKP_SAVE_FLAG     1
 
 /* Define the APP start address -------------------------------*/
+/* Default layout only: the running bootloader takes the regions from the
+ * partition table (partition.h) */
 #define ApplicationAddress    0x800A000
 
 /* Output printer switch --------------------------------------*/
@@ -15,6 +27,9 @@
 #define CMD_ERASE_STR		  "erase"
 #define CMD_MENU_STR          "menu"
 #define CMD_RUNAPP_STR        "runapp"
+#define CMD_STATS_STR         "stats"
+#define CMD_TRACE_STR         "trace"
+#define CMD_FLASHBENCH_STR    "flashbench"
 #define CMD_ERROR_STR         "error"
 #define CMD_DISWP_STR         "diswp"//禁止写保护
 
@@ -54,17 +69,129 @@
 // #error "Please select first the STM32 device to be used (in stm32f10x.h)"
 //#endif
  #define PAGE_SIZE                         (0x2000)    /* 8 Kbyte */
- #define APP_FLASH_SIZE                    (0x16000)  /* 88 KBytes */
+ #define APP_FLASH_SIZE                    (0x12000)  /* 72 KBytes */
 
 /* STM32H5 Flash Definitions ---------------------------------*/
 #define STM32_FLASH_BASE                   (0x08000000)    /* Flash base address */
+#define BOOTLOADER_SIZE                    (0x8000)        /* Sectors 0..3, nothing else may live there */
 #define STM_SECTOR_SIZE                    PAGE_SIZE       /* Sector size = 8KB */
 #define STMFLASH_BUF_SIZE                  (PAGE_SIZE / 2) /* Buffer size in half-words */
 
-/* Compute the FLASH upload image size --------------------------*/  
-#define FLASH_IMAGE_SIZE                   (uint32_t) (APP_FLASH_SIZE - (ApplicationAddress - 0x08000000))
+/* Data partitions, written by YModem batches -----------------*/
+#define CONFIG_FLASH_ADDR                  (ApplicationAddress + APP_FLASH_SIZE)
+#define CONFIG_FLASH_SIZE                  PAGE_SIZE
+#define CALIB_FLASH_ADDR                   (CONFIG_FLASH_ADDR + CONFIG_FLASH_SIZE)
+#define CALIB_FLASH_SIZE                   PAGE_SIZE
+/* The H503 has no high-cycle EDATA area: the sector holding the IAP flag
+ * stands in for it, its first quadword stays reserved for the flag. The
+ * bootloader keeps its state there (kvstore.h) */
+#define EDATA_FLASH_ADDR                   (IAP_FLAG_ADDR + 16)
+#define EDATA_FLASH_SIZE                   (PAGE_SIZE - 16)
+
+/* Partition table, in the last 256 bytes of the bootloader area;
+ * the linker script keeps the bootloader code below it ---------*/
+#define PTABLE_ADDR                        (0x08007F00)
+
+/* At boot with the flag at APPRUN_FLAG_DATA: time the console
+ * has to stop the start of the application; the bytes received
+ * go to the menu, a command included ---------------------------*/
+#define IAP_BOOT_WAIT_MS      100
 
 /* The maximum length of the command string -------------------*/
 #define CMD_STRING_SIZE       128
 
+/* Serial port buffers (sizes must be powers of two) ----------*/
+#define SERIAL_RX_CHUNK_SIZE  64
+#define SERIAL_RX_BUF_SIZE    1024
+#define SERIAL_TX_BUF_SIZE    256
+
+/* Run with the instruction cache enabled ---------------------*/
+#ifndef USE_ICACHE
+#define USE_ICACHE            1
+#endif
+
+/* Run the vector table, the flash programmer and the UART
+ * interrupts from RAM while bank 1 is busy (ramexec.h) --------*/
+#ifndef USE_RAM_EXEC
+#define USE_RAM_EXEC          1
+#endif
+
+/* Run update, upload and binary sessions at VOS0 250 MHz ------*/
+/* The host simulation (Host/sim) builds with 0 */
+#ifndef USE_PERF_CLOCK
+#define USE_PERF_CLOCK        1
+#endif
+
+/* "flashbench" command: time sector programming through the HAL and
+ * as a burst, on the first sector of the scratch partition; the
+ * default layout has none (partition.h) ------------------------*/
+#ifndef USE_FLASH_BENCH
+#define USE_FLASH_BENCH       0
+#endif
+
+/* Send zero-copy blocks (upload packets) by DMA --------------*/
+#ifndef USE_SERIAL_TX_DMA
+#define USE_SERIAL_TX_DMA     1
+#endif
+#define SERIAL_TX_DMA_CHANNEL GPDMA1_Channel0
+#define SERIAL_TX_DMA_IRQn    GPDMA1_Channel0_IRQn
+
+/* Compute CRC-16/XMODEM with the CRC peripheral --------------*/
+/* The host simulation (Host/sim) builds with 0 */
+#ifndef USE_HW_CRC
+#define USE_HW_CRC            1
+#endif
+
+/* Largest upload packet, one of 1K/2K/4K/8K -------------------*/
+#define YMODEM_TX_PACKET_SIZE 8192
+
+/* Refresh the IWDG from the scheduler idle loop --------------*/
+#define USE_IAP_WATCHDOG      0
+
+/* Run an updated application on trial under the IWDG until it
+ * confirms; give it up after TRIAL_MAX_BOOTS starts (trial.h) --*/
+#ifndef USE_TRIAL_BOOT
+#define USE_TRIAL_BOOT        1
+#endif
+#define TRIAL_MAX_BOOTS       3
+#define TRIAL_WDG_MS          4000
+
+/* Bootloader self-update from "boot:" batch files, copied from
+ * RAM (selfupdate.h); needs USE_RAM_EXEC ----------------------*/
+#ifndef USE_SELF_UPDATE
+#define USE_SELF_UPDATE       1
+#endif
+
+/* Take application and bootloader images only with a valid
+ * signature trailer (imagesig.h). The key below is the one of
+ * Host/tools/devkey.hex, for development: put the product's own
+ * in its place (Host/tools/mksign -p KEY) ----------------------*/
+#ifndef USE_SIGNED_IMAGES
+#define USE_SIGNED_IMAGES     1
+#endif
+#define IMAGESIG_PUBLIC_KEY \
+	{ \
+		0xec, 0x73, 0x04, 0x0c, 0x2d, 0x97, 0xae, 0x85, 0xdb, 0xe2, 0x83, 0xd0, 0xf7, 0x5e, 0xe7, 0xad, \
+		0xd3, 0x5a, 0xf2, 0x81, 0x85, 0xf7, 0x66, 0xe6, 0x82, 0x02, 0x27, 0x61, 0x3b, 0xbd, 0xa1, 0x29  \
+	}
+
+/* Decrypt files sent with an encryption header (imageenc.h). The
+ * key below is the one of Host/tools/devenc.hex, for development:
+ * put the product's own in its place --------------------------*/
+#ifndef USE_ENCRYPTED_IMAGES
+#define USE_ENCRYPTED_IMAGES  1
+#endif
+#define IMAGEENC_KEY \
+	{ \
+		0x51, 0xd0, 0x47, 0x39, 0x04, 0xc7, 0xc0, 0xa9, 0xa5, 0x2c, 0xe9, 0x16, 0x5d, 0x98, 0xf8, 0x47, \
+		0xe1, 0xf2, 0x99, 0xd8, 0x54, 0xee, 0xef, 0xb2, 0xe4, 0x1e, 0x43, 0xe1, 0xd7, 0x70, 0x74, 0x2e  \
+	}
+
+/* Update many boards on one RS-485 bus at once: packets sent
+ * once to every node, only the missing ones sent again
+ * (busupdate.h) -----------------------------------------------*/
+#ifndef USE_BUS_UPDATE
+#define USE_BUS_UPDATE        1
+#endif
+
 #endif
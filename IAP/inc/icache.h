@@ -0,0 +1,12 @@
+#ifndef __ICACHE_H__
+#define __ICACHE_H__
+#include <stdint.h>
+
+/* Instruction cache of the flash (C-bus) accesses. It also serves the data
+ * reads of the flash, and it is not kept coherent with program and erase:
+ * whatever changes flash invalidates it before reading the result back. */
+
+extern void ICache_Enable(void);
+extern void ICache_Invalidate(void);
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef __IMAGEENC_H__
+#define __IMAGEENC_H__
+#include <stdint.h>
+
+/* Encrypted firmware files. A file that starts with the header below is
+ * encrypted (Host/tools/mkenc): the rest of it is ChaCha20 (chacha20.h)
+ * under IMAGEENC_KEY (iap_config.h), with the nonce of the header and
+ * the block counter from 0. Ymodem_Data takes the header off and
+ * decrypts each payload in place once it passed its CRC and sequence
+ * checks, before the hash (imagesig.h) and the flash programmer: images
+ * are signed first, then encrypted. Files without the header are taken
+ * as they are; the key keeps the images secret on the way, the
+ * signature decides what runs. Read protection (RDP) keeps the key in
+ * the bootloader's flash. */
+
+#define IMAGEENC_MAGIC          0x434E4549      /* "IENC" */
+
+/* The first bytes of an encrypted file */
+typedef struct
+{
+	uint32_t magic;
+	uint8_t nonce[12];      /* Never twice with the same key */
+} ImageEnc_Header;
+
+extern uint32_t ImageEnc_Begin(const uint8_t *data, uint32_t size, uint32_t file_size);
+extern uint32_t ImageEnc_Decrypt(uint8_t *data, uint32_t size);
+extern void ImageEnc_DecryptAt(const uint8_t nonce[12], uint32_t offset, uint8_t *data, uint32_t size);
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef __IMAGESIG_H__
+#define __IMAGESIG_H__
+#include <stdint.h>
+
+/* Signed firmware. An application file (PART_APP) or a bootloader image
+ * ("boot:" file, selfupdate.h) ends with a trailer that holds an Ed25519
+ * signature (ed25519.h) of the SHA-256 digest of the bytes before it
+ * (Host/tools/mksign). The digest is computed while the file arrives:
+ * Ymodem_Data feeds it the payload of each packet that passed its CRC and
+ * sequence checks, decrypted first for an encrypted file (imageenc.h),
+ * between flash jobs, so the end of the file costs only the signature
+ * check. The signature covers the digest rather than the image because
+ * Ed25519 hashes R, at the end of the file, before the message.
+ *
+ * A file that fails the check is reported with image_size 0 in
+ * Ymodem_Files: the session then neither writes APPRUN_FLAG_DATA nor
+ * starts a trial or a bootloader copy, and the first sector of the
+ * partition is erased. Files for the other partitions are taken as they
+ * are. The key is IMAGESIG_PUBLIC_KEY (iap_config.h).
+ *
+ * An application that passed the check is recorded in the state store
+ * (KV_APPSIG, kvstore.h) with its size, and every flash job that touches
+ * PART_APP clears the record before it changes flash (FlashProg_Start),
+ * as do the application's own writes there through the flash services.
+ * IAP_RunApp() starts nothing without the record, so "runapp",
+ * BINCMD_BOOT and a later boot cannot start an image written by
+ * WRITE_BLOCK or left behind by a cancelled session. Without an EDATA
+ * partition the record only lasts until the next reset. */
+
+#define IMAGESIG_MAGIC          0x47495349      /* "ISIG" */
+
+/* The last bytes of a signed file */
+typedef struct
+{
+	uint32_t magic;
+	uint32_t size;          /* Bytes signed: the file up to the trailer */
+	uint8_t signature[64];
+} ImageSig_Trailer;
+
+extern void ImageSig_Begin(uint8_t part, const uint8_t *file_name, uint32_t addr, uint32_t file_size);
+extern void ImageSig_Update(const uint8_t *data, uint32_t size);
+extern uint32_t ImageSig_End(void);
+extern void ImageSig_Revoke(uint32_t addr, uint32_t size);
+extern uint8_t ImageSig_AppChecked(void);
+
+#endif
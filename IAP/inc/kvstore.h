@@ -0,0 +1,57 @@
+#ifndef __KVSTORE_H__
+#define __KVSTORE_H__
+#include <stdint.h>
+
+/* Bootloader state store in the EDATA partition. The H503 has no
+ * high-cycle EDATA flash, so the partition is main flash used as a log:
+ * every update appends one quadword record and the last record of a key
+ * wins. A state change costs one quadword program; the sector is erased
+ * only when the log is full and the live values are written back.
+ *
+ * Record (one quadword, little endian):
+ *   KVSTORE_TAG << 16 | key (LE32) | value (LE32) | ~value (LE32) |
+ *   ~(KVSTORE_TAG << 16 | key) (LE32)
+ * The log ends at the first blank quadword; records that fail the check
+ * are skipped. A record torn by a reset during its program either fails
+ * the check or fails ECC: the double error NMI (KvStore_EccIsr, called by
+ * NMI_Handler) marks it and the scan skips it too. KvStore_Scan, for the
+ * services, runs under the application's NMI handler, which must do the
+ * same for a torn record to be skipped. Writes go through the STMFLASH
+ * cache, so they reach flash at its flush points.
+ *
+ * Compaction is not power-fail safe: a reset between the erase of the
+ * sector and the program of the live records (about one sector erase time)
+ * loses the keys not written back yet, and the IAP flag with them. They
+ * are written back in the order of KvStore_Order, the ones a reset hurts
+ * most first. What a lost key leaves behind is safe: no trial (the
+ * bootloader stays at its prompt), no checked application (runapp
+ * refuses until the next update), no bus address, flag INIT_FLAG_DATA.
+ * KV_SELFUPDATE is only set while the RAM stage copies the bootloader,
+ * which does not compact. A second sector to alternate with would have to
+ * come out of the application partition; the scratch partition, the
+ * other candidate, holds the staged bootloader while KV_SELFUPDATE
+ * matters. */
+
+#define KVSTORE_TAG             0x4B56u         /* "VK" */
+#define KVSTORE_RECORD_SIZE     16
+
+typedef enum
+{
+	KV_FLAG = 0,            /* IAP flag, was the halfword at IAP_FLAG_ADDR */
+	KV_TRIAL,               /* Trial boot state (trial.h) */
+	KV_SELFUPDATE,          /* Staged bootloader file size, copy pending (selfupdate.h) */
+	KV_BUSADDR,             /* RS-485 bus address (busupdate.h) */
+	KV_APPSIG,              /* Size of the checked application image, 0: none (imagesig.h) */
+	KV_COUNT
+} KvStore_Key;
+
+extern void KvStore_Init(void);
+extern uint8_t KvStore_EccIsr(void);
+extern uint8_t KvStore_Ready(void);
+extern int8_t KvStore_Get(uint8_t key, uint32_t *value);
+extern int8_t KvStore_Set(uint8_t key, uint32_t value);
+extern void KvStore_Reserve(uint32_t count);
+extern void KvStore_Encode(uint8_t key, uint32_t value, uint32_t rec[4]);
+extern int8_t KvStore_Scan(uint32_t base, uint32_t size, uint8_t key, uint32_t *value, uint32_t *free);
+
+#endif
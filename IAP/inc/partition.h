@@ -0,0 +1,66 @@
+#ifndef __PARTITION_H__
+#define __PARTITION_H__
+#include <stdint.h>
+
+/* Flash layout. The table is read once at boot from PTABLE_ADDR (the tail
+ * of the bootloader area, programmed per product); when that area is blank
+ * or does not pass the checks, the default layout from iap_config.h is
+ * used. Every flash path looks the regions up here.
+ *
+ * The default layout fills the 128 KB of the H503 and has no scratch
+ * partition: "flashbench" refuses to run, and a bootloader image is
+ * staged over the application (selfupdate.h). A product that wants
+ * either takes the room from the application in its table
+ * (Host/tools/mkptable).
+ *
+ * A YModem batch file selects its partition by name: "config:settings.bin"
+ * goes to the config partition, a name without a prefix goes to the
+ * application. */
+
+#define PTABLE_MAGIC            0x54504149      /* "IAPT" */
+#define PTABLE_VERSION          1
+#define PTABLE_MAX_ENTRIES      8
+#define PARTITION_NAME_SIZE     8
+
+typedef enum
+{
+	PART_APP = 0,           /* Application slot (A) */
+	PART_CONFIG,
+	PART_CALIB,
+	PART_EDATA,             /* Bootloader state store (kvstore.h) */
+	PART_FLAG,              /* IAP flag / journal area */
+	PART_SCRATCH,           /* Free for staging, never booted */
+	PART_APP_B,             /* Reserved for a second application slot:
+	                           nothing boots, checks or stages it, it
+	                           takes files like a data partition */
+	PART_COUNT
+} Partition_Type;
+
+typedef struct
+{
+	uint32_t type;          /* Partition_Type */
+	uint32_t addr;
+	uint32_t size;
+	char name[PARTITION_NAME_SIZE];
+} Partition;
+
+/* Layout of the table in flash */
+typedef struct
+{
+	uint32_t magic;
+	uint16_t version;
+	uint16_t count;
+	Partition entry[PTABLE_MAX_ENTRIES];
+} Partition_Table;
+
+extern void Partition_Init(void);
+extern uint8_t Partition_FromFlash(void);
+extern const Partition *Partition_Get(uint8_t type);
+extern const Partition *Partition_Lookup(uint8_t type);
+extern uint32_t Partition_Addr(uint8_t type);
+extern uint32_t Partition_Size(uint8_t type);
+extern const Partition *Partition_Find(uint32_t addr, uint32_t size);
+extern const Partition *Partition_LookupRange(uint32_t addr, uint32_t size);
+extern int8_t Partition_FromFileName(const uint8_t *file_name, uint8_t *type);
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef __RAMEXEC_H__
+#define __RAMEXEC_H__
+#include <stdint.h>
+#include "iap_config.h"
+
+/* Code that runs while a bank 1 sector is erased or programmed. The
+ * bootloader and the first application sectors share bank 1, and a fetch
+ * from a busy bank stalls the CPU until the operation ends, interrupts
+ * included. Everything on the path the CPU takes meanwhile lives in RAM:
+ * - the vector table, copied to .ram_vector by RamExec_Init()
+ * - the flash programmer job (flashprog.c) with the cache invalidation and
+ *   counters it calls, the burst programmer and the scheduler loop, marked
+ *   RAMFUNC; they do their own copies and compares, libc is in flash
+ * - the UART receive and transmit interrupts down to Serial and Sched_Post
+ *   (serial.c, sched.c, trace.c), marked RAMFUNC
+ * - the HAL functions those call, listed in the .ramfunc section of
+ *   STM32H503CBTX_FLASH.ld; the startup code copies the section.
+ * Task code still runs from flash: a task that gets the CPU while bank 1
+ * is busy waits for the operation to end. */
+
+#if (USE_RAM_EXEC == 1)
+#define RAMFUNC                 __attribute__((section(".RamFunc"), noinline))
+#else
+#define RAMFUNC
+#endif
+
+/* Cortex-M33 exceptions + STM32H503 interrupts, up to COMP1_IRQn */
+#define RAMEXEC_VECTORS         (16 + 134)
+
+extern void RamExec_Init(void);
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef __SCHED_H__
+#define __SCHED_H__
+#include <stdint.h>
+
+/* Exported constants --------------------------------------------------------*/
+#define SCHED_QUEUE_SIZE        32      /* Must be a power of two */
+
+/* Task identifiers, one state machine per task */
+typedef enum
+{
+	TASK_MENU = 0,
+	TASK_YMODEM,
+	TASK_FLASH,
+	TASK_CMD,
+	TASK_COUNT
+} Sched_TaskId;
+
+/* Event types delivered to the task handlers */
+typedef enum
+{
+	EVT_START = 0,          /* Task has been started, param is task specific */
+	EVT_TIMEOUT,            /* Software timer of the task expired */
+	EVT_UART_RX,            /* Bytes are waiting in the serial receive ring */
+	EVT_UART_IDLE,          /* The receive line went idle */
+	EVT_FLASH_EOP,          /* Flash controller finished one operation */
+	EVT_FLASH_ERROR,        /* Flash controller reported an error, param = sector/address */
+	EVT_FLASH_DONE,         /* A programmer job completed, param = 0 ok, else error */
+	EVT_YMODEM_DONE,        /* A YModem session ended, param = Ymodem result code */
+	EVT_CMD_DONE            /* The binary command session went quiet */
+} Sched_EventType;
+
+/* Exported types ------------------------------------------------------------*/
+typedef struct
+{
+	uint8_t  task;
+	uint8_t  type;
+	uint32_t param;
+} Sched_Event;
+
+typedef void (*Sched_Handler)(const Sched_Event *evt);
+
+/* Exported functions ------------------------------------------------------- */
+void Sched_Init(void);
+void Sched_Register(uint8_t task, Sched_Handler handler);
+int8_t Sched_Post(uint8_t task, uint8_t type, uint32_t param);
+void Sched_SetTimer(uint8_t task, uint32_t timeout_ms);
+void Sched_StopTimer(uint8_t task);
+uint32_t Sched_Dispatch(void);
+void Sched_Run(void);
+void Sched_IdleHook(void);
+
+#endif
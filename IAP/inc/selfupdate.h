@@ -0,0 +1,62 @@
+#ifndef __SELFUPDATE_H__
+#define __SELFUPDATE_H__
+#include <stdint.h>
+#include "partition.h"
+
+/* Self-update of the bootloader. A YModem batch file named "boot:..." is
+ * a new bootloader image: the session stages it like any other file, in
+ * the scratch partition, or in the application partition when the layout
+ * has none. The application is lost then, and the session refuses a batch
+ * that would write both to the application partition (Ymodem_Start, -6).
+ * The staged file is the image followed by a trailer (Host/tools/mkboot),
+ * then with USE_SIGNED_IMAGES the signature trailer (imagesig.h) over
+ * both; it is checked before the first erase: signature, trailer, CRC-32
+ * over the image, size and the initial stack pointer and reset vector.
+ *
+ * The copy over the bootloader sectors then runs from RAM, interrupts off,
+ * and ends in a reset: every sector up to PTABLE_ADDR is erased and burst
+ * programmed from the staged image (STMFLASH_ProgramBurst) and checked
+ * back, again until it checks (the stage never resets into a partial
+ * bootloader); the partition table of the product is kept. Before the copy,
+ * the state store records the staged file (KV_SELFUPDATE): a reset that
+ * still finds a working bootloader starts the copy again, and the new
+ * bootloader clears the record and the staged image once it finds itself
+ * installed.
+ *
+ * The copy is NOT power-fail safe. From the erase of sector 0 until the
+ * last sector is programmed and checked (four sector erases and 32 KB of
+ * programming, tens of milliseconds) no complete bootloader is in flash,
+ * and a reset in that window leaves nothing that reads KV_SELFUPDATE: the
+ * device needs the ST system bootloader (BOOT0) or a debugger. Neither
+ * real fix fits this part's layout:
+ * - Bank swap (SWAP_BANK) needs the new image staged at the same offset
+ *   in bank 2, but bank 2 is the application partition and the
+ *   application straddles the banks (iap_config.h), so swapping would
+ *   break it.
+ * - An immutable first stage in sector 0 that finishes an interrupted
+ *   copy would take sector 0 out of the 32 KB bootloader area. It would
+ *   also need its own copy of the kvstore scan, CRC-32 and flash code,
+ *   and a linker script with two entry points.
+ * Keep the power on during the copy; SelfUpdate_Start says so on the
+ * console. */
+
+#define SELFUPDATE_PREFIX       "boot:"
+#define SELFUPDATE_MAGIC        0x44505542      /* "BUPD" */
+#define SELFUPDATE_IMAGE_MAX    (PTABLE_ADDR - STM32_FLASH_BASE)
+
+/* At the end of the staged file, after the image padded to 16 bytes */
+typedef struct
+{
+	uint32_t magic;
+	uint32_t size;          /* Image bytes, a multiple of 16 */
+	uint32_t crc;           /* CRC-32 (IEEE 802.3) of the image */
+	uint32_t check;         /* ~crc */
+} SelfUpdate_Trailer;
+
+extern uint8_t SelfUpdate_IsBootFile(const uint8_t *file_name);
+extern const Partition *SelfUpdate_Staging(void);
+extern uint32_t SelfUpdate_Crc32(uint32_t crc, const uint8_t *data, uint32_t size);
+extern void SelfUpdate_Init(void);
+extern int8_t SelfUpdate_Start(void);
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef __SERIAL_H__
+#define __SERIAL_H__
+#include <stdint.h>
+#include "iap_config.h"
+
+/* Interrupt driven serial port: the receiver fills a ring buffer and posts
+ * EVT_UART_RX / EVT_UART_IDLE to the task owning the console, the
+ * transmitter drains a queue from the TX complete interrupt. */
+
+extern void Serial_Init(void);
+extern void Serial_SetRxOwner(uint8_t task);
+extern uint32_t Serial_Read(uint8_t *buf, uint32_t len);
+extern uint32_t Serial_Available(void);
+extern void Serial_RxFlush(void);
+extern uint32_t Serial_Write(const uint8_t *data, uint32_t len);
+extern void Serial_WriteBlock(const uint8_t *data, uint32_t len);
+extern uint32_t Serial_TxTimeMs(uint32_t bytes);
+extern void Serial_Flush(void);
+extern void Serial_Stop(void);
+
+/* Called from the USART HAL callbacks */
+extern void Serial_RxEventIsr(uint16_t size);
+extern void Serial_ErrorIsr(void);
+extern void Serial_TxIsr(void);
+#if (USE_SERIAL_TX_DMA == 1)
+extern void Serial_DmaIsr(void);
+#endif
+
+#endif
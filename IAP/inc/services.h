@@ -0,0 +1,61 @@
+#ifndef __SERVICES_H__
+#define __SERVICES_H__
+#include <stdint.h>
+
+/* Bootloader services for the application: a table of entry points at a
+ * fixed flash address (SERVICES region of the linker script), so the
+ * application calls the bootloader's flash programmer and CRC engine
+ * instead of linking its own.
+ *
+ * The application owns the RAM by then, so the services run from flash
+ * and keep no state in RAM: they only use the stack, the peripheral
+ * registers and constants. Nothing they call may be RAMFUNC or in the
+ * .ramfunc list of the linker script; they drive the flash lock and the
+ * ICACHE on the registers. Their flash waits stall the CPU when the
+ * sector is in bank 1, interrupts included. The YModem engine is not
+ * offered; it needs the bootloader's scheduler, serial buffers and RAM
+ * vector table.
+ *
+ * Versioning: entries are only ever appended. An application checks
+ * magic, then that count covers the last entry it calls. */
+
+#define SERVICES_ADDR           0x08007E00
+#define SERVICES_MAGIC          0x43565342      /* "BSVC" */
+#define SERVICES_VERSION        2
+
+/* Returned by the flash services for a range outside the partitions of
+ * the table, or in the flag and EDATA areas: the bootloader's state */
+#define SERVICES_ERR_RANGE      0x80000000u
+
+typedef struct
+{
+	uint32_t magic;
+	uint16_t version;
+	uint16_t count;         /* Entries after this header */
+	/* Erase the sector holding addr. In the application partition this
+	   and flash_program first clear the bootloader's record of the checked
+	   image (imagesig.h): "runapp" refuses the result until an update.
+	   Returns 0: ok, else FLASH_NSSR error flags or SERVICES_ERR_RANGE */
+	uint32_t (*flash_erase)(uint32_t addr);
+	/* Program size bytes (a multiple of 16) at the quadword aligned addr,
+	   erased beforehand. Same returns as flash_erase */
+	uint32_t (*flash_program)(uint32_t addr, const void *data, uint32_t size);
+	/* CRC-16/XMODEM, as the YModem packets carry it */
+	uint16_t (*crc16)(const uint8_t *data, uint32_t size);
+	/* Core clock cycle counter (DWT), started on first use */
+	uint32_t (*cycles)(void);
+	/* Busy wait at the current core clock */
+	void (*delay_us)(uint32_t us);
+	/* Version 2. Confirm the image on trial (trial.h); nothing to do when
+	   it is not on trial. Returns as flash_erase */
+	uint32_t (*trial_confirm)(void);
+} Services_Table;
+
+#define SERVICES_COUNT          6
+
+/* The application's view of the table */
+#define SERVICES                ((const Services_Table *)SERVICES_ADDR)
+
+extern const Services_Table Services;
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef __SHA256_H__
+#define __SHA256_H__
+#include <stdint.h>
+
+/* SHA-256 (FIPS 180-4), fed a piece at a time. The compression function
+ * reads the block as aligned words: whole blocks are hashed in place when
+ * the data is word aligned (the YModem payload is), anything else goes
+ * through the block buffer of the context. Free of HAL includes, the host
+ * tools build it too. */
+
+#define SHA256_DIGEST_SIZE      32
+#define SHA256_BLOCK_SIZE       64
+
+typedef struct
+{
+	uint32_t state[8];
+	uint32_t block[SHA256_BLOCK_SIZE / 4];  /* Partial block */
+	uint32_t fill;                          /* Bytes in block */
+	uint64_t bytes;                         /* Message length so far */
+} Sha256_Ctx;
+
+extern void Sha256_Init(Sha256_Ctx *ctx);
+extern void Sha256_Update(Sha256_Ctx *ctx, const uint8_t *data, uint32_t size);
+extern void Sha256_Final(Sha256_Ctx *ctx, uint8_t digest[SHA256_DIGEST_SIZE]);
+extern void Sha256(const uint8_t *data, uint32_t size, uint8_t digest[SHA256_DIGEST_SIZE]);
+
+#endif
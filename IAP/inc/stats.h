@@ -0,0 +1,67 @@
+#ifndef __STATS_H__
+#define __STATS_H__
+#include <stdint.h>
+
+/* Per-session performance counters. A session is an update, upload, erase
+ * or binary command session started from the menu: the counters are
+ * cleared when it starts and frozen when it ends, so they can be read
+ * afterwards with the "stats" command or BINCMD_GET_STATS. Shared with
+ * the host client (the block is sent as is, little endian), so keep this
+ * header free of HAL includes.
+ *
+ * The cycle counts come from the DWT cycle counter:
+ * - compute: the scheduler dispatching events (interrupts included)
+ * - uart_wait: sleeping in WFI while no flash job is running
+ * - flash_busy: from the start to the end of each flash programmer job,
+ *   whatever the CPU does meanwhile
+ * - blank_check: reading sectors to skip the erase of the blank ones
+ * - hash: the SHA-256 of signed files as they arrive (imagesig.h)
+ * - verify: their signature checks
+ * - decrypt: the encrypted files as they arrive (imageenc.h) */
+
+#define STATS_SIZE_CLASSES      11      /* Packet sizes 8B .. 8KB, log2(size) - 3 */
+
+typedef struct
+{
+	uint64_t compute_cycles;
+	uint64_t uart_wait_cycles;
+	uint64_t flash_busy_cycles;
+	uint64_t blank_check_cycles;
+	uint64_t hash_cycles;
+	uint64_t verify_cycles;
+	uint64_t decrypt_cycles;
+	uint32_t core_clock;        /* Hz, to turn cycles into time */
+	uint32_t elapsed_ms;
+	uint32_t rx_bytes;          /* Bytes off the line */
+	uint32_t packets[STATS_SIZE_CLASSES]; /* YModem packets received or sent */
+	uint32_t crc_errors;        /* Packets with a bad CRC or sequence complement */
+	uint32_t seq_errors;        /* Packets out of sequence */
+	uint32_t naks;              /* Retransmissions requested (NAK or 'C') */
+	uint32_t resends;           /* Upload packets sent again */
+	uint32_t uart_overruns;
+	uint32_t uart_framing;
+	uint32_t flash_erases;      /* Sectors */
+	uint32_t erases_skipped;    /* Sectors found blank */
+	uint32_t flash_programs;    /* Quadwords */
+	uint32_t hashed_bytes;      /* Bytes of signed files hashed */
+	uint32_t decrypted_bytes;
+} Stats_Counters;
+
+extern Stats_Counters Stats;
+extern volatile uint8_t Stats_Running;
+
+/* Count only while a session runs */
+#define STATS_ADD(field, n)     do { if (Stats_Running) Stats.field += (n); } while (0)
+#define STATS_INC(field)        STATS_ADD(field, 1)
+
+extern void Stats_Init(void);
+extern void Stats_Begin(void);
+extern void Stats_End(void);
+extern void Stats_Get(Stats_Counters *out);
+extern uint32_t Stats_Cycles(void);
+extern void Stats_Compute(uint32_t cycles);
+extern void Stats_Sleep(uint32_t cycles);
+extern void Stats_FlashBusy(uint8_t busy);
+extern void Stats_Packet(uint32_t size);
+
+#endif
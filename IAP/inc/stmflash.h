@@ -8,6 +8,14 @@
 extern uint16_t STMFLASH_ReadHalfWord(uint32_t faddr);		 //读出半字  
 extern void STMFLASH_Write(uint32_t addr,uint16_t *buffer,uint16_t count);		//从指定地址开始写入指定长度的数据
 extern void STMFLASH_Read(uint32_t ReadAddr,uint16_t *pBuffer,uint16_t NumToRead);   		//从指定地址开始读出指定长度的数据
+extern uint32_t STMFLASH_Flush(void);
+extern uint32_t STMFLASH_Rewrite(uint32_t addr, const uint8_t *data, uint32_t len);
+extern HAL_StatusTypeDef STMFLASH_EraseSector(uint32_t secpos);
+extern uint32_t STMFLASH_ProgramBurst(uint32_t addr, const uint32_t *data, uint32_t count);
+#if (USE_FLASH_BENCH == 1)
+extern int8_t STMFLASH_Bench(uint32_t addr, uint32_t *hal_cycles, uint32_t *burst_cycles);
+extern int8_t STMFLASH_BenchRead(uint32_t addr, uint32_t *halfword_cycles, uint32_t *read_cycles);
+#endif
 #endif
 
 
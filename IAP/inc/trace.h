@@ -0,0 +1,67 @@
+#ifndef __TRACE_H__
+#define __TRACE_H__
+#include <stdint.h>
+
+/* Protocol event trace: a ring of timestamped events in a RAM section the
+ * startup code leaves alone, so the events leading up to a reset can still
+ * be read afterwards. Shared with the host decoder (Host/tools/iaptrace),
+ * so keep this header free of HAL includes.
+ *
+ * The "trace" menu command dumps the ring, oldest event first:
+ *   TRACE_MAGIC (LE32) | core clock Hz (LE32) | lost (LE32) | entries (LE16) |
+ *   entries * Trace_Entry | crc (BE16)
+ * Entries are little endian; the CRC is CRC-16/XMODEM over everything in
+ * front of it. lost counts the events overwritten since the ring was
+ * cleared. Time stamps are raw DWT cycles: they wrap every 2^32 cycles
+ * (43 s at 100 MHz) and restart at every TRACE_BOOT. They count at the
+ * header's clock until a TRACE_CLOCK event, at the clock it gives after it. */
+
+#define TRACE_MAGIC             0x31435254u     /* "TRC1" */
+#define TRACE_ENTRIES           512             /* Must be a power of two */
+
+/* Events, seq is the YModem sequence number where it applies */
+typedef enum
+{
+	TRACE_BOOT = 1,         /* Bootloader started, arg = 0 cold, 1 trace kept */
+	TRACE_SESSION_START,    /* arg = 0 update, 1 upload */
+	TRACE_SESSION_END,      /* arg = result (low 16 bits) */
+	TRACE_PKT_START,        /* Start byte seen, arg = payload size */
+	TRACE_PKT_DATA,         /* Payload complete */
+	TRACE_PKT_CRC,          /* CRC checked, arg = 1 good, 0 bad */
+	TRACE_ACK,              /* ACK sent */
+	TRACE_NAK,              /* NAK sent */
+	TRACE_POLL,             /* 'C' sent */
+	TRACE_EOT,              /* EOT received */
+	TRACE_ERASE_START,      /* arg = sectors */
+	TRACE_ERASE_END,        /* arg = status */
+	TRACE_PROG_START,       /* arg = quadwords */
+	TRACE_PROG_END,         /* arg = status */
+	TRACE_TX_PKT,           /* Upload packet sent, arg = payload size */
+	TRACE_TX_ACK,           /* Upload packet acknowledged */
+	TRACE_TX_NAK,           /* Upload packet refused or timed out */
+	TRACE_CLOCK             /* Clock profile switched, arg = new core clock MHz */
+} Trace_Event;
+
+typedef struct
+{
+	uint32_t cycles;        /* DWT cycle counter */
+	uint8_t event;
+	uint8_t seq;
+	uint16_t arg;
+} Trace_Entry;
+
+typedef struct
+{
+	uint32_t magic;
+	uint32_t head;          /* Entries ever written since the ring was cleared */
+	Trace_Entry ring[TRACE_ENTRIES];
+} Trace_Ring;
+
+extern Trace_Ring Trace;
+
+extern void Trace_Init(void);
+extern void Trace_Clear(void);
+extern void Trace_Log(uint8_t event, uint8_t seq, uint16_t arg);
+extern void Trace_Dump(void);
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef __TRIAL_H__
+#define __TRIAL_H__
+#include <stdint.h>
+
+/* Trial boot of a freshly updated application. After an update that
+ * wrote PART_APP the bootloader runs the new image on trial: the IWDG is
+ * started before the jump (TRIAL_WDG_MS, it cannot be stopped again) and
+ * every boot while the trial lasts starts the image again, up to
+ * TRIAL_MAX_BOOTS. An image that hangs is reset by the watchdog and
+ * counted; one that never confirms is given up and the bootloader stays
+ * at its prompt for a new update. A confirmed image starts at every boot
+ * through the IAP flag, as before the update.
+ *
+ * The application confirms once it is healthy with the trial_confirm
+ * service (services.h), and refreshes the IWDG from then on.
+ *
+ * State, key KV_TRIAL of the state store (kvstore.h):
+ *   TRIAL_xxx | boots << 8 */
+
+typedef enum
+{
+	TRIAL_NONE = 0,         /* Nothing on trial, the image is confirmed */
+	TRIAL_PENDING,          /* Running on trial, not confirmed yet */
+	TRIAL_FAILED            /* Never confirmed, given up */
+} Trial_State;
+
+extern void Trial_Start(void);
+extern void Trial_Boot(void);
+extern void Trial_Handoff(void);
+extern uint8_t Trial_Get(uint32_t *boots);
+
+#endif
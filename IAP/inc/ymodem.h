@@ -27,6 +27,15 @@
 /* Includes ------------------------------------------------------------------*/
 
 /* Exported types ------------------------------------------------------------*/
+/* One file of a batch session */
+typedef struct
+{
+  uint8_t part;             /* Partition_Id */
+  int32_t size;
+  uint32_t image_size;      /* Bytes signed (imagesig.h), else size; 0: rejected */
+  uint8_t name[32];
+} Ymodem_File;
+
 /* Exported constants --------------------------------------------------------*/
 #define PACKET_SEQNO_INDEX      (1)
 #define PACKET_SEQNO_COMP_INDEX (2)
@@ -43,6 +52,8 @@
 #define PACKET_512B_SIZE        (512)
 #define PACKET_1KB_SIZE         (1024)
 #define PACKET_2KB_SIZE		    (2048)
+#define PACKET_4KB_SIZE         (4096)
+#define PACKET_8KB_SIZE         (8192)
 
 #define FILE_NAME_LENGTH        (256)
 #define FILE_SIZE_LENGTH        (16)
@@ -58,6 +69,8 @@
 #define STX_512B				(0xA7)
 #define STX_1KB                 (0xA8)
 #define STX_2KB                 (0XA9)
+#define STX_4KB                 (0xAA)  /* Upload only */
+#define STX_8KB                 (0xAB)  /* Upload only */
 
 #define EOT                     (0x04)  /* end of transmission */
 #define ACK                     (0x06)  /* acknowledge */
@@ -69,15 +82,23 @@
 #define ABORT2                  (0x61)  /* 'a' == 0x61, abort by user */
 
 #define NAK_TIMEOUT             (0x100000)
+#define YMODEM_NAK_TIMEOUT_MS   (1000)  /* Receive engine: silence before re-sending 'C' */
 #define MAX_ERRORS              (5)
+#define YMODEM_TX_MAX_ERRORS    (10)    /* Retries per upload packet */
+#define YMODEM_BATCH_MAX        (8)     /* Files reported per batch session */
 
 extern uint32_t FlashDestination;
 extern uint8_t file_name[FILE_NAME_LENGTH];
+extern Ymodem_File Ymodem_Files[YMODEM_BATCH_MAX];
+extern uint8_t Ymodem_FileCount;
 
 /* Exported macro ------------------------------------------------------------*/
 /* Exported functions ------------------------------------------------------- */
-int32_t Ymodem_Receive (uint8_t *);
-uint8_t Ymodem_Transmit (uint8_t *,const  uint8_t* , uint32_t );
+void Ymodem_Init (void);
+int8_t Ymodem_Start (uint8_t notify);
+int8_t Ymodem_SendStart (uint32_t addr, uint32_t size, const uint8_t *name, uint8_t notify);
+uint16_t UpdateCRC16 (uint16_t crcIn, uint8_t byte);
+uint16_t Cal_CRC16 (const uint8_t* data, uint32_t size);
 
 #endif  /* _YMODEM_H_ */
 
@@ -0,0 +1,501 @@
+#include "bincmd.h"
+#include "iap.h"
+#include "iap_config.h"
+#include "common.h"
+#include "sched.h"
+#include "serial.h"
+#include "flashprog.h"
+#include "ymodem.h"
+#include "partition.h"
+#include "imagesig.h"
+#include "stats.h"
+#include "busupdate.h"
+
+/* Private define ------------------------------------------------------------*/
+#define BINCMD_BUF_SIZE         (BINCMD_HEADER_SIZE + BINCMD_MAX_PAYLOAD + 2)
+#define BINCMD_IDLE_TIMEOUT_MS  2000    /* Hand the console back to the menu */
+
+/* Private typedef -----------------------------------------------------------*/
+typedef enum
+{
+	BC_IDLE = 0,
+	BC_SOF0,                /* Hunting for the first sync byte */
+	BC_SOF1,
+	BC_FRAME,               /* Collecting header, payload and CRC */
+	BC_WAIT                 /* A frame waits for the flash programmer */
+} BinCmd_State;
+
+/* Private variables ---------------------------------------------------------*/
+static __ALIGNED(4) uint8_t BinCmd_Buf[2][BINCMD_BUF_SIZE];
+
+static struct
+{
+	uint8_t state;
+	uint8_t notify;
+	uint8_t rx;             /* Buffer being received into */
+	uint8_t busy;           /* A flash job runs for the frame in the other buffer */
+	uint8_t boot;           /* Jump to the application once the answer is out */
+	uint16_t need;
+	uint16_t count;
+} bc;
+
+/************************************************************************/
+static uint32_t BinCmd_Get32(const uint8_t *p)
+{
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/************************************************************************/
+static void BinCmd_Put32(uint8_t *p, uint32_t v)
+{
+	p[0] = (uint8_t)v;
+	p[1] = (uint8_t)(v >> 8);
+	p[2] = (uint8_t)(v >> 16);
+	p[3] = (uint8_t)(v >> 24);
+}
+
+/************************************************************************/
+static uint16_t BinCmd_Crc(uint16_t crc, const uint8_t *data, uint32_t len)
+{
+	while (len--)
+	{
+		crc = UpdateCRC16(crc, *data++);
+	}
+	return crc;
+}
+
+/**
+  * @brief  Send a response frame; data is sent straight from its location
+  *         (RAM or flash) without being copied.
+  */
+static void BinCmd_Respond(const uint8_t *frame, uint8_t status, const uint8_t *data, uint16_t len)
+{
+	uint8_t head[2 + BINCMD_HEADER_SIZE + 1];
+	uint16_t crc;
+
+	head[0] = BINCMD_SOF0;
+	head[1] = BINCMD_SOF1;
+	head[2] = frame[0] | BINCMD_RESPONSE;
+	head[3] = frame[1];
+	head[4] = (uint8_t)(len + 1);
+	head[5] = (uint8_t)((len + 1) >> 8);
+	head[6] = status;
+	crc = BinCmd_Crc(0, head + 2, sizeof(head) - 2);
+	crc = BinCmd_Crc(crc, data, len);
+	crc = UpdateCRC16(crc, 0);
+	crc = UpdateCRC16(crc, 0);
+
+	Serial_Write(head, sizeof(head));
+	Serial_Write(data, len);
+	head[0] = (uint8_t)(crc >> 8);
+	head[1] = (uint8_t)crc;
+	Serial_Write(head, 2);
+}
+
+/**
+  * @brief  Erase and write must stay inside one partition, and out of the
+  *         state sector: erasing EDATA wipes the flag and the kvstore
+  *         behind its RAM copy
+  */
+static uint8_t BinCmd_InPartition(uint32_t addr, uint32_t size)
+{
+	const Partition *p = Partition_Find(addr, size);
+
+	return (p != 0) && (p->type != PART_FLAG) && (p->type != PART_EDATA);
+}
+
+/**
+  * @brief  BOOT with the size of the file written at the application
+  *         address: check its signature from flash, as a bus update does
+  */
+static void BinCmd_CheckApp(uint32_t file_size)
+{
+	const Partition *p = Partition_Get(PART_APP);
+
+	if ((p == 0) || (file_size == 0) || (file_size > p->size))
+	{
+		return;
+	}
+	ImageSig_Begin(PART_APP, (const uint8_t *)"", p->addr, file_size);
+	ImageSig_Update((const uint8_t *)(uintptr_t)p->addr, file_size);
+	ImageSig_End();
+}
+
+/************************************************************************/
+static uint8_t BinCmd_InFlash(uint32_t addr, uint32_t size)
+{
+	return (addr >= STM32_FLASH_BASE) && (size <= FLASH_SIZE_DEFAULT) &&
+	       (addr - STM32_FLASH_BASE <= FLASH_SIZE_DEFAULT - size);
+}
+
+#if (USE_BUS_UPDATE == 1)
+/**
+  * @brief  Execute a bus update request (busupdate.h) that is for this node
+  *         or for all of them; only the first kind is answered
+  * @retval 0: done, 1: flash job started (BinCmd_FlashDone)
+  */
+static uint8_t BinCmd_Bus(uint8_t *frame)
+{
+	uint16_t len = frame[2] | ((uint16_t)frame[3] << 8);
+	uint8_t *payload = frame + BINCMD_HEADER_SIZE;
+	uint8_t addr = BusUpdate_Address(), status = BINCMD_OK;
+	uint8_t answer[9 + 2 * BINCMD_BUS_MISSING_MAX];
+	uint16_t n = 0;
+	BusUpdate_Params params;
+	int8_t result = 0;
+
+	if ((len == 0) || (addr == BINCMD_ADDR_NONE) ||
+	    ((payload[0] != addr) && (payload[0] != BINCMD_ADDR_ALL)))
+	{
+		return 0;
+	}
+	switch (frame[0])
+	{
+		case BINCMD_BUS_BEGIN:
+			if (len != BINCMD_BUS_BEGIN_SIZE)
+			{
+				result = -1;
+				break;
+			}
+			params.session = BinCmd_Get32(payload + 1);
+			params.size = BinCmd_Get32(payload + 5);
+			params.packet = payload[9] | ((uint16_t)payload[10] << 8);
+			params.part = payload[11];
+			params.flags = payload[12];
+			memcpy(params.nonce, payload + 13, sizeof(params.nonce));
+			result = BusUpdate_Begin(&params);
+			break;
+
+		case BINCMD_BUS_DATA:
+			result = (len < 3) ? -1 :
+			         BusUpdate_Data(payload[1] | ((uint16_t)payload[2] << 8), payload + 3, len - 3u);
+			break;
+
+		case BINCMD_BUS_STATUS:
+			if ((len != 3) || (payload[0] == BINCMD_ADDR_ALL))
+				return 0;
+			n = BusUpdate_Status(payload[1] | ((uint16_t)payload[2] << 8), answer);
+			break;
+
+		case BINCMD_BUS_BOOT:
+			if (BusUpdate_Boot() != 0)
+			{
+				status = BINCMD_ERR_BOOT;
+				break;
+			}
+			bc.boot = 1;
+			break;
+
+		default:
+			status = BINCMD_ERR_CMD;
+			break;
+	}
+	if (result == 1)
+	{
+		return 1;
+	}
+	if (result < 0)
+	{
+		status = (result == -1) ? BINCMD_ERR_ARG : BINCMD_ERR_FLASH;
+	}
+	if (payload[0] != BINCMD_ADDR_ALL)
+	{
+		BinCmd_Respond(frame, status, answer, n);
+	}
+	return 0;
+}
+#endif
+
+/**
+  * @brief  Execute a received frame
+  * @retval 0: answered, 1: flash job started (answer when it completes)
+  */
+static uint8_t BinCmd_Execute(uint8_t *frame)
+{
+	uint8_t cmd = frame[0];
+	uint16_t len = frame[2] | ((uint16_t)frame[3] << 8);
+	uint8_t *payload = frame + BINCMD_HEADER_SIZE;
+	uint8_t info[20];
+	Stats_Counters stats;
+	uint32_t addr = BinCmd_Get32(payload), size = BinCmd_Get32(payload + 4);
+	uint16_t crc;
+
+#if (USE_BUS_UPDATE == 1)
+	if (BINCMD_IS_BUS(cmd))
+	{
+		return BinCmd_Bus(frame);
+	}
+#endif
+	switch (cmd)
+	{
+		case BINCMD_GET_INFO:
+			info[0] = BINCMD_VERSION;
+			info[1] = IAP_VERSION_MAJOR;
+			info[2] = IAP_VERSION_MINOR;
+			info[3] = IAP_VERSION_PATCH;
+			BinCmd_Put32(info + 4, Partition_Addr(PART_APP));
+			BinCmd_Put32(info + 8, Partition_Size(PART_APP));
+			BinCmd_Put32(info + 12, PAGE_SIZE);
+			info[16] = (uint8_t)BINCMD_MAX_DATA;
+			info[17] = (uint8_t)(BINCMD_MAX_DATA >> 8);
+			info[18] = BusUpdate_Address();
+			BinCmd_Respond(frame, BINCMD_OK, info, 19);
+			return 0;
+
+		case BINCMD_ERASE_RANGE:
+			if ((len != 8) || !BinCmd_InPartition(addr, size))
+				break;
+			if (FlashProg_Erase(addr, size, TASK_CMD) != 0)
+			{
+				BinCmd_Respond(frame, BINCMD_ERR_FLASH, 0, 0);
+				return 0;
+			}
+			return 1;
+
+		case BINCMD_WRITE_BLOCK:
+			size = (uint32_t)len - 4;
+			if ((len < 4) || !BinCmd_InPartition(addr, size))
+				break;
+			if (FlashProg_Program(addr, payload + 4, size, TASK_CMD) != 0)
+			{
+				BinCmd_Respond(frame, BINCMD_ERR_ARG, 0, 0);
+				return 0;
+			}
+			return 1;
+
+		case BINCMD_READ_BLOCK:
+			size = payload[4] | ((uint32_t)payload[5] << 8);
+			if ((len != 6) || (size > BINCMD_MAX_DATA) || !BinCmd_InFlash(addr, size))
+				break;
+			BinCmd_Respond(frame, BINCMD_OK, (const uint8_t *)(uintptr_t)addr, (uint16_t)size);
+			return 0;
+
+		case BINCMD_VERIFY:
+			if ((len != 8) || !BinCmd_InFlash(addr, size))
+				break;
+			crc = Cal_CRC16((const uint8_t *)(uintptr_t)addr, size);
+			info[0] = (uint8_t)crc;
+			info[1] = (uint8_t)(crc >> 8);
+			BinCmd_Respond(frame, BINCMD_OK, info, 2);
+			return 0;
+
+		case BINCMD_BOOT:
+			if ((len == 4) && !ImageSig_AppChecked())
+			{
+				BinCmd_CheckApp(addr);
+			}
+			if ((((*(__IO uint32_t*)(uintptr_t)Partition_Addr(PART_APP)) & 0x2FFE0000) != 0x20000000) ||
+			    !ImageSig_AppChecked())
+			{
+				BinCmd_Respond(frame, BINCMD_ERR_BOOT, 0, 0);
+				return 0;
+			}
+			BinCmd_Respond(frame, BINCMD_OK, 0, 0);
+			bc.boot = 1;
+			return 0;
+
+		case BINCMD_GET_STATS:
+			Stats_Get(&stats);
+			BinCmd_Respond(frame, BINCMD_OK, (const uint8_t *)&stats, sizeof(stats));
+			return 0;
+
+		case BINCMD_SET_ADDR:
+			if ((len != 1) || (BusUpdate_SetAddress(payload[0]) != 0))
+				break;
+			BinCmd_Respond(frame, BINCMD_OK, 0, 0);
+			return 0;
+
+		default:
+			BinCmd_Respond(frame, BINCMD_ERR_CMD, 0, 0);
+			return 0;
+	}
+	BinCmd_Respond(frame, BINCMD_ERR_ARG, 0, 0);
+	return 0;
+}
+
+/**
+  * @brief  A frame is complete in the receive buffer
+  */
+static void BinCmd_Frame(void)
+{
+	uint8_t *frame = BinCmd_Buf[bc.rx];
+	uint16_t len = frame[2] | ((uint16_t)frame[3] << 8);
+	uint16_t crc = ((uint16_t)frame[BINCMD_HEADER_SIZE + len] << 8) | frame[BINCMD_HEADER_SIZE + len + 1];
+
+	bc.state = BC_SOF0;
+	if (Cal_CRC16(frame, BINCMD_HEADER_SIZE + len) != crc)
+	{
+		STATS_INC(crc_errors);
+		if (BusUpdate_Address() == BINCMD_ADDR_NONE)
+		{
+			BinCmd_Respond(frame, BINCMD_ERR_CRC, 0, 0);
+		}
+		return;
+	}
+	if (frame[0] & BINCMD_RESPONSE)
+	{
+		/* Another node answering on the bus */
+		return;
+	}
+	if (bc.busy)
+	{
+		/* Keep the answers in request order */
+		bc.state = BC_WAIT;
+		return;
+	}
+	if (BinCmd_Execute(frame))
+	{
+		bc.busy = 1;
+		bc.rx ^= 1;
+	}
+}
+
+/************************************************************************/
+static void BinCmd_RxData(void)
+{
+	uint8_t c;
+	uint32_t n, total = 0;
+
+	while ((bc.state != BC_WAIT) && !bc.boot)
+	{
+		if (bc.state != BC_FRAME)
+		{
+			if (Serial_Read(&c, 1) == 0)
+				break;
+			total++;
+			if (bc.state == BC_SOF0)
+			{
+				if (c == BINCMD_SOF0)
+					bc.state = BC_SOF1;
+			}
+			else if (c == BINCMD_SOF1)
+			{
+				bc.state = BC_FRAME;
+				bc.count = 0;
+				bc.need = BINCMD_HEADER_SIZE;
+			}
+			else
+			{
+				bc.state = (c == BINCMD_SOF0) ? BC_SOF1 : BC_SOF0;
+			}
+			continue;
+		}
+		n = Serial_Read(BinCmd_Buf[bc.rx] + bc.count, bc.need);
+		if (n == 0)
+			break;
+		total += n;
+		bc.count += n;
+		bc.need -= n;
+		if (bc.need != 0)
+			continue;
+		if (bc.count == BINCMD_HEADER_SIZE)
+		{
+			n = BinCmd_Buf[bc.rx][2] | ((uint16_t)BinCmd_Buf[bc.rx][3] << 8);
+			if (n > BINCMD_MAX_PAYLOAD)
+			{
+				bc.state = BC_SOF0;
+				continue;
+			}
+			bc.need = n + 2;
+		}
+		else
+		{
+			BinCmd_Frame();
+		}
+	}
+	if (bc.boot)
+	{
+		IAP_RunApp();
+		bc.boot = 0;
+	}
+	if (total != 0)
+	{
+		Sched_SetTimer(TASK_CMD, (bc.state == BC_FRAME) ? BINCMD_BYTE_TIMEOUT_MS : BINCMD_IDLE_TIMEOUT_MS);
+	}
+}
+
+/**
+  * @brief  The flash job of the previous frame finished: answer it, then
+  *         run the frame that was waiting behind it
+  */
+static void BinCmd_FlashDone(uint32_t status)
+{
+	uint8_t *frame = BinCmd_Buf[bc.rx ^ 1];
+
+	bc.busy = 0;
+	if (BINCMD_IS_BUS(frame[0]))
+	{
+		status = BusUpdate_FlashDone(status);
+	}
+	if (!BINCMD_IS_BUS(frame[0]) || (frame[BINCMD_HEADER_SIZE] != BINCMD_ADDR_ALL))
+	{
+		BinCmd_Respond(frame, status ? BINCMD_ERR_FLASH : BINCMD_OK, 0, 0);
+	}
+	if (bc.state == BC_WAIT)
+	{
+		bc.state = BC_SOF0;
+		if (BinCmd_Execute(BinCmd_Buf[bc.rx]))
+		{
+			bc.busy = 1;
+			bc.rx ^= 1;
+		}
+	}
+	BinCmd_RxData();
+	Sched_SetTimer(TASK_CMD, BINCMD_IDLE_TIMEOUT_MS);
+}
+
+/************************************************************************/
+static void BinCmd_Task(const Sched_Event *evt)
+{
+	if (bc.state == BC_IDLE)
+		return;
+	switch (evt->type)
+	{
+		case EVT_UART_RX:
+			BinCmd_RxData();
+			break;
+		case EVT_FLASH_DONE:
+			BinCmd_FlashDone(evt->param);
+			break;
+		case EVT_TIMEOUT:
+			if (bc.busy || (bc.state == BC_WAIT))
+			{
+				Sched_SetTimer(TASK_CMD, BINCMD_IDLE_TIMEOUT_MS);
+			}
+			else if (bc.state == BC_FRAME)
+			{
+				/* Incomplete frame, resynchronise */
+				bc.state = BC_SOF0;
+				Sched_SetTimer(TASK_CMD, BINCMD_IDLE_TIMEOUT_MS);
+			}
+			else
+			{
+				bc.state = BC_IDLE;
+				Sched_Post(bc.notify, EVT_CMD_DONE, 0);
+			}
+			break;
+		default:
+			break;
+	}
+}
+
+/************************************************************************/
+void BinCmd_Init(void)
+{
+	bc.state = BC_IDLE;
+	Sched_Register(TASK_CMD, BinCmd_Task);
+}
+
+/**
+  * @brief  Take over the console; the menu has just consumed BINCMD_SOF0.
+  *         EVT_CMD_DONE goes to notify once the host stays quiet.
+  */
+void BinCmd_Start(uint8_t notify)
+{
+	memset(&bc, 0, sizeof(bc));
+	bc.notify = notify;
+	bc.state = BC_SOF1;
+	Serial_SetRxOwner(TASK_CMD);
+	Sched_SetTimer(TASK_CMD, BINCMD_BYTE_TIMEOUT_MS);
+	Sched_Post(TASK_CMD, EVT_UART_RX, 0);
+}
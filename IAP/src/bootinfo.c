@@ -0,0 +1,79 @@
+#include "bootinfo.h"
+#include "iap_config.h"
+#include "stm32h5xx_hal.h"
+#include <stddef.h>
+
+/* Private variables ---------------------------------------------------------*/
+BootInfo BootInfo_Block __attribute__((section(".bootinfo")));
+static uint32_t BootInfo_ResetCause;
+static int32_t BootInfo_Update;
+
+typedef char BootInfo_Fits[(sizeof(BootInfo) <= BOOTINFO_SIZE) ? 1 : -1];
+
+/************************************************************************/
+static uint32_t BootInfo_Checksum(const BootInfo *info)
+{
+	const uint32_t *word = (const uint32_t *)info;
+	uint32_t check = 0;
+	uint32_t i;
+
+	for (i = 0; i < offsetof(BootInfo, check) / 4; i++)
+	{
+		check ^= word[i];
+	}
+	return ~check;
+}
+
+/**
+  * @brief  Take the reset cause before anything clears it; the application
+  *         finds it in the block
+  */
+void BootInfo_Init(void)
+{
+	BootInfo_ResetCause = RCC->RSR;
+	__HAL_RCC_CLEAR_RESET_FLAGS();
+	BootInfo_Update = BOOTINFO_NO_UPDATE;
+}
+
+/**
+  * @param  result: the session result, as EVT_YMODEM_DONE carries it
+  */
+void BootInfo_SetUpdate(int32_t result)
+{
+	BootInfo_Update = result;
+}
+
+/**
+  * @brief  Write the block for the application, with the clock tree as it
+  *         is now; called last thing before the jump
+  */
+void BootInfo_Publish(void)
+{
+	BootInfo *info = &BootInfo_Block;
+
+	info->magic = BOOTINFO_MAGIC;
+	info->version = BOOTINFO_VERSION;
+	info->size = sizeof(BootInfo);
+	info->bl_version = (IAP_VERSION_MAJOR << 16) | (IAP_VERSION_MINOR << 8) | IAP_VERSION_PATCH;
+	info->reset_cause = BootInfo_ResetCause;
+	info->update = BootInfo_Update;
+	info->sysclk = HAL_RCC_GetSysClockFreq();
+	info->hclk = HAL_RCC_GetHCLKFreq();
+	info->pclk1 = HAL_RCC_GetPCLK1Freq();
+	info->pclk2 = HAL_RCC_GetPCLK2Freq();
+	info->pclk3 = HAL_RCC_GetPCLK3Freq();
+	info->usart1_clk = HAL_RCCEx_GetPeriphCLKFreq(RCC_PERIPHCLK_USART1);
+	info->rcc_cr = RCC->CR;
+	info->vos = HAL_PWREx_GetVoltageRange();
+	info->latency = __HAL_FLASH_GET_LATENCY();
+	info->check = BootInfo_Checksum(info);
+}
+
+/**
+  * @retval 1: the block is complete and in this format
+  */
+uint8_t BootInfo_Valid(const BootInfo *info)
+{
+	return (info->magic == BOOTINFO_MAGIC) && (info->size == sizeof(BootInfo)) &&
+	       (info->check == BootInfo_Checksum(info));
+}
@@ -0,0 +1,244 @@
+#include "busupdate.h"
+#include "bincmd.h"
+#include "iap.h"
+#include "iap_config.h"
+#include "common.h"
+#include "sched.h"
+#include "flashprog.h"
+#include "partition.h"
+#include "kvstore.h"
+#include "imagesig.h"
+#include "imageenc.h"
+#include "trial.h"
+#include "bootinfo.h"
+#include "stats.h"
+#include <string.h>
+
+/* Private variables ---------------------------------------------------------*/
+static struct
+{
+	uint8_t state;              /* BINCMD_BUS_xxx */
+	uint8_t job;                /* Flash job running: BINCMD_BUS_BEGIN or _DATA, 0: none */
+	uint16_t job_seq;
+	uint32_t addr;              /* Of the partition */
+	uint16_t packets;
+	uint16_t received;
+	uint32_t image_size;        /* Once checked (imagesig.h) */
+	BusUpdate_Params params;
+	uint32_t map[BINCMD_BUS_MAX_PACKETS / 32];   /* Bit per packet programmed */
+} bu;
+
+/************************************************************************/
+static uint8_t BusUpdate_Have(uint16_t seq)
+{
+	return (bu.map[seq / 32] >> (seq % 32)) & 1;
+}
+
+/************************************************************************/
+static void BusUpdate_Put16(uint8_t *p, uint16_t v)
+{
+	p[0] = (uint8_t)v;
+	p[1] = (uint8_t)(v >> 8);
+}
+
+/**
+  * @retval The node's address, BINCMD_ADDR_NONE when it has none
+  */
+uint8_t BusUpdate_Address(void)
+{
+	uint32_t addr;
+
+	return (KvStore_Get(KV_BUSADDR, &addr) == 0) ? (uint8_t)addr : BINCMD_ADDR_NONE;
+}
+
+/**
+  * @retval 0: ok, -1: BINCMD_ADDR_ALL, or no state store
+  */
+int8_t BusUpdate_SetAddress(uint8_t addr)
+{
+	if (addr == BINCMD_ADDR_ALL)
+	{
+		return -1;
+	}
+	return KvStore_Set(KV_BUSADDR, addr);
+}
+
+/**
+  * @brief  Start a session: erase the range the image goes to. The state
+  *         store and the flag are never a target, the address lives there.
+  * @retval 1: erase job started (BusUpdate_FlashDone), 0: this session
+  *         runs already, -1: bad parameters, -2: programmer busy
+  */
+int8_t BusUpdate_Begin(const BusUpdate_Params *params)
+{
+	const Partition *part = Partition_Get(params->part);
+	uint32_t packets;
+
+	if ((params->session == bu.params.session) &&
+	    ((bu.state != BINCMD_BUS_IDLE) && (bu.state != BINCMD_BUS_FAILED)))
+	{
+		return 0;
+	}
+	if ((part == 0) || (part->type == PART_FLAG) || (part->type == PART_EDATA) ||
+	    (params->size == 0) || (params->size > part->size) ||
+	    (params->packet == 0) || (params->packet % BINCMD_BUS_BLOCK != 0) ||
+	    (params->packet > BINCMD_MAX_DATA))
+	{
+		return -1;
+	}
+#if (USE_ENCRYPTED_IMAGES != 1)
+	if (params->flags & BINCMD_BUS_ENCRYPTED)
+	{
+		return -1;
+	}
+#endif
+	packets = (params->size + params->packet - 1) / params->packet;
+	if (packets > BINCMD_BUS_MAX_PACKETS)
+	{
+		return -1;
+	}
+	if (FlashProg_Erase(part->addr, params->size, TASK_CMD) != 0)
+	{
+		return -2;
+	}
+	memset(&bu, 0, sizeof(bu));
+	bu.params = *params;
+	bu.addr = part->addr;
+	bu.packets = (uint16_t)packets;
+	bu.job = BINCMD_BUS_BEGIN;
+	return 1;
+}
+
+/**
+  * @brief  A packet of the session; data has room for its padding to a
+  *         quadword and must stay until BusUpdate_FlashDone
+  * @retval 1: program job started, 0: no session or packet already in,
+  *         -1: bad packet, -2: programmer busy
+  */
+int8_t BusUpdate_Data(uint16_t seq, uint8_t *data, uint32_t size)
+{
+	uint32_t offset = (uint32_t)seq * bu.params.packet;
+
+	if ((bu.state != BINCMD_BUS_RECEIVING) || (seq >= bu.packets))
+	{
+		return 0;
+	}
+	if (size != ((seq == bu.packets - 1) ? bu.params.size - offset : bu.params.packet))
+	{
+		return -1;
+	}
+	if (BusUpdate_Have(seq))
+	{
+		return 0;
+	}
+	if (bu.params.flags & BINCMD_BUS_ENCRYPTED)
+	{
+		ImageEnc_DecryptAt(bu.params.nonce, offset, data, size);
+	}
+	Stats_Packet(size);
+	while (size % FLASH_QUADWORD_SIZE)
+	{
+		data[size++] = 0xFF;
+	}
+	if (FlashProg_Program(bu.addr + offset, data, size, TASK_CMD) != 0)
+	{
+		return -2;
+	}
+	bu.job = BINCMD_BUS_DATA;
+	bu.job_seq = seq;
+	return 1;
+}
+
+/**
+  * @brief  Every packet is in: check the image, from flash
+  */
+static void BusUpdate_Check(void)
+{
+	ImageSig_Begin(bu.params.part, (const uint8_t *)"", bu.addr, bu.params.size);
+	ImageSig_Update((const uint8_t *)(uintptr_t)bu.addr, bu.params.size);
+	bu.image_size = ImageSig_End();
+	if (bu.image_size != 0)
+	{
+		bu.state = BINCMD_BUS_VERIFIED;
+		return;
+	}
+	bu.state = BINCMD_BUS_REJECTED;
+	IAP_Reject(bu.params.part);
+}
+
+/**
+  * @brief  The flash job of BusUpdate_Begin or _Data finished. A failed
+  *         program leaves quadwords that cannot be written again: the
+  *         session needs a new BEGIN.
+  * @retval 0: ok, 1: flash error
+  */
+uint8_t BusUpdate_FlashDone(uint32_t status)
+{
+	uint8_t job = bu.job;
+
+	bu.job = 0;
+	if (status != 0)
+	{
+		bu.state = BINCMD_BUS_FAILED;
+		return 1;
+	}
+	if (job == BINCMD_BUS_BEGIN)
+	{
+		bu.state = BINCMD_BUS_RECEIVING;
+	}
+	else if ((job == BINCMD_BUS_DATA) && !BusUpdate_Have(bu.job_seq))
+	{
+		bu.map[bu.job_seq / 32] |= 1u << (bu.job_seq % 32);
+		if (++bu.received == bu.packets)
+		{
+			BusUpdate_Check();
+		}
+	}
+	return 0;
+}
+
+/**
+  * @brief  The STATUS answer: session, state, packets, missing count, then
+  *         the first BINCMD_BUS_MISSING_MAX missing sequence numbers from
+  *         first on
+  * @param  out: 9 + 2 * BINCMD_BUS_MISSING_MAX bytes
+  * @retval Bytes written
+  */
+uint16_t BusUpdate_Status(uint16_t first, uint8_t *out)
+{
+	uint16_t n = 0, seq;
+
+	BusUpdate_Put16(out, (uint16_t)bu.params.session);
+	BusUpdate_Put16(out + 2, (uint16_t)(bu.params.session >> 16));
+	out[4] = bu.state;
+	BusUpdate_Put16(out + 5, bu.packets);
+	BusUpdate_Put16(out + 7, bu.packets - bu.received);
+	if (bu.state == BINCMD_BUS_RECEIVING)
+	{
+		for (seq = first; (seq < bu.packets) && (n < BINCMD_BUS_MISSING_MAX); seq++)
+		{
+			if (!BusUpdate_Have(seq))
+			{
+				BusUpdate_Put16(out + 9 + 2 * n++, seq);
+			}
+		}
+	}
+	return 9 + 2 * n;
+}
+
+/**
+  * @brief  Leave the checked image ready to start, as after a YModem
+  *         update: on trial for an application
+  * @retval 0: the caller jumps to it, -1: no checked application
+  */
+int8_t BusUpdate_Boot(void)
+{
+	if ((bu.state != BINCMD_BUS_VERIFIED) || (bu.params.part != PART_APP))
+	{
+		return -1;
+	}
+	BootInfo_SetUpdate((int32_t)bu.image_size);
+	Trial_Start();
+	IAP_WriteFlag(APPRUN_FLAG_DATA);
+	return 0;
+}
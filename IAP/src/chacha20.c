@@ -0,0 +1,121 @@
+#include "chacha20.h"
+#include <string.h>
+
+#define ROTL(x, n)      (((x) << (n)) | ((x) >> (32 - (n))))
+
+#define QUARTER(a, b, c, d) \
+	do \
+	{ \
+		a += b; d = ROTL(d ^ a, 16); \
+		c += d; b = ROTL(b ^ c, 12); \
+		a += b; d = ROTL(d ^ a, 8); \
+		c += d; b = ROTL(b ^ c, 7); \
+	} while (0)
+
+/**
+  * @brief  One key stream block; the state is in locals for the 20 rounds,
+  *         a column and a diagonal round per pass
+  */
+static void ChaCha20_Block(const uint32_t in[16], uint32_t out[16])
+{
+	uint32_t x0 = in[0], x1 = in[1], x2 = in[2], x3 = in[3];
+	uint32_t x4 = in[4], x5 = in[5], x6 = in[6], x7 = in[7];
+	uint32_t x8 = in[8], x9 = in[9], x10 = in[10], x11 = in[11];
+	uint32_t x12 = in[12], x13 = in[13], x14 = in[14], x15 = in[15];
+	uint32_t i;
+
+	for (i = 0; i < 10; i++)
+	{
+		QUARTER(x0, x4, x8, x12);
+		QUARTER(x1, x5, x9, x13);
+		QUARTER(x2, x6, x10, x14);
+		QUARTER(x3, x7, x11, x15);
+		QUARTER(x0, x5, x10, x15);
+		QUARTER(x1, x6, x11, x12);
+		QUARTER(x2, x7, x8, x13);
+		QUARTER(x3, x4, x9, x14);
+	}
+	out[0] = x0 + in[0];
+	out[1] = x1 + in[1];
+	out[2] = x2 + in[2];
+	out[3] = x3 + in[3];
+	out[4] = x4 + in[4];
+	out[5] = x5 + in[5];
+	out[6] = x6 + in[6];
+	out[7] = x7 + in[7];
+	out[8] = x8 + in[8];
+	out[9] = x9 + in[9];
+	out[10] = x10 + in[10];
+	out[11] = x11 + in[11];
+	out[12] = x12 + in[12];
+	out[13] = x13 + in[13];
+	out[14] = x14 + in[14];
+	out[15] = x15 + in[15];
+}
+
+/************************************************************************/
+static uint32_t ChaCha20_Load(const uint8_t *p)
+{
+	return p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/**
+  * @param  counter: of the first block, 0 or 1 as RFC 8439 uses it
+  */
+void ChaCha20_Init(ChaCha20_Ctx *ctx, const uint8_t key[CHACHA20_KEY_SIZE],
+                   const uint8_t nonce[CHACHA20_NONCE_SIZE], uint32_t counter)
+{
+	uint32_t i;
+
+	ctx->state[0] = 0x61707865;     /* "expand 32-byte k" */
+	ctx->state[1] = 0x3320646E;
+	ctx->state[2] = 0x79622D32;
+	ctx->state[3] = 0x6B206574;
+	for (i = 0; i < 8; i++)
+	{
+		ctx->state[4 + i] = ChaCha20_Load(key + 4 * i);
+	}
+	ctx->state[12] = counter;
+	for (i = 0; i < 3; i++)
+	{
+		ctx->state[13 + i] = ChaCha20_Load(nonce + 4 * i);
+	}
+	ctx->used = CHACHA20_BLOCK_SIZE;
+}
+
+/**
+  * @brief  XOR the next size bytes of key stream into data
+  */
+void ChaCha20_Xor(ChaCha20_Ctx *ctx, uint8_t *data, uint32_t size)
+{
+	const uint8_t *stream = (const uint8_t *)ctx->stream;
+	uint32_t *w, i, n;
+
+	/* What is left of the last block */
+	for (; (ctx->used < CHACHA20_BLOCK_SIZE) && (size != 0); size--)
+	{
+		*data++ ^= stream[ctx->used++];
+	}
+	for (; size != 0; data += n, size -= n)
+	{
+		ChaCha20_Block(ctx->state, ctx->stream);
+		ctx->state[12]++;
+		n = (size < CHACHA20_BLOCK_SIZE) ? size : CHACHA20_BLOCK_SIZE;
+		if ((n == CHACHA20_BLOCK_SIZE) && (((uintptr_t)data & 3) == 0))
+		{
+			w = (uint32_t *)data;
+			for (i = 0; i < CHACHA20_BLOCK_SIZE / 4; i++)
+			{
+				w[i] ^= ctx->stream[i];
+			}
+		}
+		else
+		{
+			for (i = 0; i < n; i++)
+			{
+				data[i] ^= stream[i];
+			}
+		}
+		ctx->used = n;
+	}
+}
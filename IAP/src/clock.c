@@ -0,0 +1,146 @@
+#include "clock.h"
+#include "iap_config.h"
+#include "serial.h"
+#include "trace.h"
+#include "stm32h5xx_hal.h"
+
+extern UART_HandleTypeDef huart1;
+
+/* Private variables ---------------------------------------------------------*/
+static uint8_t Clock_Current = CLOCK_NORMAL;
+
+#if (USE_PERF_CLOCK == 1)
+/* HSE 8 MHz / PLLM 4 = 2 MHz into PLL1, SYSCLK = 2 MHz * PLLN / PLLP */
+static const struct
+{
+	uint32_t vos;
+	uint32_t plln;
+	uint32_t latency;
+	uint32_t delay;
+} Clock_Profiles[] =
+{
+	{ PWR_REGULATOR_VOLTAGE_SCALE3, 100, FLASH_LATENCY_4, FLASH_PROGRAMMING_DELAY_2 },
+	{ PWR_REGULATOR_VOLTAGE_SCALE0, 250, FLASH_LATENCY_5, FLASH_PROGRAMMING_DELAY_2 },
+};
+
+/************************************************************************/
+static void Clock_SetVoltage(uint32_t vos)
+{
+	__HAL_PWR_VOLTAGESCALING_CONFIG(vos);
+	while (!__HAL_PWR_GET_FLAG(PWR_FLAG_VOSRDY))
+	{
+	}
+}
+
+/**
+  * @brief  Run from HSE while PLL1 is stopped and started again with the
+  *         new multiplier. HAL_RCC_ClockConfig moves the wait states in
+  *         the right order and brings SysTick to the new HCLK.
+  */
+static int8_t Clock_SetPll(uint32_t plln, uint32_t latency)
+{
+	RCC_OscInitTypeDef osc = {0};
+	RCC_ClkInitTypeDef clk = {0};
+
+	clk.ClockType = RCC_CLOCKTYPE_HCLK | RCC_CLOCKTYPE_SYSCLK |
+	                RCC_CLOCKTYPE_PCLK1 | RCC_CLOCKTYPE_PCLK2 | RCC_CLOCKTYPE_PCLK3;
+	clk.SYSCLKSource = RCC_SYSCLKSOURCE_HSE;
+	clk.AHBCLKDivider = RCC_SYSCLK_DIV1;
+	clk.APB1CLKDivider = RCC_HCLK_DIV1;
+	clk.APB2CLKDivider = RCC_HCLK_DIV1;
+	clk.APB3CLKDivider = RCC_HCLK_DIV1;
+	if (HAL_RCC_ClockConfig(&clk, __HAL_FLASH_GET_LATENCY()) != HAL_OK)
+	{
+		return -1;
+	}
+
+	osc.OscillatorType = RCC_OSCILLATORTYPE_NONE;
+	osc.PLL.PLLState = RCC_PLL_ON;
+	osc.PLL.PLLSource = RCC_PLL1_SOURCE_HSE;
+	osc.PLL.PLLM = 4;
+	osc.PLL.PLLN = plln;
+	osc.PLL.PLLP = 2;
+	osc.PLL.PLLQ = 2;
+	osc.PLL.PLLR = 2;
+	osc.PLL.PLLRGE = RCC_PLL1_VCIRANGE_1;
+	osc.PLL.PLLVCOSEL = RCC_PLL1_VCORANGE_WIDE;
+	osc.PLL.PLLFRACN = 0;
+	if (HAL_RCC_OscConfig(&osc) != HAL_OK)
+	{
+		return -1;
+	}
+
+	clk.SYSCLKSource = RCC_SYSCLKSOURCE_PLLCLK;
+	if (HAL_RCC_ClockConfig(&clk, latency) != HAL_OK)
+	{
+		return -1;
+	}
+	return 0;
+}
+
+/**
+  * @brief  Bring BRR back to the configured baud rate if the USART1 kernel
+  *         clock moved with the profile. The port is stopped for the write,
+  *         so wait for the transmitter to drain first.
+  */
+static void Clock_UartRetune(void)
+{
+	uint32_t brr = UART_DIV_SAMPLING16(HAL_RCCEx_GetPeriphCLKFreq(RCC_PERIPHCLK_USART1),
+	                                   huart1.Init.BaudRate, huart1.Init.ClockPrescaler);
+
+	if ((brr < 16) || (huart1.Instance->BRR == brr))
+	{
+		return;
+	}
+	Serial_Flush();
+	__HAL_UART_DISABLE(&huart1);
+	huart1.Instance->BRR = brr;
+	__HAL_UART_ENABLE(&huart1);
+}
+#endif
+
+/**
+  * @brief  Switch the system clock profile. The voltage goes up before
+  *         the frequency and comes down after it.
+  * @retval 0: ok, -1: the clock tree refused, the normal profile is back
+  */
+int8_t Clock_SetProfile(uint8_t profile)
+{
+#if (USE_PERF_CLOCK == 1)
+	int8_t status = 0;
+
+	if ((profile > CLOCK_PERF) || (profile == Clock_Current))
+	{
+		return 0;
+	}
+	if (profile == CLOCK_PERF)
+	{
+		Clock_SetVoltage(Clock_Profiles[CLOCK_PERF].vos);
+	}
+	if (Clock_SetPll(Clock_Profiles[profile].plln, Clock_Profiles[profile].latency) != 0)
+	{
+		/* Fall back to the startup configuration */
+		profile = CLOCK_NORMAL;
+		status = -1;
+		Clock_SetPll(Clock_Profiles[CLOCK_NORMAL].plln, Clock_Profiles[CLOCK_NORMAL].latency);
+	}
+	__HAL_FLASH_SET_PROGRAM_DELAY(Clock_Profiles[profile].delay);
+	if (profile == CLOCK_NORMAL)
+	{
+		Clock_SetVoltage(Clock_Profiles[CLOCK_NORMAL].vos);
+	}
+	Clock_Current = profile;
+	Clock_UartRetune();
+	Trace_Log(TRACE_CLOCK, 0, (uint16_t)(SystemCoreClock / 1000000));
+	return status;
+#else
+	(void)profile;
+	return 0;
+#endif
+}
+
+/************************************************************************/
+uint8_t Clock_GetProfile(void)
+{
+	return Clock_Current;
+}
@@ -24,9 +24,13 @@
 
 /* Includes ------------------------------------------------------------------*/
 #include "common.h"
+#include "serial.h"
+#include "partition.h"
+#include "flashprog.h"
+#include "stats.h"
+#include "icache.h"
 #include <string.h>
 #include <stdlib.h>
-extern UART_HandleTypeDef huart1;
 #ifdef USE_FULL_ASSERT
 /**
   * @brief  Reports the name of the source file and the source line number
@@ -59,6 +63,7 @@ void assert_failed(uint8_t* file, uint32_t line)
   */
 void STM_EVAL_COMInit(UART_InitTypeDef* UART_InitStruct)
 {
+  (void)UART_InitStruct;
   /* This function is not used in HAL implementation, USART is initialized in main.c */
   /* USART initialization is handled by MX_USART1_UART_Init() in main.c */
 }
@@ -220,13 +225,8 @@ uint32_t GetIntegerInput(int32_t * num)
   */
 uint32_t SerialKeyPressed(uint8_t *key)
 {
-	// Non-blocking: poll RXNE flag and read RDR directly
-	if (__HAL_UART_GET_FLAG(&huart1, UART_FLAG_RXNE) != RESET)
-	{
-		*key = (uint8_t)(huart1.Instance->RDR & 0xFF);
-		return 1;
-	}
-	return 0;
+	// Non-blocking: take the next byte from the interrupt receive ring
+	return Serial_Read(key, 1);
 }
 
 /**
@@ -250,11 +250,7 @@ uint8_t GetKey(void)
   */
 void SerialPutChar(uint8_t c)
 {
-	// EVAL_COM1->TDR = c;
-	// while ((EVAL_COM1->ISR & USART_ISR_TXE) == RESET)
-	// {
-	// }
-	HAL_UART_Transmit(&huart1, &c, 1, HAL_MAX_DELAY);
+	Serial_Write(&c, 1);
 }
 
 /**
@@ -265,12 +261,7 @@ void SerialPutChar(uint8_t c)
 void Serial_PutString(uint8_t *s)
 {
 #if (ENABLE_PUTSTR == 1)
-	// while (*s != '\0')
-	// {
-	// 	SerialPutChar(*s);
-	// 	s++;
-	// }
-	HAL_UART_Transmit(&huart1, s, strlen((const char*)s), HAL_MAX_DELAY);
+	Serial_Write(s, strlen((const char*)s));
 #endif
 }
 
@@ -283,27 +274,10 @@ void GetInputString (uint8_t * buffP)
 {
 	uint32_t bytes_read = 0;
 	uint8_t c = 0;
-	/* Ensure UART is ready and clear stale errors before blocking receive */
-	HAL_UART_AbortReceive(&huart1);
-	__HAL_UART_CLEAR_OREFLAG(&huart1);
-	__HAL_UART_CLEAR_NEFLAG(&huart1);
-	__HAL_UART_CLEAR_FEFLAG(&huart1);
-	(void)huart1.Instance->RDR; // flush data register
+	Serial_RxFlush();
 	for(;;)
 	{
-		HAL_StatusTypeDef rx = HAL_UART_Receive(&huart1, &c, 1, HAL_MAX_DELAY);
-		if (rx != HAL_OK)
-		{
-			if (rx == HAL_BUSY)
-			{
-				HAL_UART_AbortReceive(&huart1);
-			}
-			__HAL_UART_CLEAR_OREFLAG(&huart1);
-			__HAL_UART_CLEAR_NEFLAG(&huart1);
-			__HAL_UART_CLEAR_FEFLAG(&huart1);
-			(void)huart1.Instance->RDR; // flush
-			continue; // retry
-		}
+		c = GetKey();
 		if (c == '\r' || c == '\n')
 		{
 			SerialPutString("\r\n");
@@ -362,37 +336,45 @@ uint8_t EraseSomePages(__IO uint32_t size, uint8_t outPutCont)
 {
 	uint32_t EraseCounter = 0x0;
 	uint32_t NbrOfSector = 0;
+	uint32_t index;
 	uint8_t erase_cont[3] = {0};
 	HAL_StatusTypeDef status = HAL_OK;
 	FLASH_EraseInitTypeDef EraseInitStruct;
 	uint32_t SectorError = 0;
 	
 	NbrOfSector = FLASH_PagesMask(size);
+	index = (Partition_Addr(PART_APP) - FLASH_BASE) / PAGE_SIZE;
 
-	/* Erase the FLASH sectors */
+	/* Erase the FLASH sectors that are not blank already */
 	HAL_FLASH_Unlock();
 	
 	EraseInitStruct.TypeErase = FLASH_TYPEERASE_SECTORS;
-	EraseInitStruct.Banks = FLASH_BANK_1;
-	EraseInitStruct.Sector = (ApplicationAddress - FLASH_BASE) / PAGE_SIZE;
-	EraseInitStruct.NbSectors = NbrOfSector;
-	
-	status = HAL_FLASHEx_Erase(&EraseInitStruct, &SectorError);
+	EraseInitStruct.NbSectors = 1;
 	
-	if(status == HAL_OK)
+	for (EraseCounter = 0; (EraseCounter < NbrOfSector) && (status == HAL_OK); EraseCounter++, index++)
 	{
-		for (EraseCounter = 0; EraseCounter < NbrOfSector; EraseCounter++)
+		if (FlashProg_Blank(FLASH_BASE + index * PAGE_SIZE, PAGE_SIZE))
 		{
-			if(outPutCont == 1)
-			{
-				Int2Str(erase_cont, EraseCounter + 1);
-				SerialPutString(erase_cont);
-				SerialPutString("@");
-			}
+			STATS_INC(erases_skipped);
+		}
+		else
+		{
+			EraseInitStruct.Banks = (index < FLASH_SECTOR_NB) ? FLASH_BANK_1 : FLASH_BANK_2;
+			EraseInitStruct.Sector = index % FLASH_SECTOR_NB;
+			STATS_INC(flash_erases);
+			status = HAL_FLASHEx_Erase(&EraseInitStruct, &SectorError);
+		}
+		if((status == HAL_OK) && (outPutCont == 1))
+		{
+			memset(erase_cont, 0, sizeof(erase_cont));
+			Int2Str(erase_cont, EraseCounter + 1);
+			SerialPutString(erase_cont);
+			SerialPutString("@");
 		}
 	}
 	
 	HAL_FLASH_Lock();
+	ICache_Invalidate();
 	
 	if(status != HAL_OK)
 	{
@@ -0,0 +1,680 @@
+#include "ed25519.h"
+#include <string.h>
+
+/* GF(2^255 - 19): 16 signed limbs of 16 bits, kept in 64 bits for the sums */
+typedef int64_t Fe[16];
+
+/* SHA-512, for the scalars of the scheme ------------------------------------*/
+typedef struct
+{
+	uint64_t state[8];
+	uint8_t block[128];
+	uint32_t fill;
+	uint64_t bytes;
+} Sha512_Ctx;
+
+static const uint64_t Sha512_K[80] =
+{
+	0x428A2F98D728AE22ULL, 0x7137449123EF65CDULL, 0xB5C0FBCFEC4D3B2FULL, 0xE9B5DBA58189DBBCULL,
+	0x3956C25BF348B538ULL, 0x59F111F1B605D019ULL, 0x923F82A4AF194F9BULL, 0xAB1C5ED5DA6D8118ULL,
+	0xD807AA98A3030242ULL, 0x12835B0145706FBEULL, 0x243185BE4EE4B28CULL, 0x550C7DC3D5FFB4E2ULL,
+	0x72BE5D74F27B896FULL, 0x80DEB1FE3B1696B1ULL, 0x9BDC06A725C71235ULL, 0xC19BF174CF692694ULL,
+	0xE49B69C19EF14AD2ULL, 0xEFBE4786384F25E3ULL, 0x0FC19DC68B8CD5B5ULL, 0x240CA1CC77AC9C65ULL,
+	0x2DE92C6F592B0275ULL, 0x4A7484AA6EA6E483ULL, 0x5CB0A9DCBD41FBD4ULL, 0x76F988DA831153B5ULL,
+	0x983E5152EE66DFABULL, 0xA831C66D2DB43210ULL, 0xB00327C898FB213FULL, 0xBF597FC7BEEF0EE4ULL,
+	0xC6E00BF33DA88FC2ULL, 0xD5A79147930AA725ULL, 0x06CA6351E003826FULL, 0x142929670A0E6E70ULL,
+	0x27B70A8546D22FFCULL, 0x2E1B21385C26C926ULL, 0x4D2C6DFC5AC42AEDULL, 0x53380D139D95B3DFULL,
+	0x650A73548BAF63DEULL, 0x766A0ABB3C77B2A8ULL, 0x81C2C92E47EDAEE6ULL, 0x92722C851482353BULL,
+	0xA2BFE8A14CF10364ULL, 0xA81A664BBC423001ULL, 0xC24B8B70D0F89791ULL, 0xC76C51A30654BE30ULL,
+	0xD192E819D6EF5218ULL, 0xD69906245565A910ULL, 0xF40E35855771202AULL, 0x106AA07032BBD1B8ULL,
+	0x19A4C116B8D2D0C8ULL, 0x1E376C085141AB53ULL, 0x2748774CDF8EEB99ULL, 0x34B0BCB5E19B48A8ULL,
+	0x391C0CB3C5C95A63ULL, 0x4ED8AA4AE3418ACBULL, 0x5B9CCA4F7763E373ULL, 0x682E6FF3D6B2B8A3ULL,
+	0x748F82EE5DEFB2FCULL, 0x78A5636F43172F60ULL, 0x84C87814A1F0AB72ULL, 0x8CC702081A6439ECULL,
+	0x90BEFFFA23631E28ULL, 0xA4506CEBDE82BDE9ULL, 0xBEF9A3F7B2C67915ULL, 0xC67178F2E372532BULL,
+	0xCA273ECEEA26619CULL, 0xD186B8C721C0C207ULL, 0xEADA7DD6CDE0EB1EULL, 0xF57D4F7FEE6ED178ULL,
+	0x06F067AA72176FBAULL, 0x0A637DC5A2C898A6ULL, 0x113F9804BEF90DAEULL, 0x1B710B35131C471BULL,
+	0x28DB77F523047D84ULL, 0x32CAAB7B40C72493ULL, 0x3C9EBE0A15C9BEBCULL, 0x431D67C49C100D4CULL,
+	0x4CC5D4BECB3E42B6ULL, 0x597F299CFC657E2AULL, 0x5FCB6FAB3AD6FAECULL, 0x6C44198C4A475817ULL
+};
+
+#define ROTR64(x, n)    (((x) >> (n)) | ((x) << (64 - (n))))
+
+/************************************************************************/
+static void Sha512_Block(uint64_t state[8], const uint8_t *p)
+{
+	uint64_t w[16], s[8], t1, t2;
+	uint32_t i, j;
+
+	for (i = 0; i < 16; i++)
+	{
+		for (w[i] = 0, j = 0; j < 8; j++)
+		{
+			w[i] = (w[i] << 8) | p[8 * i + j];
+		}
+	}
+	memcpy(s, state, sizeof(s));
+	for (i = 0; i < 80; i++)
+	{
+		if (i >= 16)
+		{
+			t1 = w[(i + 14) & 15];
+			t2 = w[(i + 1) & 15];
+			w[i & 15] += (ROTR64(t1, 19) ^ ROTR64(t1, 61) ^ (t1 >> 6)) + w[(i + 9) & 15] +
+			             (ROTR64(t2, 1) ^ ROTR64(t2, 8) ^ (t2 >> 7));
+		}
+		t1 = s[7] + (ROTR64(s[4], 14) ^ ROTR64(s[4], 18) ^ ROTR64(s[4], 41)) +
+		     (s[6] ^ (s[4] & (s[5] ^ s[6]))) + Sha512_K[i] + w[i & 15];
+		t2 = (ROTR64(s[0], 28) ^ ROTR64(s[0], 34) ^ ROTR64(s[0], 39)) +
+		     ((s[0] & s[1]) | (s[2] & (s[0] | s[1])));
+		memmove(s + 1, s, 7 * sizeof(s[0]));
+		s[4] += t1;
+		s[0] = t1 + t2;
+	}
+	for (i = 0; i < 8; i++)
+	{
+		state[i] += s[i];
+	}
+}
+
+/************************************************************************/
+static void Sha512_Init(Sha512_Ctx *ctx)
+{
+	ctx->state[0] = 0x6A09E667F3BCC908ULL;
+	ctx->state[1] = 0xBB67AE8584CAA73BULL;
+	ctx->state[2] = 0x3C6EF372FE94F82BULL;
+	ctx->state[3] = 0xA54FF53A5F1D36F1ULL;
+	ctx->state[4] = 0x510E527FADE682D1ULL;
+	ctx->state[5] = 0x9B05688C2B3E6C1FULL;
+	ctx->state[6] = 0x1F83D9ABFB41BD6BULL;
+	ctx->state[7] = 0x5BE0CD19137E2179ULL;
+	ctx->fill = 0;
+	ctx->bytes = 0;
+}
+
+/************************************************************************/
+static void Sha512_Update(Sha512_Ctx *ctx, const uint8_t *data, uint32_t size)
+{
+	ctx->bytes += size;
+	while (size-- != 0)
+	{
+		ctx->block[ctx->fill++] = *data++;
+		if (ctx->fill == sizeof(ctx->block))
+		{
+			Sha512_Block(ctx->state, ctx->block);
+			ctx->fill = 0;
+		}
+	}
+}
+
+/************************************************************************/
+static void Sha512_Final(Sha512_Ctx *ctx, uint8_t digest[64])
+{
+	uint64_t bits = ctx->bytes * 8;
+	uint32_t i;
+
+	ctx->block[ctx->fill++] = 0x80;
+	if (ctx->fill > sizeof(ctx->block) - 16)
+	{
+		memset(ctx->block + ctx->fill, 0, sizeof(ctx->block) - ctx->fill);
+		Sha512_Block(ctx->state, ctx->block);
+		ctx->fill = 0;
+	}
+	memset(ctx->block + ctx->fill, 0, sizeof(ctx->block) - ctx->fill);
+	for (i = 0; i < 8; i++)
+	{
+		ctx->block[sizeof(ctx->block) - 1 - i] = (uint8_t)(bits >> (8 * i));
+	}
+	Sha512_Block(ctx->state, ctx->block);
+	for (i = 0; i < 64; i++)
+	{
+		digest[i] = (uint8_t)(ctx->state[i / 8] >> (56 - 8 * (i % 8)));
+	}
+}
+
+/* Field ---------------------------------------------------------------------*/
+static const Fe Fe_Zero = {0};
+static const Fe Fe_One = {1};
+/* -121665 / 121666 */
+static const Fe Fe_D =
+{
+	0x78a3, 0x1359, 0x4dca, 0x75eb, 0xd8ab, 0x4141, 0x0a4d, 0x0070,
+	0xe898, 0x7779, 0x4079, 0x8cc7, 0xfe73, 0x2b6f, 0x6cee, 0x5203
+};
+static const Fe Fe_D2 =
+{
+	0xf159, 0x26b2, 0x9b94, 0xebd6, 0xb156, 0x8283, 0x149a, 0x00e0,
+	0xd130, 0xeef3, 0x80f2, 0x198e, 0xfce7, 0x56df, 0xd9dc, 0x2406
+};
+/* sqrt(-1) */
+static const Fe Fe_I =
+{
+	0xa0b0, 0x4a0e, 0x1b27, 0xc4ee, 0xe478, 0xad2f, 0x1806, 0x2f43,
+	0xd7a7, 0x3dfb, 0x0099, 0x2b4d, 0xdf0b, 0x4fc1, 0x2480, 0x2b83
+};
+/* The base point */
+static const Fe Fe_Bx =
+{
+	0xd51a, 0x8f25, 0x2d60, 0xc956, 0xa7b2, 0x9525, 0xc760, 0x692c,
+	0xdc5c, 0xfdd6, 0xe231, 0xc0a4, 0x53fe, 0xcd6e, 0x36d3, 0x2169
+};
+static const Fe Fe_By =
+{
+	0x6658, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666,
+	0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666
+};
+
+/************************************************************************/
+static void Fe_Copy(Fe o, const Fe a)
+{
+	memcpy(o, a, sizeof(Fe));
+}
+
+/**
+  * @brief  Bring the limbs back to 16 bits, the carry out of the top one
+  *         folded in as 2^256 = 38
+  */
+static void Fe_Carry(Fe o)
+{
+	int64_t c;
+	uint32_t i;
+
+	for (i = 0; i < 16; i++)
+	{
+		o[i] += (int64_t)1 << 16;
+		c = o[i] >> 16;
+		if (i < 15)
+		{
+			o[i + 1] += c - 1;
+		}
+		else
+		{
+			o[0] += 38 * (c - 1);
+		}
+		o[i] &= 0xFFFF;
+	}
+}
+
+/**
+  * @brief  Swap p and q when b is 1, without a branch
+  */
+static void Fe_Select(Fe p, Fe q, int32_t b)
+{
+	int64_t t, mask = -(int64_t)b;
+	uint32_t i;
+
+	for (i = 0; i < 16; i++)
+	{
+		t = mask & (p[i] ^ q[i]);
+		p[i] ^= t;
+		q[i] ^= t;
+	}
+}
+
+/**
+  * @brief  Fully reduced, little endian
+  */
+static void Fe_Pack(uint8_t o[32], const Fe n)
+{
+	Fe m, t;
+	int32_t b;
+	uint32_t i, j;
+
+	Fe_Copy(t, n);
+	Fe_Carry(t);
+	Fe_Carry(t);
+	Fe_Carry(t);
+	for (j = 0; j < 2; j++)
+	{
+		m[0] = t[0] - 0xffed;
+		for (i = 1; i < 15; i++)
+		{
+			m[i] = t[i] - 0xffff - ((m[i - 1] >> 16) & 1);
+			m[i - 1] &= 0xffff;
+		}
+		m[15] = t[15] - 0x7fff - ((m[14] >> 16) & 1);
+		b = (int32_t)((m[15] >> 16) & 1);
+		m[14] &= 0xffff;
+		Fe_Select(t, m, 1 - b);
+	}
+	for (i = 0; i < 16; i++)
+	{
+		o[2 * i] = (uint8_t)t[i];
+		o[2 * i + 1] = (uint8_t)(t[i] >> 8);
+	}
+}
+
+/************************************************************************/
+static void Fe_Unpack(Fe o, const uint8_t n[32])
+{
+	uint32_t i;
+
+	for (i = 0; i < 16; i++)
+	{
+		o[i] = n[2 * i] + ((int64_t)n[2 * i + 1] << 8);
+	}
+	o[15] &= 0x7fff;
+}
+
+/**
+  * @retval 0: equal
+  */
+static int32_t Fe_Compare(const Fe a, const Fe b)
+{
+	uint8_t c[32], d[32];
+
+	Fe_Pack(c, a);
+	Fe_Pack(d, b);
+	return memcmp(c, d, sizeof(c));
+}
+
+/************************************************************************/
+static uint8_t Fe_Parity(const Fe a)
+{
+	uint8_t d[32];
+
+	Fe_Pack(d, a);
+	return d[0] & 1;
+}
+
+/************************************************************************/
+static void Fe_Add(Fe o, const Fe a, const Fe b)
+{
+	uint32_t i;
+
+	for (i = 0; i < 16; i++)
+	{
+		o[i] = a[i] + b[i];
+	}
+}
+
+/************************************************************************/
+static void Fe_Sub(Fe o, const Fe a, const Fe b)
+{
+	uint32_t i;
+
+	for (i = 0; i < 16; i++)
+	{
+		o[i] = a[i] - b[i];
+	}
+}
+
+/**
+  * @brief  o = a * b. The limbs fit 32 bits in and out of Fe_Add/Fe_Sub,
+  *         so each product is a single SMLAL on the M33
+  */
+static void Fe_Mul(Fe o, const Fe a, const Fe b)
+{
+	int64_t t[31];
+	int32_t ai;
+	uint32_t i, j;
+
+	memset(t, 0, sizeof(t));
+	for (i = 0; i < 16; i++)
+	{
+		ai = (int32_t)a[i];
+		for (j = 0; j < 16; j++)
+		{
+			t[i + j] += (int64_t)ai * (int32_t)b[j];
+		}
+	}
+	for (i = 0; i < 15; i++)
+	{
+		t[i] += 38 * t[i + 16];
+	}
+	memcpy(o, t, sizeof(Fe));
+	Fe_Carry(o);
+	Fe_Carry(o);
+}
+
+/************************************************************************/
+static void Fe_Square(Fe o, const Fe a)
+{
+	Fe_Mul(o, a, a);
+}
+
+/**
+  * @brief  o = a^(p - 2) = 1 / a
+  */
+static void Fe_Invert(Fe o, const Fe a)
+{
+	Fe c;
+	int32_t i;
+
+	Fe_Copy(c, a);
+	for (i = 253; i >= 0; i--)
+	{
+		Fe_Square(c, c);
+		if ((i != 2) && (i != 4))
+		{
+			Fe_Mul(c, c, a);
+		}
+	}
+	Fe_Copy(o, c);
+}
+
+/**
+  * @brief  o = a^((p - 5) / 8), for the square root
+  */
+static void Fe_Pow2523(Fe o, const Fe a)
+{
+	Fe c;
+	int32_t i;
+
+	Fe_Copy(c, a);
+	for (i = 250; i >= 0; i--)
+	{
+		Fe_Square(c, c);
+		if (i != 1)
+		{
+			Fe_Mul(c, c, a);
+		}
+	}
+	Fe_Copy(o, c);
+}
+
+/* Points, extended coordinates (X, Y, Z, T) ---------------------------------*/
+/************************************************************************/
+static void Ge_Add(Fe p[4], Fe q[4])
+{
+	Fe a, b, c, d, t, e, f, g, h;
+
+	Fe_Sub(a, p[1], p[0]);
+	Fe_Sub(t, q[1], q[0]);
+	Fe_Mul(a, a, t);
+	Fe_Add(b, p[0], p[1]);
+	Fe_Add(t, q[0], q[1]);
+	Fe_Mul(b, b, t);
+	Fe_Mul(c, p[3], q[3]);
+	Fe_Mul(c, c, Fe_D2);
+	Fe_Mul(d, p[2], q[2]);
+	Fe_Add(d, d, d);
+	Fe_Sub(e, b, a);
+	Fe_Sub(f, d, c);
+	Fe_Add(g, d, c);
+	Fe_Add(h, b, a);
+	Fe_Mul(p[0], e, f);
+	Fe_Mul(p[1], h, g);
+	Fe_Mul(p[2], g, f);
+	Fe_Mul(p[3], e, h);
+}
+
+/************************************************************************/
+static void Ge_Swap(Fe p[4], Fe q[4], uint8_t b)
+{
+	uint32_t i;
+
+	for (i = 0; i < 4; i++)
+	{
+		Fe_Select(p[i], q[i], b);
+	}
+}
+
+/************************************************************************/
+static void Ge_Pack(uint8_t r[32], Fe p[4])
+{
+	Fe tx, ty, zi;
+
+	Fe_Invert(zi, p[2]);
+	Fe_Mul(tx, p[0], zi);
+	Fe_Mul(ty, p[1], zi);
+	Fe_Pack(r, ty);
+	r[31] ^= Fe_Parity(tx) << 7;
+}
+
+/**
+  * @brief  p = s * q, a ladder over the 256 bits of s; q is clobbered
+  */
+static void Ge_ScalarMult(Fe p[4], Fe q[4], const uint8_t s[32])
+{
+	int32_t i;
+	uint8_t b;
+
+	Fe_Copy(p[0], Fe_Zero);
+	Fe_Copy(p[1], Fe_One);
+	Fe_Copy(p[2], Fe_One);
+	Fe_Copy(p[3], Fe_Zero);
+	for (i = 255; i >= 0; i--)
+	{
+		b = (s[i / 8] >> (i & 7)) & 1;
+		Ge_Swap(p, q, b);
+		Ge_Add(q, p);
+		Ge_Add(p, p);
+		Ge_Swap(p, q, b);
+	}
+}
+
+/************************************************************************/
+static void Ge_ScalarBase(Fe p[4], const uint8_t s[32])
+{
+	Fe q[4];
+
+	Fe_Copy(q[0], Fe_Bx);
+	Fe_Copy(q[1], Fe_By);
+	Fe_Copy(q[2], Fe_One);
+	Fe_Mul(q[3], Fe_Bx, Fe_By);
+	Ge_ScalarMult(p, q, s);
+}
+
+/**
+  * @brief  r = -P for the encoded point P
+  * @retval 0: ok, -1: not a point of the curve
+  */
+static int8_t Ge_UnpackNeg(Fe r[4], const uint8_t p[32])
+{
+	Fe t, chk, num, den, den2, den4, den6;
+
+	Fe_Copy(r[2], Fe_One);
+	Fe_Unpack(r[1], p);
+	Fe_Square(num, r[1]);
+	Fe_Mul(den, num, Fe_D);
+	Fe_Sub(num, num, r[2]);
+	Fe_Add(den, r[2], den);
+
+	Fe_Square(den2, den);
+	Fe_Square(den4, den2);
+	Fe_Mul(den6, den4, den2);
+	Fe_Mul(t, den6, num);
+	Fe_Mul(t, t, den);
+
+	Fe_Pow2523(t, t);
+	Fe_Mul(t, t, num);
+	Fe_Mul(t, t, den);
+	Fe_Mul(t, t, den);
+	Fe_Mul(r[0], t, den);
+
+	Fe_Square(chk, r[0]);
+	Fe_Mul(chk, chk, den);
+	if (Fe_Compare(chk, num) != 0)
+	{
+		Fe_Mul(r[0], r[0], Fe_I);
+	}
+	Fe_Square(chk, r[0]);
+	Fe_Mul(chk, chk, den);
+	if (Fe_Compare(chk, num) != 0)
+	{
+		return -1;
+	}
+	if (Fe_Parity(r[0]) == (p[31] >> 7))
+	{
+		Fe_Sub(r[0], Fe_Zero, r[0]);
+	}
+	Fe_Mul(r[3], r[0], r[1]);
+	return 0;
+}
+
+/* Scalars modulo L = 2^252 + 27742317777372353535851937790883648493 ---------*/
+static const int64_t Sc_L[32] =
+{
+	0xed, 0xd3, 0xf5, 0x5c, 0x1a, 0x63, 0x12, 0x58, 0xd6, 0x9c, 0xf7, 0xa2, 0xde, 0xf9, 0xde, 0x14,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x10
+};
+
+/**
+  * @brief  r = x mod L, x as 64 signed byte-sized digits
+  */
+static void Sc_ModL(uint8_t r[32], int64_t x[64])
+{
+	int64_t carry;
+	int32_t i, j;
+
+	for (i = 63; i >= 32; i--)
+	{
+		carry = 0;
+		for (j = i - 32; j < i - 12; j++)
+		{
+			x[j] += carry - 16 * x[i] * Sc_L[j - (i - 32)];
+			carry = (x[j] + 128) >> 8;
+			x[j] -= carry * 256;
+		}
+		x[j] += carry;
+		x[i] = 0;
+	}
+	carry = 0;
+	for (j = 0; j < 32; j++)
+	{
+		x[j] += carry - (x[31] >> 4) * Sc_L[j];
+		carry = x[j] >> 8;
+		x[j] &= 255;
+	}
+	for (j = 0; j < 32; j++)
+	{
+		x[j] -= carry * Sc_L[j];
+	}
+	for (i = 0; i < 32; i++)
+	{
+		x[i + 1] += x[i] >> 8;
+		r[i] = (uint8_t)x[i];
+	}
+}
+
+/**
+  * @brief  Reduce a 64 byte hash in place, to its first 32 bytes
+  */
+static void Sc_Reduce(uint8_t r[64])
+{
+	int64_t x[64];
+	uint32_t i;
+
+	for (i = 0; i < 64; i++)
+	{
+		x[i] = r[i];
+	}
+	memset(r, 0, 64);
+	Sc_ModL(r, x);
+}
+
+/**
+  * @brief  1 when s < L, the only encoding RFC 8032 accepts
+  */
+static uint8_t Sc_Canonical(const uint8_t s[32])
+{
+	int32_t i;
+
+	for (i = 31; i >= 0; i--)
+	{
+		if (s[i] != Sc_L[i])
+		{
+			return s[i] < Sc_L[i];
+		}
+	}
+	return 0;
+}
+
+/**
+  * @brief  The secret scalar (clamped) and the nonce prefix of a seed
+  */
+static void Ed25519_Expand(uint8_t d[64], const uint8_t seed[ED25519_KEY_SIZE])
+{
+	Sha512_Ctx ctx;
+
+	Sha512_Init(&ctx);
+	Sha512_Update(&ctx, seed, ED25519_KEY_SIZE);
+	Sha512_Final(&ctx, d);
+	d[0] &= 248;
+	d[31] &= 127;
+	d[31] |= 64;
+}
+
+/************************************************************************/
+void Ed25519_PublicKey(uint8_t pub[ED25519_KEY_SIZE], const uint8_t seed[ED25519_KEY_SIZE])
+{
+	uint8_t d[64];
+	Fe p[4];
+
+	Ed25519_Expand(d, seed);
+	Ge_ScalarBase(p, d);
+	Ge_Pack(pub, p);
+}
+
+/************************************************************************/
+void Ed25519_Sign(uint8_t sig[ED25519_SIG_SIZE], const uint8_t *msg, uint32_t size,
+                  const uint8_t seed[ED25519_KEY_SIZE])
+{
+	uint8_t d[64], r[64], h[64], pub[ED25519_KEY_SIZE];
+	int64_t x[64];
+	Sha512_Ctx ctx;
+	Fe p[4];
+	uint32_t i, j;
+
+	Ed25519_Expand(d, seed);
+	Ge_ScalarBase(p, d);
+	Ge_Pack(pub, p);
+
+	/* R = r B, r = H(prefix || M) */
+	Sha512_Init(&ctx);
+	Sha512_Update(&ctx, d + 32, 32);
+	Sha512_Update(&ctx, msg, size);
+	Sha512_Final(&ctx, r);
+	Sc_Reduce(r);
+	Ge_ScalarBase(p, r);
+	Ge_Pack(sig, p);
+
+	/* S = r + H(R || A || M) a mod L */
+	Sha512_Init(&ctx);
+	Sha512_Update(&ctx, sig, 32);
+	Sha512_Update(&ctx, pub, ED25519_KEY_SIZE);
+	Sha512_Update(&ctx, msg, size);
+	Sha512_Final(&ctx, h);
+	Sc_Reduce(h);
+	memset(x, 0, sizeof(x));
+	for (i = 0; i < 32; i++)
+	{
+		x[i] = r[i];
+	}
+	for (i = 0; i < 32; i++)
+	{
+		for (j = 0; j < 32; j++)
+		{
+			x[i + j] += h[i] * (int64_t)d[j];
+		}
+	}
+	Sc_ModL(sig + 32, x);
+}
+
+/**
+  * @brief  Check S B = R + H(R || A || M) A
+  * @retval 0: valid, -1: not
+  */
+int8_t Ed25519_Verify(const uint8_t sig[ED25519_SIG_SIZE], const uint8_t *msg, uint32_t size,
+                      const uint8_t pub[ED25519_KEY_SIZE])
+{
+	uint8_t h[64], check[32];
+	Sha512_Ctx ctx;
+	Fe p[4], q[4];
+
+	if (!Sc_Canonical(sig + 32) || (Ge_UnpackNeg(q, pub) != 0))
+	{
+		return -1;
+	}
+	Sha512_Init(&ctx);
+	Sha512_Update(&ctx, sig, 32);
+	Sha512_Update(&ctx, pub, ED25519_KEY_SIZE);
+	Sha512_Update(&ctx, msg, size);
+	Sha512_Final(&ctx, h);
+	Sc_Reduce(h);
+	Ge_ScalarMult(p, q, h);         /* -H A */
+	Ge_ScalarBase(q, sig + 32);     /* S B */
+	Ge_Add(p, q);
+	Ge_Pack(check, p);
+	return (memcmp(check, sig, sizeof(check)) == 0) ? 0 : -1;
+}
@@ -0,0 +1,368 @@
+#include "flashprog.h"
+#include "sched.h"
+#include "common.h"
+#include "stats.h"
+#include "trace.h"
+#include "stmflash.h"
+#include "imagesig.h"
+#include "icache.h"
+#include "ramexec.h"
+
+/* Private typedef -----------------------------------------------------------*/
+typedef enum
+{
+	FP_IDLE = 0,
+	FP_ERASE,
+	FP_PROGRAM
+} FlashProg_State;
+
+/* Private variables ---------------------------------------------------------*/
+static struct
+{
+	uint8_t state;
+	uint8_t notify;
+	uint32_t addr;              /* Next sector or quadword to process */
+	uint32_t end;
+	const uint8_t *src;
+	uint32_t job_addr;          /* Kept for the final verify */
+	const uint8_t *job_src;
+	uint32_t skipped;           /* Bit per sector whose last erase was skipped as blank */
+} fp;
+
+static uint32_t FlashProg_QuadWord[FLASH_QUADWORD_SIZE / 4];
+
+/**
+  * @brief  Map a flash address to its bank and bank relative sector.
+  */
+RAMFUNC static void FlashProg_SectorOf(uint32_t addr, uint32_t *bank, uint32_t *sector)
+{
+	uint32_t index = (addr - FLASH_BASE) / FLASH_SECTOR_SIZE;
+
+	*bank = (index < FLASH_SECTOR_NB) ? FLASH_BANK_1 : FLASH_BANK_2;
+	*sector = index % FLASH_SECTOR_NB;
+}
+
+/**
+  * @brief  Bits of the sectors touched by [addr, addr + size), size > 0
+  */
+RAMFUNC static uint32_t FlashProg_SectorMask(uint32_t addr, uint32_t size)
+{
+	uint32_t first = (addr - FLASH_BASE) / FLASH_SECTOR_SIZE;
+	uint32_t last = (addr - FLASH_BASE + size - 1) / FLASH_SECTOR_SIZE;
+	uint32_t mask = 0;
+
+	for (; (first <= last) && (first < 32); first++)
+	{
+		mask |= 1u << first;
+	}
+	return mask;
+}
+
+/**
+  * @brief  Number of sectors touched by [addr, addr + size).
+  */
+uint32_t FlashProg_SectorCount(uint32_t addr, uint32_t size)
+{
+	uint32_t first = (addr - FLASH_BASE) / FLASH_SECTOR_SIZE;
+	uint32_t last = (addr - FLASH_BASE + size + FLASH_SECTOR_SIZE - 1) / FLASH_SECTOR_SIZE;
+
+	return (size == 0) ? 0 : (last - first);
+}
+
+/**
+  * @brief  1 if [addr, addr + size) reads all 0xFF. Four words per loop,
+  *         stops at the first programmed one.
+  * @note   Blank means never programmed only because no path of the
+  *         bootloader programs an all 0xFF quadword (it would read blank
+  *         and fail the ECC check once written again).
+  */
+RAMFUNC uint8_t FlashProg_Blank(uint32_t addr, uint32_t size)
+{
+	const uint32_t *p = (const uint32_t *)(uintptr_t)addr;
+	const uint32_t *end = p + size / 4;
+	uint32_t start = Stats_Cycles();
+
+	while ((p < end) && ((p[0] & p[1] & p[2] & p[3]) == 0xFFFFFFFF))
+	{
+		p += 4;
+	}
+	STATS_ADD(blank_check_cycles, Stats_Cycles() - start);
+	return p >= end;
+}
+
+/**
+  * @brief  1 if [addr, addr + size) holds src. memcmp() is in flash; word
+  *         compares when src is word aligned, as the YModem buffers are.
+  */
+RAMFUNC static uint8_t FlashProg_Same(uint32_t addr, const uint8_t *src, uint32_t size)
+{
+	const uint8_t *flash = (const uint8_t *)(uintptr_t)addr;
+	const uint32_t *w;
+	uint32_t i = 0;
+
+	if (((uintptr_t)src & 3) == 0)
+	{
+		for (w = (const uint32_t *)(uintptr_t)src; i + 4 <= size; i += 4)
+		{
+			if (*(const uint32_t *)(uintptr_t)(addr + i) != *w++)
+			{
+				return 0;
+			}
+		}
+	}
+	for (; i < size; i++)
+	{
+		if (flash[i] != src[i])
+		{
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/**
+  * @brief  A program job failed and one of its sectors only read blank
+  *         when its erase was skipped: the cells were not erased (a quadword
+  *         of 0xFF programmed earlier, an erase cut short). Erase every
+  *         sector of the job for real, keeping what else they hold, with
+  *         the job's data on top. Blocks for the erases; it is rare.
+  *         Runs from flash: the erases and programs it waits for are RAM
+  *         code (STMFLASH_Rewrite()), nothing is busy when it returns.
+  * @retval 0: ok, else the flash error
+  */
+static uint32_t FlashProg_Recover(void)
+{
+	uint32_t addr = fp.job_addr, next, err = 0;
+	const uint8_t *src = fp.job_src;
+
+	while ((addr < fp.end) && (err == 0))
+	{
+		next = addr - (addr - FLASH_BASE) % FLASH_SECTOR_SIZE + FLASH_SECTOR_SIZE;
+		if (next > fp.end)
+		{
+			next = fp.end;
+		}
+		STATS_INC(flash_erases);
+		err = STMFLASH_Rewrite(addr, src, next - addr);
+		fp.skipped &= ~FlashProg_SectorMask(addr, 1);
+		src += next - addr;
+		addr = next;
+	}
+	if ((err == 0) && !FlashProg_Same(fp.job_addr, fp.job_src, fp.end - fp.job_addr))
+	{
+		err = 1;
+	}
+	return err;
+}
+
+/************************************************************************/
+RAMFUNC static void FlashProg_Finish(uint32_t status)
+{
+	ICache_Invalidate();
+	if ((status == 0) && (fp.state == FP_PROGRAM))
+	{
+		if (!FlashProg_Same(fp.job_addr, fp.job_src, fp.end - fp.job_addr))
+		{
+			status = 1;
+		}
+	}
+	if ((status != 0) && (fp.state == FP_PROGRAM) &&
+	    (fp.skipped & FlashProg_SectorMask(fp.job_addr, fp.end - fp.job_addr)))
+	{
+		status = FlashProg_Recover();
+	}
+	HAL_FLASH_Lock();
+	Stats_FlashBusy(0);
+	Trace_Log((fp.state == FP_ERASE) ? TRACE_ERASE_END : TRACE_PROG_END, 0, (uint16_t)status);
+	fp.state = FP_IDLE;
+	Sched_Post(fp.notify, EVT_FLASH_DONE, status);
+}
+
+/**
+  * @brief  Stage the next quadword of the job, src in any alignment.
+  *         Words put together by hand: a byte loop may become a call to
+  *         memcpy(), which is in flash.
+  */
+RAMFUNC static void FlashProg_Stage(void)
+{
+	const uint8_t *src = fp.src;
+	uint32_t i;
+
+	for (i = 0; i < FLASH_QUADWORD_SIZE / 4; i++, src += 4)
+	{
+		FlashProg_QuadWord[i] = (uint32_t)src[0] | ((uint32_t)src[1] << 8) |
+		                        ((uint32_t)src[2] << 16) | ((uint32_t)src[3] << 24);
+	}
+}
+
+/**
+  * @brief  1 if the quadword staged in FlashProg_QuadWord is all 0xFF
+  */
+RAMFUNC static uint8_t FlashProg_QuadWordBlank(void)
+{
+	return (FlashProg_QuadWord[0] & FlashProg_QuadWord[1] &
+	        FlashProg_QuadWord[2] & FlashProg_QuadWord[3]) == 0xFFFFFFFF;
+}
+
+/**
+  * @brief  Launch the next sector erase or quadword program of the job.
+  *         Sectors still blank from an earlier erase and blank quadwords
+  *         are skipped (see FlashProg_Blank()); a later program job that
+  *         fails in a skipped sector erases it after all
+  *         (FlashProg_Recover()).
+  */
+RAMFUNC static void FlashProg_Step(void)
+{
+	FLASH_EraseInitTypeDef EraseInitStruct;
+	uint32_t bank, sector;
+
+	if (fp.state == FP_ERASE)
+	{
+		while ((fp.addr < fp.end) && FlashProg_Blank(fp.addr, FLASH_SECTOR_SIZE))
+		{
+			fp.skipped |= FlashProg_SectorMask(fp.addr, 1);
+			fp.addr += FLASH_SECTOR_SIZE;
+			STATS_INC(erases_skipped);
+		}
+		if (fp.addr >= fp.end)
+		{
+			FlashProg_Finish(0);
+			return;
+		}
+		FlashProg_SectorOf(fp.addr, &bank, &sector);
+		EraseInitStruct.TypeErase = FLASH_TYPEERASE_SECTORS;
+		EraseInitStruct.Banks = bank;
+		EraseInitStruct.Sector = sector;
+		EraseInitStruct.NbSectors = 1;
+		fp.skipped &= ~FlashProg_SectorMask(fp.addr, 1);
+		fp.addr += FLASH_SECTOR_SIZE;
+		STATS_INC(flash_erases);
+		if (HAL_FLASHEx_Erase_IT(&EraseInitStruct) != HAL_OK)
+		{
+			FlashProg_Finish(1);
+		}
+	}
+	else
+	{
+		do
+		{
+			if (fp.addr >= fp.end)
+			{
+				FlashProg_Finish(0);
+				return;
+			}
+			FlashProg_Stage();
+			fp.src += FLASH_QUADWORD_SIZE;
+			fp.addr += FLASH_QUADWORD_SIZE;
+		} while (FlashProg_QuadWordBlank());
+		STATS_INC(flash_programs);
+		if (HAL_FLASH_Program_IT(FLASH_TYPEPROGRAM_QUADWORD, fp.addr - FLASH_QUADWORD_SIZE,
+		                         (uintptr_t)FlashProg_QuadWord) != HAL_OK)
+		{
+			FlashProg_Finish(1);
+		}
+	}
+}
+
+/************************************************************************/
+RAMFUNC static void FlashProg_Task(const Sched_Event *evt)
+{
+	if (fp.state == FP_IDLE)
+	{
+		return;
+	}
+	switch (evt->type)
+	{
+		case EVT_FLASH_EOP:
+			FlashProg_Step();
+			break;
+		case EVT_FLASH_ERROR:
+			FlashProg_Finish(1);
+			break;
+		default:
+			break;
+	}
+}
+
+/************************************************************************/
+static int8_t FlashProg_Start(uint8_t state, uint32_t addr, uint32_t end, const uint8_t *src, uint8_t notify)
+{
+	if (fp.state != FP_IDLE)
+	{
+		return -1;
+	}
+	ImageSig_Revoke(addr, end - addr);
+	if (STMFLASH_Flush() != 0) // Pending small writes land before the job changes flash
+	{
+		return -1;
+	}
+	fp.state = state;
+	fp.notify = notify;
+	fp.addr = fp.job_addr = addr;
+	fp.end = end;
+	fp.src = fp.job_src = src;
+
+	HAL_FLASH_Unlock();
+	__HAL_FLASH_CLEAR_FLAG(FLASH_FLAG_ALL_ERRORS);
+	Stats_FlashBusy(1);
+	Trace_Log((state == FP_ERASE) ? TRACE_ERASE_START : TRACE_PROG_START, 0,
+	          (uint16_t)((end - addr) / ((state == FP_ERASE) ? FLASH_SECTOR_SIZE : FLASH_QUADWORD_SIZE)));
+	FlashProg_Step();
+	return 0;
+}
+
+/**
+  * @brief  Erase every sector touched by [addr, addr + size).
+  * @retval 0: Job accepted
+  *        -1: Programmer busy, or the cached writes before it not flushed
+  */
+int8_t FlashProg_Erase(uint32_t addr, uint32_t size, uint8_t notify)
+{
+	uint32_t start = addr - ((addr - FLASH_BASE) % FLASH_SECTOR_SIZE);
+
+	return FlashProg_Start(FP_ERASE, start, start + FlashProg_SectorCount(addr, size) * FLASH_SECTOR_SIZE,
+	                       0, notify);
+}
+
+/**
+  * @brief  Program len bytes (multiple of 16) at the quadword aligned addr.
+  *         data must stay valid until EVT_FLASH_DONE.
+  * @retval 0: Job accepted
+  *        -1: Programmer busy, bad alignment, or the cached writes
+  *            before it not flushed
+  */
+int8_t FlashProg_Program(uint32_t addr, const uint8_t *data, uint32_t len, uint8_t notify)
+{
+	if (((addr | len) & (FLASH_QUADWORD_SIZE - 1)) != 0)
+	{
+		return -1;
+	}
+	return FlashProg_Start(FP_PROGRAM, addr, addr + len, data, notify);
+}
+
+/************************************************************************/
+uint8_t FlashProg_Busy(void)
+{
+	return fp.state != FP_IDLE;
+}
+
+/************************************************************************/
+void FlashProg_Init(void)
+{
+	fp.state = FP_IDLE;
+	Sched_Register(TASK_FLASH, FlashProg_Task);
+	HAL_NVIC_SetPriority(FLASH_IRQn, 1, 0);
+	HAL_NVIC_EnableIRQ(FLASH_IRQn);
+}
+
+/************************************************************************/
+RAMFUNC void HAL_FLASH_EndOfOperationCallback(uint32_t ReturnValue)
+{
+	Sched_Post(TASK_FLASH, EVT_FLASH_EOP, ReturnValue);
+}
+
+/************************************************************************/
+RAMFUNC void HAL_FLASH_OperationErrorCallback(uint32_t ReturnValue)
+{
+	Sched_Post(TASK_FLASH, EVT_FLASH_ERROR, ReturnValue);
+}
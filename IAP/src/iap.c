@@ -1,13 +1,43 @@
 #include "iap_config.h"
 #include "iap.h"
 #include "stmflash.h"
+#include "partition.h"
 #include "ymodem.h"
+#include "sched.h"
+#include "serial.h"
+#include "flashprog.h"
+#include "bincmd.h"
+#include "stats.h"
+#include "trace.h"
+#include "kvstore.h"
+#include "icache.h"
+#include "clock.h"
+#include "ramexec.h"
+#include "bootinfo.h"
+#include "trial.h"
+#include "selfupdate.h"
+#include "busupdate.h"
+#include "imagesig.h"
+
+/* Menu task states */
+typedef enum
+{
+	MENU_PROMPT = 0,        /* Waiting for a command */
+	MENU_BOOTWAIT,          /* Application starts unless a key comes first */
+	MENU_UPDATE,            /* YModem session running */
+	MENU_UPLOAD,            /* YModem upload running */
+	MENU_ERASE,             /* Erase job running */
+	MENU_BINARY             /* Binary command session owns the console */
+} IAP_MenuState;
 
 pFunction Jump_To_Application;
 uint32_t JumpAddress;
 uint32_t BlockNbr = 0, UserMemoryMask = 0;
 __IO uint32_t FlashProtection = 0;
-uint8_t tab_1024[1024] = {0};
+static uint8_t MenuState = MENU_PROMPT;
+static uint32_t cmdLen = 0;
+
+static void IAP_MenuTask(const Sched_Event *evt);
 
 
 /************************************************************************/
@@ -21,22 +51,36 @@ static void FLASH_DisableWriteProtectionPages(void)
 /************************************************************************/
 void IAP_WriteFlag(uint16_t flag)
 {
+	if (KvStore_Set(KV_FLAG, flag) == 0)
+	{
+		return;
+	}
 #if (USE_BKP_SAVE_FLAG == 1)
 	// BKP is not supported in this implementation
-	STMFLASH_Write(IAP_FLAG_ADDR, &flag, 1);
+	STMFLASH_Write(Partition_Addr(PART_FLAG), &flag, 1);
 #else 
-	STMFLASH_Write(IAP_FLAG_ADDR, &flag, 1);
+	STMFLASH_Write(Partition_Addr(PART_FLAG), &flag, 1);
 #endif 	
 }
 
 /************************************************************************/
 uint16_t IAP_ReadFlag(void)
 {
+	uint32_t flag;
+
+	if (KvStore_Get(KV_FLAG, &flag) == 0)
+	{
+		return (uint16_t)flag;
+	}
+	if (KvStore_Ready())
+	{
+		return INIT_FLAG_DATA;
+	}
 #if (USE_BKP_SAVE_FLAG == 1)
 	// BKP is not supported in this implementation
-	return STMFLASH_ReadHalfWord(IAP_FLAG_ADDR);  
+	return STMFLASH_ReadHalfWord(Partition_Addr(PART_FLAG));  
 #else
-	return STMFLASH_ReadHalfWord(IAP_FLAG_ADDR);  
+	return STMFLASH_ReadHalfWord(Partition_Addr(PART_FLAG));  
 #endif 	
 }
 
@@ -49,20 +93,90 @@ void IAP_UART_Init(void)
 
 void IAP_Init(void)
 {
+    RamExec_Init();
+    BootInfo_Init();
+    ICache_Enable();
     IAP_UART_Init();
 #if (USE_BKP_SAVE_FLAG == 1)
 	// BKP is not supported in this implementation
 #endif
+	Partition_Init();
+	KvStore_Init();
+	Stats_Init();
+	Trace_Init();
+	Sched_Init();
+	Serial_Init();
+	FlashProg_Init();
+	Ymodem_Init();
+	BinCmd_Init();
+	SelfUpdate_Init();
+	Sched_Register(TASK_MENU, IAP_MenuTask);
+	Sched_Post(TASK_MENU, EVT_START, 0);
 }
+
+#if (USE_IAP_WATCHDOG == 1)
+/************************************************************************/
+RAMFUNC void Sched_IdleHook(void)
+{
+	IWDG->KR = 0x0000AAAAU; /* Reload key */
+}
+#endif
+
+/**
+  * @brief  Leave the interrupt controller the way the application finds it
+  *         after a reset (bootinfo.h): nothing enabled or pending, SysTick
+  *         stopped
+  */
+static void IAP_Quiesce(void)
+{
+	uint32_t i;
+
+	__disable_irq();
+	SysTick->CTRL = 0;
+	SCB->ICSR = SCB_ICSR_PENDSTCLR_Msk;
+	for (i = 0; i < sizeof(NVIC->ICER) / sizeof(NVIC->ICER[0]); i++)
+	{
+		NVIC->ICER[i] = 0xFFFFFFFF;
+		NVIC->ICPR[i] = 0xFFFFFFFF;
+	}
+	__DSB();
+	__ISB();
+	__enable_irq();
+}
+
 /************************************************************************/
 int8_t IAP_RunApp(void)
 {
-	if (((*(__IO uint32_t*)ApplicationAddress) & 0x2FFE0000 ) == 0x20000000)
+	uint32_t app = Partition_Addr(PART_APP);
+
+	if (!ImageSig_AppChecked())
+	{
+		SerialPutString("\r\n Application not verified.\r\n");
+		return -1;
+	}
+	if (((*(__IO uint32_t*)(uintptr_t)app) & 0x2FFE0000 ) == 0x20000000)
 	{   
-		SerialPutString("\r\n Run to app.\r\n");
-		JumpAddress = *(__IO uint32_t*) (ApplicationAddress + 4);
-		Jump_To_Application = (pFunction) JumpAddress;
-		__set_MSP(*(__IO uint32_t*) ApplicationAddress);
+		if (BusUpdate_Address() == BINCMD_ADDR_NONE)
+		{
+			/* On a bus a node only talks when asked (busupdate.h) */
+			SerialPutString("\r\n Run to app.\r\n");
+		}
+		KvStore_Reserve(2); // Trial confirmation and a services write to PART_APP
+		if (STMFLASH_Flush() != 0) // The flag and the trial state must be in flash
+		{
+			SerialPutString("\r\n State not saved, app not started.\r\n");
+			return -1;
+		}
+		Trial_Handoff();
+		ICache_Invalidate(); // The app starts with a clean, enabled cache
+		Clock_SetProfile(CLOCK_NORMAL); // and with the startup clock tree
+		Serial_Stop();
+		IAP_Quiesce();
+		BootInfo_Publish();
+		JumpAddress = *(__IO uint32_t*) (uintptr_t)(app + 4);
+		Jump_To_Application = (pFunction) (uintptr_t)JumpAddress;
+		SCB->VTOR = app; // Off the RAM copy of the bootloader's table
+		__set_MSP(*(__IO uint32_t*) (uintptr_t)app);
 		Jump_To_Application();
 		return 0;
 	}
@@ -75,8 +189,6 @@ int8_t IAP_RunApp(void)
 
 
 /************************************************************************/
-extern uint8_t UART1_flag;
-extern UART_HandleTypeDef huart1;
 uint8_t cmdStr[CMD_STRING_SIZE] = {0};
 void IAP_Main_Menu(void)
 {
@@ -88,79 +200,309 @@ void IAP_Main_Menu(void)
 	
 	// Flash protection is not supported in this implementation
 	FlashProtection = 0;
+	MenuState = MENU_PROMPT;
+	cmdLen = 0;
+	Serial_SetRxOwner(TASK_MENU);
+	if (STMFLASH_Flush() != 0) // Back at the prompt: the flag is final
+	{
+		SerialPutString("\r\n State not saved !\r\n");
+	}
 	// 打印菜单一次，避免循环反复刷屏
-	SerialPutString("\r\n IAP Main Menu (V 0.2.0)\r\n");
+	SerialPutString("\r\n IAP Main Menu (V " IAP_VERSION_STRING ")\r\n");
 	SerialPutString(" update\r\n");
-	SerialPutString(" upload\r\n");
+	SerialPutString(" upload [addr size]\r\n");
 	SerialPutString(" erase\r\n");
 	SerialPutString(" menu\r\n");
 	SerialPutString(" runapp\r\n");
+	SerialPutString(" stats\r\n");
+	SerialPutString(" trace\r\n");
+#if (USE_FLASH_BENCH == 1)
+	SerialPutString(" flashbench\r\n");
+#endif
 	if(FlashProtection != 0)//There is write protected
 	{
 		SerialPutString(" diswp\r\n");
 	}
 	SerialPutString(" cmd> ");
-	while (1)
+}
+
+/**
+  * @brief  "upload" sends the application area, "upload addr size" any
+  *         flash range
+  */
+static void IAP_UploadCommand(void)
+{
+	uint8_t *arg = cmdStr + sizeof(CMD_UPLOAD_STR) - 1;
+	uint8_t *size_str;
+	int32_t addr = Partition_Addr(PART_APP), size = Partition_Size(PART_APP);
+
+	if (*arg == ' ')
+	{
+		while (*arg == ' ')
+			arg++;
+		size_str = (uint8_t *)strchr((char *)arg, ' ');
+		if (size_str != NULL)
+		{
+			*size_str++ = '\0';
+			while (*size_str == ' ')
+				size_str++;
+		}
+		if ((size_str == NULL) || !Str2Int(arg, &addr) || !Str2Int(size_str, &size) ||
+		    ((uint32_t)addr < STM32_FLASH_BASE) || ((uint32_t)size > FLASH_SIZE_DEFAULT) ||
+		    ((uint32_t)addr - STM32_FLASH_BASE > FLASH_SIZE_DEFAULT - (uint32_t)size))
+		{
+			SerialPutString(" Invalid range !\r\n");
+			return;
+		}
+	}
+	IAP_WriteFlag(UPLOAD_FLAG_DATA);
+	if(IAP_Upload((uint32_t)addr, (uint32_t)size) == 0)
+		MenuState = MENU_UPLOAD;
+	else
+		IAP_WriteFlag(INIT_FLAG_DATA);
+}
+
+/************************************************************************/
+static void IAP_Command(void)
+{
+	cmdStr[cmdLen] = '\0';
+	cmdLen = 0;
+	if(strcmp((char *)cmdStr, CMD_UPDATE_STR) == 0)
+	{
+		IAP_WriteFlag(UPDATE_FLAG_DATA);
+		if(IAP_Update() == 0)
+			MenuState = MENU_UPDATE;
+	}
+	else if((strncmp((char *)cmdStr, CMD_UPLOAD_STR, sizeof(CMD_UPLOAD_STR) - 1) == 0) &&
+	        ((cmdStr[sizeof(CMD_UPLOAD_STR) - 1] == '\0') || (cmdStr[sizeof(CMD_UPLOAD_STR) - 1] == ' ')))
 	{
+		IAP_UploadCommand();
+	}
+	else if(strcmp((char *)cmdStr, CMD_ERASE_STR) == 0)
+	{
+		IAP_WriteFlag(ERASE_FLAG_DATA);
+		if(IAP_Erase() == 0)
+			MenuState = MENU_ERASE;
+		else
+			IAP_WriteFlag(INIT_FLAG_DATA);
+	}
+	else if(strcmp((char *)cmdStr, CMD_MENU_STR) == 0)
+	{
+		IAP_WriteFlag(INIT_FLAG_DATA);
+		IAP_Main_Menu();
+	}
+	else if(strcmp((char *)cmdStr, CMD_RUNAPP_STR) == 0)
+	{
+		IAP_WriteFlag(APPRUN_FLAG_DATA);
+		if(IAP_RunApp())
+		{
+			IAP_WriteFlag(INIT_FLAG_DATA);
+			IAP_Main_Menu();
+		}
+	}
+	else if(strcmp((char *)cmdStr, CMD_STATS_STR) == 0)
+	{
+		IAP_Stats();
+	}
+	else if(strcmp((char *)cmdStr, CMD_TRACE_STR) == 0)
+	{
+		Trace_Dump();
+	}
+#if (USE_FLASH_BENCH == 1)
+	else if(strcmp((char *)cmdStr, CMD_FLASHBENCH_STR) == 0)
+	{
+		IAP_FlashBench();
+	}
+#endif
+	else if(strcmp((char *)cmdStr, CMD_DISWP_STR) == 0)
+	{
+		FLASH_DisableWriteProtectionPages();
+	}
+	else
+	{
+		SerialPutString(" Invalid CMD !\r\n");
+	}
+	memset(cmdStr,0,CMD_STRING_SIZE);
+}
 
-//		GetInputString(cmdStr);
-		HAL_UARTEx_ReceiveToIdle_IT(&huart1, cmdStr, CMD_STRING_SIZE);
-		if(UART1_flag){
-			UART1_flag=0;
-			if(strcmp((char *)cmdStr, CMD_UPDATE_STR) == 0)
+/**
+  * @brief  Collect a command; it ends at CR/LF or when the line goes idle.
+  */
+static void IAP_MenuRx(uint8_t idle)
+{
+	uint8_t c;
+
+	while (Serial_Read(&c, 1) != 0)
+	{
+		if ((cmdLen == 0) && (c == BINCMD_SOF0))
+		{
+			/* A production station speaks the binary protocol */
+			MenuState = MENU_BINARY;
+			Clock_SetProfile(CLOCK_PERF);
+			Stats_Begin();
+			BinCmd_Start(TASK_MENU);
+			return;
+		}
+		if (c == '\r' || c == '\n')
+		{
+			if (cmdLen != 0)
 			{
-				IAP_WriteFlag(UPDATE_FLAG_DATA);
-				return;
+				IAP_Command();
+				if (MenuState != MENU_PROMPT)
+					return;
 			}
-			else if(strcmp((char *)cmdStr, CMD_UPLOAD_STR) == 0)
+			continue;
+		}
+		if (cmdLen < CMD_STRING_SIZE - 1)
+		{
+			cmdStr[cmdLen++] = c;
+		}
+	}
+	if (idle && (cmdLen != 0))
+	{
+		IAP_Command();
+	}
+}
+
+/************************************************************************/
+static void IAP_MenuTask(const Sched_Event *evt)
+{
+	switch (evt->type)
+	{
+		case EVT_START:
+			Trial_Boot();
+			if (IAP_ReadFlag() == APPRUN_FLAG_DATA)
 			{
-				IAP_WriteFlag(UPLOAD_FLAG_DATA);
-				return;
+				/* The console keeps a way into the menu */
+				MenuState = MENU_BOOTWAIT;
+				Serial_SetRxOwner(TASK_MENU);
+				Sched_SetTimer(TASK_MENU, IAP_BOOT_WAIT_MS);
+				break;
 			}
-			else if(strcmp((char *)cmdStr, CMD_ERASE_STR) == 0)
+			IAP_WriteFlag(INIT_FLAG_DATA);
+			IAP_Main_Menu();
+			break;
+		case EVT_TIMEOUT:
+			if (MenuState != MENU_BOOTWAIT)
+				break;
+			if (IAP_RunApp() == 0)
+				break;
+			IAP_WriteFlag(INIT_FLAG_DATA);
+			IAP_Main_Menu();
+			break;
+		case EVT_UART_RX:
+		case EVT_UART_IDLE:
+			if (MenuState == MENU_BOOTWAIT)
 			{
-				IAP_WriteFlag(ERASE_FLAG_DATA);
-				return;
+				Sched_StopTimer(TASK_MENU);
+				IAP_WriteFlag(INIT_FLAG_DATA);
+				IAP_Main_Menu();
 			}
-			else if(strcmp((char *)cmdStr, CMD_MENU_STR) == 0)
+			if (MenuState == MENU_PROMPT)
+				IAP_MenuRx(evt->type == EVT_UART_IDLE);
+			break;
+		case EVT_YMODEM_DONE:
+			Stats_End();
+			Clock_SetProfile(CLOCK_NORMAL);
+			if (MenuState == MENU_UPLOAD)
 			{
+				IAP_UploadResult((int32_t)evt->param);
 				IAP_WriteFlag(INIT_FLAG_DATA);
+				IAP_Main_Menu();
+				break;
 			}
-			else if(strcmp((char *)cmdStr, CMD_RUNAPP_STR) == 0)
+			if (MenuState != MENU_UPDATE)
+				break;
+			if ((IAP_UpdateResult((int32_t)evt->param) == 0) && (SelfUpdate_Start() == 0))
 			{
 				IAP_WriteFlag(APPRUN_FLAG_DATA);
-				return;
-			}
-			else if(strcmp((char *)cmdStr, CMD_DISWP_STR) == 0)
-			{
-				FLASH_DisableWriteProtectionPages();
-			}
-			else
-			{
-				SerialPutString(" Invalid CMD !\r\n");
+				if (IAP_RunApp() == 0)
+					break;
 			}
-			memset(cmdStr,0,CMD_STRING_SIZE);
-		}
+			IAP_WriteFlag(INIT_FLAG_DATA);
+			IAP_Main_Menu();
+			break;
+		case EVT_CMD_DONE:
+			Stats_End();
+			Clock_SetProfile(CLOCK_NORMAL);
+			MenuState = MENU_PROMPT;
+			Serial_SetRxOwner(TASK_MENU);
+			break;
+		case EVT_FLASH_DONE:
+			if (MenuState != MENU_ERASE)
+				break;
+			Stats_End();
+			IAP_EraseResult(evt->param);
+			IAP_WriteFlag(INIT_FLAG_DATA);
+			IAP_Main_Menu();
+			break;
+		default:
+			break;
 	}
 }
 
 
 /************************************************************************/
 int8_t IAP_Update(void)
+{
+	Clock_SetProfile(CLOCK_PERF);
+	Stats_Begin();
+	if (Ymodem_Start(TASK_MENU) != 0)
+	{
+		Stats_End();
+		Clock_SetProfile(CLOCK_NORMAL);
+		SerialPutString(" Receive Filed.\r\n");
+		return -4;
+	}
+	return 0;
+}
+
+/**
+  * @brief  A file failed its signature check (imagesig.h): erase the first
+  *         sector of its partition, vector table included, so that nothing
+  *         starts it. Also for bus updates (busupdate.h).
+  */
+void IAP_Reject(uint8_t part)
+{
+	HAL_FLASH_Unlock();
+	STMFLASH_EraseSector((Partition_Addr(part) - STM32_FLASH_BASE) / STM_SECTOR_SIZE);
+	HAL_FLASH_Lock();
+	ICache_Invalidate();
+}
+
+/************************************************************************/
+int8_t IAP_UpdateResult(int32_t Size)
 {
 	uint8_t Number[10] = "";
-	int32_t Size = 0;
-	Size = Ymodem_Receive(&tab_1024[0]);
+	uint8_t i;
+	int8_t result = 0;
+	Serial_SetRxOwner(TASK_MENU);
+	BootInfo_SetUpdate(Size);
 	if (Size > 0)
 	{
 		SerialPutString("\r\n Update Over!\r\n");
-		SerialPutString(" Name: ");
-		SerialPutString(file_name);
-		Int2Str(Number, Size);
-		SerialPutString("\r\n Size: ");
-		SerialPutString(Number);
-		SerialPutString(" Bytes.\r\n");
-		return 0;
+		for (i = 0; i < Ymodem_FileCount; i++)
+		{
+			SerialPutString(" Name: ");
+			SerialPutString(Ymodem_Files[i].name);
+			SerialPutString("\r\n Partition: ");
+			SerialPutString(Partition_Get(Ymodem_Files[i].part)->name);
+			Int2Str(Number, Ymodem_Files[i].size);
+			SerialPutString("\r\n Size: ");
+			SerialPutString(Number);
+			SerialPutString(" Bytes.\r\n");
+			if (Ymodem_Files[i].image_size == 0)
+			{
+				SerialPutString(" Signature check failed!\r\n");
+				IAP_Reject(Ymodem_Files[i].part);
+				result = -5;
+			}
+			else if ((Ymodem_Files[i].part == PART_APP) && !SelfUpdate_IsBootFile(Ymodem_Files[i].name))
+			{
+				Trial_Start();
+			}
+		}
+		return result;
 	}
 	else if (Size == -1)
 	{
@@ -177,6 +519,16 @@ int8_t IAP_Update(void)
 		SerialPutString("\r\n Aborted by user.\r\n");
 		return -3;
 	}
+	else if (Size == -4)
+	{
+		SerialPutString("\r\n Unknown partition!\r\n");
+		return -4;
+	}
+	else if (Size == -6)
+	{
+		SerialPutString("\r\n Bootloader and application in one batch, send them one at a time.\r\n");
+		return -6;
+	}
 	else
 	{
 		SerialPutString(" Receive Filed.\r\n");
@@ -186,29 +538,40 @@ int8_t IAP_Update(void)
 
 
 /************************************************************************/
-int8_t IAP_Upload(void)
+int8_t IAP_Upload(uint32_t addr, uint32_t size)
 {
-	uint32_t status = 0; 
 	SerialPutString("\n\n\rSelect Receive File ... (press any key to abort)\n\r");
-	if (GetKey() == CRC16)
+	Clock_SetProfile(CLOCK_PERF);
+	Stats_Begin();
+	if (Ymodem_SendStart(addr, size, (const uint8_t*)"UploadedFlashImage.bin", TASK_MENU) != 0)
 	{
-		status = Ymodem_Transmit((uint8_t*)ApplicationAddress, (const uint8_t*)"UploadedFlashImage.bin", FLASH_IMAGE_SIZE);
-		if (status != 0) 
-		{
-			SerialPutString("\n\rError Occured while Transmitting File\n\r");
-			return -1;
-		}
-		else
-		{
-			SerialPutString("\n\rFile Trasmitted Successfully \n\r");
-			return -2;
-		}
+		Stats_End();
+		Clock_SetProfile(CLOCK_NORMAL);
+		SerialPutString("\n\rError Occured while Transmitting File\n\r");
+		return -1;
 	}
-	else
+	return 0;
+}
+
+/************************************************************************/
+int8_t IAP_UploadResult(int32_t status)
+{
+	Serial_SetRxOwner(TASK_MENU);
+	if (status == 0)
 	{
-		SerialPutString("\r\n\nAborted by user.\n\r");  
+		SerialPutString("\n\rFile Trasmitted Successfully \n\r");
 		return 0;
 	}
+	else if (status == -3)
+	{
+		SerialPutString("\r\n\nAborted by user.\n\r");
+		return -3;
+	}
+	else
+	{
+		SerialPutString("\n\rError Occured while Transmitting File\n\r");
+		return -1;
+	}
 }
 
 
@@ -216,14 +579,145 @@ int8_t IAP_Upload(void)
 int8_t IAP_Erase(void)
 {
 	uint8_t erase_cont[3] = {0};
-	Int2Str(erase_cont, FLASH_IMAGE_SIZE / PAGE_SIZE);
+	const Partition *app = Partition_Get(PART_APP);
+	Int2Str(erase_cont, FlashProg_SectorCount(app->addr, app->size));
 	SerialPutString(" @");//?�????���bug
 	SerialPutString(erase_cont);
 	SerialPutString("@");
-	if(EraseSomePages(FLASH_IMAGE_SIZE, 1))
+	Stats_Begin();
+	if(FlashProg_Erase(app->addr, app->size, TASK_MENU) == 0)
 		return 0;
-	else
+	Stats_End();
+	return -1;
+}
+
+/************************************************************************/
+int8_t IAP_EraseResult(uint32_t status)
+{
+	uint8_t erase_cont[3] = {0};
+	uint32_t EraseCounter;
+	const Partition *app = Partition_Get(PART_APP);
+	if(status != 0)
 		return -1;
+	for (EraseCounter = 0; EraseCounter < FlashProg_SectorCount(app->addr, app->size); EraseCounter++)
+	{
+		Int2Str(erase_cont, EraseCounter + 1);
+		SerialPutString(erase_cont);
+		SerialPutString("@");
+	}
+	return 0;
 }
 	
 
+/************************************************************************/
+static void IAP_PutStat(const char *label, uint32_t value, const char *unit)
+{
+	uint8_t Number[11] = "";
+
+	Int2Str(Number, (int32_t)value);
+	SerialPutString(label);
+	SerialPutString(Number);
+	SerialPutString(unit);
+	SerialPutString("\r\n");
+}
+
+/************************************************************************/
+static uint32_t IAP_CyclesToUs(uint64_t cycles, uint32_t clock)
+{
+	clock /= 1000000;
+	return (clock != 0) ? (uint32_t)(cycles / clock) : 0;
+}
+
+/**
+  * @brief  Print the counters of the last (or running) session
+  */
+void IAP_Stats(void)
+{
+	Stats_Counters st;
+	uint8_t Number[11] = "";
+	uint32_t packets = 0;
+	uint8_t i;
+
+	Stats_Get(&st);
+	SerialPutString("\r\n Session statistics:\r\n");
+	IAP_PutStat(" Elapsed: ", st.elapsed_ms, " ms");
+	IAP_PutStat(" Bytes received: ", st.rx_bytes, "");
+	for (i = 0; i < STATS_SIZE_CLASSES; i++)
+	{
+		packets += st.packets[i];
+		if (st.packets[i] != 0)
+		{
+			memset(Number, 0, sizeof(Number));
+			Int2Str(Number, 8 << i);
+			SerialPutString(" Packets of ");
+			SerialPutString(Number);
+			IAP_PutStat(" bytes: ", st.packets[i], "");
+		}
+	}
+	IAP_PutStat(" CRC errors: ", st.crc_errors, "");
+	IAP_PutStat(" Sequence errors: ", st.seq_errors, "");
+	IAP_PutStat(" NAKs sent: ", st.naks, "");
+	IAP_PutStat(" Packets resent: ", st.resends, "");
+	IAP_PutStat(" UART overruns: ", st.uart_overruns, "");
+	IAP_PutStat(" UART framing errors: ", st.uart_framing, "");
+	IAP_PutStat(" Sectors erased: ", st.flash_erases, "");
+	IAP_PutStat(" Sectors already blank: ", st.erases_skipped, "");
+	IAP_PutStat(" Blank check: ", IAP_CyclesToUs(st.blank_check_cycles, st.core_clock), " us");
+	IAP_PutStat(" Quadwords programmed: ", st.flash_programs, "");
+	IAP_PutStat(" Flash busy: ", IAP_CyclesToUs(st.flash_busy_cycles, st.core_clock), " us");
+	IAP_PutStat(" UART wait: ", IAP_CyclesToUs(st.uart_wait_cycles, st.core_clock), " us");
+	IAP_PutStat(" Compute: ", IAP_CyclesToUs(st.compute_cycles, st.core_clock), " us");
+	if (packets != 0)
+	{
+		IAP_PutStat(" Compute per packet: ", IAP_CyclesToUs(st.compute_cycles / packets, st.core_clock), " us");
+	}
+	if (st.hashed_bytes != 0)
+	{
+		IAP_PutStat(" SHA-256: ", IAP_CyclesToUs(st.hash_cycles, st.core_clock), " us");
+		IAP_PutStat(" SHA-256 per byte: ", (uint32_t)(st.hash_cycles / st.hashed_bytes), " cycles");
+		IAP_PutStat(" Signature check: ", IAP_CyclesToUs(st.verify_cycles, st.core_clock), " us");
+	}
+	if (st.decrypted_bytes != 0)
+	{
+		IAP_PutStat(" ChaCha20: ", IAP_CyclesToUs(st.decrypt_cycles, st.core_clock), " us");
+		IAP_PutStat(" ChaCha20 per byte: ", (uint32_t)(st.decrypt_cycles / st.decrypted_bytes), " cycles");
+	}
+	IAP_PutStat(" Core clock: ", st.core_clock / 1000000, " MHz");
+}
+
+#if (USE_FLASH_BENCH == 1)
+/**
+  * @brief  Time reading the first application sector, then the programming
+  *         of one sector with HAL_FLASH_Program per quadword and with the
+  *         burst loop, on the scratch partition. The default layout has
+  *         none (partition.h): refused without a table that adds one.
+  */
+void IAP_FlashBench(void)
+{
+	const Partition *scratch = Partition_Get(PART_SCRATCH);
+	uint32_t hal_cycles, burst_cycles;
+
+	if (scratch == 0)
+	{
+		SerialPutString("\r\n No scratch partition: the default layout has none,\r\n"
+		                " program a partition table with one (Host/tools/mkptable).\r\n");
+		return;
+	}
+	if (STMFLASH_BenchRead(Partition_Addr(PART_APP), &hal_cycles, &burst_cycles) != 0)
+	{
+		SerialPutString("\r\n Flash error\r\n");
+		return;
+	}
+	SerialPutString("\r\n Sector read time:\r\n");
+	IAP_PutStat(" Halfword loop: ", IAP_CyclesToUs(hal_cycles, SystemCoreClock), " us");
+	IAP_PutStat(" STMFLASH_Read: ", IAP_CyclesToUs(burst_cycles, SystemCoreClock), " us");
+	if (STMFLASH_Bench(scratch->addr, &hal_cycles, &burst_cycles) != 0)
+	{
+		SerialPutString("\r\n Flash error\r\n");
+		return;
+	}
+	SerialPutString("\r\n Sector program time:\r\n");
+	IAP_PutStat(" HAL per quadword: ", IAP_CyclesToUs(hal_cycles, SystemCoreClock), " us");
+	IAP_PutStat(" Burst: ", IAP_CyclesToUs(burst_cycles, SystemCoreClock), " us");
+}
+#endif
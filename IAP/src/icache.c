@@ -0,0 +1,36 @@
+#include "icache.h"
+#include "iap_config.h"
+#include "stm32h5xx_hal.h"
+#include "ramexec.h"
+
+/**
+  * @brief  Enable the cache once the invalidation that follows reset has
+  *         finished (2-way, the reset configuration)
+  */
+void ICache_Enable(void)
+{
+#if (USE_ICACHE == 1)
+	while (ICACHE->SR & ICACHE_SR_BUSYF)
+	{
+	}
+	ICACHE->FCR = ICACHE_FCR_CBSYENDF;
+	ICACHE->CR |= ICACHE_CR_EN;
+#endif
+}
+
+/**
+  * @brief  Drop every cached line, after flash has been programmed or
+  *         erased. In RAM for the flash programmer job (flashprog.c).
+  */
+RAMFUNC void ICache_Invalidate(void)
+{
+	if ((ICACHE->CR & ICACHE_CR_EN) == 0)
+	{
+		return;
+	}
+	ICACHE->CR |= ICACHE_CR_CACHEINV;
+	while (ICACHE->SR & ICACHE_SR_BUSYF)
+	{
+	}
+	ICACHE->FCR = ICACHE_FCR_CBSYENDF;
+}
@@ -0,0 +1,86 @@
+#include "imageenc.h"
+#include "iap_config.h"
+#include "chacha20.h"
+#include "stats.h"
+#include <string.h>
+
+/* Private variables ---------------------------------------------------------*/
+static const uint8_t ImageEnc_Key[CHACHA20_KEY_SIZE] = IMAGEENC_KEY;
+
+static ChaCha20_Ctx ImageEnc_Cipher;
+static struct
+{
+	uint8_t encrypted;      /* The file being received */
+	uint32_t fill;          /* Header bytes received */
+	ImageEnc_Header header;
+} ie;
+
+/**
+  * @brief  The first payload bytes of a file: is it encrypted
+  * @retval Bytes of the file before the image: the header size, or 0
+  */
+uint32_t ImageEnc_Begin(const uint8_t *data, uint32_t size, uint32_t file_size)
+{
+	uint32_t magic;
+
+	ie.encrypted = 0;
+	ie.fill = 0;
+#if (USE_ENCRYPTED_IMAGES == 1)
+	if ((size >= sizeof(magic)) && (file_size > sizeof(ImageEnc_Header)))
+	{
+		memcpy(&magic, data, sizeof(magic));
+		ie.encrypted = (magic == IMAGEENC_MAGIC);
+	}
+#endif
+	return ie.encrypted ? sizeof(ImageEnc_Header) : 0;
+}
+
+/**
+  * @brief  The next payload bytes of the file, in order: decrypt them in
+  *         place
+  * @retval Leading bytes that were header, not image
+  */
+uint32_t ImageEnc_Decrypt(uint8_t *data, uint32_t size)
+{
+	uint32_t n = 0, start;
+
+	if (!ie.encrypted)
+	{
+		return 0;
+	}
+	if (ie.fill < sizeof(ImageEnc_Header))
+	{
+		n = sizeof(ImageEnc_Header) - ie.fill;
+		if (n > size)
+		{
+			n = size;
+		}
+		memcpy((uint8_t *)&ie.header + ie.fill, data, n);
+		ie.fill += n;
+		if (ie.fill < sizeof(ImageEnc_Header))
+		{
+			return n;
+		}
+		ChaCha20_Init(&ImageEnc_Cipher, ImageEnc_Key, ie.header.nonce, 0);
+	}
+	start = Stats_Cycles();
+	ChaCha20_Xor(&ImageEnc_Cipher, data + n, size - n);
+	STATS_ADD(decrypt_cycles, Stats_Cycles() - start);
+	STATS_ADD(decrypted_bytes, size - n);
+	return n;
+}
+
+/**
+  * @brief  Decrypt bytes of an image that come in any order (busupdate.h),
+  *         in place
+  * @param  offset: in the image, a multiple of the ChaCha20 block
+  */
+void ImageEnc_DecryptAt(const uint8_t nonce[12], uint32_t offset, uint8_t *data, uint32_t size)
+{
+	uint32_t start = Stats_Cycles();
+
+	ChaCha20_Init(&ImageEnc_Cipher, ImageEnc_Key, nonce, offset / CHACHA20_BLOCK_SIZE);
+	ChaCha20_Xor(&ImageEnc_Cipher, data, size);
+	STATS_ADD(decrypt_cycles, Stats_Cycles() - start);
+	STATS_ADD(decrypted_bytes, size);
+}
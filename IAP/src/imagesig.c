@@ -0,0 +1,146 @@
+#include "imagesig.h"
+#include "iap_config.h"
+#include "partition.h"
+#include "selfupdate.h"
+#include "kvstore.h"
+#include "sha256.h"
+#include "ed25519.h"
+#include "stats.h"
+#include <string.h>
+
+/* Private variables ---------------------------------------------------------*/
+static const uint8_t ImageSig_Key[ED25519_KEY_SIZE] = IMAGESIG_PUBLIC_KEY;
+
+static Sha256_Ctx ImageSig_Hash;
+static struct
+{
+	uint8_t active;         /* The file being received must be signed */
+	uint8_t app;            /* and is the application, not a "boot:" file */
+	uint8_t checked;        /* KV_APPSIG when there is no state store */
+	uint32_t addr;          /* Where it is written */
+	uint32_t file_size;
+	uint32_t size;          /* Bytes to hash, the file up to the trailer */
+	uint32_t fed;           /* Hashed so far */
+} is;
+
+/**
+  * @brief  A new file of the batch: start its digest if it must be signed
+  */
+void ImageSig_Begin(uint8_t part, const uint8_t *file_name, uint32_t addr, uint32_t file_size)
+{
+#if (USE_SIGNED_IMAGES == 1)
+	is.active = (part == PART_APP) || SelfUpdate_IsBootFile(file_name);
+#else
+	is.active = 0;
+#endif
+	is.app = (part == PART_APP) && !SelfUpdate_IsBootFile(file_name);
+	is.addr = addr;
+	is.file_size = file_size;
+	is.size = (file_size > sizeof(ImageSig_Trailer)) ? file_size - sizeof(ImageSig_Trailer) : 0;
+	is.fed = 0;
+	if (is.active)
+	{
+		Sha256_Init(&ImageSig_Hash);
+	}
+}
+
+/**
+  * @brief  The next payload bytes of the file, in order; the trailer and
+  *         the padding of the last packet are left out
+  */
+void ImageSig_Update(const uint8_t *data, uint32_t size)
+{
+	uint32_t start;
+
+	if (!is.active || (is.fed >= is.size))
+	{
+		return;
+	}
+	if (size > is.size - is.fed)
+	{
+		size = is.size - is.fed;
+	}
+	start = Stats_Cycles();
+	Sha256_Update(&ImageSig_Hash, data, size);
+	STATS_ADD(hash_cycles, Stats_Cycles() - start);
+	STATS_ADD(hashed_bytes, size);
+	is.fed += size;
+}
+
+/**
+  * @brief  The file is complete and in flash: check its trailer
+  * @retval The image size to use: the signed bytes, or the file size for a
+  *         file that needs no signature. 0: the check failed
+  */
+uint32_t ImageSig_End(void)
+{
+	ImageSig_Trailer t;
+	uint8_t digest[SHA256_DIGEST_SIZE];
+	uint32_t start;
+	int8_t result;
+
+	if (!is.active)
+	{
+		return is.file_size;
+	}
+	is.active = 0;
+	if ((is.size == 0) || (is.fed != is.size))
+	{
+		return 0;
+	}
+	memcpy(&t, (const void *)(uintptr_t)(is.addr + is.size), sizeof(t));
+	if ((t.magic != IMAGESIG_MAGIC) || (t.size != is.size))
+	{
+		return 0;
+	}
+	Sha256_Final(&ImageSig_Hash, digest);
+	start = Stats_Cycles();
+	result = Ed25519_Verify(t.signature, digest, sizeof(digest), ImageSig_Key);
+	STATS_ADD(verify_cycles, Stats_Cycles() - start);
+	if (result != 0)
+	{
+		return 0;
+	}
+	if (is.app)
+	{
+		is.checked = 1;
+		KvStore_Set(KV_APPSIG, is.size);
+	}
+	return is.size;
+}
+
+/**
+  * @brief  A flash job is about to change [addr, addr + size): forget the
+  *         checked application when the range touches PART_APP. The record
+  *         reaches flash with the STMFLASH_Flush() before the job.
+  */
+void ImageSig_Revoke(uint32_t addr, uint32_t size)
+{
+	const Partition *p = Partition_Get(PART_APP);
+
+	if ((p == 0) || (addr >= p->addr + p->size) || (p->addr >= addr + size))
+	{
+		return;
+	}
+	is.checked = 0;
+	KvStore_Set(KV_APPSIG, 0);
+}
+
+/**
+  * @brief  1 when the application in PART_APP may be started: it passed
+  *         its check and nothing wrote the partition since
+  */
+uint8_t ImageSig_AppChecked(void)
+{
+#if (USE_SIGNED_IMAGES == 1)
+	uint32_t size;
+
+	if (!KvStore_Ready())
+	{
+		return is.checked;
+	}
+	return (KvStore_Get(KV_APPSIG, &size) == 0) && (size != 0);
+#else
+	return 1;
+#endif
+}
@@ -0,0 +1,229 @@
+#include "kvstore.h"
+#include "partition.h"
+#include "stmflash.h"
+
+/* Private variables ---------------------------------------------------------*/
+/* Write-back order of KvStore_Compact: the sector is programmed from its
+ * start, so a reset during the program keeps the first records */
+static const uint8_t KvStore_Order[KV_COUNT] =
+{
+	KV_SELFUPDATE, KV_TRIAL, KV_APPSIG, KV_BUSADDR, KV_FLAG
+};
+
+static struct
+{
+	uint32_t base;
+	uint32_t slots;             /* Records the partition holds, 0: no store */
+	uint32_t head;              /* Next free slot */
+	uint32_t present;           /* Bit per key */
+	uint32_t value[KV_COUNT];
+} kv;
+
+/* Set by KvStore_EccIsr() while KvStore_Init() reads a record */
+static volatile uint8_t KvStore_Scanning;
+static volatile uint8_t KvStore_Torn;
+
+/************************************************************************/
+static uint8_t KvStore_Valid(const uint32_t *rec)
+{
+	return (rec[0] == ~rec[3]) && (rec[1] == ~rec[2]) &&
+	       ((rec[0] >> 16) == KVSTORE_TAG) && ((rec[0] & 0xFFFF) < KV_COUNT);
+}
+
+/**
+  * @brief  Replay the log of the EDATA partition into RAM
+  */
+void KvStore_Init(void)
+{
+	const Partition *p = Partition_Get(PART_EDATA);
+	const uint32_t *rec;
+	uint32_t r[4], key;
+
+	memset(&kv, 0, sizeof(kv));
+	if (p == 0)
+	{
+		return;
+	}
+	kv.base = p->addr;
+	kv.slots = p->size / KVSTORE_RECORD_SIZE;
+	KvStore_Scanning = 1;
+	for (kv.head = 0; kv.head < kv.slots; kv.head++)
+	{
+		rec = (const uint32_t *)(uintptr_t)(kv.base + kv.head * KVSTORE_RECORD_SIZE);
+		KvStore_Torn = 0;
+		r[0] = rec[0];
+		r[1] = rec[1];
+		r[2] = rec[2];
+		r[3] = rec[3];
+		__DSB(); // The NMI of a double ECC error is in before the check
+		if (KvStore_Torn)
+		{
+			continue;
+		}
+		if ((r[0] & r[1] & r[2] & r[3]) == 0xFFFFFFFF)
+		{
+			break;
+		}
+		if (KvStore_Valid(r))
+		{
+			key = r[0] & 0xFFFF;
+			kv.value[key] = r[1];
+			kv.present |= 1u << key;
+		}
+	}
+	KvStore_Scanning = 0;
+}
+
+/**
+  * @brief  From NMI_Handler: a double ECC error while KvStore_Init() reads
+  *         the log is a record whose program a reset cut short. Clear it
+  *         and have the scan skip the record.
+  * @retval 1: handled, 0: not a scan read, the NMI is not survivable
+  */
+uint8_t KvStore_EccIsr(void)
+{
+	if (!KvStore_Scanning || ((FLASH->ECCDETR & FLASH_ECCR_ECCD) == 0))
+	{
+		return 0;
+	}
+	FLASH->ECCDETR = FLASH_ECCR_ECCD;
+	KvStore_Torn = 1;
+	return 1;
+}
+
+/**
+  * @brief  1 when there is an EDATA partition to keep the state in
+  */
+uint8_t KvStore_Ready(void)
+{
+	return kv.slots != 0;
+}
+
+/**
+  * @retval 0: found, -1: never set
+  */
+int8_t KvStore_Get(uint8_t key, uint32_t *value)
+{
+	if ((key >= KV_COUNT) || ((kv.present & (1u << key)) == 0))
+	{
+		return -1;
+	}
+	*value = kv.value[key];
+	return 0;
+}
+
+/************************************************************************/
+void KvStore_Encode(uint8_t key, uint32_t value, uint32_t rec[4])
+{
+	rec[0] = ((uint32_t)KVSTORE_TAG << 16) | key;
+	rec[1] = value;
+	rec[2] = ~rec[1];
+	rec[3] = ~rec[0];
+}
+
+/**
+  * @brief  Look a key up in the log at base, without the RAM state: for
+  *         code that runs once the application owns the RAM (services.c)
+  * @param  free: the first blank slot, 0 when the log is full
+  * @retval 0: found, -1: never set
+  */
+int8_t KvStore_Scan(uint32_t base, uint32_t size, uint8_t key, uint32_t *value, uint32_t *free)
+{
+	const uint32_t *rec;
+	uint32_t slot;
+	int8_t found = -1;
+
+	*free = 0;
+	for (slot = 0; slot < size / KVSTORE_RECORD_SIZE; slot++)
+	{
+		rec = (const uint32_t *)(uintptr_t)(base + slot * KVSTORE_RECORD_SIZE);
+		if ((rec[0] & rec[1] & rec[2] & rec[3]) == 0xFFFFFFFF)
+		{
+			*free = (uint32_t)(uintptr_t)rec;
+			break;
+		}
+		if (KvStore_Valid(rec) && ((rec[0] & 0xFFFF) == key))
+		{
+			*value = rec[1];
+			found = 0;
+		}
+	}
+	return found;
+}
+
+/************************************************************************/
+static void KvStore_Append(uint8_t key)
+{
+	uint32_t rec[4];
+
+	KvStore_Encode(key, kv.value[key], rec);
+	STMFLASH_Write(kv.base + kv.head * KVSTORE_RECORD_SIZE, (uint16_t *)rec, KVSTORE_RECORD_SIZE / 2);
+	kv.head++;
+}
+
+/**
+  * @brief  The log is full: blank the partition and write the live values
+  *         back, in KvStore_Order. The STMFLASH cache turns this into one
+  *         erase and program of the sector at its next flush; see
+  *         kvstore.h for a reset in between.
+  */
+static void KvStore_Compact(void)
+{
+	static const uint16_t blank[KVSTORE_RECORD_SIZE / 2] =
+	{
+		0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF
+	};
+	uint32_t i;
+
+	for (i = 0; i < kv.slots; i++)
+	{
+		STMFLASH_Write(kv.base + i * KVSTORE_RECORD_SIZE, (uint16_t *)blank, KVSTORE_RECORD_SIZE / 2);
+	}
+	kv.head = 0;
+	for (i = 0; i < KV_COUNT; i++)
+	{
+		if (kv.present & (1u << KvStore_Order[i]))
+		{
+			KvStore_Append(KvStore_Order[i]);
+		}
+	}
+}
+
+/**
+  * @brief  Make room for count more records, so writers that only append
+  *         (KvStore_Scan) do not find the log full
+  */
+void KvStore_Reserve(uint32_t count)
+{
+	if ((kv.slots != 0) && (kv.head + count > kv.slots))
+	{
+		KvStore_Compact();
+	}
+}
+
+/**
+  * @brief  Set a value. Setting the value a key already has costs nothing.
+  * @retval 0: ok, -1: no store or bad key
+  */
+int8_t KvStore_Set(uint8_t key, uint32_t value)
+{
+	if ((kv.slots == 0) || (key >= KV_COUNT))
+	{
+		return -1;
+	}
+	if ((kv.present & (1u << key)) && (kv.value[key] == value))
+	{
+		return 0;
+	}
+	kv.value[key] = value;
+	kv.present |= 1u << key;
+	if (kv.head >= kv.slots)
+	{
+		KvStore_Compact();
+	}
+	else
+	{
+		KvStore_Append(key);
+	}
+	return 0;
+}
@@ -0,0 +1,197 @@
+#include "partition.h"
+#include "iap_config.h"
+#include "stm32h5xx_hal.h"
+#include <string.h>
+
+/* Used when the table in flash is blank or invalid */
+static const Partition_Table Partition_Default =
+{
+	PTABLE_MAGIC, PTABLE_VERSION, 5,
+	{
+		{ PART_APP,    ApplicationAddress, APP_FLASH_SIZE,    "app" },
+		{ PART_CONFIG, CONFIG_FLASH_ADDR,  CONFIG_FLASH_SIZE, "config" },
+		{ PART_CALIB,  CALIB_FLASH_ADDR,   CALIB_FLASH_SIZE,  "calib" },
+		{ PART_EDATA,  EDATA_FLASH_ADDR,   EDATA_FLASH_SIZE,  "edata" },
+		{ PART_FLAG,   IAP_FLAG_ADDR,      16,                "flag" },
+	}
+};
+
+static Partition_Table Partition_Ram;
+static uint8_t Partition_Loaded = 0;
+
+/**
+  * @brief  Check one entry: inside the flash above the bootloader sectors
+  *         (any type, an entry in the table's own sector would be erased
+  *         with the bootloader) and on quadword boundaries. All but the flag and EDATA areas, which
+  *         share a sector, must cover whole sectors so erasing one never
+  *         touches another.
+  */
+static uint8_t Partition_EntryValid(const Partition *p)
+{
+	uint32_t end = STM32_FLASH_BASE + FLASH_SIZE_DEFAULT;
+
+	if ((p->type >= PART_COUNT) || (p->size == 0) || (p->name[PARTITION_NAME_SIZE - 1] != '\0') ||
+	    (p->addr < STM32_FLASH_BASE + BOOTLOADER_SIZE) || (p->addr >= end) || (p->size > end - p->addr))
+		return 0;
+	if (((p->addr | p->size) & 15u) != 0)
+		return 0;
+	if ((p->type == PART_FLAG) || (p->type == PART_EDATA))
+		return 1;
+	return ((((p->addr - STM32_FLASH_BASE) | p->size) % PAGE_SIZE) == 0);
+}
+
+/************************************************************************/
+static uint8_t Partition_TableValid(const Partition_Table *t)
+{
+	uint32_t i, j, seen = 0;
+
+	if ((t->magic != PTABLE_MAGIC) || (t->version != PTABLE_VERSION) ||
+	    (t->count == 0) || (t->count > PTABLE_MAX_ENTRIES))
+		return 0;
+	for (i = 0; i < t->count; i++)
+	{
+		if (!Partition_EntryValid(&t->entry[i]) || (seen & (1u << t->entry[i].type)))
+			return 0;
+		seen |= 1u << t->entry[i].type;
+		for (j = 0; j < i; j++)
+		{
+			if ((t->entry[i].addr < t->entry[j].addr + t->entry[j].size) &&
+			    (t->entry[j].addr < t->entry[i].addr + t->entry[i].size))
+				return 0;
+		}
+	}
+	/* The bootloader cannot work without these two */
+	return (seen & ((1u << PART_APP) | (1u << PART_FLAG))) == ((1u << PART_APP) | (1u << PART_FLAG));
+}
+
+/**
+  * @brief  Copy the table into RAM once; falls back to the default layout.
+  */
+void Partition_Init(void)
+{
+	const Partition_Table *flash = (const Partition_Table *)PTABLE_ADDR;
+
+	Partition_Loaded = Partition_TableValid(flash);
+	memcpy(&Partition_Ram, Partition_Loaded ? flash : &Partition_Default, sizeof(Partition_Ram));
+}
+
+/**
+  * @brief  1 when the layout came from the table in flash, 0 for the default.
+  */
+uint8_t Partition_FromFlash(void)
+{
+	return Partition_Loaded;
+}
+
+/************************************************************************/
+const Partition *Partition_Get(uint8_t type)
+{
+	uint32_t i;
+
+	for (i = 0; i < Partition_Ram.count; i++)
+	{
+		if (Partition_Ram.entry[i].type == type)
+			return &Partition_Ram.entry[i];
+	}
+	return 0;
+}
+
+/**
+  * @brief  Partition_Get() from the table in flash, without the RAM copy:
+  *         for code that runs once the application owns the RAM
+  *         (services.c)
+  */
+const Partition *Partition_Lookup(uint8_t type)
+{
+	const Partition_Table *t = (const Partition_Table *)PTABLE_ADDR;
+	uint32_t i;
+
+	if (!Partition_TableValid(t))
+		t = &Partition_Default;
+	for (i = 0; i < t->count; i++)
+	{
+		if (t->entry[i].type == type)
+			return &t->entry[i];
+	}
+	return 0;
+}
+
+/************************************************************************/
+uint32_t Partition_Addr(uint8_t type)
+{
+	const Partition *p = Partition_Get(type);
+
+	return (p != 0) ? p->addr : 0;
+}
+
+/************************************************************************/
+uint32_t Partition_Size(uint8_t type)
+{
+	const Partition *p = Partition_Get(type);
+
+	return (p != 0) ? p->size : 0;
+}
+
+/************************************************************************/
+static const Partition *Partition_FindIn(const Partition_Table *t, uint32_t addr, uint32_t size)
+{
+	const Partition *p;
+	uint32_t i;
+
+	for (i = 0; i < t->count; i++)
+	{
+		p = &t->entry[i];
+		if ((addr >= p->addr) && (size <= p->size) && (addr - p->addr <= p->size - size))
+			return p;
+	}
+	return 0;
+}
+
+/**
+  * @brief  The partition that holds all of [addr, addr + size), if any.
+  */
+const Partition *Partition_Find(uint32_t addr, uint32_t size)
+{
+	return Partition_FindIn(&Partition_Ram, addr, size);
+}
+
+/**
+  * @brief  Partition_Find() from the table in flash, see Partition_Lookup()
+  */
+const Partition *Partition_LookupRange(uint32_t addr, uint32_t size)
+{
+	const Partition_Table *t = (const Partition_Table *)PTABLE_ADDR;
+
+	return Partition_FindIn(Partition_TableValid(t) ? t : &Partition_Default, addr, size);
+}
+
+/**
+  * @brief  Find the partition a file is meant for from its "name:" prefix.
+  *         The flag and EDATA areas share the bootloader's state sector
+  *         (kvstore.h) and take no files.
+  * @retval 0: found, -1: unknown partition name or a state area
+  */
+int8_t Partition_FromFileName(const uint8_t *file_name, uint8_t *type)
+{
+	const char *colon = strchr((const char *)file_name, ':');
+	uint32_t len, i;
+
+	if (colon == 0)
+	{
+		*type = PART_APP;
+		return 0;
+	}
+	len = (uint32_t)(colon - (const char *)file_name);
+	for (i = 0; i < Partition_Ram.count; i++)
+	{
+		if ((strlen(Partition_Ram.entry[i].name) == len) &&
+		    (strncmp(Partition_Ram.entry[i].name, (const char *)file_name, len) == 0))
+		{
+			if ((Partition_Ram.entry[i].type == PART_FLAG) || (Partition_Ram.entry[i].type == PART_EDATA))
+				return -1;
+			*type = (uint8_t)Partition_Ram.entry[i].type;
+			return 0;
+		}
+	}
+	return -1;
+}
@@ -0,0 +1,29 @@
+#include "ramexec.h"
+#include <string.h>
+#include "stm32h5xx_hal.h"
+
+/* Startup code, the vector table at the start of the flash */
+extern const uint32_t g_pfnVectors[RAMEXEC_VECTORS];
+
+#if (USE_RAM_EXEC == 1)
+/* At the start of the RAM, so it meets the 1KB alignment VTOR needs */
+static uint32_t RamExec_Vectors[RAMEXEC_VECTORS] __attribute__((section(".ram_vector")));
+#endif
+
+/**
+  * @brief  Take the exceptions through a copy of the vector table in RAM,
+  *         so the interrupt entry does not read a busy bank 1
+  */
+void RamExec_Init(void)
+{
+#if (USE_RAM_EXEC == 1)
+	uint32_t primask = __get_PRIMASK();
+
+	memcpy(RamExec_Vectors, g_pfnVectors, sizeof(RamExec_Vectors));
+	__disable_irq();
+	SCB->VTOR = (uint32_t)(uintptr_t)RamExec_Vectors;
+	__DSB();
+	__ISB();
+	__set_PRIMASK(primask);
+#endif
+}
@@ -0,0 +1,159 @@
+#include "sched.h"
+#include "stm32h5xx_hal.h"
+#include "stats.h"
+#include "ramexec.h"
+
+/* Run-to-completion scheduler: interrupts and tasks post events into one
+ * queue, the main loop hands them to the task handlers one at a time and
+ * sleeps with WFI when there is nothing left to do. */
+
+static Sched_Handler Sched_Handlers[TASK_COUNT];
+static Sched_Event Sched_Queue[SCHED_QUEUE_SIZE];
+static volatile uint32_t Sched_Head = 0, Sched_Tail = 0;
+
+static uint32_t Sched_TimerStart[TASK_COUNT];
+static uint32_t Sched_TimerPeriod[TASK_COUNT];
+static uint8_t Sched_TimerArmed[TASK_COUNT];
+
+/************************************************************************/
+void Sched_Init(void)
+{
+	uint8_t i;
+	Sched_Head = 0;
+	Sched_Tail = 0;
+	for (i = 0; i < TASK_COUNT; i++)
+	{
+		Sched_Handlers[i] = 0;
+		Sched_TimerArmed[i] = 0;
+	}
+}
+
+/************************************************************************/
+void Sched_Register(uint8_t task, Sched_Handler handler)
+{
+	if (task < TASK_COUNT)
+	{
+		Sched_Handlers[task] = handler;
+	}
+}
+
+/**
+  * @brief  Queue an event for a task. Safe to call from interrupt context.
+  * @param  task: Destination task
+  * @param  type: Event type
+  * @param  param: Event specific parameter
+  * @retval 0: Queued
+  *        -1: Queue full, event dropped
+  */
+RAMFUNC int8_t Sched_Post(uint8_t task, uint8_t type, uint32_t param)
+{
+	uint32_t primask = __get_PRIMASK();
+	int8_t ret = -1;
+
+	__disable_irq();
+	if ((Sched_Head - Sched_Tail) < SCHED_QUEUE_SIZE)
+	{
+		Sched_Event *evt = &Sched_Queue[Sched_Head & (SCHED_QUEUE_SIZE - 1)];
+		evt->task = task;
+		evt->type = type;
+		evt->param = param;
+		Sched_Head++;
+		ret = 0;
+	}
+	__set_PRIMASK(primask);
+	return ret;
+}
+
+/************************************************************************/
+void Sched_SetTimer(uint8_t task, uint32_t timeout_ms)
+{
+	if (task < TASK_COUNT)
+	{
+		Sched_TimerStart[task] = HAL_GetTick();
+		Sched_TimerPeriod[task] = timeout_ms;
+		Sched_TimerArmed[task] = 1;
+	}
+}
+
+/************************************************************************/
+void Sched_StopTimer(uint8_t task)
+{
+	if (task < TASK_COUNT)
+	{
+		Sched_TimerArmed[task] = 0;
+	}
+}
+
+/************************************************************************/
+RAMFUNC static void Sched_CheckTimers(void)
+{
+	uint32_t now = HAL_GetTick();
+	uint8_t i;
+
+	for (i = 0; i < TASK_COUNT; i++)
+	{
+		if (Sched_TimerArmed[i] && (now - Sched_TimerStart[i]) >= Sched_TimerPeriod[i])
+		{
+			Sched_TimerArmed[i] = 0;
+			Sched_Post(i, EVT_TIMEOUT, 0);
+		}
+	}
+}
+
+/**
+  * @brief  Deliver every queued event to its task, including the events
+  *         posted by the handlers themselves while draining.
+  * @retval Number of events dispatched
+  */
+RAMFUNC uint32_t Sched_Dispatch(void)
+{
+	Sched_Event evt;
+	uint32_t count = 0;
+
+	Sched_CheckTimers();
+	while (Sched_Tail != Sched_Head)
+	{
+		evt = Sched_Queue[Sched_Tail & (SCHED_QUEUE_SIZE - 1)];
+		Sched_Tail++;
+		if ((evt.task < TASK_COUNT) && (Sched_Handlers[evt.task] != 0))
+		{
+			Sched_Handlers[evt.task](&evt);
+		}
+		count++;
+	}
+	return count;
+}
+
+/**
+  * @brief  Called once per scheduler round before sleeping, e.g. to refresh
+  *         a watchdog.
+  */
+__weak RAMFUNC void Sched_IdleHook(void)
+{
+}
+
+/**
+  * @brief  Scheduler main loop, never returns.
+  */
+RAMFUNC void Sched_Run(void)
+{
+	uint32_t start;
+
+	while (1)
+	{
+		start = Stats_Cycles();
+		Sched_Dispatch();
+		Sched_IdleHook();
+
+		/* Sleep until the next interrupt; SysTick wakes us for the timers */
+		__disable_irq();
+		Stats_Compute(Stats_Cycles() - start);
+		if (Sched_Tail == Sched_Head)
+		{
+			start = Stats_Cycles();
+			__WFI();
+			Stats_Sleep(Stats_Cycles() - start);
+		}
+		__enable_irq();
+	}
+}
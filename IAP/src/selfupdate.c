@@ -0,0 +1,308 @@
+#include "selfupdate.h"
+#include "iap_config.h"
+#include "kvstore.h"
+#include "stmflash.h"
+#include "serial.h"
+#include "ymodem.h"
+#include "icache.h"
+#include "ramexec.h"
+#include "common.h"
+#include <string.h>
+
+#if (USE_SELF_UPDATE == 1) && (USE_RAM_EXEC != 1)
+#error "The self-update copy runs from RAM, it needs USE_RAM_EXEC"
+#endif
+
+/* The bootloader area: the sectors up to and with the partition table */
+#define SELFUPDATE_SECTORS      ((PTABLE_ADDR - STM32_FLASH_BASE) / STM_SECTOR_SIZE + 1)
+#define SELFUPDATE_AREA_END     (STM32_FLASH_BASE + SELFUPDATE_SECTORS * STM_SECTOR_SIZE)
+
+/* Private variables ---------------------------------------------------------*/
+/* The product's partition table, kept over the copy */
+static uint32_t SelfUpdate_Ptable[(SELFUPDATE_AREA_END - PTABLE_ADDR) / 4];
+
+/* CRC-32, reflected 0xEDB88320, four bits at a time */
+static const uint32_t SelfUpdate_CrcTable[16] =
+{
+	0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+	0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+};
+
+/************************************************************************/
+uint8_t SelfUpdate_IsBootFile(const uint8_t *file_name)
+{
+#if (USE_SELF_UPDATE == 1)
+	return strncmp((const char *)file_name, SELFUPDATE_PREFIX, sizeof(SELFUPDATE_PREFIX) - 1) == 0;
+#else
+	return 0;
+#endif
+}
+
+/**
+  * @brief  Where a bootloader image is staged: the scratch partition when
+  *         it can hold one, else the application partition
+  */
+const Partition *SelfUpdate_Staging(void)
+{
+	const Partition *p = Partition_Get(PART_SCRATCH);
+
+	if ((p == 0) || (p->size < SELFUPDATE_IMAGE_MAX + sizeof(SelfUpdate_Trailer)))
+	{
+		p = Partition_Get(PART_APP);
+	}
+	return p;
+}
+
+/**
+  * @param  crc: 0, or the result for the data before
+  */
+uint32_t SelfUpdate_Crc32(uint32_t crc, const uint8_t *data, uint32_t size)
+{
+	crc = ~crc;
+	while (size--)
+	{
+		crc ^= *data++;
+		crc = (crc >> 4) ^ SelfUpdate_CrcTable[crc & 15];
+		crc = (crc >> 4) ^ SelfUpdate_CrcTable[crc & 15];
+	}
+	return ~crc;
+}
+
+/**
+  * @brief  Check the staged file before anything is erased
+  * @param  file_size: as the YModem header gave it, less the signature
+  *         trailer (imagesig.h)
+  * @retval Image size, 0: not a bootloader image or damaged
+  */
+static uint32_t SelfUpdate_Check(uint32_t file_size)
+{
+	const Partition *p = SelfUpdate_Staging();
+	const SelfUpdate_Trailer *t;
+	const uint32_t *vector;
+	uint32_t size;
+
+	if ((p == 0) || (file_size < sizeof(SelfUpdate_Trailer)) || (file_size > p->size) ||
+	    ((file_size & 15) != 0))
+	{
+		return 0;
+	}
+	t = (const SelfUpdate_Trailer *)(p->addr + file_size - sizeof(SelfUpdate_Trailer));
+	size = t->size;
+	if ((t->magic != SELFUPDATE_MAGIC) || (t->check != ~t->crc) ||
+	    (size != file_size - sizeof(SelfUpdate_Trailer)) || (size < 8) || (size > SELFUPDATE_IMAGE_MAX))
+	{
+		return 0;
+	}
+	/* Stack in the RAM, reset handler a Thumb address inside the image */
+	vector = (const uint32_t *)(uintptr_t)p->addr;
+	if (((vector[0] & 0x2FFE0000) != 0x20000000) || ((vector[1] & 1) == 0) ||
+	    (vector[1] - STM32_FLASH_BASE >= size))
+	{
+		return 0;
+	}
+	if (SelfUpdate_Crc32(0, (const uint8_t *)(uintptr_t)p->addr, size) != t->crc)
+	{
+		return 0;
+	}
+	return size;
+}
+
+/**
+  * @brief  Erase a bank 1 sector through the registers
+  * @note   The flash must be unlocked.
+  */
+static RAMFUNC uint32_t SelfUpdate_Erase(uint32_t sector)
+{
+	uint32_t err;
+
+	FLASH->NSCCR = FLASH_FLAG_SR_ERRORS | FLASH_FLAG_EOP;
+	FLASH->NSCR = (FLASH->NSCR & ~(FLASH_CR_SNB | FLASH_CR_BKSEL | FLASH_CR_PG)) | FLASH_CR_SER |
+	              (sector << FLASH_CR_SNB_Pos);
+	FLASH->NSCR |= FLASH_CR_START;
+	while (FLASH->NSSR & (FLASH_FLAG_BSY | FLASH_FLAG_WBNE | FLASH_FLAG_DBNE))
+	{
+	}
+	err = FLASH->NSSR & FLASH_FLAG_SR_ERRORS;
+	FLASH->NSCCR = err;
+	FLASH->NSCR &= ~(FLASH_CR_SER | FLASH_CR_SNB);
+	return err;
+}
+
+/************************************************************************/
+static RAMFUNC uint8_t SelfUpdate_Same(uint32_t addr, const uint32_t *data, uint32_t words)
+{
+	const uint32_t *flash = (const uint32_t *)(uintptr_t)addr;
+
+	while (words-- != 0)
+	{
+		if (*flash++ != *data++)
+		{
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/**
+  * @brief  Put the kept partition table back, its blank quadwords left
+  *         alone
+  */
+static RAMFUNC uint32_t SelfUpdate_ProgramPtable(void)
+{
+	const uint32_t *w;
+	uint32_t q, err = 0;
+
+	for (q = 0; (q < sizeof(SelfUpdate_Ptable) / 16) && (err == 0); q++)
+	{
+		w = SelfUpdate_Ptable + q * 4;
+		if ((w[0] & w[1] & w[2] & w[3]) != 0xFFFFFFFF)
+		{
+			err = STMFLASH_ProgramBurst(PTABLE_ADDR + q * 16, w, 1);
+		}
+	}
+	return err;
+}
+
+/**
+  * @brief  The updater stage. Runs from RAM with the interrupts and the
+  *         ICACHE off: the code it replaces is gone after the first erase,
+  *         and the cache would answer the read back. Each sector is
+  *         erased, burst programmed and read back, again until it checks:
+  *         with the old bootloader partly gone, a reset would start a
+  *         damaged one. Ends in a reset once every sector is in place.
+  * @note   The flash must be unlocked.
+  */
+static RAMFUNC void SelfUpdate_Copy(const uint32_t *image, uint32_t size)
+{
+	uint32_t sector, addr, offset, words, err;
+
+	/* The read back must see flash, not lines cached before the erase
+	   (icache.h). This runs from RAM, so the cache is turned off here on
+	   the registers. The reset turns it on again. */
+	ICACHE->CR &= ~ICACHE_CR_EN;
+	while (ICACHE->SR & ICACHE_SR_BUSYF)
+	{
+	}
+	ICACHE->FCR = ICACHE_FCR_CBSYENDF;
+	for (sector = 0; sector < SELFUPDATE_SECTORS; sector++)
+	{
+		addr = STM32_FLASH_BASE + sector * STM_SECTOR_SIZE;
+		offset = sector * STM_SECTOR_SIZE;
+		words = (size <= offset) ? 0 : (size - offset < STM_SECTOR_SIZE) ? (size - offset) / 4 : STM_SECTOR_SIZE / 4;
+		for (;;)
+		{
+#if (USE_IAP_WATCHDOG == 1)
+			IWDG->KR = 0x0000AAAAU; /* Reload key */
+#endif
+			err = SelfUpdate_Erase(sector);
+			if ((err == 0) && (words != 0))
+			{
+				err = STMFLASH_ProgramBurst(addr, image + offset / 4, words / 4);
+			}
+			if ((err == 0) && (sector == SELFUPDATE_SECTORS - 1))
+			{
+				err = SelfUpdate_ProgramPtable();
+			}
+			if ((err == 0) && SelfUpdate_Same(addr, image + offset / 4, words) &&
+			    ((sector != SELFUPDATE_SECTORS - 1) ||
+			     SelfUpdate_Same(PTABLE_ADDR, SelfUpdate_Ptable, sizeof(SelfUpdate_Ptable) / 4)))
+			{
+				break;
+			}
+		}
+	}
+	/* NVIC_SystemReset() without the call into the flash */
+	SCB->AIRCR = (0x5FAUL << SCB_AIRCR_VECTKEY_Pos) | (SCB->AIRCR & SCB_AIRCR_PRIGROUP_Msk) |
+	             SCB_AIRCR_SYSRESETREQ_Msk;
+	__DSB();
+	for (;;)
+	{
+	}
+}
+
+/**
+  * @brief  Record the file, quiet the device and hand over to the stage
+  * @retval -1: the record did not reach flash, nothing erased. Does not
+  *         return otherwise.
+  */
+static int8_t SelfUpdate_Install(uint32_t file_size, uint32_t size)
+{
+	KvStore_Set(KV_SELFUPDATE, file_size);
+	if (STMFLASH_Flush() != 0) // The record is in flash before the first erase
+	{
+		SerialPutString("\r\n State not saved, bootloader not installed.\r\n");
+		return -1;
+	}
+	Serial_Stop();
+	memcpy(SelfUpdate_Ptable, (const void *)PTABLE_ADDR, sizeof(SelfUpdate_Ptable));
+	HAL_FLASH_Unlock();
+	__disable_irq();
+	SelfUpdate_Copy((const uint32_t *)(uintptr_t)SelfUpdate_Staging()->addr, size);
+	return -1;
+}
+
+/**
+  * @brief  At bootloader start, with the console up: finish a copy a
+  *         reset cut short, or clean up after the one that installed this
+  *         bootloader
+  */
+void SelfUpdate_Init(void)
+{
+	const Partition *p = SelfUpdate_Staging();
+	uint32_t file_size, size;
+
+	if ((KvStore_Get(KV_SELFUPDATE, &file_size) != 0) || (file_size == 0))
+	{
+		return;
+	}
+	size = SelfUpdate_Check(file_size);
+	if ((size != 0) && (memcmp((const void *)STM32_FLASH_BASE, (const void *)(uintptr_t)p->addr, size) != 0))
+	{
+		SerialPutString("\r\n Bootloader copy interrupted, installing again.\r\n");
+		SelfUpdate_Install(file_size, size);
+		return;
+	}
+	if (size != 0)
+	{
+		/* The staged image is not an application, nor to be installed again */
+		HAL_FLASH_Unlock();
+		STMFLASH_EraseSector((p->addr - STM32_FLASH_BASE) / STM_SECTOR_SIZE);
+		HAL_FLASH_Lock();
+		ICache_Invalidate();
+		SerialPutString("\r\n Bootloader updated.\r\n");
+	}
+	KvStore_Set(KV_SELFUPDATE, 0);
+}
+
+/**
+  * @brief  After an update session: install the bootloader image of the
+  *         batch, if it had one
+  * @retval 0: none in the batch, -1: the staged image failed its checks
+  *         or its record could not be saved.
+  *         Does not return once the copy starts.
+  */
+int8_t SelfUpdate_Start(void)
+{
+	uint32_t size;
+	uint8_t i;
+
+	for (i = 0; i < Ymodem_FileCount; i++)
+	{
+		if (SelfUpdate_IsBootFile(Ymodem_Files[i].name))
+		{
+			break;
+		}
+	}
+	if (i == Ymodem_FileCount)
+	{
+		return 0;
+	}
+	size = SelfUpdate_Check(Ymodem_Files[i].image_size);
+	if (size == 0)
+	{
+		SerialPutString("\r\n Bootloader image rejected.\r\n");
+		return -1;
+	}
+	SerialPutString("\r\n Installing the bootloader, keep the power on.\r\n");
+	return SelfUpdate_Install(Ymodem_Files[i].image_size, size);
+}
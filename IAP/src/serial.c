@@ -0,0 +1,329 @@
+#include "serial.h"
+#include "sched.h"
+#include "stats.h"
+#include "stm32h5xx_hal.h"
+#include "ramexec.h"
+
+extern UART_HandleTypeDef huart1;
+
+static uint8_t Serial_RxChunk[SERIAL_RX_CHUNK_SIZE];
+static uint8_t Serial_RxBuf[SERIAL_RX_BUF_SIZE];
+static volatile uint32_t Serial_RxHead = 0, Serial_RxTail = 0;
+static volatile uint8_t Serial_RxPosted = 0;
+static uint8_t Serial_RxOwner = TASK_MENU;
+
+static uint8_t Serial_TxBuf[SERIAL_TX_BUF_SIZE];
+static volatile uint32_t Serial_TxHead = 0, Serial_TxTail = 0;
+static volatile uint32_t Serial_TxLen = 0;   /* Queue bytes handed to the HAL */
+static volatile uint8_t Serial_TxBusy = 0;
+
+/* Zero-copy block, sent once the queue has drained up to Serial_TxMark */
+static const uint8_t * volatile Serial_TxBlock = 0;
+static uint32_t Serial_TxBlockLen = 0, Serial_TxMark = 0;
+static volatile uint8_t Serial_TxInBlock = 0;
+
+#if (USE_SERIAL_TX_DMA == 1)
+static DMA_HandleTypeDef Serial_TxDma;
+
+/**
+  * @brief  GPDMA channel feeding USART1 TDR, used for the zero-copy blocks.
+  */
+static void Serial_DmaInit(void)
+{
+	__HAL_RCC_GPDMA1_CLK_ENABLE();
+
+	Serial_TxDma.Instance = SERIAL_TX_DMA_CHANNEL;
+	Serial_TxDma.Init.Request = GPDMA1_REQUEST_USART1_TX;
+	Serial_TxDma.Init.BlkHWRequest = DMA_BREQ_SINGLE_BURST;
+	Serial_TxDma.Init.Direction = DMA_MEMORY_TO_PERIPH;
+	Serial_TxDma.Init.SrcInc = DMA_SINC_INCREMENTED;
+	Serial_TxDma.Init.DestInc = DMA_DINC_FIXED;
+	Serial_TxDma.Init.SrcDataWidth = DMA_SRC_DATAWIDTH_BYTE;
+	Serial_TxDma.Init.DestDataWidth = DMA_DEST_DATAWIDTH_BYTE;
+	Serial_TxDma.Init.Priority = DMA_LOW_PRIORITY_HIGH_WEIGHT;
+	Serial_TxDma.Init.SrcBurstLength = 1;
+	Serial_TxDma.Init.DestBurstLength = 1;
+	Serial_TxDma.Init.TransferAllocatedPort = DMA_SRC_ALLOCATED_PORT0 | DMA_DEST_ALLOCATED_PORT0;
+	Serial_TxDma.Init.TransferEventMode = DMA_TCEM_BLOCK_TRANSFER;
+	Serial_TxDma.Init.Mode = DMA_NORMAL;
+	if (HAL_DMA_Init(&Serial_TxDma) == HAL_OK)
+	{
+		__HAL_LINKDMA(&huart1, hdmatx, Serial_TxDma);
+		HAL_NVIC_SetPriority(SERIAL_TX_DMA_IRQn, 0, 0);
+		HAL_NVIC_EnableIRQ(SERIAL_TX_DMA_IRQn);
+	}
+}
+
+/************************************************************************/
+RAMFUNC void Serial_DmaIsr(void)
+{
+	HAL_DMA_IRQHandler(&Serial_TxDma);
+}
+#endif
+
+/************************************************************************/
+RAMFUNC static void Serial_RxArm(void)
+{
+	HAL_UARTEx_ReceiveToIdle_IT(&huart1, Serial_RxChunk, SERIAL_RX_CHUNK_SIZE);
+}
+
+/************************************************************************/
+void Serial_Init(void)
+{
+	Serial_RxHead = Serial_RxTail = 0;
+	Serial_TxHead = Serial_TxTail = 0;
+	Serial_TxLen = 0;
+	Serial_TxBusy = 0;
+	Serial_TxBlock = 0;
+	Serial_TxInBlock = 0;
+	Serial_RxPosted = 0;
+#if (USE_SERIAL_TX_DMA == 1)
+	Serial_DmaInit();
+#endif
+	Serial_RxArm();
+}
+
+/**
+  * @brief  Select which task receives EVT_UART_RX / EVT_UART_IDLE.
+  */
+void Serial_SetRxOwner(uint8_t task)
+{
+	Serial_RxOwner = task;
+}
+
+/**
+  * @brief  Copy a completed receive chunk into the ring, re-arm, notify owner.
+  * @param  size: Number of bytes in Serial_RxChunk
+  */
+RAMFUNC void Serial_RxEventIsr(uint16_t size)
+{
+	uint32_t type = HAL_UARTEx_GetRxEventType(&huart1);
+	uint16_t i;
+
+	for (i = 0; i < size; i++)
+	{
+		if ((Serial_RxHead - Serial_RxTail) < SERIAL_RX_BUF_SIZE)
+		{
+			Serial_RxBuf[Serial_RxHead & (SERIAL_RX_BUF_SIZE - 1)] = Serial_RxChunk[i];
+			Serial_RxHead++;
+		}
+	}
+	Serial_RxArm();
+	STATS_ADD(rx_bytes, size);
+
+	if ((size > 0) && !Serial_RxPosted)
+	{
+		Serial_RxPosted = 1;
+		Sched_Post(Serial_RxOwner, EVT_UART_RX, 0);
+	}
+	if (type == HAL_UART_RXEVENT_IDLE)
+	{
+		Sched_Post(Serial_RxOwner, EVT_UART_IDLE, 0);
+	}
+}
+
+/**
+  * @brief  Count the receive error; a blocking one (overrun) ends the HAL
+  *         reception, restart it.
+  */
+RAMFUNC void Serial_ErrorIsr(void)
+{
+	if (huart1.ErrorCode & HAL_UART_ERROR_ORE)
+	{
+		STATS_INC(uart_overruns);
+	}
+	if (huart1.ErrorCode & HAL_UART_ERROR_FE)
+	{
+		STATS_INC(uart_framing);
+	}
+	if (huart1.RxState == HAL_UART_STATE_READY)
+	{
+		Serial_RxArm();
+	}
+}
+
+/**
+  * @brief  Read up to len bytes from the receive ring.
+  * @retval Number of bytes read
+  */
+uint32_t Serial_Read(uint8_t *buf, uint32_t len)
+{
+	uint32_t n = 0;
+
+	/* Clear first so bytes arriving while we drain post a new event */
+	Serial_RxPosted = 0;
+	while ((n < len) && (Serial_RxTail != Serial_RxHead))
+	{
+		buf[n++] = Serial_RxBuf[Serial_RxTail & (SERIAL_RX_BUF_SIZE - 1)];
+		Serial_RxTail++;
+	}
+	if (Serial_RxTail != Serial_RxHead)
+	{
+		/* Caller stopped early, keep it informed about the rest */
+		Serial_RxPosted = 1;
+	}
+	return n;
+}
+
+/************************************************************************/
+uint32_t Serial_Available(void)
+{
+	return Serial_RxHead - Serial_RxTail;
+}
+
+/************************************************************************/
+void Serial_RxFlush(void)
+{
+	Serial_RxTail = Serial_RxHead;
+	Serial_RxPosted = 0;
+}
+
+/**
+  * @brief  Start the next contiguous run of the TX queue, or the pending
+  *         zero-copy block once the queue has reached it. IRQs must be off
+  *         or we must be in the TX complete interrupt.
+  */
+RAMFUNC static void Serial_TxStart(void)
+{
+	uint32_t tail = Serial_TxTail & (SERIAL_TX_BUF_SIZE - 1);
+	uint32_t len = Serial_TxHead - Serial_TxTail;
+
+	if ((Serial_TxBlock != 0) && (Serial_TxTail == Serial_TxMark))
+	{
+		Serial_TxBusy = 1;
+		Serial_TxInBlock = 1;
+		Serial_TxLen = 0;
+#if (USE_SERIAL_TX_DMA == 1)
+		HAL_UART_Transmit_DMA(&huart1, Serial_TxBlock, (uint16_t)Serial_TxBlockLen);
+#else
+		HAL_UART_Transmit_IT(&huart1, Serial_TxBlock, (uint16_t)Serial_TxBlockLen);
+#endif
+		return;
+	}
+	if (Serial_TxBlock != 0)
+	{
+		/* Stop in front of the block */
+		len = Serial_TxMark - Serial_TxTail;
+	}
+	if (len > SERIAL_TX_BUF_SIZE - tail)
+	{
+		len = SERIAL_TX_BUF_SIZE - tail;
+	}
+	Serial_TxLen = len;
+	Serial_TxBusy = (len != 0);
+	if (len != 0)
+	{
+		HAL_UART_Transmit_IT(&huart1, &Serial_TxBuf[tail], (uint16_t)len);
+	}
+}
+
+/************************************************************************/
+RAMFUNC void Serial_TxIsr(void)
+{
+	if (Serial_TxInBlock)
+	{
+		Serial_TxInBlock = 0;
+		Serial_TxBlock = 0;
+	}
+	else
+	{
+		Serial_TxTail += Serial_TxLen;
+	}
+	Serial_TxStart();
+}
+
+/**
+  * @brief  Queue bytes for transmission. Waits for room when the queue is full.
+  * @retval Number of bytes queued
+  */
+uint32_t Serial_Write(const uint8_t *data, uint32_t len)
+{
+	uint32_t i = 0, primask;
+
+	while (i < len)
+	{
+		while ((i < len) && ((Serial_TxHead - Serial_TxTail) < SERIAL_TX_BUF_SIZE))
+		{
+			Serial_TxBuf[Serial_TxHead & (SERIAL_TX_BUF_SIZE - 1)] = data[i++];
+			Serial_TxHead++;
+		}
+		primask = __get_PRIMASK();
+		__disable_irq();
+		if (!Serial_TxBusy)
+		{
+			Serial_TxStart();
+		}
+		__set_PRIMASK(primask);
+		if (i < len)
+		{
+			__NOP(); /* Queue full, the TX interrupt makes room */
+		}
+	}
+	return len;
+}
+
+/**
+  * @brief  Send len bytes (at most 65535) straight from data, in order with
+  *         the queued bytes; with USE_SERIAL_TX_DMA the DMA reads them, so
+  *         flash contents go out without being copied. data must stay valid
+  *         until the block has gone out; waits while a previous block is
+  *         still pending.
+  */
+void Serial_WriteBlock(const uint8_t *data, uint32_t len)
+{
+	uint32_t primask;
+
+	if (len == 0)
+	{
+		return;
+	}
+	while (Serial_TxBlock != 0)
+	{
+		__NOP();
+	}
+	primask = __get_PRIMASK();
+	__disable_irq();
+	Serial_TxMark = Serial_TxHead;
+	Serial_TxBlockLen = len;
+	Serial_TxBlock = data;
+	if (!Serial_TxBusy)
+	{
+		Serial_TxStart();
+	}
+	__set_PRIMASK(primask);
+}
+
+/**
+  * @brief  Time the line needs for the given number of bytes (8N1).
+  */
+uint32_t Serial_TxTimeMs(uint32_t bytes)
+{
+	return (bytes * 10u * 1000u) / huart1.Init.BaudRate + 1u;
+}
+
+/**
+  * @brief  Wait until every queued byte has left the shift register.
+  */
+void Serial_Flush(void)
+{
+	while (Serial_TxBusy)
+	{
+		__NOP();
+	}
+	while (__HAL_UART_GET_FLAG(&huart1, UART_FLAG_TC) == RESET)
+	{
+	}
+}
+
+/**
+  * @brief  Flush and quiesce the port before handing the CPU to the application.
+  */
+void Serial_Stop(void)
+{
+	Serial_Flush();
+	HAL_UART_Abort(&huart1);
+	HAL_NVIC_DisableIRQ(USART1_IRQn);
+#if (USE_SERIAL_TX_DMA == 1)
+	HAL_NVIC_DisableIRQ(SERIAL_TX_DMA_IRQn);
+#endif
+}
@@ -0,0 +1,271 @@
+#include "services.h"
+#include "iap_config.h"
+#include "ymodem.h"
+#include "partition.h"
+#include "kvstore.h"
+#include "trial.h"
+#include "stm32h5xx_hal.h"
+#include <string.h>
+
+static uint32_t Services_Revoke(uint32_t addr, uint32_t size);
+
+/**
+  * @brief  1 when [addr, addr + size) is flash the application may write:
+  *         inside one partition of the table, not the bootloader's state
+  *         sector (flag and EDATA)
+  */
+static uint8_t Services_Writable(uint32_t addr, uint32_t size)
+{
+	const Partition *p = Partition_LookupRange(addr, size);
+
+	return (p != 0) && (p->type != PART_FLAG) && (p->type != PART_EDATA);
+}
+
+/**
+  * @brief  Wait for the flash to go idle
+  * @retval 0: ok, else the FLASH_NSSR error flags (cleared)
+  */
+static uint32_t Services_FlashWait(void)
+{
+	uint32_t err;
+
+	while (FLASH->NSSR & (FLASH_FLAG_BSY | FLASH_FLAG_WBNE | FLASH_FLAG_DBNE))
+	{
+	}
+	err = FLASH->NSSR & FLASH_FLAG_SR_ERRORS;
+	if (err != 0)
+	{
+		FLASH->NSCCR = err;
+	}
+	return err;
+}
+
+/**
+  * @brief  HAL_FLASH_Unlock/Lock and ICache_Invalidate on the registers:
+  *         the bootloader's own may run from its RAM copy (the .ramfunc
+  *         list of the linker script), the application's RAM by now
+  */
+static void Services_Unlock(void)
+{
+	if (FLASH->NSCR & FLASH_CR_LOCK)
+	{
+		FLASH->NSKEYR = FLASH_KEY1;
+		FLASH->NSKEYR = FLASH_KEY2;
+	}
+}
+
+/************************************************************************/
+static void Services_Lock(void)
+{
+	FLASH->NSCR |= FLASH_CR_LOCK;
+}
+
+/************************************************************************/
+static void Services_CacheInvalidate(void)
+{
+	if ((ICACHE->CR & ICACHE_CR_EN) == 0)
+	{
+		return;
+	}
+	ICACHE->CR |= ICACHE_CR_CACHEINV;
+	while (ICACHE->SR & ICACHE_SR_BUSYF)
+	{
+	}
+	ICACHE->FCR = ICACHE_FCR_CBSYENDF;
+}
+
+/**
+  * @brief  Sector erase through the registers: HAL_FLASHEx_Erase keeps its
+  *         lock in RAM and runs from the RAM copy of the bootloader
+  */
+static uint32_t Services_FlashErase(uint32_t addr)
+{
+	uint32_t sector, err;
+
+	if (!Services_Writable(addr, 1))
+	{
+		return SERVICES_ERR_RANGE;
+	}
+	sector = (addr - STM32_FLASH_BASE) / STM_SECTOR_SIZE;
+	err = Services_Revoke(STM32_FLASH_BASE + sector * STM_SECTOR_SIZE, STM_SECTOR_SIZE);
+	if (err != 0)
+	{
+		return err;
+	}
+	Services_Unlock();
+	Services_FlashWait();
+	FLASH->NSCCR = FLASH_FLAG_SR_ERRORS | FLASH_FLAG_EOP;
+	FLASH->NSCR = (FLASH->NSCR & ~(FLASH_CR_SNB | FLASH_CR_BKSEL)) | FLASH_CR_SER |
+	              ((sector % FLASH_SECTOR_NB) << FLASH_CR_SNB_Pos) |
+	              ((sector >= FLASH_SECTOR_NB) ? FLASH_CR_BKSEL : 0);
+	FLASH->NSCR |= FLASH_CR_START;
+	err = Services_FlashWait();
+	FLASH->NSCR &= ~(FLASH_CR_SER | FLASH_CR_SNB | FLASH_CR_BKSEL);
+	Services_Lock();
+	Services_CacheInvalidate();
+	return err;
+}
+
+/**
+  * @brief  Quadword programming the way STMFLASH_ProgramBurst does it, from
+  *         flash; the source may have any alignment. No range check.
+  */
+static uint32_t Services_Program(uint32_t addr, const void *data, uint32_t size)
+{
+	__IO uint32_t *dst = (__IO uint32_t *)(uintptr_t)addr;
+	const uint8_t *src = data;
+	uint32_t quad[4], primask, err = 0;
+
+	Services_Unlock();
+	Services_FlashWait();
+	FLASH->NSCCR = FLASH_FLAG_SR_ERRORS | FLASH_FLAG_EOP;
+	FLASH->NSCR |= FLASH_CR_PG;
+	for (; (size != 0) && (err == 0); size -= 16, src += 16, dst += 4)
+	{
+		memcpy(quad, src, 16);
+		primask = __get_PRIMASK();
+		__disable_irq();
+		dst[0] = quad[0];
+		dst[1] = quad[1];
+		dst[2] = quad[2];
+		dst[3] = quad[3];
+		__set_PRIMASK(primask);
+		err = Services_FlashWait();
+	}
+	FLASH->NSCR &= ~FLASH_CR_PG;
+	Services_Lock();
+	Services_CacheInvalidate();
+	return err;
+}
+
+/************************************************************************/
+static uint32_t Services_FlashProgram(uint32_t addr, const void *data, uint32_t size)
+{
+	uint32_t err;
+
+	if ((addr & 15) || (size & 15) || !Services_Writable(addr, size))
+	{
+		return SERVICES_ERR_RANGE;
+	}
+	err = Services_Revoke(addr, size);
+	return (err != 0) ? err : Services_Program(addr, data, size);
+}
+
+/**
+  * @brief  Cal_CRC16 set up for a caller that may have used the CRC unit
+  *         otherwise; the software engine keeps its sum on the stack
+  */
+static uint16_t Services_Crc16(const uint8_t *data, uint32_t size)
+{
+#if (USE_HW_CRC == 1)
+	__HAL_RCC_CRC_CLK_ENABLE();
+	CRC->POL = 0x1021;
+	CRC->INIT = 0;
+	return Cal_CRC16(data, size);
+#else
+	uint16_t crc = 0;
+
+	while (size--)
+	{
+		crc = UpdateCRC16(crc, *data++);
+	}
+	crc = UpdateCRC16(crc, 0);
+	return UpdateCRC16(crc, 0);
+#endif
+}
+
+/************************************************************************/
+static uint32_t Services_Cycles(void)
+{
+	if ((DWT->CTRL & DWT_CTRL_CYCCNTENA_Msk) == 0)
+	{
+		DCB->DEMCR |= DCB_DEMCR_TRCENA_Msk;
+		DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+	}
+	return DWT->CYCCNT;
+}
+
+/**
+  * @brief  The clock comes from the RCC registers, not SystemCoreClock: that
+  *         variable is the application's RAM by now
+  */
+static void Services_DelayUs(uint32_t us)
+{
+	uint32_t start = Services_Cycles();
+	uint32_t cycles = us * (HAL_RCC_GetSysClockFreq() / 1000000);
+
+	while (Services_Cycles() - start < cycles)
+	{
+		__NOP();
+	}
+}
+
+/**
+  * @brief  Append a record to the state store log. IAP_RunApp() left two
+  *         records free: the trial confirmation and the revocation below
+  */
+static uint32_t Services_KvAppend(uint32_t slot, uint8_t key, uint32_t value)
+{
+	uint32_t rec[4];
+
+	if (slot == 0)
+	{
+		return SERVICES_ERR_RANGE;
+	}
+	KvStore_Encode(key, value, rec);
+	return Services_Program(slot, rec, sizeof(rec));
+}
+
+/**
+  * @brief  The application writes PART_APP: what the bootloader checked is
+  *         gone, clear KV_APPSIG (imagesig.h) before the flash changes
+  */
+static uint32_t Services_Revoke(uint32_t addr, uint32_t size)
+{
+	const Partition *app = Partition_Lookup(PART_APP);
+	const Partition *p = Partition_Lookup(PART_EDATA);
+	uint32_t value, slot;
+
+	if ((app == 0) || (p == 0) || (addr >= app->addr + app->size) || (app->addr >= addr + size))
+	{
+		return 0;
+	}
+	if ((KvStore_Scan(p->addr, p->size, KV_APPSIG, &value, &slot) != 0) || (value == 0))
+	{
+		return 0;
+	}
+	return Services_KvAppend(slot, KV_APPSIG, 0);
+}
+
+/**
+  * @brief  Append TRIAL_NONE to the state store log
+  */
+static uint32_t Services_TrialConfirm(void)
+{
+	const Partition *p = Partition_Lookup(PART_EDATA);
+	uint32_t value, slot;
+
+	if (p == 0)
+	{
+		return SERVICES_ERR_RANGE;
+	}
+	if ((KvStore_Scan(p->addr, p->size, KV_TRIAL, &value, &slot) != 0) ||
+	    ((value & 0xFF) == TRIAL_NONE))
+	{
+		return 0;
+	}
+	return Services_KvAppend(slot, KV_TRIAL, TRIAL_NONE);
+}
+
+const Services_Table Services __attribute__((section(".services"))) =
+{
+	SERVICES_MAGIC,
+	SERVICES_VERSION,
+	SERVICES_COUNT,
+	Services_FlashErase,
+	Services_FlashProgram,
+	Services_Crc16,
+	Services_Cycles,
+	Services_DelayUs,
+	Services_TrialConfirm,
+};
@@ -0,0 +1,187 @@
+#include "sha256.h"
+#include <string.h>
+
+/* Private variables ---------------------------------------------------------*/
+static const uint32_t Sha256_K[64] =
+{
+	0x428A2F98, 0x71374491, 0xB5C0FBCF, 0xE9B5DBA5, 0x3956C25B, 0x59F111F1, 0x923F82A4, 0xAB1C5ED5,
+	0xD807AA98, 0x12835B01, 0x243185BE, 0x550C7DC3, 0x72BE5D74, 0x80DEB1FE, 0x9BDC06A7, 0xC19BF174,
+	0xE49B69C1, 0xEFBE4786, 0x0FC19DC6, 0x240CA1CC, 0x2DE92C6F, 0x4A7484AA, 0x5CB0A9DC, 0x76F988DA,
+	0x983E5152, 0xA831C66D, 0xB00327C8, 0xBF597FC7, 0xC6E00BF3, 0xD5A79147, 0x06CA6351, 0x14292967,
+	0x27B70A85, 0x2E1B2138, 0x4D2C6DFC, 0x53380D13, 0x650A7354, 0x766A0ABB, 0x81C2C92E, 0x92722C85,
+	0xA2BFE8A1, 0xA81A664B, 0xC24B8B70, 0xC76C51A3, 0xD192E819, 0xD6990624, 0xF40E3585, 0x106AA070,
+	0x19A4C116, 0x1E376C08, 0x2748774C, 0x34B0BCB5, 0x391C0CB3, 0x4ED8AA4A, 0x5B9CCA4F, 0x682E6FF3,
+	0x748F82EE, 0x78A5636F, 0x84C87814, 0x8CC70208, 0x90BEFFFA, 0xA4506CEB, 0xBEF9A3F7, 0xC67178F2
+};
+
+#define ROTR(x, n)      (((x) >> (n)) | ((x) << (32 - (n))))
+#define BSIG0(x)        (ROTR(x, 2) ^ ROTR(x, 13) ^ ROTR(x, 22))
+#define BSIG1(x)        (ROTR(x, 6) ^ ROTR(x, 11) ^ ROTR(x, 25))
+#define SSIG0(x)        (ROTR(x, 7) ^ ROTR(x, 18) ^ ((x) >> 3))
+#define SSIG1(x)        (ROTR(x, 17) ^ ROTR(x, 19) ^ ((x) >> 10))
+#define CH(x, y, z)     ((z) ^ ((x) & ((y) ^ (z))))
+#define MAJ(x, y, z)    (((x) & (y)) | ((z) & ((x) | (y))))
+
+/* Message words: LDR + REV for the first 16 rounds, then the schedule in
+ * place in w[], 16 rounds per pass so every index is a constant */
+#define LOAD(j)         (w[j] = __builtin_bswap32(block[j]))
+#define EXPAND(j)       (w[j] += SSIG1(w[((j) + 14) & 15]) + w[((j) + 9) & 15] + SSIG0(w[((j) + 1) & 15]))
+
+/* One round; the names rotate instead of the values */
+#define ROUND(a, b, c, d, e, f, g, h, j, WORD) \
+	do \
+	{ \
+		t = h + BSIG1(e) + CH(e, f, g) + k[j] + WORD(j); \
+		d += t; \
+		h = t + BSIG0(a) + MAJ(a, b, c); \
+	} while (0)
+
+#define ROUNDS16(WORD) \
+	do \
+	{ \
+		ROUND(a, b, c, d, e, f, g, h, 0, WORD); \
+		ROUND(h, a, b, c, d, e, f, g, 1, WORD); \
+		ROUND(g, h, a, b, c, d, e, f, 2, WORD); \
+		ROUND(f, g, h, a, b, c, d, e, 3, WORD); \
+		ROUND(e, f, g, h, a, b, c, d, 4, WORD); \
+		ROUND(d, e, f, g, h, a, b, c, 5, WORD); \
+		ROUND(c, d, e, f, g, h, a, b, 6, WORD); \
+		ROUND(b, c, d, e, f, g, h, a, 7, WORD); \
+		ROUND(a, b, c, d, e, f, g, h, 8, WORD); \
+		ROUND(h, a, b, c, d, e, f, g, 9, WORD); \
+		ROUND(g, h, a, b, c, d, e, f, 10, WORD); \
+		ROUND(f, g, h, a, b, c, d, e, 11, WORD); \
+		ROUND(e, f, g, h, a, b, c, d, 12, WORD); \
+		ROUND(d, e, f, g, h, a, b, c, 13, WORD); \
+		ROUND(c, d, e, f, g, h, a, b, 14, WORD); \
+		ROUND(b, c, d, e, f, g, h, a, 15, WORD); \
+	} while (0)
+
+/**
+  * @brief  Compress whole blocks
+  * @param  block: word aligned
+  */
+static void Sha256_Blocks(uint32_t state[8], const uint32_t *block, uint32_t count)
+{
+	uint32_t a, b, c, d, e, f, g, h, t, w[16];
+	const uint32_t *k;
+
+	for (; count != 0; count--, block += SHA256_BLOCK_SIZE / 4)
+	{
+		a = state[0];
+		b = state[1];
+		c = state[2];
+		d = state[3];
+		e = state[4];
+		f = state[5];
+		g = state[6];
+		h = state[7];
+		k = Sha256_K;
+		ROUNDS16(LOAD);
+		for (k += 16; k != Sha256_K + 64; k += 16)
+		{
+			ROUNDS16(EXPAND);
+		}
+		state[0] += a;
+		state[1] += b;
+		state[2] += c;
+		state[3] += d;
+		state[4] += e;
+		state[5] += f;
+		state[6] += g;
+		state[7] += h;
+	}
+}
+
+/************************************************************************/
+void Sha256_Init(Sha256_Ctx *ctx)
+{
+	ctx->state[0] = 0x6A09E667;
+	ctx->state[1] = 0xBB67AE85;
+	ctx->state[2] = 0x3C6EF372;
+	ctx->state[3] = 0xA54FF53A;
+	ctx->state[4] = 0x510E527F;
+	ctx->state[5] = 0x9B05688C;
+	ctx->state[6] = 0x1F83D9AB;
+	ctx->state[7] = 0x5BE0CD19;
+	ctx->fill = 0;
+	ctx->bytes = 0;
+}
+
+/************************************************************************/
+void Sha256_Update(Sha256_Ctx *ctx, const uint8_t *data, uint32_t size)
+{
+	uint32_t n;
+
+	ctx->bytes += size;
+	if (ctx->fill != 0)
+	{
+		n = SHA256_BLOCK_SIZE - ctx->fill;
+		if (n > size)
+		{
+			n = size;
+		}
+		memcpy((uint8_t *)ctx->block + ctx->fill, data, n);
+		ctx->fill += n;
+		data += n;
+		size -= n;
+		if (ctx->fill < SHA256_BLOCK_SIZE)
+		{
+			return;
+		}
+		Sha256_Blocks(ctx->state, ctx->block, 1);
+		ctx->fill = 0;
+	}
+	n = size / SHA256_BLOCK_SIZE;
+	if (((uintptr_t)data & 3) == 0)
+	{
+		Sha256_Blocks(ctx->state, (const uint32_t *)data, n);
+		data += n * SHA256_BLOCK_SIZE;
+	}
+	else
+	{
+		for (; n != 0; n--, data += SHA256_BLOCK_SIZE)
+		{
+			memcpy(ctx->block, data, SHA256_BLOCK_SIZE);
+			Sha256_Blocks(ctx->state, ctx->block, 1);
+		}
+	}
+	ctx->fill = size % SHA256_BLOCK_SIZE;
+	memcpy(ctx->block, data, ctx->fill);
+}
+
+/************************************************************************/
+void Sha256_Final(Sha256_Ctx *ctx, uint8_t digest[SHA256_DIGEST_SIZE])
+{
+	uint8_t *block = (uint8_t *)ctx->block;
+	uint64_t bits = ctx->bytes * 8;
+	uint32_t i;
+
+	block[ctx->fill++] = 0x80;
+	if (ctx->fill > SHA256_BLOCK_SIZE - 8)
+	{
+		memset(block + ctx->fill, 0, SHA256_BLOCK_SIZE - ctx->fill);
+		Sha256_Blocks(ctx->state, ctx->block, 1);
+		ctx->fill = 0;
+	}
+	memset(block + ctx->fill, 0, SHA256_BLOCK_SIZE - 8 - ctx->fill);
+	for (i = 0; i < 8; i++)
+	{
+		block[SHA256_BLOCK_SIZE - 1 - i] = (uint8_t)(bits >> (8 * i));
+	}
+	Sha256_Blocks(ctx->state, ctx->block, 1);
+	for (i = 0; i < SHA256_DIGEST_SIZE; i++)
+	{
+		digest[i] = (uint8_t)(ctx->state[i / 4] >> (24 - 8 * (i % 4)));
+	}
+}
+
+/************************************************************************/
+void Sha256(const uint8_t *data, uint32_t size, uint8_t digest[SHA256_DIGEST_SIZE])
+{
+	Sha256_Ctx ctx;
+
+	Sha256_Init(&ctx);
+	Sha256_Update(&ctx, data, size);
+	Sha256_Final(&ctx, digest);
+}
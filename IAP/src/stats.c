@@ -0,0 +1,127 @@
+#include "stats.h"
+#include <string.h>
+#include "stm32h5xx_hal.h"
+#include "ramexec.h"
+
+/* Private variables ---------------------------------------------------------*/
+Stats_Counters Stats;
+volatile uint8_t Stats_Running = 0;
+
+static uint32_t Stats_StartTick;
+static uint32_t Stats_FlashStart;
+static uint8_t Stats_FlashActive = 0;
+
+/**
+  * @brief  Start the DWT cycle counter
+  */
+void Stats_Init(void)
+{
+	DCB->DEMCR |= DCB_DEMCR_TRCENA_Msk;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+	Stats_Running = 0;
+	Stats_FlashActive = 0;
+}
+
+/************************************************************************/
+RAMFUNC uint32_t Stats_Cycles(void)
+{
+	return DWT->CYCCNT;
+}
+
+/**
+  * @brief  Clear the counters and start counting
+  */
+void Stats_Begin(void)
+{
+	uint32_t primask = __get_PRIMASK();
+
+	__disable_irq();
+	memset(&Stats, 0, sizeof(Stats));
+	Stats.core_clock = SystemCoreClock;
+	Stats_StartTick = HAL_GetTick();
+	if (Stats_FlashActive)
+	{
+		Stats_FlashStart = Stats_Cycles();
+	}
+	Stats_Running = 1;
+	__set_PRIMASK(primask);
+}
+
+/**
+  * @brief  Freeze the counters until the next session
+  */
+void Stats_End(void)
+{
+	if (Stats_Running)
+	{
+		Stats.elapsed_ms = HAL_GetTick() - Stats_StartTick;
+		Stats_Running = 0;
+	}
+}
+
+/**
+  * @brief  Consistent copy of the counters, also while a session runs
+  */
+void Stats_Get(Stats_Counters *out)
+{
+	uint32_t primask = __get_PRIMASK();
+
+	__disable_irq();
+	*out = Stats;
+	if (Stats_Running)
+	{
+		out->elapsed_ms = HAL_GetTick() - Stats_StartTick;
+		if (Stats_FlashActive)
+		{
+			out->flash_busy_cycles += Stats_Cycles() - Stats_FlashStart;
+		}
+	}
+	__set_PRIMASK(primask);
+}
+
+/************************************************************************/
+RAMFUNC void Stats_Compute(uint32_t cycles)
+{
+	STATS_ADD(compute_cycles, cycles);
+}
+
+/**
+  * @brief  The scheduler slept for the given cycles; it was waiting for the
+  *         flash programmer if a job was running, for the UART otherwise
+  */
+RAMFUNC void Stats_Sleep(uint32_t cycles)
+{
+	if (!Stats_FlashActive)
+	{
+		STATS_ADD(uart_wait_cycles, cycles);
+	}
+}
+
+/**
+  * @brief  A flash programmer job starts (1) or ends (0)
+  */
+RAMFUNC void Stats_FlashBusy(uint8_t busy)
+{
+	uint32_t now = Stats_Cycles();
+
+	if (!busy && Stats_FlashActive)
+	{
+		STATS_ADD(flash_busy_cycles, now - Stats_FlashStart);
+	}
+	Stats_FlashActive = busy;
+	Stats_FlashStart = now;
+}
+
+/**
+  * @brief  Count a YModem packet in its size class
+  */
+void Stats_Packet(uint32_t size)
+{
+	uint8_t i = 0;
+
+	while ((i < STATS_SIZE_CLASSES - 1) && ((8u << i) < size))
+	{
+		i++;
+	}
+	STATS_INC(packets[i]);
+}
@@ -1,5 +1,21 @@
 #include "stmflash.h"
 #include "iap_config.h"
+#include "stats.h"
+#include "icache.h"
+#include "ramexec.h"
+
+/* Write-back cache: STMFLASH_Write only updates the RAM image of the
+ * sector in STMFLASH_BUF and marks the quadwords it changed. The sector is
+ * programmed by STMFLASH_Flush(), or when a write moves to another sector;
+ * the error of such a flush is kept for the next STMFLASH_Flush(). */
+#define STMFLASH_CACHE_NONE     0xFFFFFFFFu
+#define STMFLASH_QUADWORDS      (STM_SECTOR_SIZE / 16)
+
+uint16_t STMFLASH_BUF[PAGE_SIZE / 2] __ALIGNED(4);     // Flash sector image, staged in RAM
+static uint32_t STMFLASH_CacheAddr = STMFLASH_CACHE_NONE;
+static uint32_t STMFLASH_Dirty[STMFLASH_QUADWORDS / 32];
+static uint32_t STMFLASH_WriteErr;     // Of the flushes STMFLASH_Write made
+
 /**
   * @brief  Read half words (16-bit data) of the specified address
   * @note   This function can be used for STM32H5 devices.
@@ -8,54 +24,213 @@
   */
 uint16_t STMFLASH_ReadHalfWord(uint32_t faddr)
 {
-	return *(uint16_t*)faddr;
+	// Data written but not flushed yet comes from the cache frame
+	if ((faddr - STMFLASH_CacheAddr) < STM_SECTOR_SIZE)
+	{
+		return STMFLASH_BUF[(faddr - STMFLASH_CacheAddr) / 2];
+	}
+	return *(uint16_t*)(uintptr_t)faddr;
 }
 
 
 /**
-  * @brief  There is no check writing.
-  * @note   This function can be used for STM32H5 devices.
-  * @param  WriteAddr: The starting address to be written.
-  * @param  pBuffer: The pointer to the data.
-  * @param  NumToWrite:  The number of half words written
-  * @retval None
+  * @brief  Erase one sector, numbered from the start of the flash
+  * @note   The flash must be unlocked.
+  */
+HAL_StatusTypeDef STMFLASH_EraseSector(uint32_t secpos)
+{
+	FLASH_EraseInitTypeDef EraseInitStruct;
+	uint32_t SectorError = 0;
+
+	EraseInitStruct.TypeErase = FLASH_TYPEERASE_SECTORS;
+	EraseInitStruct.Banks     = (secpos < FLASH_SECTOR_NB) ? FLASH_BANK_1 : FLASH_BANK_2;
+	EraseInitStruct.Sector    = secpos % FLASH_SECTOR_NB;
+	EraseInitStruct.NbSectors = 1;
+	__HAL_FLASH_CLEAR_FLAG(FLASH_FLAG_ALL_ERRORS);
+	return HAL_FLASHEx_Erase(&EraseInitStruct, &SectorError);
+}
+
+/**
+  * @brief  Program quadwords with PG set once for the whole run: each
+  *         quadword is written straight to the array and only the
+  *         hardware busy flags are polled before the next one, without
+  *         the per-call lock, timeout and PG handling of HAL_FLASH_Program.
+  * @note   The flash must be unlocked and the quadwords erased.
+  * @param  addr: quadword aligned start address
+  * @param  data: word aligned source
+  * @param  count: number of quadwords
+  * @retval 0: ok, else the FLASH_NSSR error flags
+  */
+RAMFUNC uint32_t STMFLASH_ProgramBurst(uint32_t addr, const uint32_t *data, uint32_t count)
+{
+	__IO uint32_t *dst = (__IO uint32_t *)(uintptr_t)addr;
+	uint32_t primask, err = 0;
+
+	while (FLASH->NSSR & (FLASH_FLAG_BSY | FLASH_FLAG_WBNE | FLASH_FLAG_DBNE))
+	{
+	}
+	FLASH->NSCCR = FLASH_FLAG_SR_ERRORS | FLASH_FLAG_EOP;
+	FLASH->NSCR |= FLASH_CR_PG;
+	while (count-- != 0)
+	{
+		/* The four words must reach the write buffer back to back */
+		primask = __get_PRIMASK();
+		__disable_irq();
+		dst[0] = data[0];
+		dst[1] = data[1];
+		dst[2] = data[2];
+		dst[3] = data[3];
+		__set_PRIMASK(primask);
+		dst += 4;
+		data += 4;
+		while (FLASH->NSSR & (FLASH_FLAG_BSY | FLASH_FLAG_WBNE | FLASH_FLAG_DBNE))
+		{
+		}
+		err = FLASH->NSSR & FLASH_FLAG_SR_ERRORS;
+		if (err != 0)
+		{
+			FLASH->NSCCR = err;
+			break;
+		}
+	}
+	FLASH->NSCR &= ~FLASH_CR_PG;
+	return err;
+}
+
+/**
+  * @brief  Program a staged image into an erased sector. Blank quadwords
+  *         are left alone, so they can still be written later without an
+  *         erase; every run of the others goes out as one burst.
+  * @param  addr: sector start address
+  * @param  image: PAGE_SIZE bytes, word aligned
+  * @retval 0: ok, else the FLASH_NSSR error flags
+  */
+static uint32_t STMFLASH_ProgramSector(uint32_t addr, const uint32_t *image)
+{
+	uint32_t q = 0, first, err = 0;
+	const uint32_t *w;
+
+	while ((q < PAGE_SIZE / 16) && (err == 0))
+	{
+		for (first = q; q < PAGE_SIZE / 16; q++)
+		{
+			w = image + q * 4;
+			if ((w[0] & w[1] & w[2] & w[3]) == 0xFFFFFFFF)
+			{
+				break;
+			}
+		}
+		if (q != first)
+		{
+			err = STMFLASH_ProgramBurst(addr + first * 16, image + first * 4, q - first);
+		}
+		q++;
+	}
+	return err;
+}
+
+/**
+  * @brief  Program the cached sector: only the dirty quadwords that differ
+  *         from flash, with an erase first if one of them is programmed
+  *         already. The frame is released either way.
+  * @retval 0: ok, else the FLASH_NSSR error flags or HAL status, also of a
+  *         flush STMFLASH_Write made since the last call
   */
-static void STMFLASH_Write_NoCheck(uint32_t WriteAddr,uint16_t *pBuffer,uint16_t NumToWrite)
-{ 			  
-	uint16_t i;
-	uint64_t qw_data[2]; // 128-bit = 2 x 64-bit
-	// STM32H5 requires 128-bit (quadword) programming, 16-byte aligned
-	// Process 8 halfwords (16 bytes) at a time
-	for(i=0; i<NumToWrite; i+=8)
-	{
-		// Prepare temp buffer with 0xFFFF padding
-		uint16_t temp[8] = {0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF};
-		// Copy available halfwords
-		for(uint16_t j=0; j<8 && (i+j)<NumToWrite; j++) {
-			temp[j] = pBuffer[i+j];
+uint32_t STMFLASH_Flush(void)
+{
+	const uint32_t *image = (const uint32_t *)STMFLASH_BUF;
+	const uint32_t *flash;
+	uint32_t q, first, err = 0;
+	uint8_t erase = 0;
+
+	if (STMFLASH_CacheAddr == STMFLASH_CACHE_NONE)
+	{
+		err = STMFLASH_WriteErr;
+		STMFLASH_WriteErr = 0;
+		return err;
+	}
+	flash = (const uint32_t *)(uintptr_t)STMFLASH_CacheAddr;
+	for (q = 0; q < STMFLASH_QUADWORDS; q++)
+	{
+		if ((STMFLASH_Dirty[q / 32] & (1u << (q % 32))) == 0)
+		{
+			continue;
+		}
+		if (memcmp(image + q * 4, flash + q * 4, 16) == 0)
+		{
+			STMFLASH_Dirty[q / 32] &= ~(1u << (q % 32)); // Written back to what it was
+		}
+		else if ((flash[q * 4] & flash[q * 4 + 1] & flash[q * 4 + 2] & flash[q * 4 + 3]) != 0xFFFFFFFF)
+		{
+			erase = 1;
 		}
-		// Pack 8 halfwords into two 64-bit words (128-bit total)
-		qw_data[0] = ((uint64_t)temp[0])       |
-		             ((uint64_t)temp[1] << 16) |
-		             ((uint64_t)temp[2] << 32) |
-		             ((uint64_t)temp[3] << 48);
-		qw_data[1] = ((uint64_t)temp[4])       |
-		             ((uint64_t)temp[5] << 16) |
-		             ((uint64_t)temp[6] << 32) |
-		             ((uint64_t)temp[7] << 48);
-		
-		if (HAL_FLASH_Program(FLASH_TYPEPROGRAM_QUADWORD, WriteAddr, (uint32_t)qw_data) != HAL_OK) {
-			return; // Write failed
+	}
+	HAL_FLASH_Unlock();
+	if (erase)
+	{
+		err = STMFLASH_EraseSector((STMFLASH_CacheAddr - STM32_FLASH_BASE) / STM_SECTOR_SIZE);
+		if (err == 0)
+		{
+			err = STMFLASH_ProgramSector(STMFLASH_CacheAddr, image);
 		}
-		WriteAddr += 16; // Advance by 16 bytes
 	}
-} 
+	else
+	{
+		// Each run of dirty quadwords goes out as one burst
+		for (q = 0; (q < STMFLASH_QUADWORDS) && (err == 0); q++)
+		{
+			for (first = q; (q < STMFLASH_QUADWORDS) && (STMFLASH_Dirty[q / 32] & (1u << (q % 32))); q++)
+			{
+			}
+			if (q != first)
+			{
+				err = STMFLASH_ProgramBurst(STMFLASH_CacheAddr + first * 16, image + first * 4, q - first);
+			}
+		}
+	}
+	HAL_FLASH_Lock();
+	ICache_Invalidate();
+	memset(STMFLASH_Dirty, 0, sizeof(STMFLASH_Dirty));
+	STMFLASH_CacheAddr = STMFLASH_CACHE_NONE;
+	err |= STMFLASH_WriteErr;
+	STMFLASH_WriteErr = 0;
+	return err;
+}
+
+/**
+  * @brief  Erase the sector holding addr and program it back with len
+  *         bytes of data merged over what it holds, through the cache
+  *         frame. For contents that must reach freshly erased cells.
+  * @param  len: bytes, [addr, addr + len) inside one sector
+  * @retval 0: ok, else the FLASH_NSSR error flags or HAL status
+  */
+uint32_t STMFLASH_Rewrite(uint32_t addr, const uint8_t *data, uint32_t len)
+{
+	uint32_t secaddr = addr - (addr - STM32_FLASH_BASE) % STM_SECTOR_SIZE;
+	uint32_t err;
 
-uint16_t STMFLASH_BUF[PAGE_SIZE / 2];     // Flash sector buffer
-uint16_t STM32_FLASH_SIZE[PAGE_SIZE / 2];//Up to 4k bytes
+	err = STMFLASH_Flush();
+	if (err != 0)
+	{
+		return err;
+	}
+	STMFLASH_Read(secaddr, STMFLASH_BUF, STM_SECTOR_SIZE / 2);
+	memcpy((uint8_t *)STMFLASH_BUF + (addr - secaddr), data, len);
+	HAL_FLASH_Unlock();
+	err = STMFLASH_EraseSector((secaddr - STM32_FLASH_BASE) / STM_SECTOR_SIZE);
+	if (err == 0)
+	{
+		err = STMFLASH_ProgramSector(secaddr, (const uint32_t *)STMFLASH_BUF);
+	}
+	HAL_FLASH_Lock();
+	ICache_Invalidate();
+	return err;
+}
 
 /**
   * @brief  Write data from the specified address to the specified length.
+  *         The data goes to the cache frame; flash is programmed on
+  *         STMFLASH_Flush() or when the write moves to another sector.
   * @note   This function can be used for STM32H5 devices.
   * @param  addr: The starting address to be written.(The address must be a multiple of two)
   * @param  buffer: The pointer to the data.
@@ -64,67 +239,97 @@ uint16_t STM32_FLASH_SIZE[PAGE_SIZE / 2];//Up to 4k bytes
   */
 void STMFLASH_Write(uint32_t WriteAddr,uint16_t *pBuffer,uint16_t NumToWrite)
 {
-  uint32_t secpos;	   //������ַ
-	uint16_t secoff;	   //������ƫ�Ƶ�ַ(16λ�ּ���)
-	uint16_t secremain; //������ʣ����?(16λ�ּ���)	   
- 	uint16_t i;    
-	uint32_t offaddr;   //ȥ��0X08000000��ĵ��?
+	uint32_t secaddr, i;
+
 	// Check if address is within valid flash range (STM32H503: 128KB total)
-	if(WriteAddr<STM32_FLASH_BASE || WriteAddr>=(STM32_FLASH_BASE+0x20000))return;//�Ƿ���ַ
-	HAL_FLASH_Unlock();						//����
-	offaddr=WriteAddr-STM32_FLASH_BASE;		//ʵ��ƫ�Ƶ�ַ.
-	secpos=offaddr/STM_SECTOR_SIZE;			//������ַ  0~127 for STM32F103RBT6
-	secoff=(offaddr%STM_SECTOR_SIZE)/2;		//�������ڵ�ƫ��(2���ֽ�Ϊ������λ.)
-	secremain=STM_SECTOR_SIZE/2-secoff;		//����ʣ��ռ��С   
-	if(NumToWrite<=secremain)secremain=NumToWrite;//�����ڸ�������Χ
-	while(1) 
-	{	
-		STMFLASH_Read(secpos*STM_SECTOR_SIZE+STM32_FLASH_BASE,STMFLASH_BUF,STM_SECTOR_SIZE/2);//������������������
-		for(i=0;i<secremain;i++)//У������
+	if(WriteAddr<STM32_FLASH_BASE || WriteAddr>=(STM32_FLASH_BASE+0x20000) ||
+	   NumToWrite>(STM32_FLASH_BASE+0x20000-WriteAddr)/2)return;
+	for (; NumToWrite != 0; NumToWrite--, pBuffer++, WriteAddr += 2)
+	{
+		secaddr = WriteAddr - (WriteAddr - STM32_FLASH_BASE) % STM_SECTOR_SIZE;
+		if (secaddr != STMFLASH_CacheAddr)
 		{
-			if(STMFLASH_BUF[secoff+i]!=0XFFFF)break;//��Ҫ����  	  
+			STMFLASH_WriteErr |= STMFLASH_Flush();
+			STMFLASH_Read(secaddr, STMFLASH_BUF, STM_SECTOR_SIZE / 2);
+			STMFLASH_CacheAddr = secaddr;
 		}
-		if(i<secremain)//��Ҫ����
+		i = (WriteAddr - secaddr) / 2;
+		if (STMFLASH_BUF[i] != *pBuffer)
 		{
-			HAL_FLASH_Unlock();
-			FLASH_EraseInitTypeDef EraseInitStruct;
-			uint32_t SectorError = 0;
-			EraseInitStruct.TypeErase = FLASH_TYPEERASE_SECTORS;
-			EraseInitStruct.Banks     = FLASH_BANK_1;
-			EraseInitStruct.Sector    = secpos;   // �� 8KB ��������?
-			EraseInitStruct.NbSectors = 1;
-			__HAL_FLASH_CLEAR_FLAG(FLASH_FLAG_ALL_ERRORS);
-			if (HAL_FLASHEx_Erase(&EraseInitStruct, &SectorError) != HAL_OK) {
-				HAL_FLASH_Lock();
-				return; // ����ʧ��ֱ�ӷ��أ��ɸ�����Ҫ��ӡ SectorError
-			}
-			// �����󽫻��������?0xFFFF������Ѿ���������д�?
-			memset(STMFLASH_BUF, 0xFFFF, sizeof(STMFLASH_BUF));
-			for(i=0;i<secremain;i++)//����
-			{
-				STMFLASH_BUF[i+secoff]=pBuffer[i];	  
-			}
-			STMFLASH_Write_NoCheck(secpos*STM_SECTOR_SIZE+STM32_FLASH_BASE,STMFLASH_BUF,STM_SECTOR_SIZE/2);//д����������
+			STMFLASH_BUF[i] = *pBuffer;
+			STMFLASH_Dirty[i / 256] |= 1u << ((i / 8) % 32);
+		}
+	}
+}
 
-		}else {
-			HAL_FLASH_Unlock();
-			STMFLASH_Write_NoCheck(WriteAddr,pBuffer,secremain);//д�Ѿ������˵�,ֱ��д������ʣ������.
+#if (USE_FLASH_BENCH == 1)
+/**
+  * @brief  Time the programming of one sector, quadword by quadword
+  *         through HAL_FLASH_Program and as one burst. The sector is
+  *         erased before each pass and left erased.
+  * @param  addr: sector start address, its contents are lost
+  * @retval 0: ok, -1: erase or program error
+  */
+int8_t STMFLASH_Bench(uint32_t addr, uint32_t *hal_cycles, uint32_t *burst_cycles)
+{
+	uint32_t *image = (uint32_t *)STMFLASH_BUF;
+	uint32_t secpos = (addr - STM32_FLASH_BASE) / STM_SECTOR_SIZE;
+	uint32_t i, start, err = 0;
 
-		}				   
-		if(NumToWrite==secremain)break;//д������??
-		else//д��δ����
-		{
-			secpos++;				//������ַ��1		
-			secoff=0;				//ƫ��λ��Ϊ0 	 
-		   	pBuffer+=secremain;  	//ָ��ƫ��
-			WriteAddr+=secremain;	//д��ַƫ��	   
-		   	NumToWrite-=secremain;	//�ֽ�(16λ)���ݼ�
-			if(NumToWrite>(STM_SECTOR_SIZE/2))secremain=STM_SECTOR_SIZE/2;//��һ����������д����
-			else secremain=NumToWrite;//��һ����������д����
-		}	 
-	};	
-	HAL_FLASH_Lock();//����
+	if (STMFLASH_Flush() != 0) // The frame doubles as the test pattern
+	{
+		return -1;
+	}
+	for (i = 0; i < PAGE_SIZE / 4; i++)
+	{
+		image[i] = addr + i * 4;
+	}
+	HAL_FLASH_Unlock();
+	err |= (STMFLASH_EraseSector(secpos) != HAL_OK);
+	start = Stats_Cycles();
+	for (i = 0; (i < PAGE_SIZE / 16) && (err == 0); i++)
+	{
+		err = (HAL_FLASH_Program(FLASH_TYPEPROGRAM_QUADWORD, addr + i * 16, (uintptr_t)(image + i * 4)) != HAL_OK);
+	}
+	*hal_cycles = Stats_Cycles() - start;
+	err |= (STMFLASH_EraseSector(secpos) != HAL_OK);
+	start = Stats_Cycles();
+	if (err == 0)
+	{
+		err = STMFLASH_ProgramBurst(addr, image, PAGE_SIZE / 16);
+	}
+	*burst_cycles = Stats_Cycles() - start;
+	ICache_Invalidate();
+	err |= (memcmp((const void *)(uintptr_t)addr, image, PAGE_SIZE) != 0);
+	err |= (STMFLASH_EraseSector(secpos) != HAL_OK);
+	HAL_FLASH_Lock();
+	return (err == 0) ? 0 : -1;
 }
+/**
+  * @brief  Time reading one sector into STMFLASH_BUF, halfword by halfword
+  *         as STMFLASH_Read used to and with STMFLASH_Read
+  * @retval 0: ok, -1: the cached writes before could not be flushed
+  */
+int8_t STMFLASH_BenchRead(uint32_t addr, uint32_t *halfword_cycles, uint32_t *read_cycles)
+{
+	uint32_t i, start;
+
+	if (STMFLASH_Flush() != 0)
+	{
+		return -1;
+	}
+	start = Stats_Cycles();
+	for (i = 0; i < STM_SECTOR_SIZE / 2; i++)
+	{
+		STMFLASH_BUF[i] = STMFLASH_ReadHalfWord(addr + i * 2);
+	}
+	*halfword_cycles = Stats_Cycles() - start;
+	start = Stats_Cycles();
+	STMFLASH_Read(addr, STMFLASH_BUF, STM_SECTOR_SIZE / 2);
+	*read_cycles = Stats_Cycles() - start;
+	return 0;
+}
+#endif
 
 /**
   * @brief  Start reading the specified data from the specified address.
@@ -136,12 +341,8 @@ void STMFLASH_Write(uint32_t WriteAddr,uint16_t *pBuffer,uint16_t NumToWrite)
   */
 void STMFLASH_Read(uint32_t ReadAddr,uint16_t *pBuffer,uint16_t NumToRead)
 {
-	uint16_t i;
-	for(i=0;i<NumToRead;i++)
-	{
-		pBuffer[i]=STMFLASH_ReadHalfWord(ReadAddr);//��ȡ2�ֽ�����.
-		ReadAddr+=2;//ƫ��2�ֽ�����.	
-	}
+	// The library memcpy moves aligned blocks several words per load
+	memcpy(pBuffer, (const void *)(uintptr_t)ReadAddr, NumToRead * 2);
 }
 					
 
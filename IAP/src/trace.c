@@ -0,0 +1,90 @@
+#include "trace.h"
+#include "stats.h"
+#include "serial.h"
+#include "common.h"
+#include "ymodem.h"
+#include "ramexec.h"
+
+/* Private variables ---------------------------------------------------------*/
+/* Not cleared by the startup code, see the .noinit section of the linker
+ * script */
+Trace_Ring Trace __attribute__((section(".noinit")));
+
+/************************************************************************/
+void Trace_Clear(void)
+{
+	memset(&Trace, 0, sizeof(Trace));
+	Trace.magic = TRACE_MAGIC;
+}
+
+/**
+  * @brief  Keep the events of the previous run if the ring survived the
+  *         reset, start a new one after a power up
+  */
+void Trace_Init(void)
+{
+	uint8_t kept = (Trace.magic == TRACE_MAGIC);
+
+	if (!kept)
+	{
+		Trace_Clear();
+	}
+	Trace_Log(TRACE_BOOT, 0, kept);
+}
+
+/**
+  * @brief  Record an event. Lock-free: the slot is claimed with an atomic
+  *         increment, so interrupts may log in the middle of a task's event.
+  */
+RAMFUNC void Trace_Log(uint8_t event, uint8_t seq, uint16_t arg)
+{
+	uint32_t i = __atomic_fetch_add(&Trace.head, 1, __ATOMIC_RELAXED) & (TRACE_ENTRIES - 1);
+
+	Trace.ring[i].cycles = Stats_Cycles();
+	Trace.ring[i].event = event;
+	Trace.ring[i].seq = seq;
+	Trace.ring[i].arg = arg;
+}
+
+/************************************************************************/
+static uint16_t Trace_Put(uint16_t crc, const uint8_t *data, uint32_t len)
+{
+	uint32_t i;
+
+	Serial_Write(data, len);
+	for (i = 0; i < len; i++)
+	{
+		crc = UpdateCRC16(crc, data[i]);
+	}
+	return crc;
+}
+
+/**
+  * @brief  Send the ring over the console, oldest event first (see trace.h)
+  */
+void Trace_Dump(void)
+{
+	uint32_t head = Trace.head, first, i;
+	uint32_t hdr[3];
+	uint16_t count, crc = 0;
+	uint8_t buf[2];
+
+	first = (head > TRACE_ENTRIES) ? (head - TRACE_ENTRIES) : 0;
+	count = (uint16_t)(head - first);
+	hdr[0] = TRACE_MAGIC;
+	hdr[1] = SystemCoreClock;
+	hdr[2] = first;
+	buf[0] = (uint8_t)count;
+	buf[1] = (uint8_t)(count >> 8);
+	crc = Trace_Put(crc, (const uint8_t *)hdr, sizeof(hdr));
+	crc = Trace_Put(crc, buf, 2);
+	for (i = first; i != head; i++)
+	{
+		crc = Trace_Put(crc, (const uint8_t *)&Trace.ring[i & (TRACE_ENTRIES - 1)], sizeof(Trace_Entry));
+	}
+	crc = UpdateCRC16(crc, 0);
+	crc = UpdateCRC16(crc, 0);
+	buf[0] = (uint8_t)(crc >> 8);
+	buf[1] = (uint8_t)crc;
+	Serial_Write(buf, 2);
+}
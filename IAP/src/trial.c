@@ -0,0 +1,93 @@
+#include "trial.h"
+#include "iap_config.h"
+#include "iap.h"
+#include "kvstore.h"
+#include "common.h"
+#include "stm32h5xx_hal.h"
+
+#define TRIAL_VALUE(state, boots)   ((uint32_t)(state) | ((uint32_t)(boots) << 8))
+
+/* IWDG at LSI 32 kHz / 256: 8 ms a count, 32 s at most */
+#define TRIAL_WDG_PRESCALER         6
+#define TRIAL_WDG_TICK_MS           8
+
+/**
+  * @retval Trial_State, boots: starts of the image on trial so far
+  */
+uint8_t Trial_Get(uint32_t *boots)
+{
+	uint32_t value;
+
+	if (KvStore_Get(KV_TRIAL, &value) != 0)
+	{
+		value = TRIAL_VALUE(TRIAL_NONE, 0);
+	}
+	if (boots != 0)
+	{
+		*boots = value >> 8;
+	}
+	return value & 0xFF;
+}
+
+/**
+  * @brief  The update wrote a new application: its first start, coming
+  *         next, is on trial
+  */
+void Trial_Start(void)
+{
+#if (USE_TRIAL_BOOT == 1)
+	KvStore_Set(KV_TRIAL, TRIAL_VALUE(TRIAL_PENDING, 1));
+#endif
+}
+
+/**
+  * @brief  At bootloader start, before the IAP flag is read: start the
+  *         image on trial again, or give it up once it had TRIAL_MAX_BOOTS
+  *         starts without confirming. A confirmed image (TRIAL_NONE) is
+  *         left to the flag, a given up one is never started by it.
+  */
+void Trial_Boot(void)
+{
+	uint32_t boots;
+
+	switch (Trial_Get(&boots))
+	{
+		case TRIAL_PENDING:
+			if (boots >= TRIAL_MAX_BOOTS)
+			{
+				KvStore_Set(KV_TRIAL, TRIAL_VALUE(TRIAL_FAILED, boots));
+				IAP_WriteFlag(INIT_FLAG_DATA);
+				SerialPutString("\r\n Trial boot failed, application not confirmed.\r\n");
+				break;
+			}
+			KvStore_Set(KV_TRIAL, TRIAL_VALUE(TRIAL_PENDING, boots + 1));
+			IAP_WriteFlag(APPRUN_FLAG_DATA);
+			break;
+		case TRIAL_FAILED:
+			IAP_WriteFlag(INIT_FLAG_DATA);
+			break;
+		default:
+			break;
+	}
+}
+
+/**
+  * @brief  From IAP_RunApp(), once the state store is flushed with a record
+  *         free for the confirmation: an image on trial runs under the
+  *         IWDG. Once started the IWDG runs until the next reset.
+  */
+void Trial_Handoff(void)
+{
+	if (Trial_Get(0) != TRIAL_PENDING)
+	{
+		return;
+	}
+	IWDG->KR = 0x0000CCCCU; /* Start */
+	IWDG->KR = 0x00005555U; /* Register access */
+	IWDG->PR = TRIAL_WDG_PRESCALER;
+	IWDG->RLR = TRIAL_WDG_MS / TRIAL_WDG_TICK_MS - 1;
+	while (IWDG->SR != 0)
+	{
+	}
+	IWDG->KR = 0x0000AAAAU; /* Reload */
+}
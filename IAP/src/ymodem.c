@@ -28,318 +28,986 @@
 #include "iap_config.h"
 #include "common.h"
 #include "stm32h5xx_hal_flash.h"
+#include "sched.h"
+#include "serial.h"
+#include "flashprog.h"
+#include "partition.h"
+#include "selfupdate.h"
+#include "imagesig.h"
+#include "imageenc.h"
+#include "stats.h"
+#include "trace.h"
 
 /* Private typedef -----------------------------------------------------------*/
 /* Private define ------------------------------------------------------------*/
 /* Private macro -------------------------------------------------------------*/
 /* Private variables ---------------------------------------------------------*/
 uint8_t file_name[FILE_NAME_LENGTH];
-uint32_t FlashDestination = ApplicationAddress; /* Flash user program offset */
+Ymodem_File Ymodem_Files[YMODEM_BATCH_MAX];
+uint8_t Ymodem_FileCount = 0;
+uint32_t FlashDestination = 0; /* Flash user program offset */
 uint16_t PageSize = PAGE_SIZE;
 //uint32_t EraseCounter = 0x0;
 //uint32_t NbrOfPage = 0;
 //FLASH_Status FLASHStatus = FLASH_COMPLETE;
-uint32_t RamSource;
-extern uint8_t tab_1024[1024];
 
 /* Private function prototypes -----------------------------------------------*/
+void Ymodem_PrepareIntialPacket(uint8_t *data, const uint8_t* fileName, uint32_t *length);
+static void Ymodem_CrcBegin (void);
+static void Ymodem_CrcUpdate (const uint8_t *data, uint32_t size);
+static uint16_t Ymodem_CrcEnd (void);
+
 /* Private functions ---------------------------------------------------------*/
 
 /**
-  * @brief  Receive byte from sender
+  * @brief  Send a byte
   * @param  c: Character
-  * @param  timeout: Timeout
-  * @retval 0: Byte received
-  *         -1: Timeout
+  * @retval 0: Byte sent
   */
-static  int32_t Receive_Byte (uint8_t *c, uint32_t timeout)
+static uint32_t Send_Byte (uint8_t c)
 {
-  while (timeout-- > 0)
+  if (c == ACK)
   {
-    if (SerialKeyPressed(c) == 1)
-    {
+    Trace_Log(TRACE_ACK, 0, 0);
+  }
+  else if (c == NAK)
+  {
+    Trace_Log(TRACE_NAK, 0, 0);
+  }
+  else if (c == CRC16)
+  {
+    Trace_Log(TRACE_POLL, 0, 0);
+  }
+  SerialPutChar(c);
+  return 0;
+}
+
+/**
+  * @brief  Map a packet start byte to its payload size
+  * @param  c: Start byte
+  * @retval Payload size, 0 if c does not start a data packet
+  */
+static uint16_t Ymodem_PacketSize (uint8_t c)
+{
+  switch (c)
+  {
+    case STX_8B:
+      return PACKET_8B_SIZE;
+    case STX_16B:
+      return PACKET_16B_SIZE;
+    case STX_32B:
+      return PACKET_32B_SIZE;
+    case STX_64B:
+      return PACKET_64B_SIZE;
+    case STX_128B:
+    case SOH: /* Compatible with standard terminals */
+      return PACKET_128B_SIZE;
+    case STX_256B:
+      return PACKET_256B_SIZE;
+    case STX_512B:
+      return PACKET_512B_SIZE;
+    case STX_1KB:
+    case STX: /* Compatible with standard terminals */
+      return PACKET_1KB_SIZE;
+    case STX_2KB:
+      return PACKET_2KB_SIZE;
+    default:
       return 0;
-    }
   }
-  return -1;
+}
+
+/* Receive engine ------------------------------------------------------------*/
+/* Packets are received into one of two buffers while the flash programmer
+ * works on the other, so the ACK for packet n goes out while packet n-1 is
+ * still being programmed. Each buffer keeps room in front of the packet so
+ * the unaligned tail of the previous packet can be merged in front of the
+ * payload and programmed as whole quadwords. The extra byte puts the
+ * payload, after the 3 header bytes, on a word boundary for the hash
+ * (imagesig.h); the buffers are whole words for the second one. */
+#define YMODEM_BUF_PREFIX       (FLASH_QUADWORD_SIZE + 1)
+#define YMODEM_BUF_SIZE         ((YMODEM_BUF_PREFIX + PACKET_2KB_SIZE + PACKET_OVERHEAD + 3) & ~3)
+
+typedef enum
+{
+  YM_IDLE = 0,
+  YM_RECEIVE,           /* Collecting packet bytes */
+  YM_WAIT_FLASH         /* Waiting for the programmer before answering */
+} Ymodem_State;
+
+/* ym.app_file */
+#define YM_APP_NONE             0
+#define YM_APP_IMAGE            1       /* An application */
+#define YM_APP_BOOT             2       /* A staged bootloader (selfupdate.h) */
+
+static uint8_t Ymodem_Buf[2][YMODEM_BUF_SIZE] __attribute__((aligned(4)));
+static uint8_t Ymodem_Tail[FLASH_QUADWORD_SIZE];
+
+static struct
+{
+  uint8_t state;
+  uint8_t notify;           /* Task receiving EVT_YMODEM_DONE */
+  uint8_t rx;               /* Buffer being received into */
+  uint8_t busy;             /* A program job is in flight */
+  uint8_t erasing;          /* The in-flight job is the header erase */
+  uint8_t eot;              /* EOT received, ACK withheld until flash is done */
+  uint8_t ca;               /* First CA of an abort sequence seen */
+  uint8_t errors;
+  uint8_t session_begin;
+  uint8_t part;             /* Partition of the current file */
+  uint8_t app_file;         /* What the batch wrote to PART_APP, YM_APP_xx */
+  uint16_t need;            /* Packet bytes still expected, 0 = wait start byte */
+  uint16_t count;           /* Packet bytes received */
+  uint16_t packet_size;
+  uint32_t packets_received;
+  int32_t size;
+  int32_t total;            /* Bytes of the files completed so far */
+  uint32_t written;         /* Image bytes accepted */
+  uint32_t tail_len;        /* Bytes waiting in Ymodem_Tail */
+  uint32_t job_addr;        /* Job queued behind the in-flight one */
+  const uint8_t *job_data;
+  uint32_t job_len;
+} ym;
+
+/************************************************************************/
+static void Ymodem_Finish (int32_t result)
+{
+  Trace_Log(TRACE_SESSION_END, 0, (uint16_t)result);
+  Sched_StopTimer(TASK_YMODEM);
+  ym.state = YM_IDLE;
+  Sched_Post(ym.notify, EVT_YMODEM_DONE, (uint32_t)result);
+}
+
+/************************************************************************/
+static void Ymodem_Abort (int32_t result)
+{
+  Send_Byte(CA);
+  Send_Byte(CA);
+  Ymodem_Finish(result);
+}
+
+/**
+  * @brief  Timeout or corrupted packet: drop what we have and ask again
+  */
+static void Ymodem_Error (void)
+{
+  ym.need = 0;
+  ym.count = 0;
+  ym.ca = 0;
+  if (ym.session_begin > 0)
+  {
+    ym.errors ++;
+    STATS_INC(naks);
+  }
+  if (ym.errors > MAX_ERRORS)
+  {
+    Ymodem_Abort(0);
+    return;
+  }
+  Serial_RxFlush();
+  Send_Byte(CRC16);
+  Sched_SetTimer(TASK_YMODEM, YMODEM_NAK_TIMEOUT_MS);
 }
 
 /**
-  * @brief  Send a byte
-  * @param  c: Character
-  * @retval 0: Byte sent
+  * @brief  Hand a program job to the flash task, or queue it behind the
+  *         running one
+  * @retval 1: started, 0: queued, -1: the idle programmer refused it
   */
-static uint32_t Send_Byte (uint8_t c)
+static int8_t Ymodem_Program (uint32_t addr, const uint8_t *data, uint32_t len)
 {
-  SerialPutChar(c);
+  if (!ym.busy)
+  {
+    if (FlashProg_Program(addr, data, len, TASK_YMODEM) != 0)
+    {
+      return -1;
+    }
+    ym.busy = 1;
+    return 1;
+  }
+  ym.job_addr = addr;
+  ym.job_data = data;
+  ym.job_len = len;
   return 0;
 }
 
 /**
-  * @brief  Receive a packet from sender
-  * @param  data
-  * @param  length
-  * @param  timeout
-  *     0: end of transmission
-  *    -1: abort by sender
-  *    >0: packet length
-  * @retval 0: normally return
-  *        -1: timeout or packet error
-  *         1: abort by user
+  * @brief  Parse the file name packet and erase the destination partition
   */
-static int32_t Receive_Packet (uint8_t *data, int32_t *length, uint32_t timeout)
+static void Ymodem_Header (uint8_t *packet)
 {
-  uint16_t i, packet_size;
-  uint8_t c;
-  *length = 0;
-  if (Receive_Byte(&c, timeout) != 0)
+  uint8_t file_size[FILE_SIZE_LENGTH], *file_ptr;
+  const Partition *part;
+  uint8_t app_file;
+  int32_t i;
+
+  for (i = 0, file_ptr = packet + PACKET_HEADER; (*file_ptr != 0) && (i < FILE_NAME_LENGTH - 1);)
   {
-    return -1;
+    file_name[i++] = *file_ptr++;
+  }
+  file_name[i++] = '\0';
+  for (i = 0, file_ptr ++; (*file_ptr != ' ') && (*file_ptr != 0) && (i < FILE_SIZE_LENGTH - 1);)
+  {
+    file_size[i++] = *file_ptr++;
+  }
+  file_size[i++] = '\0';
+  ym.size = 0;
+  Str2Int(file_size, &ym.size);
+
+  if (SelfUpdate_IsBootFile(file_name))
+  {
+    part = SelfUpdate_Staging();
+    ym.part = (uint8_t)part->type;
+  }
+  else if (Partition_FromFileName(file_name, &ym.part) == 0)
+  {
+    part = Partition_Get(ym.part);
+  }
+  else
+  {
+    Ymodem_Abort(-4);
+    return;
+  }
+
+  /* Without a scratch partition a bootloader is staged over the application:
+     one batch cannot carry both, the second file would erase the first */
+  if ((part != 0) && (part->type == PART_APP))
+  {
+    app_file = SelfUpdate_IsBootFile(file_name) ? YM_APP_BOOT : YM_APP_IMAGE;
+    if ((ym.app_file != YM_APP_NONE) && ((ym.app_file | app_file) & YM_APP_BOOT))
+    {
+      Ymodem_Abort(-6);
+      return;
+    }
+    ym.app_file = app_file;
+  }
+
+  /* Image size is greater than the partition */
+  if ((part == 0) || (ym.size <= 0) || ((uint32_t)ym.size > part->size))
+  {
+    Ymodem_Abort(-1);
+    return;
+  }
+
+  FlashDestination = part->addr;
+  ym.written = 0;
+  ym.tail_len = 0;
+  ym.erasing = 1;
+  if (FlashProg_Erase(part->addr, ym.size, TASK_YMODEM) != 0)
+  {
+    Ymodem_Abort(-1);
+    return;
+  }
+  ym.busy = 1;
+  ym.state = YM_WAIT_FLASH;
+  Sched_StopTimer(TASK_YMODEM);
+}
+
+/**
+  * @brief  Decrypt and hash the payload, merge it with the pending tail and
+  *         program whole quadwords
+  */
+static void Ymodem_Data (uint8_t *packet)
+{
+  uint8_t *data = packet + PACKET_HEADER;
+  uint32_t len = ym.packet_size, total, prog, skip;
+  int8_t started;
+
+  if (ym.written + len > (uint32_t)ym.size)
+  {
+    len = (uint32_t)ym.size - ym.written;
+  }
+  if (ym.written == 0)
+  {
+    /* First data of the file: what it holds after an encryption header */
+    skip = ImageEnc_Begin(data, len, (uint32_t)ym.size);
+    ImageSig_Begin(ym.part, file_name, FlashDestination, (uint32_t)ym.size - skip);
+  }
+  ym.written += len;
+  skip = ImageEnc_Decrypt(data, len);
+  data += skip;
+  len -= skip;
+  ImageSig_Update(data, len);
+
+  data -= ym.tail_len;
+  memcpy(data, Ymodem_Tail, ym.tail_len);
+  total = ym.tail_len + len;
+  prog = total & ~(uint32_t)(FLASH_QUADWORD_SIZE - 1);
+  ym.tail_len = total - prog;
+  memcpy(Ymodem_Tail, data + prog, ym.tail_len);
+
+  if (prog != 0)
+  {
+    FlashDestination += prog;
+    started = Ymodem_Program(FlashDestination - prog, data, prog);
+    if (started < 0)
+    {
+      Ymodem_Abort(-2);
+      return;
+    }
+    if (started == 0)
+    {
+      /* Both buffers are in use: hold the ACK until the programmer is done */
+      ym.state = YM_WAIT_FLASH;
+      Sched_StopTimer(TASK_YMODEM);
+      return;
+    }
+    ym.rx ^= 1;
+  }
+  Send_Byte(ACK);
+}
+
+/**
+  * @brief  End of file: program the padded tail, then ACK the EOT
+  */
+static void Ymodem_EndOfFile (void)
+{
+  uint32_t image_size, len;
+
+  if (!ym.busy && (ym.tail_len != 0))
+  {
+    memset(Ymodem_Tail + ym.tail_len, 0xFF, FLASH_QUADWORD_SIZE - ym.tail_len);
+    ym.tail_len = 0;
+    FlashDestination += FLASH_QUADWORD_SIZE;
+    if (Ymodem_Program(FlashDestination - FLASH_QUADWORD_SIZE, Ymodem_Tail, FLASH_QUADWORD_SIZE) < 0)
+    {
+      Ymodem_Abort(-2);
+      return;
+    }
+  }
+  if (ym.busy)
+  {
+    ym.eot = 1;
+    ym.state = YM_WAIT_FLASH;
+    Sched_StopTimer(TASK_YMODEM);
+    return;
+  }
+  ym.eot = 0;
+  ym.state = YM_RECEIVE;
+  if (ym.packets_received != 0)
+  {
+    /* File complete, the sender may follow with the next one of the batch */
+    image_size = ImageSig_End();
+    if ((Ymodem_FileCount == YMODEM_BATCH_MAX) && (image_size == 0))
+    {
+      Ymodem_FileCount--; // A rejected file is reported even past the list
+    }
+    if (Ymodem_FileCount < YMODEM_BATCH_MAX)
+    {
+      Ymodem_Files[Ymodem_FileCount].part = ym.part;
+      Ymodem_Files[Ymodem_FileCount].size = ym.size;
+      Ymodem_Files[Ymodem_FileCount].image_size = image_size;
+      len = strlen((const char *)file_name);
+      if (len > sizeof(Ymodem_Files[0].name) - 1)
+      {
+        len = sizeof(Ymodem_Files[0].name) - 1;
+      }
+      memcpy(Ymodem_Files[Ymodem_FileCount].name, file_name, len);
+      Ymodem_Files[Ymodem_FileCount].name[len] = '\0';
+      Ymodem_FileCount++;
+    }
+    ym.total += ym.size;
+  }
+  ym.packets_received = 0;
+  Send_Byte(ACK);
+  Send_Byte(CRC16);
+  Sched_SetTimer(TASK_YMODEM, YMODEM_NAK_TIMEOUT_MS);
+}
+
+/**
+  * @brief  A complete packet is in the receive buffer
+  */
+static void Ymodem_Packet (void)
+{
+  uint8_t *packet = Ymodem_Buf[ym.rx] + YMODEM_BUF_PREFIX;
+  uint16_t crc = ((uint16_t)packet[PACKET_HEADER + ym.packet_size] << 8) |
+                 packet[PACKET_HEADER + ym.packet_size + 1];
+  uint8_t seq = packet[PACKET_SEQNO_INDEX];
+
+  Trace_Log(TRACE_PKT_DATA, seq, 0);
+  ym.need = 0;
+  ym.count = 0;
+  if (((uint8_t)(seq ^ packet[PACKET_SEQNO_COMP_INDEX]) != 0xff) ||
+      (Cal_CRC16(packet + PACKET_HEADER, ym.packet_size) != crc))
+  {
+    Trace_Log(TRACE_PKT_CRC, seq, 0);
+    STATS_INC(crc_errors);
+    Ymodem_Error();
+    return;
+  }
+  Trace_Log(TRACE_PKT_CRC, seq, 1);
+  ym.errors = 0;
+
+  if (seq != (ym.packets_received & 0xff))
+  {
+    STATS_INC(seq_errors);
+    if ((ym.packets_received != 0) && (seq == ((ym.packets_received - 1) & 0xff)))
+    {
+      /* Our ACK was lost, the sender repeated the last packet */
+      Send_Byte(ACK);
+    }
+    else
+    {
+      STATS_INC(naks);
+      Send_Byte(NAK);
+    }
+    return;
+  }
+  Stats_Packet(ym.packet_size);
+
+  if (ym.packets_received == 0)
+  {
+    if (packet[PACKET_HEADER] == 0)
+    {
+      /* Filename packet is empty, end of the batch */
+      Send_Byte(ACK);
+      Ymodem_Finish(ym.total);
+      return;
+    }
+    ym.packets_received ++;
+    ym.session_begin = 1;
+    Ymodem_Header(packet);
+  }
+  else
+  {
+    ym.packets_received ++;
+    Ymodem_Data(packet);
+  }
+}
+
+/**
+  * @brief  Interpret a byte received outside of a packet
+  */
+static void Ymodem_StartByte (uint8_t c)
+{
+  if (ym.ca)
+  {
+    ym.ca = 0;
+    if (c == CA)
+    {
+      /* Abort by sender */
+      Send_Byte(ACK);
+      Ymodem_Finish(0);
+    }
+    return;
   }
   switch (c)
   {
-	case STX_8B:
-		packet_size = PACKET_8B_SIZE;
-	  break;
-	case STX_16B:
-	  packet_size = PACKET_16B_SIZE;
-	  break;
-	case STX_32B:
-	  packet_size = PACKET_32B_SIZE;
-	  break;
-	case STX_64B:
-	  packet_size = PACKET_64B_SIZE;
-	  break;
-	case STX_128B:
-	case SOH://Ϊ˼ݳն
-      packet_size = PACKET_128B_SIZE;
-      break;
-	case STX_256B:
-	  packet_size = PACKET_256B_SIZE;
-	  break;
-	case STX_512B:
-	  packet_size = PACKET_512B_SIZE;
-	  break;
-	case STX_1KB:
-	case STX://Ϊ˼ݳն
-      packet_size = PACKET_1KB_SIZE;
-      break;
-	case STX_2KB:
-		packet_size = PACKET_2KB_SIZE;
-	  break;
     case EOT:
-      return 0;
+      Trace_Log(TRACE_EOT, 0, 0);
+      Ymodem_EndOfFile();
+      break;
     case CA:
-      if ((Receive_Byte(&c, timeout) == 0) && (c == CA))
+      ym.ca = 1;
+      break;
+    case ABORT1:
+    case ABORT2:
+      Ymodem_Abort(-3);
+      break;
+    default:
+      ym.packet_size = Ymodem_PacketSize(c);
+      if (ym.packet_size != 0)
       {
-        *length = -1;
-        return 0;
+        Trace_Log(TRACE_PKT_START, 0, ym.packet_size);
+        Ymodem_Buf[ym.rx][YMODEM_BUF_PREFIX] = c;
+        ym.count = 1;
+        ym.need = ym.packet_size + PACKET_OVERHEAD - 1;
       }
-      else
+      break;
+  }
+}
+
+/************************************************************************/
+static void Ymodem_RxData (void)
+{
+  uint8_t c;
+  uint32_t n, total = 0;
+
+  while (ym.state == YM_RECEIVE)
+  {
+    if (ym.need == 0)
+    {
+      if (Serial_Read(&c, 1) == 0)
       {
-        return -1;
+        break;
       }
-    case ABORT1:
-    case ABORT2:
-      return 1;
-    default:
-      return -1;
+      total ++;
+      Ymodem_StartByte(c);
+    }
+    else
+    {
+      n = Serial_Read(Ymodem_Buf[ym.rx] + YMODEM_BUF_PREFIX + ym.count, ym.need);
+      if (n == 0)
+      {
+        break;
+      }
+      total += n;
+      ym.count += n;
+      ym.need -= n;
+      if (ym.need == 0)
+      {
+        Ymodem_Packet();
+      }
+    }
+  }
+  if ((total != 0) && (ym.state == YM_RECEIVE))
+  {
+    Sched_SetTimer(TASK_YMODEM, YMODEM_NAK_TIMEOUT_MS);
+  }
+}
+
+/**
+  * @brief  The flash programmer finished the in-flight job
+  */
+static void Ymodem_FlashDone (uint32_t status)
+{
+  uint32_t len = ym.job_len;
+
+  ym.busy = 0;
+  if (status != 0)
+  {
+    Ymodem_Abort(ym.erasing ? -1 : -2);
+    return;
+  }
+  if (ym.erasing)
+  {
+    ym.erasing = 0;
+    ym.state = YM_RECEIVE;
+    Send_Byte(ACK);
+    Send_Byte(CRC16);
   }
-  *data = c;
-  for (i = 1; i < (packet_size + PACKET_OVERHEAD); i ++)
+  else if (ym.job_len != 0)
   {
-    if (Receive_Byte(data + i, timeout) != 0)
+    ym.job_len = 0;
+    if (Ymodem_Program(ym.job_addr, ym.job_data, len) < 0)
     {
-      return -1;
+      /* The chunk is hashed already (imagesig.h): it must reach flash */
+      Ymodem_Abort(-2);
+      return;
     }
+    ym.rx ^= 1;
+    ym.state = YM_RECEIVE;
+    Send_Byte(ACK);
   }
-  if (data[PACKET_SEQNO_INDEX] != ((data[PACKET_SEQNO_COMP_INDEX] ^ 0xff) & 0xff))
+  if (ym.eot)
   {
-    return -1;
+    Ymodem_EndOfFile();
+    return;
   }
-  *length = packet_size;
-  return 0;
+  if (ym.state == YM_WAIT_FLASH)
+  {
+    ym.state = YM_RECEIVE;
+  }
+  Sched_SetTimer(TASK_YMODEM, YMODEM_NAK_TIMEOUT_MS);
+  if (Serial_Available() != 0)
+  {
+    Ymodem_RxData();
+  }
+}
+
+/* Transmit engine -----------------------------------------------------------*/
+/* Uploads a memory range. The payload of a data packet goes out straight from
+ * flash through Serial_WriteBlock (DMA); only the packet header, the 0x1A
+ * padding of the last packet and the CRC pass through the TX queue. Packets
+ * up to YMODEM_TX_PACKET_SIZE use the STX_xxx start bytes, the last one is
+ * shrunk to the smallest size that holds the rest. */
+typedef enum
+{
+  YT_IDLE = 0,
+  YT_START,             /* Waiting for the receiver's 'C' */
+  YT_HEADER,            /* File name packet sent, waiting for ACK */
+  YT_DATA_C,            /* Waiting for 'C' before the first data packet */
+  YT_DATA,              /* Data packet sent, waiting for ACK */
+  YT_EOT,               /* EOT sent, waiting for ACK */
+  YT_END_C,             /* Waiting for 'C' before the empty file name packet */
+  YT_END                /* Empty file name packet sent, waiting for ACK */
+} Ymodem_TxState;
+
+static uint8_t Ymodem_Block0[PACKET_128B_SIZE + PACKET_OVERHEAD];
+static uint8_t Ymodem_Pad[64];
+
+static struct
+{
+  uint8_t state;
+  uint8_t notify;           /* Task receiving EVT_YMODEM_DONE */
+  uint8_t seq;
+  uint8_t errors;
+  uint8_t ca;
+  uint8_t start;            /* Start byte of the current data packet */
+  uint16_t crc;             /* CRC of the current data packet, kept for resends */
+  uint32_t addr;            /* First byte of the current data packet */
+  uint32_t end;
+  uint32_t len;             /* Data bytes in the current packet */
+  uint32_t pkt;             /* Payload size of the current packet */
+} yt;
+
+/************************************************************************/
+static void Ymodem_TxFinish (int32_t result)
+{
+  Trace_Log(TRACE_SESSION_END, 0, (uint16_t)result);
+  Sched_StopTimer(TASK_YMODEM);
+  yt.state = YT_IDLE;
+  Sched_Post(yt.notify, EVT_YMODEM_DONE, (uint32_t)result);
 }
 
+/**
+  * @brief  Fill Ymodem_Block0 with a file name packet, an empty one when
+  *         name is NULL
+  */
+static void Ymodem_TxBlock0 (const uint8_t *name, uint32_t size)
+{
+  uint16_t crc;
+
+  if (name != 0)
+  {
+    Ymodem_PrepareIntialPacket(Ymodem_Block0, name, &size);
+  }
+  else
+  {
+    memset(Ymodem_Block0, 0, sizeof(Ymodem_Block0));
+    Ymodem_Block0[0] = SOH;
+    Ymodem_Block0[PACKET_SEQNO_COMP_INDEX] = 0xff;
+  }
+  crc = Cal_CRC16(Ymodem_Block0 + PACKET_HEADER, PACKET_128B_SIZE);
+  Ymodem_Block0[PACKET_HEADER + PACKET_128B_SIZE] = crc >> 8;
+  Ymodem_Block0[PACKET_HEADER + PACKET_128B_SIZE + 1] = crc & 0xff;
+}
 
 /**
-  * @brief  Receive a file using the ymodem protocol
-  * @param  buf: Address of the first byte
-  * @retval The size of the file
+  * @brief  Size the next data packet and compute its CRC
   */
-int32_t Ymodem_Receive (uint8_t *buf)
+static void Ymodem_TxPrepare (void)
 {
-  uint8_t packet_data[PACKET_1KB_SIZE + PACKET_OVERHEAD], file_size[FILE_SIZE_LENGTH], *file_ptr, *buf_ptr;
-  int32_t i, j, packet_length, session_done, file_done, packets_received, errors, session_begin, size = 0;
+  static const uint8_t start[] = { STX_8B, STX_16B, STX_32B, STX_64B, STX_128B, STX_256B,
+                                   STX_512B, STX_1KB, STX_2KB, STX_4KB, STX_8KB };
+  uint32_t remain = yt.end - yt.addr, pkt, i, n;
+
+#if (YMODEM_TX_PACKET_SIZE > PACKET_1KB_SIZE)
+  for (i = 0, pkt = PACKET_8B_SIZE; (pkt < YMODEM_TX_PACKET_SIZE) && (pkt < remain); i++)
+  {
+    pkt <<= 1;
+  }
+  yt.start = start[i];
+#else
+  /* Plain SOH/STX packets for standard terminals */
+  (void)start;
+  (void)i;
+  pkt = (remain > PACKET_128B_SIZE) ? PACKET_1KB_SIZE : PACKET_128B_SIZE;
+  yt.start = (pkt == PACKET_1KB_SIZE) ? STX : SOH;
+#endif
+  yt.pkt = pkt;
+  yt.len = (remain < pkt) ? remain : pkt;
 
-  /* Initialize FlashDestination variable */
-  FlashDestination = ApplicationAddress;
+  Ymodem_CrcBegin();
+  Ymodem_CrcUpdate((const uint8_t *)(uintptr_t)yt.addr, yt.len);
+  for (remain = pkt - yt.len; remain != 0; remain -= n)
+  {
+    n = (remain < sizeof(Ymodem_Pad)) ? remain : sizeof(Ymodem_Pad);
+    Ymodem_CrcUpdate(Ymodem_Pad, n);
+  }
+  yt.crc = Ymodem_CrcEnd();
+}
 
-  Send_Byte(CRC16);
-  for (session_done = 0, errors = 0, session_begin = 0; ;)
+/**
+  * @brief  (Re)send whatever the current state is waiting an answer for
+  */
+static void Ymodem_TxSend (void)
+{
+  uint8_t buf[PACKET_HEADER];
+  uint32_t pad, n;
+
+  if ((yt.state == YT_HEADER) || (yt.state == YT_END))
+  {
+    Serial_Write(Ymodem_Block0, sizeof(Ymodem_Block0));
+    n = sizeof(Ymodem_Block0);
+  }
+  else if (yt.state == YT_DATA)
   {
-    for (packets_received = 0, file_done = 0, buf_ptr = buf; ;)
+    Trace_Log(TRACE_TX_PKT, yt.seq, (uint16_t)yt.pkt);
+    buf[0] = yt.start;
+    buf[PACKET_SEQNO_INDEX] = yt.seq;
+    buf[PACKET_SEQNO_COMP_INDEX] = ~yt.seq;
+    Serial_Write(buf, PACKET_HEADER);
+    Serial_WriteBlock((const uint8_t *)(uintptr_t)yt.addr, yt.len);
+    for (pad = yt.pkt - yt.len; pad != 0; pad -= n)
     {
-      switch (Receive_Packet(packet_data, &packet_length, NAK_TIMEOUT))
-      {
-        case 0://ݰ
-		  //
-          errors = 0;
-          switch (packet_length)
-          {
-            /* Abort by sender */
-            case - 1://ʧ
-              Send_Byte(ACK);
-              return 0;
-            /* End of transmission */
-            case 0://ݰ
-              Send_Byte(ACK);
-              file_done = 1;
-              break;
-            /* Normal packet */
-            default://ݰ
-              if ((packet_data[PACKET_SEQNO_INDEX] & 0xff) != (packets_received & 0xff))
-              {
-                Send_Byte(NAK);
-              }
-              else
-              {
-                if (packets_received == 0)//Ϣ(ļ )
-                {
-                  /* Filename packet */
-                  if (packet_data[PACKET_HEADER] != 0)//ļ
-                  {
-                    /* Filename packet has valid data */
-                    for (i = 0, file_ptr = packet_data + PACKET_HEADER; (*file_ptr != 0) && (i < FILE_NAME_LENGTH);)
-                    {
-                      file_name[i++] = *file_ptr++;//ļ
-                    }
-                    file_name[i++] = '\0';//ַ־
-                    for (i = 0, file_ptr ++; (*file_ptr != ' ') && (i < FILE_SIZE_LENGTH);)
-                    {
-                      file_size[i++] = *file_ptr++;//ļС
-                    }
-                    file_size[i++] = '\0';
-                    Str2Int(file_size, &size);
-
-                    /* Test the size of the image to be sent */
-                    /* Image size is greater than Flash size */
-                    if (size > (FLASH_SIZE - 1))
-                    {
-                      /* End session */
-                      Send_Byte(CA);
-                      Send_Byte(CA);
-                      return -1;
-                    }
-
-                    /* Erase the needed pages where the user application will be loaded */
-                    /* Define the number of page to be erased */
-					if(EraseSomePages(size, 0))
-					{
-					}
-					else
-					{
-				      /* End session */
-                      Send_Byte(CA);
-                      Send_Byte(CA);
-                      return -1;
-						//Erase failed
-					}
-                    Send_Byte(ACK);
-                    Send_Byte(CRC16);
-                  }
-                  /* Filename packet is empty, end session */
-                  else
-                  {
-                    Send_Byte(ACK);
-                    file_done = 1;
-                    session_done = 1;
-                    break;
-                  }
-                }
-                /* Data packet */
-                else//ļϢ֮ʼ
-                {
-                  memcpy(buf_ptr, packet_data + PACKET_HEADER, packet_length);
-                  RamSource = (uint32_t)buf;
-                  /* Unlock FLASH */
-                  HAL_FLASH_Unlock();
-                  
-                  /* Program the data received into STM32H5 Flash */
-                  for (j = 0;(j < packet_length) && (FlashDestination <  ApplicationAddress + size);j += 4)
-                  {
-                    /* STM32H5 only supports 128-bit programming, so we'll use quadword programming for simplicity */
-                    uint64_t quadword_data[2] = {0};
-                    
-                    /* Copy 4 bytes to quadword buffer */
-                    *(uint32_t*)quadword_data = *(uint32_t*)RamSource;
-                    
-                    /* Program quadword (128-bit) */
-                    HAL_FLASH_Program(FLASH_TYPEPROGRAM_QUADWORD, FlashDestination, quadword_data[0]);
-                    
-                    /* Verify programming */
-                    if (*(uint32_t*)FlashDestination != *(uint32_t*)RamSource)
-                    {
-                      /* Lock FLASH */
-                      HAL_FLASH_Lock();
-                      
-                      /* End session */
-                      Send_Byte(CA);
-                      Send_Byte(CA);
-                      return -2;
-                    }
-                    
-                    FlashDestination += 4;
-                    RamSource += 4;
-                  }
-                  
-                  /* Lock FLASH */
-                  HAL_FLASH_Lock();
-                  Send_Byte(ACK);
-                }
-                packets_received ++;
-                session_begin = 1;
-              }
-          }
-          break;
-        case 1://û'a''A'
-          Send_Byte(CA);
-          Send_Byte(CA);
-          return -3;
-        default://
-          if (session_begin > 0)
-          {
-            errors ++;
-          }
-          if (errors > MAX_ERRORS)
-          {
-            Send_Byte(CA);
-            Send_Byte(CA);
-            return 0;
-          }
-          Send_Byte(CRC16);//Уֵ
-          break;
-      }
-      if (file_done != 0)
+      n = (pad < sizeof(Ymodem_Pad)) ? pad : sizeof(Ymodem_Pad);
+      Serial_Write(Ymodem_Pad, n);
+    }
+    buf[0] = yt.crc >> 8;
+    buf[1] = yt.crc & 0xff;
+    Serial_Write(buf, PACKET_TRAILER);
+    n = yt.pkt + PACKET_OVERHEAD;
+  }
+  else
+  {
+    Send_Byte(EOT);
+    n = 1;
+  }
+  /* The answer can only come once the packet has left the wire */
+  Sched_SetTimer(TASK_YMODEM, Serial_TxTimeMs(n) + YMODEM_NAK_TIMEOUT_MS);
+}
+
+/**
+  * @brief  Send the next data packet, or EOT when the range is done
+  */
+static void Ymodem_TxNext (void)
+{
+  yt.errors = 0;
+  if (yt.addr < yt.end)
+  {
+    Ymodem_TxPrepare();
+    yt.state = YT_DATA;
+  }
+  else
+  {
+    yt.state = YT_EOT;
+  }
+  Ymodem_TxSend();
+}
+
+/**
+  * @brief  The receiver asked for the next packet ('C'), or did not within
+  *         the timeout; carry on either way
+  */
+static void Ymodem_TxGo (void)
+{
+  if (yt.state == YT_DATA_C)
+  {
+    Ymodem_TxNext();
+  }
+  else if (yt.state == YT_END_C)
+  {
+    Ymodem_TxBlock0(0, 0);
+    yt.state = YT_END;
+    yt.errors = 0;
+    Ymodem_TxSend();
+  }
+}
+
+/************************************************************************/
+static void Ymodem_TxAck (void)
+{
+  switch (yt.state)
+  {
+    case YT_HEADER:
+      yt.state = YT_DATA_C;
+      Sched_SetTimer(TASK_YMODEM, YMODEM_NAK_TIMEOUT_MS);
+      break;
+    case YT_DATA:
+      Trace_Log(TRACE_TX_ACK, yt.seq, 0);
+      Stats_Packet(yt.pkt);
+      yt.addr += yt.len;
+      yt.seq ++;
+      Ymodem_TxNext();
+      break;
+    case YT_EOT:
+      yt.state = YT_END_C;
+      Sched_SetTimer(TASK_YMODEM, YMODEM_NAK_TIMEOUT_MS);
+      break;
+    case YT_END:
+      Ymodem_TxFinish(0);
+      break;
+    default:
+      break;
+  }
+}
+
+/**
+  * @brief  NAK or no answer: send the same thing again
+  */
+static void Ymodem_TxRetry (void)
+{
+  Trace_Log(TRACE_TX_NAK, yt.seq, yt.errors);
+  if (++yt.errors >= YMODEM_TX_MAX_ERRORS)
+  {
+    Send_Byte(CA);
+    Send_Byte(CA);
+    Ymodem_TxFinish(yt.errors);
+    return;
+  }
+  STATS_INC(resends);
+  Ymodem_TxSend();
+}
+
+/************************************************************************/
+static void Ymodem_TxRx (void)
+{
+  uint8_t c;
+
+  while ((yt.state != YT_IDLE) && (Serial_Read(&c, 1) != 0))
+  {
+    if (c == CA)
+    {
+      if (yt.ca)
       {
-        break;
+        /* Cancelled by the receiver */
+        Ymodem_TxFinish(1);
+        return;
       }
+      yt.ca = 1;
+      continue;
     }
-    if (session_done != 0)//ļ
+    yt.ca = 0;
+    switch (yt.state)
     {
-      break;
+      case YT_START:
+        if (c != CRC16)
+        {
+          /* Any other key aborts */
+          Ymodem_TxFinish(-3);
+          return;
+        }
+        yt.state = YT_HEADER;
+        Ymodem_TxSend();
+        break;
+      case YT_DATA_C:
+      case YT_END_C:
+        if (c == CRC16)
+        {
+          Ymodem_TxGo();
+        }
+        break;
+      default:
+        if (c == ACK)
+        {
+          Ymodem_TxAck();
+        }
+        else if (c == NAK)
+        {
+          Ymodem_TxRetry();
+        }
+        break;
     }
   }
-  return (int32_t)size;
+}
+
+/************************************************************************/
+static void Ymodem_TxTask (const Sched_Event *evt)
+{
+  switch (evt->type)
+  {
+    case EVT_UART_RX:
+      Ymodem_TxRx();
+      break;
+    case EVT_TIMEOUT:
+      if ((yt.state == YT_DATA_C) || (yt.state == YT_END_C))
+      {
+        Ymodem_TxGo();
+      }
+      else if (yt.state != YT_START)
+      {
+        Ymodem_TxRetry();
+      }
+      break;
+    default:
+      break;
+  }
+}
+
+/************************************************************************/
+static void Ymodem_Task (const Sched_Event *evt)
+{
+  if (yt.state != YT_IDLE)
+  {
+    Ymodem_TxTask(evt);
+    return;
+  }
+  if (ym.state == YM_IDLE)
+  {
+    return;
+  }
+  switch (evt->type)
+  {
+    case EVT_UART_RX:
+      Ymodem_RxData();
+      break;
+    case EVT_TIMEOUT:
+      if (ym.state == YM_RECEIVE)
+      {
+        Ymodem_Error();
+      }
+      break;
+    case EVT_FLASH_DONE:
+      Ymodem_FlashDone(evt->param);
+      break;
+    default:
+      break;
+  }
 }
 
 /**
-  * @brief  check response using the ymodem protocol
-  * @param  buf: Address of the first byte
-  * @retval The size of the file
+  * @brief  Register the receive and transmit engines with the scheduler
   */
-int32_t Ymodem_CheckResponse(uint8_t c)
+void Ymodem_Init (void)
 {
+  ym.state = YM_IDLE;
+  yt.state = YT_IDLE;
+  memset(Ymodem_Pad, 0x1A, sizeof(Ymodem_Pad));
+#if (USE_HW_CRC == 1)
+  __HAL_RCC_CRC_CLK_ENABLE();
+  CRC->POL = 0x1021;
+  CRC->INIT = 0;
+#endif
+  Sched_Register(TASK_YMODEM, Ymodem_Task);
+}
+
+/**
+  * @brief  Start receiving a batch of files, each into the partition its
+  *         name selects (see partition.h); the files completed are listed
+  *         in Ymodem_Files. The result is posted to the notify task as
+  *         EVT_YMODEM_DONE:
+  *         >0: total size, 0: aborted by sender or too many errors,
+  *         -1: image too big or erase failed, -2: programming failed,
+  *         -3: aborted by user, -4: unknown partition,
+  *         -6: a bootloader and an application staged over each other
+  * @param  notify: Task to inform when the session ends
+  * @retval 0: started, -1: a session is already running
+  */
+int8_t Ymodem_Start (uint8_t notify)
+{
+  if ((ym.state != YM_IDLE) || (yt.state != YT_IDLE))
+  {
+    return -1;
+  }
+  memset(&ym, 0, sizeof(ym));
+  memset(Ymodem_Files, 0, sizeof(Ymodem_Files));
+  Ymodem_FileCount = 0;
+  ym.notify = notify;
+  ym.state = YM_RECEIVE;
+  Trace_Log(TRACE_SESSION_START, 0, 0);
+  FlashDestination = Partition_Addr(PART_APP);
+
+  Serial_RxFlush();
+  Serial_SetRxOwner(TASK_YMODEM);
+  Send_Byte(CRC16);
+  Sched_SetTimer(TASK_YMODEM, YMODEM_NAK_TIMEOUT_MS);
+  return 0;
+}
+
+/**
+  * @brief  Upload size bytes from addr once the receiver sends 'C'; any
+  *         other key aborts. EVT_YMODEM_DONE goes to notify with
+  *         0: sent, >0: too many errors or cancelled by the receiver,
+  *         -3: aborted by user
+  * @retval 0: started, -1: a session is already running
+  */
+int8_t Ymodem_SendStart (uint32_t addr, uint32_t size, const uint8_t *name, uint8_t notify)
+{
+  if ((ym.state != YM_IDLE) || (yt.state != YT_IDLE))
+  {
+    return -1;
+  }
+  memset(&yt, 0, sizeof(yt));
+  yt.notify = notify;
+  yt.addr = addr;
+  yt.end = addr + size;
+  yt.seq = 1;
+  Trace_Log(TRACE_SESSION_START, 0, 1);
+  Ymodem_TxBlock0(name, size);
+
+  Serial_RxFlush();
+  Serial_SetRxOwner(TASK_YMODEM);
+  yt.state = YT_START;
   return 0;
 }
 
@@ -378,45 +1046,6 @@ void Ymodem_PrepareIntialPacket(uint8_t *data, const uint8_t* fileName, uint32_t
   }
 }
 
-/**
-  * @brief  Prepare the data packet
-  * @param  timeout
-  *     0: end of transmission
-  */
-void Ymodem_PreparePacket(uint8_t *SourceBuf, uint8_t *data, uint8_t pktNo, uint32_t sizeBlk)
-{
-  uint16_t i, size, packetSize;
-  uint8_t* file_ptr;
-  
-  /* Make first three packet */
-  packetSize = sizeBlk >= PACKET_1KB_SIZE ? PACKET_1KB_SIZE : PACKET_128B_SIZE;
-  size = sizeBlk < packetSize ? sizeBlk :packetSize;
-  if (packetSize == PACKET_1KB_SIZE)
-  {
-     data[0] = STX;
-  }
-  else
-  {
-     data[0] = SOH;
-  }
-  data[1] = pktNo;
-  data[2] = (~pktNo);
-  file_ptr = SourceBuf;
-  
-  /* Filename packet has valid data */
-  for (i = PACKET_HEADER; i < size + PACKET_HEADER;i++)
-  {
-     data[i] = *file_ptr++;
-  }
-  if ( size  <= packetSize)
-  {
-    for (i = size + PACKET_HEADER; i < packetSize + PACKET_HEADER; i++)
-    {
-      data[i] = 0x1A; /* EOF (0x1A) or 0x00 */
-    }
-  }
-}
-
 /**
   * @brief  Update CRC16 for input byte
   * @param  CRC input value 
@@ -441,282 +1070,76 @@ uint16_t UpdateCRC16(uint16_t crcIn, uint8_t byte)
 }
 
 
+#if (USE_HW_CRC == 1)
 /**
-  * @brief  Cal CRC16 for YModem Packet
-  * @param  data
-  * @param  length
-   * @retval None
-  */
-uint16_t Cal_CRC16(const uint8_t* data, uint32_t size)
-{
- uint32_t crc = 0;
- const uint8_t* dataEnd = data+size;
- while(data<dataEnd)
-  crc = UpdateCRC16(crc,*data++);
- 
- crc = UpdateCRC16(crc,0);
- crc = UpdateCRC16(crc,0);
- return crc&0xffffu;
-}
-
-/**
-  * @brief  Cal Check sum for YModem Packet
-  * @param  data
-  * @param  length
-   * @retval None
+  * @brief  CRC-16/XMODEM on the CRC peripheral (polynomial set in Ymodem_Init)
   */
-uint8_t CalChecksum(const uint8_t* data, uint32_t size)
+static void Ymodem_CrcBegin (void)
 {
- uint32_t sum = 0;
- const uint8_t* dataEnd = data+size;
- while(data < dataEnd )
-   sum += *data++;
- return sum&0xffu;
+  CRC->CR = CRC_CR_POLYSIZE_0 | CRC_CR_RESET;
 }
 
-/**
-  * @brief  Transmit a data packet using the ymodem protocol
-  * @param  data
-  * @param  length
-   * @retval None
-  */
-void Ymodem_SendPacket(uint8_t *data, uint16_t length)
+/************************************************************************/
+static void Ymodem_CrcUpdate (const uint8_t *data, uint32_t size)
 {
-  uint16_t i;
-  i = 0;
-  while (i < length)
+  while ((size != 0) && (((uintptr_t)data & 3) != 0))
   {
-    Send_Byte(data[i]);
-    i++;
+    *(__IO uint8_t *)&CRC->DR = *data++;
+    size--;
   }
-}
-
-/**
-  * @brief  Transmit a file using the ymodem protocol
-  * @param  buf: Address of the first byte
-  * @retval The size of the file
-  */
-uint8_t Ymodem_Transmit (uint8_t *buf, const uint8_t* sendFileName, uint32_t sizeFile)
-{
-  
-  uint8_t packet_data[PACKET_1KB_SIZE + PACKET_OVERHEAD];
-  uint8_t FileName[FILE_NAME_LENGTH];
-  uint8_t *buf_ptr, tempCheckSum ;
-  uint16_t tempCRC, blkNumber;
-  uint8_t receivedC[2], CRC16_F = 0, i;
-  uint32_t errors, ackReceived, size = 0, pktSize;
-
-  errors = 0;
-  ackReceived = 0;
-  for (i = 0; i < (FILE_NAME_LENGTH - 1); i++)
-  {
-    FileName[i] = sendFileName[i];
-  }
-  CRC16_F = 1;       
-    
-  /* Prepare first block */
-  Ymodem_PrepareIntialPacket(&packet_data[0], FileName, &sizeFile);
-  
-  do 
-  {
-    /* Send Packet */
-    Ymodem_SendPacket(packet_data, PACKET_128B_SIZE + PACKET_HEADER);
-    /* Send CRC or Check Sum based on CRC16_F */
-    if (CRC16_F)
-    {
-       tempCRC = Cal_CRC16(&packet_data[3], PACKET_128B_SIZE);
-       Send_Byte(tempCRC >> 8);
-       Send_Byte(tempCRC & 0xFF);
-    }
-    else
-    {
-       tempCheckSum = CalChecksum (&packet_data[3], PACKET_128B_SIZE);
-       Send_Byte(tempCheckSum);
-    }
-  
-    /* Wait for Ack and 'C' */
-    if (Receive_Byte(&receivedC[0], 10000) == 0)  
-    {
-      if (receivedC[0] == ACK)
-      { 
-        /* Packet transfered correctly */
-        ackReceived = 1;
-      }
-    }
-    else
-    {
-        errors++;
-    }
-  }while (!ackReceived && (errors < 0x0A));
-  
-  if (errors >=  0x0A)
+  /* Words are fed most significant byte first */
+  for (; size >= 4; size -= 4, data += 4)
   {
-    return errors;
+    CRC->DR = __REV(*(const uint32_t *)data);
   }
-  buf_ptr = buf;
-  size = sizeFile;
-  blkNumber = 0x01;
-  /* Here 1024 bytes package is used to send the packets */
-  
-  
-  /* Resend packet if NAK  for a count of 10 else end of commuincation */
-  while (size)
-  {
-    /* Prepare next packet */
-    Ymodem_PreparePacket(buf_ptr, &packet_data[0], blkNumber, size);
-    ackReceived = 0;
-    receivedC[0]= 0;
-    errors = 0;
-    do
-    {
-      /* Send next packet */
-      if (size >= PACKET_1KB_SIZE)
-      {
-        pktSize = PACKET_1KB_SIZE;
-       
-      }
-      else
-      {
-        pktSize = PACKET_128B_SIZE;
-      }
-      Ymodem_SendPacket(packet_data, pktSize + PACKET_HEADER);
-      /* Send CRC or Check Sum based on CRC16_F */
-      /* Send CRC or Check Sum based on CRC16_F */
-      if (CRC16_F)
-      {
-         tempCRC = Cal_CRC16(&packet_data[3], pktSize);
-         Send_Byte(tempCRC >> 8);
-         Send_Byte(tempCRC & 0xFF);
-      }
-      else
-      {
-        tempCheckSum = CalChecksum (&packet_data[3], pktSize);
-        Send_Byte(tempCheckSum);
-      }
-      
-      /* Wait for Ack */
-      if ((Receive_Byte(&receivedC[0], 100000) == 0)  && (receivedC[0] == ACK))
-      {
-        ackReceived = 1;  
-        if (size > pktSize)
-        {
-           buf_ptr += pktSize;  
-           size -= pktSize;
-           if (blkNumber == (FLASH_IMAGE_SIZE/1024))
-           {
-             return 0xFF; /*  error */
-           }
-           else
-           {
-              blkNumber++;
-           }
-        }
-        else
-        {
-          buf_ptr += pktSize;
-          size = 0;
-        }
-      }
-      else
-      {
-        errors++;
-      }
-    }while(!ackReceived && (errors < 0x0A));
-    /* Resend packet if NAK  for a count of 10 else end of commuincation */
-    
-    if (errors >=  0x0A)
-    {
-      return errors;
-    }
-    
-  }
-  ackReceived = 0;
-  receivedC[0] = 0x00;
-  errors = 0;
-  do 
-  {
-    Send_Byte(EOT);
-    /* Send (EOT); */
-    /* Wait for Ack */
-      if ((Receive_Byte(&receivedC[0], 10000) == 0)  && receivedC[0] == ACK)
-      {
-        ackReceived = 1;  
-      }
-      else
-      {
-        errors++;
-      }
-  }while (!ackReceived && (errors < 0x0A));
-    
-  if (errors >=  0x0A)
+  while (size--)
   {
-    return errors;
+    *(__IO uint8_t *)&CRC->DR = *data++;
   }
-  
-  /* Last packet preparation */
-  ackReceived = 0;
-  receivedC[0] = 0x00;
-  errors = 0;
+}
 
-  packet_data[0] = SOH;
-  packet_data[1] = 0;
-  packet_data [2] = 0xFF;
+/************************************************************************/
+static uint16_t Ymodem_CrcEnd (void)
+{
+  return (uint16_t)CRC->DR;
+}
+#else
+static uint16_t Ymodem_Crc;
 
-  for (i = PACKET_HEADER; i < (PACKET_128B_SIZE + PACKET_HEADER); i++)
-  {
-     packet_data [i] = 0x00;
-  }
-  
-  do 
-  {
-    /* Send Packet */
-    Ymodem_SendPacket(packet_data, PACKET_128B_SIZE + PACKET_HEADER);
-    /* Send CRC or Check Sum based on CRC16_F */
-    tempCRC = Cal_CRC16(&packet_data[3], PACKET_128B_SIZE);
-    Send_Byte(tempCRC >> 8);
-    Send_Byte(tempCRC & 0xFF);
-  
-    /* Wait for Ack and 'C' */
-    if (Receive_Byte(&receivedC[0], 10000) == 0)  
-    {
-      if (receivedC[0] == ACK)
-      { 
-        /* Packet transfered correctly */
-        ackReceived = 1;
-      }
-    }
-    else
-    {
-        errors++;
-    }
- 
-  }while (!ackReceived && (errors < 0x0A));
-  /* Resend packet if NAK  for a count of 10  else end of commuincation */
-  if (errors >=  0x0A)
-  {
-    return errors;
-  }  
-  
-  do 
-  {
-    Send_Byte(EOT);
-    /* Send (EOT); */
-    /* Wait for Ack */
-      if ((Receive_Byte(&receivedC[0], 10000) == 0)  && receivedC[0] == ACK)
-      {
-        ackReceived = 1;  
-      }
-      else
-      {
-        errors++;
-      }
-  }while (!ackReceived && (errors < 0x0A));
-    
-  if (errors >=  0x0A)
+/************************************************************************/
+static void Ymodem_CrcBegin (void)
+{
+  Ymodem_Crc = 0;
+}
+
+/************************************************************************/
+static void Ymodem_CrcUpdate (const uint8_t *data, uint32_t size)
+{
+  while (size--)
   {
-    return errors;
+    Ymodem_Crc = UpdateCRC16(Ymodem_Crc, *data++);
   }
-  return 0; /* file trasmitted successfully */
+}
+
+/************************************************************************/
+static uint16_t Ymodem_CrcEnd (void)
+{
+  Ymodem_Crc = UpdateCRC16(Ymodem_Crc, 0);
+  return UpdateCRC16(Ymodem_Crc, 0);
+}
+#endif
+
+/**
+  * @brief  Cal CRC16 for YModem Packet
+  * @param  data
+  * @param  length
+   * @retval None
+  */
+uint16_t Cal_CRC16(const uint8_t* data, uint32_t size)
+{
+ Ymodem_CrcBegin();
+ Ymodem_CrcUpdate(data, size);
+ return Ymodem_CrcEnd();
 }
 
 /**